@@ -0,0 +1,65 @@
+#!/bin/sh
+# compares the generated matrix multiply against a naive triple loop in C
+#
+#   bench/gemm.sh [path to clm, the one on the PATH by default]
+#
+# runs on linux64, needs gcc. every size is repeated enough to run for a
+# while, and the time includes starting the program and filling the inputs.
+# the elements are 32 bit ints, so these are billions of integer multiplies
+# and adds per second, counted like flops as 2 * n^3 per multiply
+#
+# clm runs without its cache, so the programs timed are always the ones this
+# clm generates and not ones cached by an earlier run
+
+CLM=${1:-clm}
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+gcc -O2 -fno-tree-vectorize -o "$DIR/naive" "$(dirname "$0")/naive_gemm.c" ||
+  exit 1
+
+now() { date +%s%N; }
+
+# gflops n reps start end
+gflops() {
+  awk "BEGIN { printf \"%8.2f\", 2 * $1 * $1 * $1 * $2 / ($4 - $3) }"
+}
+
+printf "%6s %6s %10s %10s %10s\n" n reps naive sse2 avx2
+for size in "64 2000" "256 40" "1024 1"; do
+  set -- $size
+  n=$1
+  reps=$2
+
+  cat > "$DIR/gemm.clm" <<CLM
+A = [$n:$n]
+B = [$n:$n]
+for i in 1..$n do
+  for j in 1..$n do
+    A[i,j] = i - j
+    B[i,j] = i + j
+  end
+end
+for r in 1..$reps do
+  C = A * B
+end
+printl C[$n,$n]
+CLM
+
+  start=$(now)
+  "$DIR/naive" $n $reps > /dev/null
+  naive=$(gflops $n $reps $start $(now))
+
+  for simd in sse2 avx2; do
+    "$CLM" --no-cache --simd=$simd -o "$DIR/gemm.s" "$DIR/gemm.clm" &&
+      gcc -no-pie -o "$DIR/gemm_$simd" "$DIR/gemm.s" || exit 1
+  done
+  start=$(now)
+  "$DIR/gemm_sse2" > /dev/null
+  sse2=$(gflops $n $reps $start $(now))
+  start=$(now)
+  "$DIR/gemm_avx2" > /dev/null
+  avx2=$(gflops $n $reps $start $(now))
+
+  printf "%6s %6s %10s %10s %10s\n" $n $reps $naive $sse2 $avx2
+done
@@ -0,0 +1,37 @@
+// the textbook triple loop over 32 bit ints, the reference gemm.sh compares
+// the generated matrix multiply against
+#include <stdio.h>
+#include <stdlib.h>
+
+int main(int argc, char *argv[]) {
+  if (argc != 3) {
+    printf("usage: naive_gemm n reps\n");
+    return 1;
+  }
+  int n = atoi(argv[1]), reps = atoi(argv[2]);
+  int *a = malloc(sizeof(int) * n * n);
+  int *b = malloc(sizeof(int) * n * n);
+  int *c = malloc(sizeof(int) * n * n);
+  int i, j, p, r;
+  for (i = 0; i < n * n; i++) {
+    a[i] = i % 7 - 3;
+    b[i] = i % 5 - 2;
+  }
+
+  for (r = 0; r < reps; r++) {
+    for (i = 0; i < n; i++) {
+      for (j = 0; j < n; j++) {
+        int sum = 0;
+        for (p = 0; p < n; p++)
+          sum += a[i * n + p] * b[p * n + j];
+        c[i * n + j] = sum;
+      }
+    }
+  }
+
+  printf("%d\n", c[n * n - 1]);
+  free(a);
+  free(b);
+  free(c);
+  return 0;
+}
@@ -1,5 +1,13 @@
+#include <stdio.h>
 #include <string.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
 #include "clm.h"
 
 char *string_copy(const char *string) {
@@ -39,6 +47,220 @@ int string_equals_n(const char *string1, const char *string2, size_t n) {
     return !strncmp(string1, string2, n);
 }
 
+unsigned int string_hash(const char *string) {
+  return string_hash_n(string, strlen(string));
+}
+
+unsigned int string_hash_n(const char *string, size_t n) {
+  unsigned int hash = 2166136261u;
+  size_t i;
+  for (i = 0; i < n; i++) {
+    hash ^= (unsigned char)string[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+// shared by every compiler, so no two of them use the same generation
+static volatile unsigned int lastTypeGeneration = 0;
+
+static unsigned int next_type_generation() {
+#ifdef _WIN32
+  return (unsigned int)InterlockedIncrement((volatile LONG *)&lastTypeGeneration);
+#else
+  return __sync_add_and_fetch(&lastTypeGeneration, 1);
+#endif
+}
+
+ClmCompiler *clm_compiler_new(ClmTarget target) {
+  ClmCompiler *compiler = calloc(1, sizeof(*compiler));
+  compiler->target = target;
+  compiler->simd = CLM_SIMD_SSE2;
+  compiler->arena = clm_arena_new();
+  compiler->typeGeneration = next_type_generation();
+  return compiler;
+}
+
+void clm_compiler_invalidate_types(ClmCompiler *compiler) {
+  compiler->typeGeneration = next_type_generation();
+}
+
+int clm_compiler_option(ClmCompiler *compiler, const char *option) {
+  if (strcmp(option, "--target=win32") == 0) {
+    compiler->target = CLM_TARGET_WIN32;
+  } else if (strcmp(option, "--target=linux64") == 0) {
+    compiler->target = CLM_TARGET_LINUX64;
+  } else if (strcmp(option, "--simd=sse2") == 0) {
+    compiler->simd = CLM_SIMD_SSE2;
+  } else if (strcmp(option, "--simd=avx2") == 0) {
+    compiler->simd = CLM_SIMD_AVX2;
+  } else if (strcmp(option, "-O0") == 0) {
+    clm_optimizer_set_all_passes(compiler, 0);
+  } else if (strncmp(option, "--no-", 5) == 0) {
+    return clm_optimizer_set_pass(compiler, option + 5, 0);
+  } else {
+    return 0;
+  }
+  return 1;
+}
+
+void clm_compiler_free(ClmCompiler *compiler) {
+  if (compiler == NULL)
+    return;
+  array_list_free(compiler->imports);
+  array_list_free(compiler->modules);
+  clm_arena_free(compiler->arena);
+  free(compiler->strings);
+  free(compiler);
+}
+
+// nothing that changes after the setjmp is read after the longjmp, the
+// state is all behind arg
+void clm_recover_with(ClmCompiler *compiler, void (*run)(void *arg),
+                      void (*cleanup)(void *arg), void *arg) {
+  jmp_buf recover;
+  jmp_buf *outer = compiler->recover;
+  if (outer == NULL) {
+    run(arg);
+    return;
+  }
+  if (setjmp(recover) != 0) {
+    compiler->recover = outer;
+    cleanup(arg);
+    longjmp(*outer, 1);
+  }
+  compiler->recover = &recover;
+  run(arg);
+  compiler->recover = outer;
+}
+
+void clm_count(ClmCompiler *compiler, ClmCounter counter, long long n) {
+  if (compiler == NULL || !compiler->counting)
+    return;
+#ifdef _WIN32
+  InterlockedExchangeAdd64(&compiler->counters[counter], n);
+#else
+  __sync_add_and_fetch(&compiler->counters[counter], n);
+#endif
+}
+
+static void string_intern_insert(const char **table, size_t size,
+                                 const char *string) {
+  size_t mask = size - 1;
+  size_t i = string_hash(string) & mask;
+  while (table[i] != NULL)
+    i = (i + 1) & mask;
+  table[i] = string;
+}
+
+const char *string_intern(ClmCompiler *compiler, const char *string) {
+  return string_intern_n(compiler, string, strlen(string));
+}
+
+// the interned strings of a compiler are in an open addressing table kept at
+// most half full, and the copies are in its arena
+const char *string_intern_n(ClmCompiler *compiler, const char *string,
+                            size_t n) {
+  if (compiler->strings == NULL) {
+    compiler->stringsSize = 1024;
+    compiler->strings = calloc(compiler->stringsSize, sizeof(char *));
+  }
+
+  size_t mask = compiler->stringsSize - 1;
+  size_t i = string_hash_n(string, n) & mask;
+  for (; compiler->strings[i] != NULL; i = (i + 1) & mask) {
+    const char *other = compiler->strings[i];
+    if (strncmp(other, string, n) == 0 && other[n] == '\0')
+      return other;
+  }
+
+  char *copy = clm_arena_alloc(compiler->arena, n + 1);
+  memcpy(copy, string, n);
+  copy[n] = '\0';
+  compiler->strings[i] = copy;
+  compiler->stringsLength++;
+
+  if (2 * compiler->stringsLength > compiler->stringsSize) {
+    size_t size = 2 * compiler->stringsSize;
+    const char **table = calloc(size, sizeof(*table));
+    for (i = 0; i < compiler->stringsSize; i++) {
+      if (compiler->strings[i] != NULL)
+        string_intern_insert(table, size, compiler->strings[i]);
+    }
+    free(compiler->strings);
+    compiler->strings = table;
+    compiler->stringsSize = size;
+  }
+  return copy;
+}
+
+#define ARENA_BLOCK_SIZE (64 * 1024)
+#define ARENA_ALIGNMENT 16
+#define ARENA_ALIGN(size)                                                      \
+  (((size) + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1))
+
+// a block is malloc'd with its memory right behind it
+struct ClmArenaBlock {
+  ClmArenaBlock *next;
+  char *free; // where the next allocation starts
+  char *end;
+};
+
+static ClmArenaBlock *arena_block_new(size_t size, ClmArenaBlock *next) {
+  size_t header = ARENA_ALIGN(sizeof(ClmArenaBlock));
+  ClmArenaBlock *block = malloc(header + size);
+  block->next = next;
+  block->free = (char *)block + header;
+  block->end = block->free + size;
+  return block;
+}
+
+ClmArena *clm_arena_new() {
+  ClmArena *arena = malloc(sizeof(*arena));
+  arena->blocks = arena_block_new(ARENA_BLOCK_SIZE, NULL);
+  arena->allocations = 0;
+  arena->bytes = 0;
+  return arena;
+}
+
+void clm_arena_free(ClmArena *arena) {
+  if (arena == NULL)
+    return;
+  while (arena->blocks != NULL) {
+    ClmArenaBlock *next = arena->blocks->next;
+    free(arena->blocks);
+    arena->blocks = next;
+  }
+  free(arena);
+}
+
+void *clm_arena_alloc(ClmArena *arena, size_t size) {
+  size = ARENA_ALIGN(size);
+  arena->allocations++;
+  arena->bytes += size;
+
+  ClmArenaBlock *block = arena->blocks;
+  if ((size_t)(block->end - block->free) < size) {
+    if (size > ARENA_BLOCK_SIZE / 4) {
+      // big allocations get a block of their own behind the one being
+      // filled, so the rest of that block isn't wasted
+      block->next = arena_block_new(size, block->next);
+      block = block->next;
+    } else {
+      arena->blocks = arena_block_new(ARENA_BLOCK_SIZE, arena->blocks);
+      block = arena->blocks;
+    }
+  }
+
+  void *memory = block->free;
+  block->free += size;
+  return memory;
+}
+
+void *clm_alloc(ClmCompiler *compiler, size_t size) {
+  return clm_arena_alloc(compiler->arena, size);
+}
+
 ArrayList *array_list_new(void (*free_element)(void *element)) {
   ArrayList *self = malloc(sizeof(*self));
   self->length = 0;
@@ -49,6 +271,17 @@ ArrayList *array_list_new(void (*free_element)(void *element)) {
     self->data[i] = NULL;
   }
   self->free_element = free_element;
+  self->arena = NULL;
+  return self;
+}
+
+ArrayList *array_list_new_arena(ClmArena *arena) {
+  ArrayList *self = clm_arena_alloc(arena, sizeof(*self));
+  self->length = 0;
+  self->capacity = 8;
+  self->data = clm_arena_alloc(arena, self->capacity * sizeof(*(self->data)));
+  self->free_element = NULL;
+  self->arena = arena;
   return self;
 }
 
@@ -57,8 +290,11 @@ void array_list_free(void *data) {
     return;
 
   ArrayList *self = (ArrayList *)data;
+  if (self->arena != NULL)
+    return;
   int i;
-  for (i = self->length - 1; i >= 0; i--) {
+  // lists that don't own their elements have no free_element
+  for (i = self->length - 1; i >= 0 && self->free_element != NULL; i--) {
     self->free_element(self->data[i]);
   }
   free(self->data);
@@ -66,7 +302,14 @@ void array_list_free(void *data) {
 }
 
 void array_list_push(ArrayList *self, void *data) {
-  if (self->length == self->capacity) {
+  if (self->length == self->capacity && self->arena != NULL) {
+    // the old data stays in the arena until the arena is freed
+    void **data = clm_arena_alloc(self->arena,
+                                  2 * self->capacity * sizeof(*(self->data)));
+    memcpy(data, self->data, self->length * sizeof(*(self->data)));
+    self->data = data;
+    self->capacity = 2 * self->capacity;
+  } else if (self->length == self->capacity) {
     int i = self->capacity;
     self->capacity = 2 * self->capacity;
     self->data = realloc(self->data, self->capacity * sizeof(*(self->data)));
@@ -78,6 +321,18 @@ void array_list_push(ArrayList *self, void *data) {
   self->length += 1;
 }
 
+// removes the element at index without freeing it, and returns it
+void *array_list_remove(ArrayList *self, int index) {
+  void *element = self->data[index];
+  int i;
+  for (i = index; i < self->length - 1; i++) {
+    self->data[i] = self->data[i + 1];
+  }
+  self->length -= 1;
+  self->data[self->length] = NULL;
+  return element;
+}
+
 void array_list_foreach(ArrayList *self, void (*func)(void *data)) {
   if (self == NULL)
     return;
@@ -96,3 +351,157 @@ void array_list_foreach_2(ArrayList *self, int level,
     func(self->data[i], level);
   }
 }
+
+StringBuffer *string_buffer_new() {
+  StringBuffer *self = malloc(sizeof(*self));
+  self->length = 0;
+  self->capacity = 1024;
+  self->data = malloc(self->capacity * sizeof(*(self->data)));
+  self->data[0] = '\0';
+  return self;
+}
+
+void string_buffer_free(void *data) {
+  if (data == NULL)
+    return;
+
+  StringBuffer *self = (StringBuffer *)data;
+  free(self->data);
+  free(self);
+}
+
+// makes sure there is room for n more characters and the terminating null
+static void string_buffer_reserve(StringBuffer *self, size_t n) {
+  if (self->length + n + 1 <= self->capacity)
+    return;
+
+  while (self->length + n + 1 > self->capacity)
+    self->capacity = 2 * self->capacity;
+  self->data = realloc(self->data, self->capacity * sizeof(*(self->data)));
+}
+
+void string_buffer_append(StringBuffer *self, const char *string) {
+  string_buffer_append_n(self, string, strlen(string));
+}
+
+void string_buffer_append_n(StringBuffer *self, const char *string, size_t n) {
+  string_buffer_reserve(self, n);
+  memcpy(self->data + self->length, string, n);
+  self->length += n;
+  self->data[self->length] = '\0';
+}
+
+void string_buffer_appendf(StringBuffer *self, const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  string_buffer_vappendf(self, fmt, ap);
+  va_end(ap);
+}
+
+// formats straight into the end of the buffer, growing it and formatting
+// again only when the output didn't fit
+void string_buffer_vappendf(StringBuffer *self, const char *fmt, va_list ap) {
+  va_list ap_copy;
+  va_copy(ap_copy, ap);
+  size_t available = self->capacity - self->length;
+  int n = vsnprintf(self->data + self->length, available, fmt, ap_copy);
+  va_end(ap_copy);
+
+  if (n < 0)
+    return;
+
+  if ((size_t)n >= available) {
+    string_buffer_reserve(self, n);
+    vsnprintf(self->data + self->length, n + 1, fmt, ap);
+  }
+  self->length += n;
+}
+
+void string_buffer_clear(StringBuffer *self) {
+  self->length = 0;
+  self->data[0] = '\0';
+}
+
+int clm_cpu_count() {
+#ifdef _WIN32
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return (int)info.dwNumberOfProcessors;
+#else
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return count > 0 ? (int)count : 1;
+#endif
+}
+
+typedef struct {
+  int count;
+  int threads;
+  int first; // the index this thread starts at
+  void (*work)(void *arg, int index);
+  void *arg;
+} ParallelWork;
+
+static void run_parallel_work(ParallelWork *work) {
+  int i;
+  for (i = work->first; i < work->count; i += work->threads)
+    work->work(work->arg, i);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI parallel_thread(LPVOID work) {
+  run_parallel_work(work);
+  return 0;
+}
+#else
+static void *parallel_thread(void *work) {
+  run_parallel_work(work);
+  return NULL;
+}
+#endif
+
+void clm_parallel_for(int count, int threads,
+                      void (*work)(void *arg, int index), void *arg) {
+  if (threads > count)
+    threads = count;
+  if (threads < 1)
+    threads = 1;
+
+  ParallelWork *works = malloc(threads * sizeof(*works));
+#ifdef _WIN32
+  HANDLE *handles = malloc(threads * sizeof(*handles));
+#else
+  pthread_t *handles = malloc(threads * sizeof(*handles));
+#endif
+  int i;
+  for (i = 0; i < threads; i++) {
+    works[i].count = count;
+    works[i].threads = threads;
+    works[i].first = i;
+    works[i].work = work;
+    works[i].arg = arg;
+  }
+
+  // the calling thread does the first share itself
+  for (i = 1; i < threads; i++) {
+#ifdef _WIN32
+    handles[i] = CreateThread(NULL, 0, parallel_thread, &works[i], 0, NULL);
+    if (handles[i] == NULL)
+      clm_error(NULL, 0, 0, "unable to start a thread");
+#else
+    if (pthread_create(&handles[i], NULL, parallel_thread, &works[i]) != 0)
+      clm_error(NULL, 0, 0, "unable to start a thread");
+#endif
+  }
+  run_parallel_work(&works[0]);
+  for (i = 1; i < threads; i++) {
+#ifdef _WIN32
+    WaitForSingleObject(handles[i], INFINITE);
+    CloseHandle(handles[i]);
+#else
+    pthread_join(handles[i], NULL);
+#endif
+  }
+
+  free(handles);
+  free(works);
+}
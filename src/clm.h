@@ -1,6 +1,7 @@
 #ifndef CLM_H_
 #define CLM_H_
 
+#include <setjmp.h>
 #include <stdarg.h>
 #include <stdlib.h>
 
@@ -8,12 +9,15 @@
 // Forward Declarations
 //
 typedef struct ClmScope ClmScope;
+typedef struct ClmStmtNode ClmStmtNode;
+typedef struct ClmCompiler ClmCompiler;
 
 //
 // Errors (note: not implemented in clm.c - implemented in the corresponding
 // main.c)
 //
-void clm_error(int line, int col, const char *fmt, ...);
+// the error is in compiler, or outside of any compilation when it is NULL
+void clm_error(ClmCompiler *compiler, int line, int col, const char *fmt, ...);
 
 //
 // String
@@ -22,6 +26,41 @@ char *string_copy(const char *string);
 char *string_copy_n(const char *string, size_t n);
 int string_equals(const char *string1, const char *string2);
 int string_equals_n(const char *string1, const char *string2, size_t n);
+// FNV-1a, for the hash tables keyed by name
+unsigned int string_hash(const char *string);
+unsigned int string_hash_n(const char *string, size_t n);
+
+// the one copy of a string, so interned strings with the same text are the
+// same pointer. each compiler has its own, and its copies live until it is
+// freed
+const char *string_intern(ClmCompiler *compiler, const char *string);
+const char *string_intern_n(ClmCompiler *compiler, const char *string,
+                            size_t n);
+
+//
+// Arena
+//
+// a bump allocator for everything that lives as long as a compilation: the
+// AST, its lists, scopes and symbols. nothing allocated from an arena is freed
+// on its own, the whole arena is released at once
+//
+typedef struct ClmArenaBlock ClmArenaBlock;
+
+typedef struct ClmArena {
+  ClmArenaBlock *blocks; // the block being filled first
+  // how many allocations there have been and how many bytes they took, for
+  // the time report
+  size_t allocations;
+  size_t bytes;
+} ClmArena;
+
+ClmArena *clm_arena_new();
+void clm_arena_free(ClmArena *arena);
+void *clm_arena_alloc(ClmArena *arena, size_t size);
+
+// the front end allocates from the arena of the compiler it runs on.
+// clm_alloc(compiler, size) is clm_arena_alloc(compiler->arena, size)
+void *clm_alloc(ClmCompiler *compiler, size_t size);
 
 //
 // ArrayList
@@ -29,19 +68,55 @@ int string_equals_n(const char *string1, const char *string2, size_t n);
 typedef struct ArrayList {
   void **data;
   void (*free_element)(void *element);
+  ClmArena *arena; // where data lives if it isn't malloc'd
   int capacity;
   int length;
 } ArrayList;
 
 ArrayList *array_list_new(void (*free_element)(void *element));
+// a list in arena, array_list_free does nothing to it
+ArrayList *array_list_new_arena(ClmArena *arena);
 void array_list_free(void *data);
 
 void array_list_push(ArrayList *self, void *data);
+void *array_list_remove(ArrayList *self, int index);
 
 void array_list_foreach(ArrayList *self, void (*func)(void *data));
 void array_list_foreach_2(ArrayList *self, int level,
                           void (*func)(void *data, int l));
 
+//
+// StringBuffer
+//
+// a growable string that keeps track of its length, appending doesn't rescan
+// the string like strcat and the capacity doubles when it runs out
+//
+typedef struct StringBuffer {
+  char *data;
+  size_t length;
+  size_t capacity;
+} StringBuffer;
+
+StringBuffer *string_buffer_new();
+void string_buffer_free(void *data);
+
+void string_buffer_append(StringBuffer *self, const char *string);
+void string_buffer_append_n(StringBuffer *self, const char *string, size_t n);
+void string_buffer_appendf(StringBuffer *self, const char *fmt, ...);
+void string_buffer_vappendf(StringBuffer *self, const char *fmt, va_list ap);
+void string_buffer_clear(StringBuffer *self);
+
+//
+// Threads
+//
+// how many threads can run at once on this machine
+int clm_cpu_count();
+// calls work(arg, i) for every i in [0, count), spread over up to threads
+// threads (one of them the calling thread), and returns when all are done.
+// thread t does every index i with i % threads == t, in order
+void clm_parallel_for(int count, int threads,
+                      void (*work)(void *arg, int index), void *arg);
+
 //
 // Lexer Structs
 //
@@ -65,27 +140,181 @@ static char *clmLexerSymbolStrings[] = {
 #undef token
 };
 
+// a token is a span of the source it was lexed from, so the source has to
+// outlive its tokens
 typedef struct ClmLexerToken {
   ClmLexerSymbol sym;
-  char *raw;
+  int offset;
+  int length;
   int lineNo;
   int colNo;
 } ClmLexerToken;
 
+// every token of a source, stored contiguously
+typedef struct ClmTokens {
+  const char *source;
+  ClmLexerToken *data;
+  int length;
+  int capacity;
+} ClmTokens;
+
+void clm_tokens_free(void *data);
+// the text of a token, interned
+const char *clm_token_text(ClmCompiler *compiler, ClmTokens *tokens,
+                           ClmLexerToken *token);
+
 //
 // Pretty Printing
 //
-void clm_print_tokens(ArrayList *tokens);
+void clm_print_tokens(ClmTokens *tokens);
 void clm_print_statements(ArrayList *statements);
 
+//
+// Targets
+//
+typedef enum ClmTarget {
+  CLM_TARGET_WIN32,  // 32 bit PE console program assembled with fasm
+  CLM_TARGET_LINUX64 // x86-64 System V, GNU as intel syntax linked with libc
+} ClmTarget;
+
+// the widest vector instructions the generated code may use for matrices
+typedef enum ClmSimd {
+  CLM_SIMD_SSE2, // 4 ints per register, every x86-64 cpu has these
+  CLM_SIMD_AVX2  // 8 ints per register
+} ClmSimd;
+
+#ifdef _WIN32
+#define CLM_PATH_SEPARATOR ';'
+#else
+#define CLM_PATH_SEPARATOR ':'
+#endif
+
+//
+// Compiler
+//
+// one compilation: its options and everything that lives as long as it does.
+// the main functions of the modules run on the compiler they are given, and
+// the scratch state of a phase is in a context its main function makes and
+// passes down, so compilations on different threads can run at the same time.
+// what a main function returns is the caller's and isn't touched by the next
+// compilation
+//
+#define CLM_MAX_OPTIMIZER_PASSES 16
+
+// code generated apart from a program, with the spill slots it needs and
+// whether it calls the GEMM routine, so it can be appended to one
+typedef struct ClmGeneratedCode {
+  StringBuffer *code;
+  int spillSlots;
+  int gemmUsed;
+} ClmGeneratedCode;
+
+// what a compilation did, for the time report (see clm_report.h)
+typedef enum ClmCounter {
+  CLM_COUNTER_TOKENS,
+  CLM_COUNTER_AST_NODES,
+  CLM_COUNTER_SCOPE_LOOKUPS,
+  CLM_COUNTER_TYPE_RECOMPUTATIONS, // types and sizes worked out again
+  CLM_COUNTER_ASM_BYTES,
+  CLM_NUM_COUNTERS
+} ClmCounter;
+
+struct ClmCompiler {
+  ClmTarget target;
+  ClmSimd simd;
+  ClmArena *arena; // the AST, scopes, symbols and interned strings
+  int threads;     // for generating functions, 0 for one per cpu
+
+  // the interned strings, an open addressing table
+  const char **strings;
+  size_t stringsSize; // a power of 2
+  size_t stringsLength;
+
+  // cached expression types are stale when their generation isn't this one.
+  // no two compilers have the same generation, so the nodes of an imported
+  // function are retyped by each program that generates them
+  unsigned int typeGeneration;
+
+  // functions declared in other compilations that the program can call, as
+  // their STMT_TYPE_FUNC_DEC nodes. they are generated along with it, unless
+  // importsCode is set: their code generated ahead of time with the same
+  // target and simd, which is appended instead
+  ArrayList *imports;
+  const ClmGeneratedCode *importsCode;
+
+  // the directories imported modules are looked for in, after the one the
+  // program is in, separated by CLM_PATH_SEPARATOR. may be NULL
+  const char *modulePath;
+  // the modules the program imported (ClmModule, see clm_module.h), and the
+  // compiler whose import this one is compiling a module for
+  ArrayList *modules;
+  ClmCompiler *importer;
+
+  // a cache directory the code of each function is reused from and stored
+  // to, NULL to generate every function (see clm_cache_function_key)
+  const char *functionCache;
+
+  // when recover is set, clm_error adds the error to diagnostics and jumps
+  // to it instead of exiting, so a long lived process can carry on. errors
+  // can't jump between threads, so functions are generated on one
+  jmp_buf *recover;
+  StringBuffer *diagnostics;
+  const char *fileName; // what the errors are reported against
+
+  // the counters are only added to while counting is set, the code gen's
+  // threads add to them too
+  int counting;
+  long long counters[CLM_NUM_COUNTERS];
+
+  unsigned int disabledPasses; // a bit for each optimizer pass
+  // what the last run of the optimizer did
+  int passChanges[CLM_MAX_OPTIMIZER_PASSES];
+  int optimizerIterations;
+};
+
+ClmCompiler *clm_compiler_new(ClmTarget target);
+void clm_compiler_free(ClmCompiler *compiler);
+// sets an option given like on the command line, --target=linux64,
+// --simd=avx2, -O0 or --no-<pass>. returns 0 for an unknown option
+int clm_compiler_option(ClmCompiler *compiler, const char *option);
+// makes every expression type cached by compiler stale
+void clm_compiler_invalidate_types(ClmCompiler *compiler);
+// adds n to a counter of compiler, if it is counting
+void clm_count(ClmCompiler *compiler, ClmCounter counter, long long n);
+// calls run(arg). when an error in it is recovered from, cleanup(arg) frees
+// what run had so far before the error goes on to compiler->recover
+void clm_recover_with(ClmCompiler *compiler, void (*run)(void *arg),
+                      void (*cleanup)(void *arg), void *arg);
+
 //
 // Main functions for each module
 //
-ArrayList *clm_lexer_main(const char *fileContents);
-ArrayList *clm_parser_main(ArrayList *tokens);
-ClmScope *clm_symbol_gen_main(ArrayList *statements);
-void clm_type_check_main(ArrayList *statements, ClmScope *globalScope);
-void clm_optimizer_main(ArrayList *statements, ClmScope *globalScope);
-const char *clm_code_gen_main(ArrayList *statements, ClmScope *globalScope);
+// the source is length bytes and doesn't need a terminating null, lexing
+// stops at the first null if it has one
+ClmTokens *clm_lexer_main(ClmCompiler *compiler, const char *source,
+                          size_t length);
+ArrayList *clm_parser_main(ClmCompiler *compiler, ClmTokens *tokens);
+ClmScope *clm_symbol_gen_main(ClmCompiler *compiler, ArrayList *statements);
+void clm_type_check_main(ClmCompiler *compiler, ArrayList *statements,
+                         ClmScope *globalScope);
+void clm_optimizer_main(ClmCompiler *compiler, ArrayList *statements,
+                        ClmScope *globalScope);
+// passes are named like fold-constants, returns 0 for an unknown name
+int clm_optimizer_set_pass(ClmCompiler *compiler, const char *name,
+                           int enabled);
+void clm_optimizer_set_all_passes(ClmCompiler *compiler, int enabled);
+void clm_optimizer_print_report(ClmCompiler *compiler);
+// the program's code, which the caller frees
+char *clm_code_gen_main(ClmCompiler *compiler, ArrayList *statements,
+                        ClmScope *globalScope);
+// writes the program to fd as it is generated instead of keeping it in memory
+void clm_code_gen_stream(ClmCompiler *compiler, ArrayList *statements,
+                         ClmScope *globalScope, int fd);
+// the code of one function on its own, with the spill slots it needs and
+// whether it calls the GEMM routine, for a module interface
+StringBuffer *clm_code_gen_function(ClmCompiler *compiler,
+                                    ClmStmtNode *function,
+                                    ClmScope *globalScope,
+                                    int *out_spill_slots, int *out_gemm_used);
 
 #endif
@@ -1,56 +1,266 @@
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "clm_asm.h"
+#include "clm_code_gen.h"
+
+// instructions are formatted straight into the code buffer
+#define ASM_WRITE(...) writeLinef(gen, __VA_ARGS__)
+
+extern void writeLine(ClmCodeGen *gen, const char *line);
+extern void writeLinef(ClmCodeGen *gen, const char *fmt, ...);
+
+struct AsmTargetInfo {
+  int wordSize;
+  const char *registers[12]; // indexed by AsmReg, NULL if the target lacks it
+  int numAllocatable;
+  AsmReg allocatable[8];
+  const char *fpuRegisters[8];
+  const char *dwordPtr;
+  const char *qwordPtr;
+  const char *wordPtr;
+  const char *header;
+  const char *start;
+  const char *exitProcess;
+  const char *dataSection;
+};
+
+static const AsmTargetInfo win32 = {
+    4,
+    {"eax", "ebx", "ecx", "edx", "esp", "ebp", "esi", "edi"},
+    4,
+    {REG_B, REG_C, REG_SI, REG_DI},
+    {"st0", "st1", "st2", "st3", "st4", "st5", "st6", "st7"},
+    "dword ",
+    "qword ",
+    "dword ",
+    "format PE console\n"
+    "entry start\n"
+    "\n"
+    "include 'win32a.inc'\n"
+    "include 'macro/import32.inc'\n"
+    "\n"
+    "section '.rdata' data readable\n"
+    "        print_int db '%d',0\n"
+    "        print_int_spc db '%d',32,0\n"
+    "        print_int_nl db '%d',10,0\n"
+    "        print_float db '%f',0\n"
+    "        print_float_spc db '%f',32,0\n"
+    "        print_float_nl db '%f',10,0\n"
+    "        print_char db '%c',13,0\n"
+    "        print_char_spc db '%c',13,32,0\n"
+    "        print_char_nl db '%c',13,10,0\n"
+    "\n"
+    "section '.idata' data readable import\n"
+    "        library kernel32, 'kernel32.dll', \\\n"
+    "                msvcrt,   'msvcrt.dll'\n"
+    "        import kernel32, ExitProcess, 'ExitProcess'\n"
+    "        import msvcrt, printf, 'printf', \\\n"
+    "                malloc, 'malloc', \\\n"
+    "                calloc, 'calloc', \\\n"
+    "                free, 'free'\n"
+    "\n"
+    "section '.code' code executable\n",
+    "start:\n",
+    "invoke ExitProcess, 0\n",
+    "section '.data' data readable writable\n"
+    "__T_EAX__ dd 0\n"
+    "__T_EBX__ dd 0\n"
+    "__T_END__ dd 0\n"
+    "__T_ROW_END__ dd 0\n"
+    "__T_ESP__ dd 0\n"
+    "__INT_CONSTANT__ dd 0\n"
+    "__FLOAT_CONSTANT__ dd 0\n"
+    "__DOUBLE_CONSTANT__ dq 0\n"};
+
+// link with: gcc -no-pie output.s
+// globals are addressed absolutely, so the program can't be position
+// independent
+static const AsmTargetInfo linux64 = {
+    8,
+    {"rax", "rbx", "rcx", "rdx", "rsp", "rbp", "rsi", "rdi", "r8", "r9", "r10",
+     "r11"},
+    8,
+    {REG_B, REG_C, REG_SI, REG_DI, REG_8, REG_9, REG_10, REG_11},
+    {"st(0)", "st(1)", "st(2)", "st(3)", "st(4)", "st(5)", "st(6)", "st(7)"},
+    "dword ptr ",
+    "qword ptr ",
+    "qword ptr ",
+    ".intel_syntax noprefix\n"
+    ".globl main\n"
+    ".section .note.GNU-stack,\"\",@progbits\n"
+    "\n"
+    ".section .rodata\n"
+    "        print_int: .asciz \"%d\"\n"
+    "        print_int_spc: .asciz \"%d \"\n"
+    "        print_int_nl: .asciz \"%d\\n\"\n"
+    "        print_float: .asciz \"%f\"\n"
+    "        print_float_spc: .asciz \"%f \"\n"
+    "        print_float_nl: .asciz \"%f\\n\"\n"
+    "        print_char: .asciz \"%c\"\n"
+    "        print_char_spc: .asciz \"%c \"\n"
+    "        print_char_nl: .asciz \"%c\\n\"\n"
+    "        print_nl: .asciz \"\\n\"\n"
+    "\n"
+    ".text\n",
+    "main:\n",
+    "and rsp,-16\n"
+    "xor edi,edi\n"
+    "call exit\n",
+    ".data\n"
+    "__T_EAX__: .quad 0\n"
+    "__T_EBX__: .quad 0\n"
+    "__T_END__: .quad 0\n"
+    "__T_ROW_END__: .quad 0\n"
+    "__T_ESP__: .quad 0\n"
+    "__INT_CONSTANT__: .quad 0\n"
+    "__FLOAT_CONSTANT__: .quad 0\n"
+    "__DOUBLE_CONSTANT__: .quad 0\n"};
+
+void asm_set_target(ClmCodeGen *gen, ClmTarget t) {
+  gen->target = t;
+  gen->info = t == CLM_TARGET_LINUX64 ? &linux64 : &win32;
+}
+
+ClmTarget asm_get_target(ClmCodeGen *gen) { return gen->target; }
+
+int asm_word_size(ClmCodeGen *gen) { return gen->info->wordSize; }
+
+void asm_header(ClmCodeGen *gen) { writeLine(gen, gen->info->header); }
+
+void asm_start(ClmCodeGen *gen) { writeLine(gen, gen->info->start); }
+
+void asm_exit_process(ClmCodeGen *gen) {
+  writeLine(gen, gen->info->exitProcess);
+}
+
+void asm_data_section(ClmCodeGen *gen) {
+  writeLine(gen, gen->info->dataSection);
+}
+
+void asm_data(ClmCodeGen *gen, const char *name, const int *words,
+              int num_words, int num_zeros) {
+  int i;
+
+  if (gen->target == CLM_TARGET_LINUX64) {
+    writeLinef(gen, "%s: .quad ", name);
+  } else {
+    writeLinef(gen, "%s dd ", name);
+  }
+
+  for (i = 0; i < num_words; i++) {
+    writeLinef(gen, i == 0 ? "%d" : ", %d", words[i]);
+  }
+  writeLine(gen, "\n");
+
+  if (num_zeros > 0) {
+    if (gen->target == CLM_TARGET_LINUX64) {
+      writeLinef(gen, ".zero %d\n", num_zeros * gen->info->wordSize);
+    } else {
+      writeLinef(gen, "dd %d dup 0\n", num_zeros);
+    }
+  }
+}
+
+const char *asm_reg(ClmCodeGen *gen, AsmReg reg) {
+  return gen->info->registers[(int)reg];
+}
+
+const char *asm_reg_dword(AsmReg reg) {
+  static const char *dwords[12] = {"eax", "ebx", "ecx",  "edx",  "esp",  "ebp",
+                                   "esi", "edi", "r8d", "r9d", "r10d", "r11d"};
+  return dwords[(int)reg];
+}
+
+const char *asm_fpu_reg(ClmCodeGen *gen, int n) {
+  return gen->info->fpuRegisters[n];
+}
+
+const AsmReg *asm_allocatable_regs(ClmCodeGen *gen, int *count) {
+  *count = gen->info->numAllocatable;
+  return gen->info->allocatable;
+}
 
-#define ASM_WRITE(...)                                                         \
-  char buffer[64];                                                             \
-  sprintf(buffer, __VA_ARGS__);                                                \
-  writeLine(buffer);
+void asm_set_simd(ClmCodeGen *gen, ClmSimd s) { gen->simd = s; }
 
-extern void writeLine(const char *line);
+ClmSimd asm_get_simd(ClmCodeGen *gen) { return gen->simd; }
 
-void pop_int_into(const char *dest) {
+int asm_vector_lanes(ClmCodeGen *gen) {
+  return gen->simd == CLM_SIMD_AVX2 ? 8 : 4;
+}
+
+int asm_vector_regs(ClmCodeGen *gen) {
+  return gen->target == CLM_TARGET_LINUX64 ? 16 : 8;
+}
+
+const char *asm_vector_reg(ClmCodeGen *gen, int n) {
+  static const char *xmm[16] = {"xmm0",  "xmm1",  "xmm2",  "xmm3",
+                                "xmm4",  "xmm5",  "xmm6",  "xmm7",
+                                "xmm8",  "xmm9",  "xmm10", "xmm11",
+                                "xmm12", "xmm13", "xmm14", "xmm15"};
+  static const char *ymm[16] = {"ymm0",  "ymm1",  "ymm2",  "ymm3",
+                                "ymm4",  "ymm5",  "ymm6",  "ymm7",
+                                "ymm8",  "ymm9",  "ymm10", "ymm11",
+                                "ymm12", "ymm13", "ymm14", "ymm15"};
+  return gen->simd == CLM_SIMD_AVX2 ? ymm[n] : xmm[n];
+}
+
+const char *asm_xmm_reg(int n) {
+  static const char *xmm[8] = {"xmm0", "xmm1", "xmm2", "xmm3",
+                               "xmm4", "xmm5", "xmm6", "xmm7"};
+  return xmm[n];
+}
+
+static void format_mem(char *out, const char *ptr, const char *base,
+                       int offset, const char *index) {
+  int len = sprintf(out, "%s[%s", ptr, base);
+  if (offset != 0)
+    len += sprintf(out + len, "%+d", offset);
+  if (index != NULL)
+    len += sprintf(out + len, "+%s", index);
+  sprintf(out + len, "]");
+}
+
+void asm_mem(ClmCodeGen *gen, char *out, const char *base, int offset,
+             const char *index) {
+  format_mem(out, gen->info->wordPtr, base, offset, index);
+}
+
+void asm_mem_dword(ClmCodeGen *gen, char *out, const char *base, int offset,
+                   const char *index) {
+  format_mem(out, gen->info->dwordPtr, base, offset, index);
+}
+
+void asm_mem_qword(ClmCodeGen *gen, char *out, const char *base, int offset,
+                   const char *index) {
+  format_mem(out, gen->info->qwordPtr, base, offset, index);
+}
+
+void pop_int_into(ClmCodeGen *gen, const char *dest) {
   // pop type
-  asm_pop(dest);
+  asm_pop(gen, dest);
 
   // overwrite type with int value
-  asm_pop(dest);
+  asm_pop(gen, dest);
 }
 
-void pop_float_into(const char *dest) {
+void pop_float_into(ClmCodeGen *gen, const char *dest) {
   // pop type off of general stack
-  asm_pop(EAX);
+  asm_pop(gen, EAX(gen));
 
   // pop value off of fpu stack
-  asm_pop_f(dest);
-}
-
-// size_location is the location of the numbber of elements the matrix has
-// this assumes esp is pointing like so
-//
-// vals
-// ...
-// cols
-// rows
-// type
-// <- esp
-void pop_matrix_of_size(const char *size_location) {
-  asm_mov(EAX, size_location); // eax contains number of elements
-  asm_imul(EAX, "4");
-  asm_add(EAX, "16");
-  asm_sub(ESP, EAX); // esp -= (num elements * 4 + 16)
+  asm_pop_f(gen, dest);
 }
 
-void asm_comment(const char *line) {
-  char buffer[128];
-  sprintf(buffer, "; %s\n", line);
-  writeLine(buffer);
+void asm_comment(ClmCodeGen *gen, const char *line) {
+  writeLinef(gen, "%s %s\n", gen->target == CLM_TARGET_LINUX64 ? "#" : ";",
+             line);
 }
 
-void asm_pop(const char *dest) { ASM_WRITE("pop %s\n", dest); }
+void asm_pop(ClmCodeGen *gen, const char *dest) { ASM_WRITE("pop %s\n", dest); }
 
-void asm_push(const char *src) { ASM_WRITE("push %s\n", src); }
+void asm_push(ClmCodeGen *gen, const char *src) { ASM_WRITE("push %s\n", src); }
 
 /*
   from fasm docs:
@@ -61,51 +271,263 @@ void asm_push(const char *src) { ASM_WRITE("push %s\n", src); }
   getting rid of ST0. fstp accepts the same operands as the fst instruction and
   can also store value in the 80-bit memory.""
 */
-void asm_pop_f(const char *dest) { ASM_WRITE("fstp %s\n", dest); }
+void asm_pop_f(ClmCodeGen *gen, const char *dest) {
+  ASM_WRITE("fstp %s\n", dest);
+}
+
+void asm_push_f(ClmCodeGen *gen, const char *src) {
+  ASM_WRITE("fld %s\n", src);
+}
 
-void asm_push_f(const char *src) { ASM_WRITE("fld %s\n", src); }
+void asm_push_const_i(ClmCodeGen *gen, int val) { ASM_WRITE("push %d\n", val); }
 
-void asm_push_const_i(int val) { ASM_WRITE("push %d\n", val); }
+// the float is written out as its bits, so no precision is lost printing it
+void asm_push_const_f(ClmCodeGen *gen, float val) {
+  char location[64];
+  unsigned int bits;
+  memcpy(&bits, &val, sizeof(bits));
 
-void asm_push_const_f(float val) {
-  ASM_WRITE("mov [" FLOAT_CONST "],%f\nfld [" FLOAT_CONST "]\n", val);
+  asm_mem_dword(gen, location, FLOAT_CONST, 0, NULL);
+  ASM_WRITE("mov %s,%u\n", location, bits);
+  asm_push_f(gen, location);
 }
 
-void asm_push_const_c(char val) { ASM_WRITE("push %c\n", val); }
+void asm_push_const_c(ClmCodeGen *gen, char val) {
+  ASM_WRITE("push %c\n", val);
+}
 
-void asm_add(const char *dest, const char *other) {
+void asm_add(ClmCodeGen *gen, const char *dest, const char *other) {
   ASM_WRITE("add %s,%s\n", dest, other);
 }
 
-void asm_add_i(const char *dest, int i) { ASM_WRITE("add %s,%d\n", dest, i); }
+void asm_add_i(ClmCodeGen *gen, const char *dest, int i) {
+  ASM_WRITE("add %s,%d\n", dest, i);
+}
 
-void asm_sub(const char *dest, const char *other) {
+void asm_sub(ClmCodeGen *gen, const char *dest, const char *other) {
   ASM_WRITE("sub %s,%s\n", dest, other);
 }
 
-void asm_imul(const char *dest, const char *other) {
+void asm_sub_i(ClmCodeGen *gen, const char *dest, int i) {
+  ASM_WRITE("sub %s,%d\n", dest, i);
+}
+
+void asm_imul(ClmCodeGen *gen, const char *dest, const char *other) {
   ASM_WRITE("imul %s,%s\n", dest, other);
 }
 
-void asm_div(const char *denom) { ASM_WRITE("div %s\n", denom); }
+void asm_imul_i(ClmCodeGen *gen, const char *dest, int i) {
+  ASM_WRITE("imul %s,%d\n", dest, i);
+}
+
+void asm_div(ClmCodeGen *gen, const char *denom) {
+  ASM_WRITE("div %s\n", denom);
+}
+
+// the low 32 bits of a word sized register or memory operand
+static void dword_operand(ClmCodeGen *gen, char *out, const char *operand) {
+  size_t length = strlen(gen->info->wordPtr);
+  int i;
+  for (i = 0; i <= REG_11; i++) {
+    const char *reg = gen->info->registers[i];
+    if (reg != NULL && strcmp(operand, reg) == 0) {
+      strcpy(out, asm_reg_dword((AsmReg)i));
+      return;
+    }
+  }
+  if (strncmp(operand, gen->info->wordPtr, length) == 0)
+    sprintf(out, "%s%s", gen->info->dwordPtr, operand + length);
+  else
+    strcpy(out, operand);
+}
+
+// a 64 bit idiv doesn't trap on INT_MIN / -1, so it is always 32 bits
+void asm_idiv(ClmCodeGen *gen, const char *denom) {
+  char dword[64];
+  dword_operand(gen, dword, denom);
+  ASM_WRITE("idiv %s\n", dword);
+  asm_wrap_int(gen, EAX(gen));
+}
+
+void asm_movsx_dword(ClmCodeGen *gen, const char *dest, const char *src) {
+  if (gen->target == CLM_TARGET_LINUX64) {
+    ASM_WRITE("movsxd %s,%s\n", dest, src);
+  } else {
+    ASM_WRITE("mov %s,%s\n", dest, src);
+  }
+}
+
+void asm_sign_extend_a(ClmCodeGen *gen) { writeLine(gen, "cdq\n"); }
+
+void asm_wrap_int(ClmCodeGen *gen, const char *reg) {
+  char dword[64];
+  if (gen->target != CLM_TARGET_LINUX64)
+    return;
+  dword_operand(gen, dword, reg);
+  ASM_WRITE("movsxd %s,%s\n", reg, dword);
+}
+
+// setcc only writes al, the movzx clears the rest of eax (and of rax, since
+// writing a 32 bit register zero extends it)
+void asm_set(ClmCodeGen *gen, const char *condition) {
+  ASM_WRITE("set%s al\n", condition);
+  writeLine(gen, "movzx eax,al\n");
+}
+
+void asm_movss(ClmCodeGen *gen, const char *dest, const char *src) {
+  ASM_WRITE("movss %s,%s\n", dest, src);
+}
+
+void asm_movd(ClmCodeGen *gen, const char *dest, const char *src) {
+  ASM_WRITE("movd %s,%s\n", dest, src);
+}
+
+void asm_cvtsi2ss(ClmCodeGen *gen, const char *dest, const char *src) {
+  ASM_WRITE("cvtsi2ss %s,%s\n", dest, src);
+}
+
+void asm_cvttss2si(ClmCodeGen *gen, const char *dest, const char *src) {
+  ASM_WRITE("cvttss2si %s,%s\n", dest, src);
+}
+
+void asm_addss(ClmCodeGen *gen, const char *dest, const char *other) {
+  ASM_WRITE("addss %s,%s\n", dest, other);
+}
+
+void asm_subss(ClmCodeGen *gen, const char *dest, const char *other) {
+  ASM_WRITE("subss %s,%s\n", dest, other);
+}
+
+void asm_mulss(ClmCodeGen *gen, const char *dest, const char *other) {
+  ASM_WRITE("mulss %s,%s\n", dest, other);
+}
 
-void asm_fxch(const char *arg1, const char *arg2) {
+void asm_divss(ClmCodeGen *gen, const char *dest, const char *other) {
+  ASM_WRITE("divss %s,%s\n", dest, other);
+}
+
+void asm_comiss(ClmCodeGen *gen, const char *arg1, const char *arg2) {
+  ASM_WRITE("comiss %s,%s\n", arg1, arg2);
+}
+
+// sse2 instructions overwrite their first operand, the vex form takes it
+// as both the destination and the first source
+static void packed(ClmCodeGen *gen, const char *op, const char *dest,
+                   const char *other) {
+  if (gen->simd == CLM_SIMD_AVX2)
+    ASM_WRITE("v%s %s,%s,%s\n", op, dest, dest, other);
+  else
+    ASM_WRITE("%s %s,%s\n", op, dest, other);
+}
+
+void asm_movdqu(ClmCodeGen *gen, const char *dest, const char *src) {
+  ASM_WRITE("%smovdqu %s,%s\n", gen->simd == CLM_SIMD_AVX2 ? "v" : "", dest,
+            src);
+}
+
+void asm_movdqa(ClmCodeGen *gen, const char *dest, const char *src) {
+  ASM_WRITE("%smovdqa %s,%s\n", gen->simd == CLM_SIMD_AVX2 ? "v" : "", dest,
+            src);
+}
+
+void asm_pxor(ClmCodeGen *gen, const char *dest, const char *other) {
+  packed(gen, "pxor", dest, other);
+}
+
+void asm_paddd(ClmCodeGen *gen, const char *dest, const char *other) {
+  packed(gen, "paddd", dest, other);
+}
+
+void asm_psubd(ClmCodeGen *gen, const char *dest, const char *other) {
+  packed(gen, "psubd", dest, other);
+}
+
+void asm_pmulld(ClmCodeGen *gen, const char *dest, const char *other) {
+  packed(gen, "pmulld", dest, other);
+}
+
+void asm_pmuludq(ClmCodeGen *gen, const char *dest, const char *other) {
+  packed(gen, "pmuludq", dest, other);
+}
+
+void asm_psrlq(ClmCodeGen *gen, const char *dest, int bits) {
+  if (gen->simd == CLM_SIMD_AVX2)
+    ASM_WRITE("vpsrlq %s,%s,%d\n", dest, dest, bits);
+  else
+    ASM_WRITE("psrlq %s,%d\n", dest, bits);
+}
+
+void asm_pshufd(ClmCodeGen *gen, const char *dest, const char *src, int order) {
+  ASM_WRITE("%spshufd %s,%s,%d\n", gen->simd == CLM_SIMD_AVX2 ? "v" : "", dest,
+            src, order);
+}
+
+void asm_punpckldq(ClmCodeGen *gen, const char *dest, const char *other) {
+  packed(gen, "punpckldq", dest, other);
+}
+
+void asm_mulps(ClmCodeGen *gen, const char *dest, const char *other) {
+  packed(gen, "mulps", dest, other);
+}
+
+void asm_divps(ClmCodeGen *gen, const char *dest, const char *other) {
+  packed(gen, "divps", dest, other);
+}
+
+void asm_cvtdq2ps(ClmCodeGen *gen, const char *dest, const char *src) {
+  ASM_WRITE("%scvtdq2ps %s,%s\n", gen->simd == CLM_SIMD_AVX2 ? "v" : "", dest,
+            src);
+}
+
+void asm_cvttps2dq(ClmCodeGen *gen, const char *dest, const char *src) {
+  ASM_WRITE("%scvttps2dq %s,%s\n", gen->simd == CLM_SIMD_AVX2 ? "v" : "", dest,
+            src);
+}
+
+void asm_movd_lane(ClmCodeGen *gen, const char *dest, const char *src) {
+  ASM_WRITE("%smovd %s,%s\n", gen->simd == CLM_SIMD_AVX2 ? "v" : "", dest, src);
+}
+
+void asm_pbroadcastd(ClmCodeGen *gen, const char *dest, const char *src) {
+  if (gen->simd == CLM_SIMD_AVX2) {
+    ASM_WRITE("vpbroadcastd %s,%s\n", dest, src);
+  } else {
+    ASM_WRITE("movd %s,%s\n", dest, src);
+    ASM_WRITE("pshufd %s,%s,0\n", dest, dest);
+  }
+}
+
+void asm_vzeroupper(ClmCodeGen *gen) { writeLine(gen, "vzeroupper\n"); }
+
+void asm_fxch(ClmCodeGen *gen, const char *arg1, const char *arg2) {
   ASM_WRITE("fxch %s,%s\n", arg1, arg2);
 }
 
-void asm_fild(const char *src) { ASM_WRITE("fild %s\n", src); }
+void asm_fild(ClmCodeGen *gen, const char *src) { ASM_WRITE("fild %s\n", src); }
 
-void asm_fiadd(const char *other) { ASM_WRITE("fiadd %s\n", other); }
+void asm_fiadd(ClmCodeGen *gen, const char *other) {
+  ASM_WRITE("fiadd %s\n", other);
+}
 
-void asm_fisub(const char *other) { ASM_WRITE("fisub %s\n", other); }
+void asm_fisub(ClmCodeGen *gen, const char *other) {
+  ASM_WRITE("fisub %s\n", other);
+}
 
-void asm_fimul(const char *other) { ASM_WRITE("fimul %s\n", other); }
+void asm_fimul(ClmCodeGen *gen, const char *other) {
+  ASM_WRITE("fimul %s\n", other);
+}
 
-void asm_fidiv(const char *other) { ASM_WRITE("fidiv %s\n", other); }
+void asm_fidiv(ClmCodeGen *gen, const char *other) {
+  ASM_WRITE("fidiv %s\n", other);
+}
 
-void asm_fisubr(const char *other) { ASM_WRITE("fisubr %s\n", other); }
+void asm_fisubr(ClmCodeGen *gen, const char *other) {
+  ASM_WRITE("fisubr %s\n", other);
+}
 
-void asm_fidivr(const char *other) { ASM_WRITE("fidivr %s\n", other); }
+void asm_fidivr(ClmCodeGen *gen, const char *other) {
+  ASM_WRITE("fidivr %s\n", other);
+}
 
 /*
   from fasm doc:
@@ -118,155 +540,270 @@ void asm_fidivr(const char *other) { ASM_WRITE("fidivr %s\n", other); }
   If both operands are FPU registers, at least one of them should be ST0
   register. An operand in memory can be a 32-bit or 64-bit value."
 */
-void asm_fadd(const char *dest, const char *other) {
+void asm_fadd(ClmCodeGen *gen, const char *dest, const char *other) {
   ASM_WRITE("fadd %s,%s\n", dest, other);
 }
 
-void asm_fsub(const char *dest, const char *other) {
+void asm_fsub(ClmCodeGen *gen, const char *dest, const char *other) {
   ASM_WRITE("fsub %s,%s\n", dest, other);
 }
 
-void asm_fmul(const char *dest, const char *other) {
+void asm_fmul(ClmCodeGen *gen, const char *dest, const char *other) {
   ASM_WRITE("fmul %s,%s\n", dest, other);
 }
 
-void asm_fdiv(const char *dest, const char *other) {
+void asm_fdiv(ClmCodeGen *gen, const char *dest, const char *other) {
   ASM_WRITE("fdiv %s,%s\n", dest, other);
 }
 
-void asm_faddp(const char *dest, const char *other) {
+void asm_faddp(ClmCodeGen *gen, const char *dest, const char *other) {
   ASM_WRITE("faddp %s,%s\n", dest, other);
 }
 
-void asm_fsubp(const char *dest, const char *other) {
+void asm_fsubp(ClmCodeGen *gen, const char *dest, const char *other) {
   ASM_WRITE("fsubp %s,%s\n", dest, other);
 }
 
-void asm_fmulp(const char *dest, const char *other) {
+void asm_fmulp(ClmCodeGen *gen, const char *dest, const char *other) {
   ASM_WRITE("fmulp %s,%s\n", dest, other);
 }
 
-void asm_fdivp(const char *dest, const char *other) {
+void asm_fdivp(ClmCodeGen *gen, const char *dest, const char *other) {
   ASM_WRITE("fdivp %s,%s\n", dest, other);
 }
 
-void asm_fsubr(const char *dest, const char *other) {
+void asm_fsubr(ClmCodeGen *gen, const char *dest, const char *other) {
   ASM_WRITE("fsubr %s,%s\n", dest, other);
 }
 
-void asm_fdivr(const char *dest, const char *other) {
+void asm_fdivr(ClmCodeGen *gen, const char *dest, const char *other) {
   ASM_WRITE("fdivr %s,%s\n", dest, other);
 }
 
-void asm_fsubrp(const char *dest, const char *other) {
+void asm_fsubrp(ClmCodeGen *gen, const char *dest, const char *other) {
   ASM_WRITE("fsubrp %s,%s\n", dest, other);
 }
 
-void asm_fdivrp(const char *dest, const char *other) {
+void asm_fdivrp(ClmCodeGen *gen, const char *dest, const char *other) {
   ASM_WRITE("fdivrp %s,%s\n", dest, other);
 }
 
-void asm_inc(const char *arg) { ASM_WRITE("inc %s\n", arg); }
+void asm_inc(ClmCodeGen *gen, const char *arg) { ASM_WRITE("inc %s\n", arg); }
 
-void asm_dec(const char *arg) { ASM_WRITE("dec %s\n", arg); }
+void asm_dec(ClmCodeGen *gen, const char *arg) { ASM_WRITE("dec %s\n", arg); }
 
-void asm_neg(const char *arg) { ASM_WRITE("dec %s\n", arg); }
+void asm_neg(ClmCodeGen *gen, const char *arg) { ASM_WRITE("neg %s\n", arg); }
 
-void asm_mov(const char *dest, const char *src) {
+void asm_mov(ClmCodeGen *gen, const char *dest, const char *src) {
   ASM_WRITE("mov %s,%s\n", dest, src);
 }
 
-void asm_mov_i(const char *dest, int i) { ASM_WRITE("mov %s,%d\n", dest, i); }
+void asm_mov_i(ClmCodeGen *gen, const char *dest, int i) {
+  ASM_WRITE("mov %s,%d\n", dest, i);
+}
 
-void asm_lea(const char *dest, const char *src) {
+void asm_lea(ClmCodeGen *gen, const char *dest, const char *src) {
   ASM_WRITE("lea %s,%s\n", dest, src);
 }
 
-void asm_xchg(const char *arg1, const char *arg2) {
+void asm_xchg(ClmCodeGen *gen, const char *arg1, const char *arg2) {
   ASM_WRITE("xchg %s,%s\n", arg1, arg2);
 }
 
-void asm_and(const char *arg1, const char *arg2) {
+void asm_and(ClmCodeGen *gen, const char *arg1, const char *arg2) {
   ASM_WRITE("and %s,%s\n", arg1, arg2);
 }
 
-void asm_or(const char *arg1, const char *arg2) {
+void asm_or(ClmCodeGen *gen, const char *arg1, const char *arg2) {
   ASM_WRITE("or %s,%s\n", arg1, arg2);
 }
 
-void asm_xor(const char *arg1, const char *arg2) {
+void asm_xor(ClmCodeGen *gen, const char *arg1, const char *arg2) {
   ASM_WRITE("xor %s,%s\n", arg1, arg2);
 }
 
-void asm_cmp(const char *arg1, const char *arg2) {
+void asm_cmp(ClmCodeGen *gen, const char *arg1, const char *arg2) {
   ASM_WRITE("cmp %s,%s\n", arg1, arg2);
 }
 
-void asm_jmp(const char *label) { ASM_WRITE("jmp %s\n", label); }
+void asm_jmp(ClmCodeGen *gen, const char *label) {
+  ASM_WRITE("jmp %s\n", label);
+}
 
-void asm_jmp_g(const char *label) { ASM_WRITE("jmp %s\n", label); }
+void asm_jmp_g(ClmCodeGen *gen, const char *label) {
+  ASM_WRITE("jg %s\n", label);
+}
 
-void asm_jmp_ge(const char *label) { ASM_WRITE("jge %s\n", label); }
+void asm_jmp_ge(ClmCodeGen *gen, const char *label) {
+  ASM_WRITE("jge %s\n", label);
+}
 
-void asm_jmp_l(const char *label) { ASM_WRITE("jl %s\n", label); }
+void asm_jmp_l(ClmCodeGen *gen, const char *label) {
+  ASM_WRITE("jl %s\n", label);
+}
 
-void asm_jmp_le(const char *label) { ASM_WRITE("jle %s\n", label); }
+void asm_jmp_le(ClmCodeGen *gen, const char *label) {
+  ASM_WRITE("jle %s\n", label);
+}
 
-void asm_jmp_eq(const char *label) { ASM_WRITE("je %s\n", label); }
+void asm_jmp_eq(ClmCodeGen *gen, const char *label) {
+  ASM_WRITE("je %s\n", label);
+}
 
-void asm_jmp_neq(const char *label) { ASM_WRITE("jne %s\n", label); }
+void asm_jmp_neq(ClmCodeGen *gen, const char *label) {
+  ASM_WRITE("jne %s\n", label);
+}
 
-void asm_label(const char *name) { ASM_WRITE("%s:\n", name); }
+void asm_label(ClmCodeGen *gen, const char *name) { ASM_WRITE("%s:\n", name); }
 
-void asm_call(const char *name) { ASM_WRITE("call _%s\n", name); }
+void asm_call(ClmCodeGen *gen, const char *name) {
+  ASM_WRITE("call _%s\n", name);
+}
 
-void asm_ret() { writeLine("ret\n"); }
+void asm_call_routine(ClmCodeGen *gen, const char *label) {
+  ASM_WRITE("call %s\n", label);
+}
 
-void asm_print_float(const char *src, int spc, int nl) {
-  asm_push_regs();
+void asm_ret(ClmCodeGen *gen) { writeLine(gen, "ret\n"); }
 
-  char buffer[128];
-  if (nl)
-    sprintf(buffer, "cinvoke printf, print_float_nl, %s\n", src);
-  else if (spc)
-    sprintf(buffer, "cinvoke printf, print_float_spc, %s\n", src);
+void asm_ret_i(ClmCodeGen *gen, int bytes) {
+  if (bytes == 0)
+    asm_ret(gen);
   else
-    sprintf(buffer, "cinvoke printf, print_float, %s\n", src);
-  writeLine(buffer);
+    ASM_WRITE("ret %d\n", bytes);
+}
 
-  asm_pop_regs();
+// calls printf with the format string at the label format and one argument
+// win32 uses fasm's cinvoke macro, linux64 follows the system v abi where the
+// stack has to be 16 byte aligned at the call and al holds the number of
+// vector registers used
+static void print_with(ClmCodeGen *gen, const char *format, const char *arg,
+                       int is_double) {
+  if (gen->target == CLM_TARGET_WIN32) {
+    asm_push_regs(gen);
+    if (arg == NULL) {
+      writeLinef(gen, "cinvoke printf, %s\n", format);
+    } else if (is_double) {
+      writeLinef(gen, "cinvoke printf, %s, dword [%s], dword [%s+4]\n", format,
+                 arg, arg);
+    } else {
+      writeLinef(gen, "cinvoke printf, %s, %s\n", format, arg);
+    }
+    asm_pop_regs(gen);
+    return;
+  }
+
+  // load the argument first, it may be relative to rsp
+  if (arg != NULL) {
+    if (is_double) {
+      writeLinef(gen, "movsd xmm0,qword ptr [%s]\n", arg);
+    } else {
+      writeLinef(gen, "mov rsi,%s\n", arg);
+    }
+  }
+  asm_push_regs(gen);
+  writeLine(gen, "mov r12,rsp\n" "and rsp,-16\n");
+  writeLinef(gen, "lea rdi,[rip+%s]\n", format);
+  writeLine(gen, is_double ? "mov eax,1\n" : "xor eax,eax\n");
+  writeLine(gen, "call printf\n" "mov rsp,r12\n");
+  asm_pop_regs(gen);
 }
 
-void asm_print_int(const char *src, int spc, int nl) {
-  asm_push_regs();
+// the label of the format string, into out
+static void print_format(char *out, const char *type, int spc, int nl) {
+  sprintf(out, "print_%s%s", type, nl ? "_nl" : spc ? "_spc" : "");
+}
 
-  char buffer[64];
-  if (nl)
-    sprintf(buffer, "cinvoke printf, print_int_nl, %s\n", src);
-  else if (spc)
-    sprintf(buffer, "cinvoke printf, print_int_spc, %s\n", src);
-  else
-    sprintf(buffer, "cinvoke printf, print_int, %s\n", src);
-  writeLine(buffer);
+void asm_print_float(ClmCodeGen *gen, const char *label, int spc, int nl) {
+  char format[32];
+  print_format(format, "float", spc, nl);
+  print_with(gen, format, label, 1);
+}
 
-  asm_pop_regs();
+void asm_print_int(ClmCodeGen *gen, const char *src, int spc, int nl) {
+  char format[32];
+  print_format(format, "int", spc, nl);
+  print_with(gen, format, src, 0);
 }
 
-void asm_print_char(const char *src, int spc, int nl) {
-  asm_push_regs();
+void asm_print_char(ClmCodeGen *gen, const char *src, int spc, int nl) {
+  char format[32];
+  print_format(format, "char", spc, nl);
+  print_with(gen, format, src, 0);
+}
 
-  char buffer[64];
-  if (nl)
-    sprintf(buffer, "cinvoke printf, print_char_nl, %s\n", src);
-  else if (spc)
-    sprintf(buffer, "cinvoke printf, print_char_spc, %s\n", src);
-  else
-    sprintf(buffer, "cinvoke printf, print_char, %s\n", src);
-  writeLine(buffer);
+void asm_print_newline(ClmCodeGen *gen) {
+  if (gen->target == CLM_TARGET_WIN32) {
+    asm_print_char(gen, "''", 0, 1);
+  } else {
+    print_with(gen, "print_nl", NULL, 0);
+  }
+}
 
-  asm_pop_regs();
+// calls a c runtime function with one or two arguments, which can't be
+// relative to esp. everything but eax is preserved
+static void call_c(ClmCodeGen *gen, const char *func, const char *arg1,
+                   const char *arg2) {
+  if (gen->target == CLM_TARGET_WIN32) {
+    writeLine(gen, "push ecx\n" "push edx\n");
+    if (arg2 == NULL) {
+      writeLinef(gen, "cinvoke %s, %s\n", func, arg1);
+    } else {
+      writeLinef(gen, "cinvoke %s, %s, %s\n", func, arg1, arg2);
+    }
+    writeLine(gen, "pop edx\n" "pop ecx\n");
+    return;
+  }
+
+  writeLine(gen, "push rcx\n"
+            "push rdx\n"
+            "push rsi\n"
+            "push rdi\n"
+            "push r8\n"
+            "push r9\n"
+            "push r10\n"
+            "push r11\n");
+  if (arg2 != NULL)
+    writeLinef(gen, "mov rsi,%s\n", arg2);
+  writeLinef(gen, "mov rdi,%s\n", arg1);
+  writeLine(gen, "mov r12,rsp\n" "and rsp,-16\n");
+  writeLinef(gen, "call %s\n", func);
+  writeLine(gen, "mov rsp,r12\n"
+            "pop r11\n"
+            "pop r10\n"
+            "pop r9\n"
+            "pop r8\n"
+            "pop rdi\n"
+            "pop rsi\n"
+            "pop rdx\n"
+            "pop rcx\n");
 }
 
-void asm_push_regs() { writeLine("pushad\n"); }
+void asm_malloc(ClmCodeGen *gen, const char *size) {
+  call_c(gen, "malloc", size, NULL);
+}
 
-void asm_pop_regs() { writeLine("popad\n"); }
+void asm_calloc(ClmCodeGen *gen, const char *size) {
+  call_c(gen, "calloc", "1", size);
+}
+
+void asm_free(ClmCodeGen *gen, const char *ptr) {
+  call_c(gen, "free", ptr, NULL);
+}
+
+// only the registers printf may clobber need saving
+void asm_push_regs(ClmCodeGen *gen) {
+  if (gen->target == CLM_TARGET_WIN32) {
+    writeLine(gen, "pushad\n");
+  } else {
+    writeLine(gen, "push rax\n" "push rcx\n" "push rdx\n");
+  }
+}
+
+void asm_pop_regs(ClmCodeGen *gen) {
+  if (gen->target == CLM_TARGET_WIN32) {
+    writeLine(gen, "popad\n");
+  } else {
+    writeLine(gen, "pop rdx\n" "pop rcx\n" "pop rax\n");
+  }
+}
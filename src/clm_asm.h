@@ -1,61 +1,94 @@
 #ifndef CLM_ASM_H_
 #define CLM_ASM_H_
 
-static const char ASM_HEADER[] =
-    "format PE console\n"
-    "entry start\n"
-    "\n"
-    "include 'win32a.inc'\n"
-    "include 'macro/import32.inc'\n"
-    "\n"
-    "section '.rdata' data readable\n"
-    "        print_int db '%%d',0\n"
-    "        print_int_spc db '%%d',32,0\n"
-    "        print_int_nl db '%%d',10,0\n"
-    "        print_float db '%%f',0\n"
-    "        print_float_spc db '%%f',32,0\n"
-    "        print_float_nl db '%%f',10,0\n"
-    "        print_char db '%%c',13,0\n"
-    "        print_char_spc db '%%c',13,32,0\n"
-    "        print_char_nl db '%%c',13,10,0\n"
-    "\n"
-    "section '.idata' data readable import\n"
-    "        library kernel32, 'kernel32.dll', \\\n"
-    "                msvcrt,   'msvcrt.dll'\n"
-    "        import kernel32, ExitProcess, 'ExitProcess'\n"
-    "        import msvcrt, printf, 'printf'\n"
-    "\n"
-    "section '.code' code executable\n";
-
-static const char ASM_EXIT_PROCESS[] = "invoke ExitProcess, 0\n";
-static const char ASM_START[] = "start:\n";
-static const char ASM_DATA[] = "section '.data' data readable writable\n"
-                               "__T_EAX__ dd 0\n"
-                               "__T_EBX__ dd 0\n"
-                               "__T_END__ dd 0\n"
-                               "__T_ROW_END__ dd 0\n"
-                               "__T_ESP__ dd 0\n"
-                               "__INT_CONSTANT__ dd 0\n"
-                               "__FLOAT_CONSTANT__ dd 0\n"
-                               "__DOUBLE_CONSTANT__ dq 0\n";
-
-// general 32 bit registers
-#define EAX "eax"
-#define EBX "ebx"
-#define ECX "ecx"
-#define EDX "edx"
-#define ESP "esp"
-#define EBP "ebp"
-
-// FPU registers
-#define ST0 "st0"
-#define ST1 "st1"
-#define ST2 "st2"
-#define ST3 "st3"
-#define ST4 "st4"
-#define ST5 "st5"
-#define ST6 "st6"
-#define ST7 "st7"
+#include "clm.h"
+
+// every emitter writes to the code generator it is given, which also holds
+// the target and vector extension it emits for, see clm_code_gen.h
+typedef struct ClmCodeGen ClmCodeGen;
+typedef struct AsmTargetInfo AsmTargetInfo;
+
+//
+// Targets
+//
+// every value the generated code works with lives in a stack slot that is
+// one machine word wide: 4 bytes on win32 and 8 bytes on linux64. offsets
+// that the code generator computes are in slots, and are scaled to bytes
+// with SLOT() when they are emitted
+//
+void asm_set_target(ClmCodeGen *gen, ClmTarget target);
+ClmTarget asm_get_target(ClmCodeGen *gen);
+int asm_word_size(ClmCodeGen *gen);
+
+#define SLOT(gen, n) ((n) * asm_word_size(gen))
+
+// the fixed parts of a program
+void asm_header(ClmCodeGen *gen);
+void asm_start(ClmCodeGen *gen);
+void asm_exit_process(ClmCodeGen *gen);
+void asm_data_section(ClmCodeGen *gen);
+
+// defines a word sized data label holding the given words followed by
+// num_zeros words of 0
+void asm_data(ClmCodeGen *gen, const char *name, const int *words,
+              int num_words, int num_zeros);
+
+// vector registers are xmm for sse2 and ymm for avx2. there are 8 of them on
+// win32 and 16 on linux64
+void asm_set_simd(ClmCodeGen *gen, ClmSimd simd);
+ClmSimd asm_get_simd(ClmCodeGen *gen);
+int asm_vector_lanes(ClmCodeGen *gen); // 32 bit ints per vector register
+int asm_vector_regs(ClmCodeGen *gen);
+const char *asm_vector_reg(ClmCodeGen *gen, int n);
+
+// general registers, these are the 32 bit registers on win32 and
+// the 64 bit registers on linux64. r8 - r11 only exist on linux64
+typedef enum AsmReg {
+  REG_A,
+  REG_B,
+  REG_C,
+  REG_D,
+  REG_SP,
+  REG_BP,
+  REG_SI,
+  REG_DI,
+  REG_8,
+  REG_9,
+  REG_10,
+  REG_11
+} AsmReg;
+
+const char *asm_reg(ClmCodeGen *gen, AsmReg reg);
+// the low 32 bits of a register, matrix elements are always 32 bits
+const char *asm_reg_dword(AsmReg reg);
+
+// the registers the register allocator may keep values in. eax and edx are
+// never handed out, division needs them and they are left as scratch
+const AsmReg *asm_allocatable_regs(ClmCodeGen *gen, int *count);
+
+// sse registers, named the same on every target
+const char *asm_xmm_reg(int n);
+
+#define EAX(gen) asm_reg(gen, REG_A)
+#define EBX(gen) asm_reg(gen, REG_B)
+#define ECX(gen) asm_reg(gen, REG_C)
+#define EDX(gen) asm_reg(gen, REG_D)
+#define ESP(gen) asm_reg(gen, REG_SP)
+#define EBP(gen) asm_reg(gen, REG_BP)
+#define ESI(gen) asm_reg(gen, REG_SI)
+#define EDI(gen) asm_reg(gen, REG_DI)
+
+// FPU registers, the assemblers spell these differently
+const char *asm_fpu_reg(ClmCodeGen *gen, int n);
+
+#define ST0(gen) asm_fpu_reg(gen, 0)
+#define ST1(gen) asm_fpu_reg(gen, 1)
+#define ST2(gen) asm_fpu_reg(gen, 2)
+#define ST3(gen) asm_fpu_reg(gen, 3)
+#define ST4(gen) asm_fpu_reg(gen, 4)
+#define ST5(gen) asm_fpu_reg(gen, 5)
+#define ST6(gen) asm_fpu_reg(gen, 6)
+#define ST7(gen) asm_fpu_reg(gen, 7)
 
 // compiler only globals to give more temporary
 #define T_EAX "__T_EAX__"
@@ -63,91 +96,170 @@ static const char ASM_DATA[] = "section '.data' data readable writable\n"
 #define T_END "__T_END__"
 #define T_ROW_END "__T_ROW_END__"
 #define T_ESP "__T_ESP__"
+#define SPILL "__SPILL__"
 #define INT_CONST "__INT_CONSTANT__"
 #define FLOAT_CONST "__FLOAT_CONSTANT__"
 #define DOUBLE_CONST "__DOUBLE_CONSTANT__"
 
-#define LABEL_SIZE 32
+#define LABEL_SIZE 256
+
+// memory operands
+// formats [base+offset+index] into out, where offset is in bytes and index
+// may be NULL. asm_mem is word sized, asm_mem_dword and asm_mem_qword are
+// for the fpu which always works with 32 bit ints/floats and 64 bit doubles
+void asm_mem(ClmCodeGen *gen, char *out, const char *base, int offset,
+             const char *index);
+void asm_mem_dword(ClmCodeGen *gen, char *out, const char *base, int offset,
+                   const char *index);
+void asm_mem_qword(ClmCodeGen *gen, char *out, const char *base, int offset,
+                   const char *index);
 
-void pop_int_into(const char *dest);
-void pop_float_into(const char *dest);
-void pop_matrix_of_size(const char *size_location);
+void pop_int_into(ClmCodeGen *gen, const char *dest);
+void pop_float_into(ClmCodeGen *gen, const char *dest);
 
 // general commands
-void asm_comment(const char *line);
-void asm_pop(const char *dest);
-void asm_push(const char *src);
-void asm_pop_f(const char *dest);
-void asm_push_f(const char *src);
-void asm_push_const_i(int val);
-void asm_push_const_f(float val);
-void asm_push_const_c(char val);
+void asm_comment(ClmCodeGen *gen, const char *line);
+void asm_pop(ClmCodeGen *gen, const char *dest);
+void asm_push(ClmCodeGen *gen, const char *src);
+void asm_pop_f(ClmCodeGen *gen, const char *dest);
+void asm_push_f(ClmCodeGen *gen, const char *src);
+void asm_push_const_i(ClmCodeGen *gen, int val);
+void asm_push_const_f(ClmCodeGen *gen, float val);
+void asm_push_const_c(ClmCodeGen *gen, char val);
 
 // integer arithmetic
-void asm_add(const char *dest, const char *other);
-void asm_add_i(const char *dest, int i);
-void asm_sub(const char *dest, const char *other);
-void asm_imul(const char *dest, const char *other);
-void asm_div(const char *denom);
+void asm_add(ClmCodeGen *gen, const char *dest, const char *other);
+void asm_add_i(ClmCodeGen *gen, const char *dest, int i);
+void asm_sub(ClmCodeGen *gen, const char *dest, const char *other);
+void asm_sub_i(ClmCodeGen *gen, const char *dest, int i);
+void asm_imul(ClmCodeGen *gen, const char *dest, const char *other);
+void asm_imul_i(ClmCodeGen *gen, const char *dest, int i);
+void asm_div(ClmCodeGen *gen, const char *denom);
+// divides edx:eax by the int in denom, a word sized register or memory
+// operand, and leaves the quotient in eax as an int (see asm_wrap_int)
+void asm_idiv(ClmCodeGen *gen, const char *denom);
+// loads a 32 bit int from memory, sign extended to the size of dest
+void asm_movsx_dword(ClmCodeGen *gen, const char *dest, const char *src);
+// sign extends eax into edx, ready for idiv
+void asm_sign_extend_a(ClmCodeGen *gen);
+// ints are 32 bits on every target, like matrix elements and the optimizer's
+// folds. on linux64 the word sized register reg is sign extended from its low
+// 32 bits, which has to follow any int arithmetic that can overflow them
+void asm_wrap_int(ClmCodeGen *gen, const char *reg);
+// sets eax to 1 if the condition (g, le, ne, a, ...) holds and 0 otherwise
+void asm_set(ClmCodeGen *gen, const char *condition);
+
+// scalar sse arithmetic, floats are always 32 bits
+void asm_movss(ClmCodeGen *gen, const char *dest, const char *src);
+void asm_movd(ClmCodeGen *gen, const char *dest, const char *src);
+void asm_cvtsi2ss(ClmCodeGen *gen, const char *dest, const char *src);
+// converts a float to an int, rounding towards zero
+void asm_cvttss2si(ClmCodeGen *gen, const char *dest, const char *src);
+void asm_addss(ClmCodeGen *gen, const char *dest, const char *other);
+void asm_subss(ClmCodeGen *gen, const char *dest, const char *other);
+void asm_mulss(ClmCodeGen *gen, const char *dest, const char *other);
+void asm_divss(ClmCodeGen *gen, const char *dest, const char *other);
+void asm_comiss(ClmCodeGen *gen, const char *arg1, const char *arg2);
+
+// packed 32 bit integer sse, these use the vex encoded form when avx2 is
+// enabled, with dest as both the destination and the first source. memory
+// operands don't have to be aligned
+void asm_movdqu(ClmCodeGen *gen, const char *dest, const char *src);
+void asm_movdqa(ClmCodeGen *gen, const char *dest,
+                const char *src); // registers only
+void asm_pxor(ClmCodeGen *gen, const char *dest, const char *other);
+void asm_paddd(ClmCodeGen *gen, const char *dest, const char *other);
+void asm_psubd(ClmCodeGen *gen, const char *dest, const char *other);
+// avx2 only, sse2 multiplies with pmuludq
+void asm_pmulld(ClmCodeGen *gen, const char *dest, const char *other);
+void asm_pmuludq(ClmCodeGen *gen, const char *dest, const char *other);
+void asm_psrlq(ClmCodeGen *gen, const char *dest, int bits);
+void asm_pshufd(ClmCodeGen *gen, const char *dest, const char *src, int order);
+void asm_punpckldq(ClmCodeGen *gen, const char *dest, const char *other);
+// packed 32 bit floats, and conversions between them and 32 bit ints
+void asm_mulps(ClmCodeGen *gen, const char *dest, const char *other);
+void asm_divps(ClmCodeGen *gen, const char *dest, const char *other);
+void asm_cvtdq2ps(ClmCodeGen *gen, const char *dest, const char *src);
+void asm_cvttps2dq(ClmCodeGen *gen, const char *dest,
+                   const char *src); // rounds towards zero
+// movd for the packed code, between memory and the lowest lane of a vector
+// register. dest is an xmm register, loading zeroes the rest of it
+void asm_movd_lane(ClmCodeGen *gen, const char *dest, const char *src);
+// copies the 32 bit int at src, in memory, into every lane of dest
+void asm_pbroadcastd(ClmCodeGen *gen, const char *dest, const char *src);
+// has to follow avx2 code before any sse is run again
+void asm_vzeroupper(ClmCodeGen *gen);
 
 // general fpu commands
-void asm_fxch(const char *arg1, const char *arg2);
-void asm_fild(const char *src);
+void asm_fxch(ClmCodeGen *gen, const char *arg1, const char *arg2);
+void asm_fild(ClmCodeGen *gen, const char *src);
 
 // fpu arithmetic with integers
-void asm_fiadd(const char *other);
-void asm_fisub(const char *other);
-void asm_fimul(const char *other);
-void asm_fidiv(const char *other);
-void asm_fisubr(const char *other);
-void asm_fidivr(const char *other);
+void asm_fiadd(ClmCodeGen *gen, const char *other);
+void asm_fisub(ClmCodeGen *gen, const char *other);
+void asm_fimul(ClmCodeGen *gen, const char *other);
+void asm_fidiv(ClmCodeGen *gen, const char *other);
+void asm_fisubr(ClmCodeGen *gen, const char *other);
+void asm_fidivr(ClmCodeGen *gen, const char *other);
 
 // fpu arithmetic
-void asm_fadd(const char *dest, const char *other);
-void asm_fsub(const char *dest, const char *other);
-void asm_fmul(const char *dest, const char *other);
-void asm_fdiv(const char *dest, const char *other);
-void asm_faddp(const char *dest, const char *other);
-void asm_fsubp(const char *dest, const char *other);
-void asm_fmulp(const char *dest, const char *other);
-void asm_fdivp(const char *dest, const char *other);
-void asm_fsubr(const char *dest, const char *other);
-void asm_fdivr(const char *dest, const char *other);
-void asm_fsubrp(const char *dest, const char *other);
-void asm_fdivrp(const char *dest, const char *other);
-
-void asm_inc(const char *arg);
-void asm_dec(const char *arg);
-void asm_neg(const char *arg);
-
-void asm_mov(const char *dest, const char *src);
-void asm_mov_i(const char *dest, int i);
-
-void asm_lea(const char *dest, const char *src);
-void asm_xchg(const char *arg1, const char *arg2);
-
-void asm_and(const char *arg1, const char *arg2);
-void asm_or(const char *arg1, const char *arg2);
-void asm_xor(const char *arg1, const char *arg2);
-void asm_cmp(const char *arg1, const char *arg2);
-
-void asm_jmp(const char *label);
-void asm_jmp_g(const char *label);
-void asm_jmp_ge(const char *label);
-void asm_jmp_l(const char *label);
-void asm_jmp_le(const char *label);
-void asm_jmp_eq(const char *label);
-void asm_jmp_neq(const char *label);
-
-void asm_label(const char *name);
-void asm_call(const char *name);
-void asm_ret();
-
-// TODO improve this interface
-void asm_print_float(const char *src, int spc, int nl);
-void asm_print_int(const char *src, int spc, int nl);
-void asm_print_char(const char *src, int spc, int nl);
-void asm_push_regs();
-void asm_pop_regs();
+void asm_fadd(ClmCodeGen *gen, const char *dest, const char *other);
+void asm_fsub(ClmCodeGen *gen, const char *dest, const char *other);
+void asm_fmul(ClmCodeGen *gen, const char *dest, const char *other);
+void asm_fdiv(ClmCodeGen *gen, const char *dest, const char *other);
+void asm_faddp(ClmCodeGen *gen, const char *dest, const char *other);
+void asm_fsubp(ClmCodeGen *gen, const char *dest, const char *other);
+void asm_fmulp(ClmCodeGen *gen, const char *dest, const char *other);
+void asm_fdivp(ClmCodeGen *gen, const char *dest, const char *other);
+void asm_fsubr(ClmCodeGen *gen, const char *dest, const char *other);
+void asm_fdivr(ClmCodeGen *gen, const char *dest, const char *other);
+void asm_fsubrp(ClmCodeGen *gen, const char *dest, const char *other);
+void asm_fdivrp(ClmCodeGen *gen, const char *dest, const char *other);
+
+void asm_inc(ClmCodeGen *gen, const char *arg);
+void asm_dec(ClmCodeGen *gen, const char *arg);
+void asm_neg(ClmCodeGen *gen, const char *arg);
+
+void asm_mov(ClmCodeGen *gen, const char *dest, const char *src);
+void asm_mov_i(ClmCodeGen *gen, const char *dest, int i);
+
+void asm_lea(ClmCodeGen *gen, const char *dest, const char *src);
+void asm_xchg(ClmCodeGen *gen, const char *arg1, const char *arg2);
+
+void asm_and(ClmCodeGen *gen, const char *arg1, const char *arg2);
+void asm_or(ClmCodeGen *gen, const char *arg1, const char *arg2);
+void asm_xor(ClmCodeGen *gen, const char *arg1, const char *arg2);
+void asm_cmp(ClmCodeGen *gen, const char *arg1, const char *arg2);
+
+void asm_jmp(ClmCodeGen *gen, const char *label);
+void asm_jmp_g(ClmCodeGen *gen, const char *label);
+void asm_jmp_ge(ClmCodeGen *gen, const char *label);
+void asm_jmp_l(ClmCodeGen *gen, const char *label);
+void asm_jmp_le(ClmCodeGen *gen, const char *label);
+void asm_jmp_eq(ClmCodeGen *gen, const char *label);
+void asm_jmp_neq(ClmCodeGen *gen, const char *label);
+
+void asm_label(ClmCodeGen *gen, const char *name);
+void asm_call(ClmCodeGen *gen, const char *name);
+// calls one of the compiler's own routines, which aren't clm functions
+void asm_call_routine(ClmCodeGen *gen, const char *label);
+void asm_ret(ClmCodeGen *gen);
+// returns and pops bytes of arguments off the stack
+void asm_ret_i(ClmCodeGen *gen, int bytes);
+
+// printing goes through the c runtime's printf on every target
+// asm_print_float takes the label of a double in memory
+void asm_print_float(ClmCodeGen *gen, const char *label, int spc, int nl);
+void asm_print_int(ClmCodeGen *gen, const char *src, int spc, int nl);
+void asm_print_char(ClmCodeGen *gen, const char *src, int spc, int nl);
+void asm_print_newline(ClmCodeGen *gen);
+void asm_push_regs(ClmCodeGen *gen);
+void asm_pop_regs(ClmCodeGen *gen);
+
+// heap memory from the c runtime, the pointer is returned in eax. the
+// arguments can't be relative to esp, every register except eax is preserved
+void asm_malloc(ClmCodeGen *gen, const char *size);
+void asm_calloc(ClmCodeGen *gen, const char *size);
+void asm_free(ClmCodeGen *gen, const char *ptr);
 
 #endif
@@ -25,68 +25,76 @@ const char *unary_op_to_string(UnaryOp op) {
   return strings[(int)op];
 }
 
-ClmExpNode *clm_exp_new_int(int val) {
-  ClmExpNode *node = malloc(sizeof(*node));
-  node->type = EXP_TYPE_INT;
+// nothing about a new node's type or size is cached yet
+static ClmExpNode *exp_new(ClmCompiler *compiler, ExpType type) {
+  ClmExpNode *node = clm_alloc(compiler, sizeof(*node));
+  node->type = type;
+  node->typeGeneration = 0;
+  node->sizeGeneration = 0;
+  clm_count(compiler, CLM_COUNTER_AST_NODES, 1);
+  return node;
+}
+
+ClmExpNode *clm_exp_new_int(ClmCompiler *compiler, int val) {
+  ClmExpNode *node = exp_new(compiler, EXP_TYPE_INT);
   node->ival = val;
   return node;
 }
 
-ClmExpNode *clm_exp_new_float(float fval) {
-  ClmExpNode *node = malloc(sizeof(*node));
-  node->type = EXP_TYPE_FLOAT;
+ClmExpNode *clm_exp_new_float(ClmCompiler *compiler, float fval) {
+  ClmExpNode *node = exp_new(compiler, EXP_TYPE_FLOAT);
   node->fval = fval;
   return node;
 }
 
-ClmExpNode *clm_exp_new_string(const char *str) {
-  ClmExpNode *node = malloc(sizeof(*node));
-  node->type = EXP_TYPE_STRING;
-  node->str = string_copy(str);
+ClmExpNode *clm_exp_new_string(ClmCompiler *compiler, const char *str) {
+  ClmExpNode *node = exp_new(compiler, EXP_TYPE_STRING);
+  node->str = str;
   return node;
 }
 
-ClmExpNode *clm_exp_new_arith(ArithOp operand, ClmExpNode *right,
-                              ClmExpNode *left) {
-  ClmExpNode *node = malloc(sizeof(*node));
-  node->type = EXP_TYPE_ARITH;
+ClmExpNode *clm_exp_new_arith(ClmCompiler *compiler, ArithOp operand,
+                              ClmExpNode *right, ClmExpNode *left) {
+  ClmExpNode *node = exp_new(compiler, EXP_TYPE_ARITH);
   node->arithExp.operand = operand;
   node->arithExp.right = right;
   node->arithExp.left = left;
   return node;
 }
 
-ClmExpNode *clm_exp_new_bool(BoolOp operand, ClmExpNode *right,
-                             ClmExpNode *left) {
-  ClmExpNode *node = malloc(sizeof(*node));
-  node->type = EXP_TYPE_BOOL;
+ClmExpNode *clm_exp_new_bool(ClmCompiler *compiler, BoolOp operand,
+                             ClmExpNode *right, ClmExpNode *left) {
+  ClmExpNode *node = exp_new(compiler, EXP_TYPE_BOOL);
   node->boolExp.operand = operand;
   node->boolExp.right = right;
   node->boolExp.left = left;
   return node;
 }
 
-ClmExpNode *clm_exp_new_call(char *name, ArrayList *params) {
-  ClmExpNode *node = malloc(sizeof(*node));
-  node->type = EXP_TYPE_CALL;
-  node->callExp.name = string_copy(name);
+ClmExpNode *clm_exp_new_call(ClmCompiler *compiler, const char *name,
+                             ArrayList *params) {
+  ClmExpNode *node = exp_new(compiler, EXP_TYPE_CALL);
+  node->callExp.name = name;
   node->callExp.params = params;
+  node->callExp.symbol = NULL;
   return node;
 }
 
-ClmExpNode *clm_exp_new_index(const char *id, ClmExpNode *rowIndex,
-                              ClmExpNode *colIndex) {
-  ClmExpNode *node = malloc(sizeof(*node));
-  node->type = EXP_TYPE_INDEX;
-  node->indExp.id = string_copy(id);
+ClmExpNode *clm_exp_new_index(ClmCompiler *compiler, const char *id,
+                              ClmExpNode *rowIndex, ClmExpNode *colIndex) {
+  ClmExpNode *node = exp_new(compiler, EXP_TYPE_INDEX);
+  node->indExp.id = id;
   node->indExp.rowIndex = rowIndex;
   node->indExp.colIndex = colIndex;
+  node->indExp.rowEnd = NULL;
+  node->indExp.colEnd = NULL;
+  node->indExp.symbol = NULL;
   return node;
 }
 
-ClmExpNode *clm_exp_new_mat_dec(float *arr, int length, int cols) {
-  ClmExpNode *node = malloc(sizeof(*node));
-  node->type = EXP_TYPE_MAT_DEC;
+ClmExpNode *clm_exp_new_mat_dec(ClmCompiler *compiler, float *arr, int length,
+                                int cols) {
+  ClmExpNode *node = exp_new(compiler, EXP_TYPE_MAT_DEC);
   node->matDecExp.arr = arr;
   node->matDecExp.length = length;
   node->matDecExp.size.rows = length / cols;
@@ -96,110 +104,49 @@ ClmExpNode *clm_exp_new_mat_dec(float *arr, int length, int cols) {
   return node;
 }
 
-ClmExpNode *clm_exp_new_empty_mat_dec(int rows, int cols, const char *rowVar,
-                                      const char *colVar) {
-  ClmExpNode *node = malloc(sizeof(*node));
-  node->type = EXP_TYPE_MAT_DEC;
+ClmExpNode *clm_exp_new_empty_mat_dec(ClmCompiler *compiler, int rows, int cols,
+                                      const char *rowVar, const char *colVar) {
+  ClmExpNode *node = exp_new(compiler, EXP_TYPE_MAT_DEC);
   node->matDecExp.arr = NULL;
   node->matDecExp.length = 0;
   node->matDecExp.size.rows = rows;
   node->matDecExp.size.cols = cols;
-  node->matDecExp.size.rowVar = string_copy(rowVar);
-  node->matDecExp.size.colVar = string_copy(colVar);
+  node->matDecExp.size.rowVar = rowVar;
+  node->matDecExp.size.colVar = colVar;
   return node;
 }
 
-ClmExpNode *clm_exp_new_param(const char *name, ClmType type, int rows,
-                              int cols, const char *rowVar,
-                              const char *colVar) {
-  ClmExpNode *node = malloc(sizeof(*node));
-  node->type = EXP_TYPE_PARAM;
-  node->paramExp.name = string_copy(name);
+ClmExpNode *clm_exp_new_param(ClmCompiler *compiler, const char *name,
+                              ClmType type, int rows, int cols,
+                              const char *rowVar, const char *colVar) {
+  ClmExpNode *node = exp_new(compiler, EXP_TYPE_PARAM);
+  node->paramExp.name = name;
   node->paramExp.type = type;
   node->paramExp.size.rows = rows;
   node->paramExp.size.cols = cols;
-  node->paramExp.size.rowVar = string_copy(rowVar);
-  node->paramExp.size.colVar = string_copy(colVar);
+  node->paramExp.size.rowVar = rowVar;
+  node->paramExp.size.colVar = colVar;
   return node;
 }
 
-ClmExpNode *clm_exp_new_unary(UnaryOp operand, ClmExpNode *node) {
-  ClmExpNode *unaryNode = malloc(sizeof(*unaryNode));
-  unaryNode->type = EXP_TYPE_UNARY;
-  node->unaryExp.operand = operand;
-  node->unaryExp.node = node;
+ClmExpNode *clm_exp_new_unary(ClmCompiler *compiler, UnaryOp operand,
+                              ClmExpNode *node) {
+  ClmExpNode *unaryNode = exp_new(compiler, EXP_TYPE_UNARY);
+  unaryNode->unaryExp.operand = operand;
+  unaryNode->unaryExp.node = node;
   return unaryNode;
 }
 
-static void matrix_size_free(MatrixSize size) {
-  free(size.rowVar);
-  free(size.colVar);
-}
-
-void clm_exp_free(void *data) {
-  if (data == NULL)
-    return;
-
-  ClmExpNode *node = (ClmExpNode *)data;
+// the unboxed node's parent is overwritten with it. the other child and the
+// old node are left in the arena
+void clm_exp_unbox_right(ClmExpNode *node) {
   switch (node->type) {
-  case EXP_TYPE_INT:
-  case EXP_TYPE_FLOAT:
-    break;
-  case EXP_TYPE_STRING:
-    free(node->str);
-    break;
   case EXP_TYPE_ARITH:
-    clm_exp_free(node->arithExp.left);
-    clm_exp_free(node->arithExp.right);
+    *node = *node->arithExp.right;
     break;
   case EXP_TYPE_BOOL:
-    clm_exp_free(node->boolExp.left);
-    clm_exp_free(node->boolExp.right);
-    break;
-  case EXP_TYPE_CALL:
-    free(node->callExp.name);
-    array_list_free(node->callExp.params);
-    break;
-  case EXP_TYPE_INDEX:
-    free(node->indExp.id);
-    clm_exp_free(node->indExp.rowIndex);
-    clm_exp_free(node->indExp.colIndex);
-    break;
-  case EXP_TYPE_MAT_DEC:
-    free(node->matDecExp.arr);
-    matrix_size_free(node->matDecExp.size);
-    break;
-  case EXP_TYPE_PARAM:
-    free(node->paramExp.name);
-    matrix_size_free(node->paramExp.size);
-    break;
-  case EXP_TYPE_UNARY:
-    clm_exp_free(node->unaryExp.node);
+    *node = *node->boolExp.right;
     break;
-  }
-  free(node);
-}
-
-void clm_exp_unbox_right(ClmExpNode *node) {
-  switch (node->type) {
-  case EXP_TYPE_ARITH: {
-    clm_exp_free(node->arithExp.left);
-
-    ClmExpNode *unboxed = node->arithExp.right;
-    *node = *unboxed;
-
-    free(unboxed);
-    break;
-  }
-  case EXP_TYPE_BOOL: {
-    clm_exp_free(node->boolExp.left);
-
-    ClmExpNode *unboxed = node->boolExp.right;
-    *node = *unboxed;
-
-    free(unboxed);
-    break;
-  }
   default:
     break;
   }
@@ -207,34 +154,18 @@ void clm_exp_unbox_right(ClmExpNode *node) {
 
 void clm_exp_unbox_left(ClmExpNode *node) {
   switch (node->type) {
-  case EXP_TYPE_ARITH: {
-    clm_exp_free(node->arithExp.right);
-
-    ClmExpNode *unboxed = node->arithExp.left;
-    *node = *unboxed;
-
-    free(unboxed);
+  case EXP_TYPE_ARITH:
+    *node = *node->arithExp.left;
     break;
-  }
-  case EXP_TYPE_BOOL: {
-    clm_exp_free(node->boolExp.right);
-
-    ClmExpNode *unboxed = node->boolExp.left;
-    *node = *unboxed;
-
-    free(unboxed);
+  case EXP_TYPE_BOOL:
+    *node = *node->boolExp.left;
     break;
-  }
   default:
     break;
   }
 }
 
-void clm_exp_unbox_unary(ClmExpNode *node) {
-  ClmExpNode *unboxed = node->unaryExp.node;
-  *node = *unboxed;
-  free(unboxed);
-}
+void clm_exp_unbox_unary(ClmExpNode *node) { *node = *node->unaryExp.node; }
 
 void clm_exp_print(void *data, int level) {
   ClmExpNode *node = data;
@@ -286,9 +217,23 @@ void clm_exp_print(void *data, int level) {
     clm_exp_print(node->indExp.rowIndex, level + 2);
     printf("\n");
 
+    if (node->indExp.rowEnd != NULL) {
+      insert_whitespace(level + 1);
+      printf("rowEnd:");
+      clm_exp_print(node->indExp.rowEnd, level + 2);
+      printf("\n");
+    }
+
     insert_whitespace(level + 1);
     printf("colIndex:");
     clm_exp_print(node->indExp.colIndex, level + 2);
+
+    if (node->indExp.colEnd != NULL) {
+      printf("\n");
+      insert_whitespace(level + 1);
+      printf("colEnd:");
+      clm_exp_print(node->indExp.colEnd, level + 2);
+    }
     break;
   case EXP_TYPE_MAT_DEC:
     if (node->matDecExp.arr == NULL) {
@@ -332,126 +277,105 @@ int clm_exp_has_no_inds(ClmExpNode *node) {
   return 0;
 }
 
-ClmStmtNode *clm_stmt_new_assign(ClmExpNode *lhs, ClmExpNode *rhs) {
-  ClmStmtNode *node = malloc(sizeof(*node));
-  node->type = STMT_TYPE_ASSIGN;
+int clm_exp_is_element(ClmExpNode *node) {
+  return node->type == EXP_TYPE_INDEX && node->indExp.rowIndex != NULL &&
+         node->indExp.colIndex != NULL && node->indExp.rowEnd == NULL &&
+         node->indExp.colEnd == NULL;
+}
+
+static ClmStmtNode *stmt_new(ClmCompiler *compiler, StmtType type) {
+  ClmStmtNode *node = clm_alloc(compiler, sizeof(*node));
+  node->type = type;
+  clm_count(compiler, CLM_COUNTER_AST_NODES, 1);
+  return node;
+}
+
+ClmStmtNode *clm_stmt_new_assign(ClmCompiler *compiler, ClmExpNode *lhs,
+                                 ClmExpNode *rhs) {
+  ClmStmtNode *node = stmt_new(compiler, STMT_TYPE_ASSIGN);
   node->assignStmt.lhs = lhs;
   node->assignStmt.rhs = rhs;
   return node;
 }
 
-ClmStmtNode *clm_stmt_new_call(ClmExpNode *callExpr) {
-  ClmStmtNode *node = malloc(sizeof(*node));
-  node->type = STMT_TYPE_CALL;
+ClmStmtNode *clm_stmt_new_call(ClmCompiler *compiler, ClmExpNode *callExpr) {
+  ClmStmtNode *node = stmt_new(compiler, STMT_TYPE_CALL);
   node->callExpr = callExpr;
   return node;
 }
 
-ClmStmtNode *clm_stmt_new_cond(ClmExpNode *condition, ArrayList *trueBody,
-                               ArrayList *falseBody) {
-  ClmStmtNode *node = malloc(sizeof(*node));
-  node->type = STMT_TYPE_CONDITIONAL;
+ClmStmtNode *clm_stmt_new_cond(ClmCompiler *compiler, ClmExpNode *condition,
+                               ArrayList *trueBody, ArrayList *falseBody) {
+  ClmStmtNode *node = stmt_new(compiler, STMT_TYPE_CONDITIONAL);
   node->conditionStmt.condition = condition;
   node->conditionStmt.trueBody = trueBody;
   node->conditionStmt.falseBody = falseBody;
+  node->conditionStmt.trueScope = NULL;
+  node->conditionStmt.falseScope = NULL;
   return node;
 }
 
-ClmStmtNode *clm_stmt_new_dec(char *name, ArrayList *params, ClmType returnType,
+ClmStmtNode *clm_stmt_new_dec(ClmCompiler *compiler, const char *name,
+                              ArrayList *params, ClmType returnType,
                               int returnRows, int returnCols,
-                              char *returnRowsVars, char *returnColsVar,
-                              ArrayList *body) {
-  ClmStmtNode *node = malloc(sizeof(*node));
-  node->type = STMT_TYPE_FUNC_DEC;
-  node->funcDecStmt.name = string_copy(name);
+                              const char *returnRowsVars,
+                              const char *returnColsVar, ArrayList *body) {
+  ClmStmtNode *node = stmt_new(compiler, STMT_TYPE_FUNC_DEC);
+  node->funcDecStmt.name = name;
   node->funcDecStmt.parameters = params;
   node->funcDecStmt.returnType = returnType;
   node->funcDecStmt.returnSize.rows = returnRows;
   node->funcDecStmt.returnSize.cols = returnCols;
-  node->funcDecStmt.returnSize.rowVar = string_copy(returnRowsVars);
-  node->funcDecStmt.returnSize.colVar = string_copy(returnColsVar);
+  node->funcDecStmt.returnSize.rowVar = returnRowsVars;
+  node->funcDecStmt.returnSize.colVar = returnColsVar;
   node->funcDecStmt.body = body;
+  node->funcDecStmt.scope = NULL;
   return node;
 }
 
-ClmStmtNode *clm_stmt_new_for_loop(char *varId, ClmExpNode *start, ClmExpNode *end,
-                               ClmExpNode *delta, ArrayList *body) {
-  ClmStmtNode *node = malloc(sizeof(*node));
-  node->type = STMT_TYPE_FOR_LOOP;
-  node->forLoopStmt.varId = string_copy(varId);
+ClmStmtNode *clm_stmt_new_for_loop(ClmCompiler *compiler, const char *varId,
+                                   ClmExpNode *start, ClmExpNode *end,
+                                   ClmExpNode *delta, ArrayList *body) {
+  ClmStmtNode *node = stmt_new(compiler, STMT_TYPE_FOR_LOOP);
+  node->forLoopStmt.varId = varId;
   node->forLoopStmt.start = start;
   node->forLoopStmt.end = end;
   node->forLoopStmt.delta = delta;
   node->forLoopStmt.body = body;
+  node->forLoopStmt.var = NULL;
   return node;
 }
 
-ClmStmtNode *clm_stmt_new_while_loop(ClmExpNode *condition, ArrayList *loopBody){
-  ClmStmtNode *node = malloc(sizeof(*node));
-  node->type = STMT_TYPE_WHILE_LOOP;
+ClmStmtNode *clm_stmt_new_while_loop(ClmCompiler *compiler,
+                                     ClmExpNode *condition,
+                                     ArrayList *loopBody){
+  ClmStmtNode *node = stmt_new(compiler, STMT_TYPE_WHILE_LOOP);
   node->whileLoopStmt.condition = condition;
   node->whileLoopStmt.body = loopBody;
   return node;
 }
 
-ClmStmtNode *clm_stmt_new_print(ClmExpNode *expression, int appendNewline) {
-  ClmStmtNode *node = malloc(sizeof(*node));
-  node->type = STMT_TYPE_PRINT;
+ClmStmtNode *clm_stmt_new_print(ClmCompiler *compiler, ClmExpNode *expression,
+                                int appendNewline) {
+  ClmStmtNode *node = stmt_new(compiler, STMT_TYPE_PRINT);
   node->printStmt.expression = expression;
   node->printStmt.appendNewline = appendNewline;
   return node;
 }
 
-ClmStmtNode *clm_stmt_new_return(ClmExpNode *returnExpr) {
-  ClmStmtNode *node = malloc(sizeof(*node));
-  node->type = STMT_TYPE_RET;
+ClmStmtNode *clm_stmt_new_return(ClmCompiler *compiler,
+                                 ClmExpNode *returnExpr) {
+  ClmStmtNode *node = stmt_new(compiler, STMT_TYPE_RET);
   node->returnExpr = returnExpr;
   return node;
 }
 
-void clm_stmt_free(void *data) {
-  if (data == NULL)
-    return;
-
-  ClmStmtNode *node = (ClmStmtNode *)data;
-  switch (node->type) {
-  case STMT_TYPE_ASSIGN:
-    clm_exp_free(node->assignStmt.lhs);
-    clm_exp_free(node->assignStmt.rhs);
-    break;
-  case STMT_TYPE_CALL:
-    clm_exp_free(node->callExpr);
-    break;
-  case STMT_TYPE_CONDITIONAL:
-    clm_exp_free(node->conditionStmt.condition);
-    array_list_free(node->conditionStmt.trueBody);
-    array_list_free(node->conditionStmt.falseBody);
-    break;
-  case STMT_TYPE_FUNC_DEC:
-    free(node->funcDecStmt.name);
-    matrix_size_free(node->funcDecStmt.returnSize);
-    array_list_free(node->funcDecStmt.parameters);
-    array_list_free(node->funcDecStmt.body);
-    break;
-  case STMT_TYPE_FOR_LOOP:
-    free(node->forLoopStmt.varId);
-    clm_exp_free(node->forLoopStmt.start);
-    clm_exp_free(node->forLoopStmt.end);
-    clm_exp_free(node->forLoopStmt.delta);
-    array_list_free(node->forLoopStmt.body);
-    break;
-  case STMT_TYPE_WHILE_LOOP:
-    clm_exp_free(node->whileLoopStmt.condition);
-    array_list_free(node->whileLoopStmt.body);
-    break;
-  case STMT_TYPE_PRINT:
-    clm_exp_free(node->printStmt.expression);
-    break;
-  case STMT_TYPE_RET:
-    clm_exp_free(node->returnExpr);
-    break;
-  }
-  free(node);
+ClmStmtNode *clm_stmt_new_import(ClmCompiler *compiler, const char *module,
+                                 ArrayList *names) {
+  ClmStmtNode *node = stmt_new(compiler, STMT_TYPE_IMPORT);
+  node->importStmt.module = module;
+  node->importStmt.names = names;
+  return node;
 }
 
 void clm_stmt_print(void *data, int level) {
@@ -557,5 +481,14 @@ void clm_stmt_print(void *data, int level) {
     printf("expression: ");
     clm_exp_print(node->returnExpr, level + 2);
     break;
+  case STMT_TYPE_IMPORT: {
+    int i;
+    printf("type : import, module : %s\n", node->importStmt.module);
+    insert_whitespace(level + 1);
+    printf("names:");
+    for (i = 0; i < node->importStmt.names->length; i++)
+      printf(" %s", (const char *)node->importStmt.names->data[i]);
+    break;
+  }
   }
 }
@@ -7,6 +7,8 @@
 // Forward Declarations
 //
 typedef struct ArrayList ArrayList;
+struct ClmSymbol;
+struct ClmScope;
 
 //
 // Expression
@@ -55,8 +57,8 @@ typedef enum ExpType {
 typedef struct MatrixSize {
   int rows;
   int cols;
-  char *rowVar;
-  char *colVar;
+  const char *rowVar;
+  const char *colVar;
 } MatrixSize;
 
 typedef struct ClmExpNode {
@@ -67,7 +69,7 @@ typedef struct ClmExpNode {
 
     float fval;
 
-    char *str;
+    const char *str; // interned
 
     struct {
       ArithOp operand;
@@ -82,14 +84,20 @@ typedef struct ClmExpNode {
     } boolExp;
 
     struct {
-      char *name;
+      const char *name;
       ArrayList *params; // array list of ClmExpNode
+      struct ClmSymbol *symbol; // bound by the symbol gen
     } callExp;
 
+    // a missing index is the whole row or column (A[x,] A[,y]), and an end
+    // makes the index a range of them (A[x..z, y])
     struct {
-      char *id;
+      const char *id;
       struct ClmExpNode *rowIndex;
       struct ClmExpNode *colIndex;
+      struct ClmExpNode *rowEnd;
+      struct ClmExpNode *colEnd;
+      struct ClmSymbol *symbol; // bound by the symbol gen
     } indExp;
 
     struct {
@@ -99,7 +107,7 @@ typedef struct ClmExpNode {
     } matDecExp;
 
     struct {
-      char *name;
+      const char *name;
       ClmType type;
       MatrixSize size;
     } paramExp;
@@ -110,28 +118,41 @@ typedef struct ClmExpNode {
     } unaryExp;
   };
 
+  // the type and size of the expression, cached by clm_type_of_exp and
+  // clm_size_of_exp. they're only used while their generation is current,
+  // see clm_compiler_invalidate_types
+  ClmType cachedType;
+  int cachedRows;
+  int cachedCols;
+  unsigned int typeGeneration;
+  unsigned int sizeGeneration;
+
   int lineNo;
   int colNo;
 } ClmExpNode;
 
-ClmExpNode *clm_exp_new_int(int val);
-ClmExpNode *clm_exp_new_float(float fval);
-ClmExpNode *clm_exp_new_string(const char *str);
-ClmExpNode *clm_exp_new_arith(ArithOp operand, ClmExpNode *right,
-                              ClmExpNode *left);
-ClmExpNode *clm_exp_new_bool(BoolOp operand, ClmExpNode *right,
-                             ClmExpNode *left);
-ClmExpNode *clm_exp_new_call(char *functionName, ArrayList *params);
-ClmExpNode *clm_exp_new_index(const char *id, ClmExpNode *rowIndex,
-                              ClmExpNode *colIndex);
-ClmExpNode *clm_exp_new_mat_dec(float *arr, int length, int cols);
-ClmExpNode *clm_exp_new_empty_mat_dec(int rows, int cols, const char *rowVar,
-                                      const char *colVar);
-ClmExpNode *clm_exp_new_param(const char *name, ClmType type, int rows,
-                              int cols, const char *rowVar, const char *colVar);
-ClmExpNode *clm_exp_new_unary(UnaryOp operand, ClmExpNode *node);
-
-void clm_exp_free(void *data);
+// nodes, and the lists they own, are allocated from the arena of the compiler
+// they are made for and go away with it
+ClmExpNode *clm_exp_new_int(ClmCompiler *compiler, int val);
+ClmExpNode *clm_exp_new_float(ClmCompiler *compiler, float fval);
+ClmExpNode *clm_exp_new_string(ClmCompiler *compiler, const char *str);
+ClmExpNode *clm_exp_new_arith(ClmCompiler *compiler, ArithOp operand,
+                              ClmExpNode *right, ClmExpNode *left);
+ClmExpNode *clm_exp_new_bool(ClmCompiler *compiler, BoolOp operand,
+                             ClmExpNode *right, ClmExpNode *left);
+ClmExpNode *clm_exp_new_call(ClmCompiler *compiler, const char *functionName,
+                             ArrayList *params);
+ClmExpNode *clm_exp_new_index(ClmCompiler *compiler, const char *id,
+                              ClmExpNode *rowIndex, ClmExpNode *colIndex);
+ClmExpNode *clm_exp_new_mat_dec(ClmCompiler *compiler, float *arr, int length,
+                                int cols);
+ClmExpNode *clm_exp_new_empty_mat_dec(ClmCompiler *compiler, int rows, int cols,
+                                      const char *rowVar, const char *colVar);
+ClmExpNode *clm_exp_new_param(ClmCompiler *compiler, const char *name,
+                              ClmType type, int rows, int cols,
+                              const char *rowVar, const char *colVar);
+ClmExpNode *clm_exp_new_unary(ClmCompiler *compiler, UnaryOp operand,
+                              ClmExpNode *node);
 
 void clm_exp_unbox_right(ClmExpNode *node);
 void clm_exp_unbox_left(ClmExpNode *node);
@@ -140,6 +161,8 @@ void clm_exp_unbox_unary(ClmExpNode *node);
 void clm_exp_print(void *data, int level);
 
 int clm_exp_has_no_inds(ClmExpNode *node);
+// A[x,y], a single element rather than a slice of the matrix
+int clm_exp_is_element(ClmExpNode *node);
 
 //
 // Statements
@@ -152,7 +175,8 @@ typedef enum StmtType {
   STMT_TYPE_FOR_LOOP,
   STMT_TYPE_WHILE_LOOP,
   STMT_TYPE_PRINT,
-  STMT_TYPE_RET
+  STMT_TYPE_RET,
+  STMT_TYPE_IMPORT
 } StmtType;
 
 typedef struct ClmStmtNode {
@@ -168,24 +192,29 @@ typedef struct ClmStmtNode {
       ClmExpNode *condition;
       ArrayList *trueBody;  // array list of ClmStmtNode
       ArrayList *falseBody; // array list of ClmStmtNode
+      // the scopes of the bodies, bound by the symbol gen
+      struct ClmScope *trueScope;
+      struct ClmScope *falseScope;
     } conditionStmt;
 
     ClmExpNode *callExpr;
 
     struct {
-      char *name;
+      const char *name;
       ArrayList *parameters; // array list of ClmExpNode
       ClmType returnType;
       MatrixSize returnSize;
       ArrayList *body; // array list of ClmStmtNode
+      struct ClmScope *scope; // bound by the symbol gen
     } funcDecStmt;
 
     struct {
-      char *varId;
+      const char *varId;
       ClmExpNode *start;
       ClmExpNode *end;
       ClmExpNode *delta;
       ArrayList *body; // array list of ClmStmtNode
+      struct ClmSymbol *var; // bound by the symbol gen
     } forLoopStmt;
 
     struct {
@@ -199,28 +228,41 @@ typedef struct ClmStmtNode {
     } printStmt;
 
     ClmExpNode *returnExpr;
+
+    // import names from module, resolved by the symbol gen
+    struct {
+      const char *module;
+      ArrayList *names; // array list of the interned function names
+    } importStmt;
   };
 
   int lineNo;
   int colNo;
 } ClmStmtNode;
 
-ClmStmtNode *clm_stmt_new_assign(ClmExpNode *lhs, ClmExpNode *rhs);
-ClmStmtNode *clm_stmt_new_call(ClmExpNode *callExpr);
-ClmStmtNode *clm_stmt_new_cond(ClmExpNode *condition, ArrayList *trueBody,
-                               ArrayList *falseBody);
-ClmStmtNode *clm_stmt_new_dec(char *name, ArrayList *params, ClmType returnType,
+ClmStmtNode *clm_stmt_new_assign(ClmCompiler *compiler, ClmExpNode *lhs,
+                                 ClmExpNode *rhs);
+ClmStmtNode *clm_stmt_new_call(ClmCompiler *compiler, ClmExpNode *callExpr);
+ClmStmtNode *clm_stmt_new_cond(ClmCompiler *compiler, ClmExpNode *condition,
+                               ArrayList *trueBody, ArrayList *falseBody);
+ClmStmtNode *clm_stmt_new_dec(ClmCompiler *compiler, const char *name,
+                              ArrayList *params, ClmType returnType,
                               int returnRows, int returnCols,
-                              char *returnRowsVars, char *returnColsVar,
+                              const char *returnRowsVars,
+                              const char *returnColsVar,
                               ArrayList *functionBody);
-ClmStmtNode *clm_stmt_new_for_loop(char *varId, ClmExpNode *start, ClmExpNode *end,
-                               ClmExpNode *delta, ArrayList *loopBody);
-ClmStmtNode *clm_stmt_new_while_loop(ClmExpNode *condition, ArrayList *loopBody);
-ClmStmtNode *clm_stmt_new_print(ClmExpNode *expression, int appendNewline);
-ClmStmtNode *clm_stmt_new_return(ClmExpNode *returnExpr);
+ClmStmtNode *clm_stmt_new_for_loop(ClmCompiler *compiler, const char *varId,
+                                   ClmExpNode *start, ClmExpNode *end,
+                                   ClmExpNode *delta, ArrayList *loopBody);
+ClmStmtNode *clm_stmt_new_while_loop(ClmCompiler *compiler,
+                                     ClmExpNode *condition,
+                                     ArrayList *loopBody);
+ClmStmtNode *clm_stmt_new_print(ClmCompiler *compiler, ClmExpNode *expression,
+                                int appendNewline);
+ClmStmtNode *clm_stmt_new_return(ClmCompiler *compiler, ClmExpNode *returnExpr);
+ClmStmtNode *clm_stmt_new_import(ClmCompiler *compiler, const char *module,
+                                 ArrayList *names);
 
 void clm_stmt_print(void *data, int level);
 
-void clm_stmt_free(void *data);
-
 #endif
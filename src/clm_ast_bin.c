@@ -0,0 +1,950 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clm.h"
+#include "clm_ast.h"
+#include "clm_ast_bin.h"
+#include "clm_module.h"
+#include "clm_scope.h"
+
+#ifndef CLM_VERSION
+#define CLM_VERSION "unknown"
+#endif
+
+/*
+ *
+ *  FORMAT
+ *
+ */
+
+// a binary AST is a header, the statement, expression, list, symbol and scope
+// records, the items of the lists and the symbols of the scopes, the numbers
+// of the matrices and the strings, one after the other. everything is 4 bytes
+// wide but the strings, which come last. records refer to each other by their
+// index in their table and to strings by their offset, NONE for nothing
+#define AST_FORMAT 1
+#define NONE 0xffffffffu
+
+#define STMT_FIELDS 9
+#define EXP_FIELDS 6
+
+typedef struct {
+  char magic[4];
+  unsigned int format;
+  unsigned int version;    // the CLM_VERSION that wrote it
+  unsigned int statements; // the list of the program's statements
+  unsigned int globalScope;
+  unsigned int stmtsLength;
+  unsigned int expsLength;
+  unsigned int listsLength;
+  unsigned int symbolsLength;
+  unsigned int scopesLength;
+  unsigned int itemsLength;
+  unsigned int floatsLength;
+  unsigned int stringsLength;
+} AstHeader;
+
+// the fields of a node are its members in the order they are declared,
+// see write_stmt and write_exp
+typedef struct {
+  unsigned int type;
+  int lineNo;
+  int colNo;
+  unsigned int fields[STMT_FIELDS];
+} StmtRecord;
+
+typedef struct {
+  unsigned int type;
+  int lineNo;
+  int colNo;
+  unsigned int fields[EXP_FIELDS];
+} ExpRecord;
+
+typedef enum { LIST_STMTS, LIST_EXPS, LIST_STRINGS } ListKind;
+
+typedef struct {
+  unsigned int kind;
+  unsigned int first; // in the items
+  unsigned int length;
+} ListRecord;
+
+// a parameter is declared by its node, anything else by its statement
+typedef struct {
+  unsigned int name;
+  unsigned int type;
+  unsigned int location;
+  int offset;
+  unsigned int declaration;
+} SymbolRecord;
+
+// a scope comes after its parent and after the children of its parent before
+// it. what a scope starts at is the statement or the body that refers to it
+typedef struct {
+  unsigned int parent;
+  unsigned int firstSymbol; // in the items
+  unsigned int symbolsLength;
+} ScopeRecord;
+
+typedef struct {
+  const AstHeader *header;
+  const StmtRecord *stmts;
+  const ExpRecord *exps;
+  const ListRecord *lists;
+  const SymbolRecord *symbols;
+  const ScopeRecord *scopes;
+  const unsigned int *items;
+  const float *floats;
+  const char *strings;
+} AstTables;
+
+// where the tables are, and how long the whole of it is
+static size_t ast_tables(const char *data, AstTables *tables) {
+  const AstHeader *header = (const AstHeader *)data;
+  tables->header = header;
+  tables->stmts = (const StmtRecord *)(header + 1);
+  tables->exps = (const ExpRecord *)(tables->stmts + header->stmtsLength);
+  tables->lists = (const ListRecord *)(tables->exps + header->expsLength);
+  tables->symbols =
+      (const SymbolRecord *)(tables->lists + header->listsLength);
+  tables->scopes =
+      (const ScopeRecord *)(tables->symbols + header->symbolsLength);
+  tables->items = (const unsigned int *)(tables->scopes + header->scopesLength);
+  tables->floats = (const float *)(tables->items + header->itemsLength);
+  tables->strings = (const char *)(tables->floats + header->floatsLength);
+  return sizeof(*header) + (size_t)header->stmtsLength * sizeof(StmtRecord) +
+         (size_t)header->expsLength * sizeof(ExpRecord) +
+         (size_t)header->listsLength * sizeof(ListRecord) +
+         (size_t)header->symbolsLength * sizeof(SymbolRecord) +
+         (size_t)header->scopesLength * sizeof(ScopeRecord) +
+         (size_t)header->itemsLength * sizeof(unsigned int) +
+         (size_t)header->floatsLength * sizeof(float) + header->stringsLength;
+}
+
+int clm_ast_is_binary(const char *data, size_t length) {
+  return length >= sizeof(AstHeader) &&
+         memcmp(data, CLM_AST_MAGIC, 4) == 0;
+}
+
+/*
+ *
+ *  WRITING
+ *
+ */
+
+// the index of everything given one, by its address. an open addressing
+// table kept at most half full
+typedef struct {
+  const void **keys;
+  unsigned int *values;
+  size_t size; // a power of 2
+  size_t length;
+} IndexTable;
+
+static unsigned int address_hash(const void *address) {
+  return (unsigned int)((uintptr_t)address >> 4) * 2654435761u;
+}
+
+static size_t index_slot(const IndexTable *table, const void *key) {
+  size_t mask = table->size - 1;
+  size_t i = address_hash(key) & mask;
+  while (table->keys[i] != NULL && table->keys[i] != key)
+    i = (i + 1) & mask;
+  return i;
+}
+
+static void index_table_init(IndexTable *table, size_t size) {
+  table->keys = calloc(size, sizeof(*table->keys));
+  table->values = malloc(size * sizeof(*table->values));
+  table->size = size;
+  table->length = 0;
+}
+
+static int index_find(const IndexTable *table, const void *key,
+                      unsigned int *out_index) {
+  size_t i = index_slot(table, key);
+  if (table->keys[i] == NULL)
+    return 0;
+  *out_index = table->values[i];
+  return 1;
+}
+
+static void index_insert(IndexTable *table, const void *key,
+                         unsigned int index) {
+  if (2 * (table->length + 1) > table->size) {
+    IndexTable larger;
+    size_t i;
+    index_table_init(&larger, table->size * 2);
+    for (i = 0; i < table->size; i++) {
+      if (table->keys[i] != NULL)
+        index_insert(&larger, table->keys[i], table->values[i]);
+    }
+    free(table->keys);
+    free(table->values);
+    *table = larger;
+  }
+  size_t i = index_slot(table, key);
+  table->keys[i] = key;
+  table->values[i] = index;
+  table->length++;
+}
+
+// giving something an index only queues it, its record is written once the
+// ones before it are
+typedef struct {
+  IndexTable indices;
+  ArrayList *stmts;
+  ArrayList *exps;
+  ArrayList *symbols;
+  ArrayList *scopes;
+  unsigned int listsLength;
+
+  StringBuffer *stmtRecords;
+  StringBuffer *expRecords;
+  StringBuffer *listRecords;
+  StringBuffer *symbolRecords;
+  StringBuffer *scopeRecords;
+  StringBuffer *items;
+  StringBuffer *floats;
+  StringBuffer *strings;
+} AstWriter;
+
+static void append_item(StringBuffer *buffer, unsigned int item) {
+  string_buffer_append_n(buffer, (const char *)&item, sizeof(item));
+}
+
+static unsigned int items_length(AstWriter *writer) {
+  return writer->items->length / sizeof(unsigned int);
+}
+
+static unsigned int string_index(AstWriter *writer, const char *string) {
+  unsigned int offset;
+  if (string == NULL)
+    return NONE;
+  if (!index_find(&writer->indices, string, &offset)) {
+    offset = writer->strings->length;
+    string_buffer_append_n(writer->strings, string, strlen(string) + 1);
+    index_insert(&writer->indices, string, offset);
+  }
+  return offset;
+}
+
+static unsigned int queue_index(AstWriter *writer, ArrayList *queue,
+                                void *element) {
+  unsigned int index;
+  if (element == NULL)
+    return NONE;
+  if (!index_find(&writer->indices, element, &index)) {
+    index = queue->length;
+    array_list_push(queue, element);
+    index_insert(&writer->indices, element, index);
+  }
+  return index;
+}
+
+static unsigned int stmt_index(AstWriter *writer, ClmStmtNode *node) {
+  return queue_index(writer, writer->stmts, node);
+}
+
+static unsigned int exp_index(AstWriter *writer, ClmExpNode *node) {
+  return queue_index(writer, writer->exps, node);
+}
+
+static unsigned int symbol_index(AstWriter *writer, ClmSymbol *symbol) {
+  return queue_index(writer, writer->symbols, symbol);
+}
+
+// the items of a list are given their indices when the list is
+static unsigned int list_index(AstWriter *writer, ArrayList *list,
+                               ListKind kind) {
+  unsigned int index;
+  if (list == NULL)
+    return NONE;
+  if (index_find(&writer->indices, list, &index))
+    return index;
+
+  index = writer->listsLength++;
+  index_insert(&writer->indices, list, index);
+  ListRecord record = {kind, items_length(writer), list->length};
+  int i;
+  for (i = 0; i < list->length; i++) {
+    if (kind == LIST_STMTS)
+      append_item(writer->items, stmt_index(writer, list->data[i]));
+    else if (kind == LIST_EXPS)
+      append_item(writer->items, exp_index(writer, list->data[i]));
+    else
+      append_item(writer->items, string_index(writer, list->data[i]));
+  }
+  string_buffer_append_n(writer->listRecords, (const char *)&record,
+                         sizeof(record));
+  return index;
+}
+
+static void index_scope_tree(AstWriter *writer, ClmScope *scope) {
+  int i;
+  queue_index(writer, writer->scopes, scope);
+  for (i = 0; i < scope->children->length; i++)
+    index_scope_tree(writer, scope->children->data[i]);
+}
+
+// the whole tree a scope is in is given indices at once, parents first, so
+// the children of each scope are loaded in their order
+static unsigned int scope_index(AstWriter *writer, ClmScope *scope) {
+  unsigned int index;
+  if (scope == NULL)
+    return NONE;
+  if (!index_find(&writer->indices, scope, &index)) {
+    ClmScope *root = scope;
+    while (root->parent != NULL)
+      root = root->parent;
+    index_scope_tree(writer, root);
+    index_find(&writer->indices, scope, &index);
+  }
+  return index;
+}
+
+static void write_size(AstWriter *writer, unsigned int *fields,
+                       const MatrixSize *size) {
+  fields[0] = (unsigned int)size->rows;
+  fields[1] = (unsigned int)size->cols;
+  fields[2] = string_index(writer, size->rowVar);
+  fields[3] = string_index(writer, size->colVar);
+}
+
+static void write_stmt(AstWriter *writer, ClmStmtNode *node) {
+  StmtRecord record;
+  unsigned int *fields = record.fields;
+  memset(&record, 0xff, sizeof(record));
+  record.type = node->type;
+  record.lineNo = node->lineNo;
+  record.colNo = node->colNo;
+
+  switch (node->type) {
+  case STMT_TYPE_ASSIGN:
+    fields[0] = exp_index(writer, node->assignStmt.lhs);
+    fields[1] = exp_index(writer, node->assignStmt.rhs);
+    break;
+  case STMT_TYPE_CALL:
+    fields[0] = exp_index(writer, node->callExpr);
+    break;
+  case STMT_TYPE_CONDITIONAL:
+    fields[0] = exp_index(writer, node->conditionStmt.condition);
+    fields[1] = list_index(writer, node->conditionStmt.trueBody, LIST_STMTS);
+    fields[2] = list_index(writer, node->conditionStmt.falseBody, LIST_STMTS);
+    fields[3] = scope_index(writer, node->conditionStmt.trueScope);
+    fields[4] = scope_index(writer, node->conditionStmt.falseScope);
+    break;
+  case STMT_TYPE_FUNC_DEC:
+    fields[0] = string_index(writer, node->funcDecStmt.name);
+    fields[1] = list_index(writer, node->funcDecStmt.parameters, LIST_EXPS);
+    fields[2] = node->funcDecStmt.returnType;
+    write_size(writer, fields + 3, &node->funcDecStmt.returnSize);
+    fields[7] = list_index(writer, node->funcDecStmt.body, LIST_STMTS);
+    fields[8] = scope_index(writer, node->funcDecStmt.scope);
+    break;
+  case STMT_TYPE_FOR_LOOP:
+    fields[0] = string_index(writer, node->forLoopStmt.varId);
+    fields[1] = exp_index(writer, node->forLoopStmt.start);
+    fields[2] = exp_index(writer, node->forLoopStmt.end);
+    fields[3] = exp_index(writer, node->forLoopStmt.delta);
+    fields[4] = list_index(writer, node->forLoopStmt.body, LIST_STMTS);
+    fields[5] = symbol_index(writer, node->forLoopStmt.var);
+    break;
+  case STMT_TYPE_WHILE_LOOP:
+    fields[0] = exp_index(writer, node->whileLoopStmt.condition);
+    fields[1] = list_index(writer, node->whileLoopStmt.body, LIST_STMTS);
+    break;
+  case STMT_TYPE_PRINT:
+    fields[0] = exp_index(writer, node->printStmt.expression);
+    fields[1] = node->printStmt.appendNewline;
+    break;
+  case STMT_TYPE_RET:
+    fields[0] = exp_index(writer, node->returnExpr);
+    break;
+  case STMT_TYPE_IMPORT:
+    fields[0] = string_index(writer, node->importStmt.module);
+    fields[1] = list_index(writer, node->importStmt.names, LIST_STRINGS);
+    break;
+  }
+  string_buffer_append_n(writer->stmtRecords, (const char *)&record,
+                         sizeof(record));
+}
+
+static void write_exp(AstWriter *writer, ClmExpNode *node) {
+  ExpRecord record;
+  unsigned int *fields = record.fields;
+  memset(&record, 0xff, sizeof(record));
+  record.type = node->type;
+  record.lineNo = node->lineNo;
+  record.colNo = node->colNo;
+
+  switch (node->type) {
+  case EXP_TYPE_INT:
+    fields[0] = (unsigned int)node->ival;
+    break;
+  case EXP_TYPE_FLOAT:
+    memcpy(&fields[0], &node->fval, sizeof(float));
+    break;
+  case EXP_TYPE_STRING:
+    fields[0] = string_index(writer, node->str);
+    break;
+  case EXP_TYPE_ARITH:
+    fields[0] = node->arithExp.operand;
+    fields[1] = exp_index(writer, node->arithExp.right);
+    fields[2] = exp_index(writer, node->arithExp.left);
+    break;
+  case EXP_TYPE_BOOL:
+    fields[0] = node->boolExp.operand;
+    fields[1] = exp_index(writer, node->boolExp.right);
+    fields[2] = exp_index(writer, node->boolExp.left);
+    break;
+  case EXP_TYPE_CALL:
+    fields[0] = string_index(writer, node->callExp.name);
+    fields[1] = list_index(writer, node->callExp.params, LIST_EXPS);
+    fields[2] = symbol_index(writer, node->callExp.symbol);
+    break;
+  case EXP_TYPE_INDEX:
+    fields[0] = string_index(writer, node->indExp.id);
+    fields[1] = exp_index(writer, node->indExp.rowIndex);
+    fields[2] = exp_index(writer, node->indExp.colIndex);
+    fields[3] = exp_index(writer, node->indExp.rowEnd);
+    fields[4] = exp_index(writer, node->indExp.colEnd);
+    fields[5] = symbol_index(writer, node->indExp.symbol);
+    break;
+  case EXP_TYPE_MAT_DEC:
+    if (node->matDecExp.arr != NULL) {
+      fields[0] = writer->floats->length / sizeof(float);
+      string_buffer_append_n(writer->floats,
+                             (const char *)node->matDecExp.arr,
+                             node->matDecExp.length * sizeof(float));
+    }
+    fields[1] = (unsigned int)node->matDecExp.length;
+    write_size(writer, fields + 2, &node->matDecExp.size);
+    break;
+  case EXP_TYPE_PARAM:
+    fields[0] = string_index(writer, node->paramExp.name);
+    fields[1] = node->paramExp.type;
+    write_size(writer, fields + 2, &node->paramExp.size);
+    break;
+  case EXP_TYPE_UNARY:
+    fields[0] = node->unaryExp.operand;
+    fields[1] = exp_index(writer, node->unaryExp.node);
+    break;
+  }
+  string_buffer_append_n(writer->expRecords, (const char *)&record,
+                         sizeof(record));
+}
+
+static void write_symbol(AstWriter *writer, ClmSymbol *symbol) {
+  SymbolRecord record;
+  record.name = string_index(writer, symbol->name);
+  record.type = symbol->type;
+  record.location = symbol->location;
+  record.offset = symbol->offset;
+  if (symbol->location == LOCATION_PARAMETER)
+    record.declaration = exp_index(writer, symbol->declaration);
+  else
+    record.declaration = stmt_index(writer, symbol->declaration);
+  string_buffer_append_n(writer->symbolRecords, (const char *)&record,
+                         sizeof(record));
+}
+
+static void write_scope(AstWriter *writer, ClmScope *scope) {
+  ScopeRecord record;
+  int i;
+  record.parent = scope_index(writer, scope->parent);
+  record.firstSymbol = items_length(writer);
+  record.symbolsLength = scope->symbols->length;
+  for (i = 0; i < scope->symbols->length; i++)
+    append_item(writer->items, symbol_index(writer, scope->symbols->data[i]));
+  string_buffer_append_n(writer->scopeRecords, (const char *)&record,
+                         sizeof(record));
+}
+
+StringBuffer *clm_ast_serialize(ArrayList *statements, ClmScope *globalScope) {
+  AstWriter writer;
+  AstHeader header;
+  int stmts = 0, exps = 0, symbols = 0, scopes = 0;
+
+  memset(&writer, 0, sizeof(writer));
+  index_table_init(&writer.indices, 1024);
+  writer.stmts = array_list_new(NULL);
+  writer.exps = array_list_new(NULL);
+  writer.symbols = array_list_new(NULL);
+  writer.scopes = array_list_new(NULL);
+  writer.stmtRecords = string_buffer_new();
+  writer.expRecords = string_buffer_new();
+  writer.listRecords = string_buffer_new();
+  writer.symbolRecords = string_buffer_new();
+  writer.scopeRecords = string_buffer_new();
+  writer.items = string_buffer_new();
+  writer.floats = string_buffer_new();
+  writer.strings = string_buffer_new();
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, CLM_AST_MAGIC, 4);
+  header.format = AST_FORMAT;
+  header.version = string_index(&writer, CLM_VERSION);
+  header.statements = list_index(&writer, statements, LIST_STMTS);
+  header.globalScope = scope_index(&writer, globalScope);
+
+  // writing a record gives what it refers to an index, so this goes on until
+  // nothing is left without a record
+  while (stmts < writer.stmts->length || exps < writer.exps->length ||
+         symbols < writer.symbols->length || scopes < writer.scopes->length) {
+    while (stmts < writer.stmts->length)
+      write_stmt(&writer, writer.stmts->data[stmts++]);
+    while (exps < writer.exps->length)
+      write_exp(&writer, writer.exps->data[exps++]);
+    while (scopes < writer.scopes->length)
+      write_scope(&writer, writer.scopes->data[scopes++]);
+    while (symbols < writer.symbols->length)
+      write_symbol(&writer, writer.symbols->data[symbols++]);
+  }
+
+  header.stmtsLength = writer.stmts->length;
+  header.expsLength = writer.exps->length;
+  header.listsLength = writer.listsLength;
+  header.symbolsLength = writer.symbols->length;
+  header.scopesLength = writer.scopes->length;
+  header.itemsLength = items_length(&writer);
+  header.floatsLength = writer.floats->length / sizeof(float);
+  header.stringsLength = writer.strings->length;
+
+  StringBuffer *out = string_buffer_new();
+  StringBuffer *tables[] = {writer.stmtRecords,   writer.expRecords,
+                            writer.listRecords,   writer.symbolRecords,
+                            writer.scopeRecords,  writer.items,
+                            writer.floats,        writer.strings};
+  size_t i;
+  string_buffer_append_n(out, (const char *)&header, sizeof(header));
+  for (i = 0; i < sizeof(tables) / sizeof(tables[0]); i++) {
+    string_buffer_append_n(out, tables[i]->data, tables[i]->length);
+    string_buffer_free(tables[i]);
+  }
+
+  free(writer.indices.keys);
+  free(writer.indices.values);
+  array_list_free(writer.stmts);
+  array_list_free(writer.exps);
+  array_list_free(writer.symbols);
+  array_list_free(writer.scopes);
+  return out;
+}
+
+/*
+ *
+ *  LOADING
+ *
+ */
+
+// everything is made before any of it is filled in, so a record can refer to
+// one after it. an index that is out of its table makes the file invalid
+typedef struct {
+  ClmCompiler *compiler; // the nodes are in its arena
+  AstTables tables;
+  ClmStmtNode **stmts;
+  ClmExpNode **exps;
+  ArrayList **lists;
+  ClmSymbol **symbols;
+  ClmScope **scopes;
+  int invalid;
+} AstReader;
+
+static void *element_at(AstReader *reader, void **elements,
+                        unsigned int length, unsigned int index) {
+  if (index == NONE)
+    return NULL;
+  if (index >= length) {
+    reader->invalid = 1;
+    return NULL;
+  }
+  return elements[index];
+}
+
+static ClmStmtNode *stmt_at(AstReader *reader, unsigned int index) {
+  return element_at(reader, (void **)reader->stmts,
+                    reader->tables.header->stmtsLength, index);
+}
+
+static ClmExpNode *exp_at(AstReader *reader, unsigned int index) {
+  return element_at(reader, (void **)reader->exps,
+                    reader->tables.header->expsLength, index);
+}
+
+static ArrayList *list_at(AstReader *reader, unsigned int index) {
+  return element_at(reader, (void **)reader->lists,
+                    reader->tables.header->listsLength, index);
+}
+
+static ClmSymbol *symbol_at(AstReader *reader, unsigned int index) {
+  return element_at(reader, (void **)reader->symbols,
+                    reader->tables.header->symbolsLength, index);
+}
+
+static ClmScope *scope_at(AstReader *reader, unsigned int index) {
+  return element_at(reader, (void **)reader->scopes,
+                    reader->tables.header->scopesLength, index);
+}
+
+// names are compared by address, so every string is interned
+static const char *string_at(AstReader *reader, unsigned int offset) {
+  if (offset == NONE)
+    return NULL;
+  if (offset >= reader->tables.header->stringsLength) {
+    reader->invalid = 1;
+    return NULL;
+  }
+  return string_intern(reader->compiler, reader->tables.strings + offset);
+}
+
+// what a node can't be without, which code gen uses without checking
+static void *required(AstReader *reader, void *element) {
+  if (element == NULL)
+    reader->invalid = 1;
+  return element;
+}
+
+static const char *required_string(AstReader *reader, const char *string) {
+  if (string == NULL)
+    reader->invalid = 1;
+  return string;
+}
+
+static int in_table(AstReader *reader, unsigned int first, unsigned int length,
+                    unsigned int tableLength) {
+  if ((size_t)first + length > tableLength) {
+    reader->invalid = 1;
+    return 0;
+  }
+  return 1;
+}
+
+static void read_size(AstReader *reader, const unsigned int *fields,
+                      MatrixSize *size) {
+  size->rows = (int)fields[0];
+  size->cols = (int)fields[1];
+  size->rowVar = string_at(reader, fields[2]);
+  size->colVar = string_at(reader, fields[3]);
+}
+
+static void read_list(AstReader *reader, const ListRecord *record,
+                      ArrayList *list) {
+  const unsigned int *items = reader->tables.items + record->first;
+  unsigned int i;
+  if (record->kind > LIST_STRINGS ||
+      !in_table(reader, record->first, record->length,
+                reader->tables.header->itemsLength)) {
+    reader->invalid = 1;
+    return;
+  }
+  for (i = 0; i < record->length; i++) {
+    void *item;
+    if (record->kind == LIST_STMTS)
+      item = stmt_at(reader, items[i]);
+    else if (record->kind == LIST_EXPS)
+      item = exp_at(reader, items[i]);
+    else
+      item = (void *)string_at(reader, items[i]);
+    if (item == NULL)
+      reader->invalid = 1;
+    array_list_push(list, item);
+  }
+}
+
+static void read_symbol(AstReader *reader, const SymbolRecord *record,
+                        ClmSymbol *symbol) {
+  if (record->type > CLM_TYPE_NONE || record->location > LOCATION_STACK) {
+    reader->invalid = 1;
+    return;
+  }
+  symbol->name = required_string(reader, string_at(reader, record->name));
+  symbol->type = (ClmType)record->type;
+  symbol->location = (ClmLocation)record->location;
+  symbol->offset = record->offset;
+  if (symbol->location == LOCATION_PARAMETER)
+    symbol->declaration = exp_at(reader, record->declaration);
+  else
+    symbol->declaration = stmt_at(reader, record->declaration);
+}
+
+static void read_stmt(AstReader *reader, const StmtRecord *record,
+                      ClmStmtNode *node) {
+  const unsigned int *fields = record->fields;
+  node->type = (StmtType)record->type;
+  node->lineNo = record->lineNo;
+  node->colNo = record->colNo;
+
+  switch (record->type) {
+  case STMT_TYPE_ASSIGN:
+    node->assignStmt.lhs = required(reader, exp_at(reader, fields[0]));
+    node->assignStmt.rhs = required(reader, exp_at(reader, fields[1]));
+    break;
+  case STMT_TYPE_CALL:
+    node->callExpr = required(reader, exp_at(reader, fields[0]));
+    break;
+  case STMT_TYPE_CONDITIONAL:
+    node->conditionStmt.condition =
+        required(reader, exp_at(reader, fields[0]));
+    node->conditionStmt.trueBody = required(reader, list_at(reader, fields[1]));
+    node->conditionStmt.falseBody = list_at(reader, fields[2]);
+    node->conditionStmt.trueScope =
+        required(reader, scope_at(reader, fields[3]));
+    node->conditionStmt.falseScope = scope_at(reader, fields[4]);
+    // an else has its scope, and there is no scope without one
+    if ((node->conditionStmt.falseBody == NULL) !=
+        (node->conditionStmt.falseScope == NULL))
+      reader->invalid = 1;
+    if (node->conditionStmt.trueScope != NULL)
+      node->conditionStmt.trueScope->startNode = node->conditionStmt.trueBody;
+    if (node->conditionStmt.falseScope != NULL)
+      node->conditionStmt.falseScope->startNode =
+          node->conditionStmt.falseBody;
+    break;
+  case STMT_TYPE_FUNC_DEC:
+    node->funcDecStmt.name =
+        required_string(reader, string_at(reader, fields[0]));
+    node->funcDecStmt.parameters =
+        required(reader, list_at(reader, fields[1]));
+    node->funcDecStmt.returnType = (ClmType)fields[2];
+    read_size(reader, fields + 3, &node->funcDecStmt.returnSize);
+    node->funcDecStmt.body = required(reader, list_at(reader, fields[7]));
+    node->funcDecStmt.scope = required(reader, scope_at(reader, fields[8]));
+    if (fields[2] > CLM_TYPE_NONE)
+      reader->invalid = 1;
+    if (node->funcDecStmt.scope != NULL)
+      node->funcDecStmt.scope->startNode = node;
+    break;
+  case STMT_TYPE_FOR_LOOP:
+    node->forLoopStmt.varId =
+        required_string(reader, string_at(reader, fields[0]));
+    node->forLoopStmt.start = required(reader, exp_at(reader, fields[1]));
+    node->forLoopStmt.end = required(reader, exp_at(reader, fields[2]));
+    node->forLoopStmt.delta = required(reader, exp_at(reader, fields[3]));
+    node->forLoopStmt.body = required(reader, list_at(reader, fields[4]));
+    node->forLoopStmt.var = required(reader, symbol_at(reader, fields[5]));
+    break;
+  case STMT_TYPE_WHILE_LOOP:
+    node->whileLoopStmt.condition =
+        required(reader, exp_at(reader, fields[0]));
+    node->whileLoopStmt.body = required(reader, list_at(reader, fields[1]));
+    break;
+  case STMT_TYPE_PRINT:
+    node->printStmt.expression = required(reader, exp_at(reader, fields[0]));
+    node->printStmt.appendNewline = (int)fields[1];
+    break;
+  case STMT_TYPE_RET:
+    node->returnExpr = exp_at(reader, fields[0]);
+    break;
+  case STMT_TYPE_IMPORT:
+    node->importStmt.module = string_at(reader, fields[0]);
+    node->importStmt.names = list_at(reader, fields[1]);
+    if (node->importStmt.module == NULL || node->importStmt.names == NULL)
+      reader->invalid = 1;
+    break;
+  default:
+    reader->invalid = 1;
+    break;
+  }
+}
+
+static int is_function(ClmSymbol *symbol) {
+  ClmStmtNode *declaration = symbol->declaration;
+  return symbol->location != LOCATION_PARAMETER && declaration != NULL &&
+         declaration->type == STMT_TYPE_FUNC_DEC;
+}
+
+static void read_exp(AstReader *reader, const ExpRecord *record,
+                     ClmExpNode *node) {
+  const unsigned int *fields = record->fields;
+  node->type = (ExpType)record->type;
+  node->lineNo = record->lineNo;
+  node->colNo = record->colNo;
+
+  switch (record->type) {
+  case EXP_TYPE_INT:
+    node->ival = (int)fields[0];
+    break;
+  case EXP_TYPE_FLOAT:
+    memcpy(&node->fval, &fields[0], sizeof(float));
+    break;
+  case EXP_TYPE_STRING:
+    node->str = required_string(reader, string_at(reader, fields[0]));
+    break;
+  case EXP_TYPE_ARITH:
+    node->arithExp.operand = (ArithOp)fields[0];
+    node->arithExp.right = required(reader, exp_at(reader, fields[1]));
+    node->arithExp.left = required(reader, exp_at(reader, fields[2]));
+    if (fields[0] > ARITH_OP_DIV)
+      reader->invalid = 1;
+    break;
+  case EXP_TYPE_BOOL:
+    node->boolExp.operand = (BoolOp)fields[0];
+    node->boolExp.right = required(reader, exp_at(reader, fields[1]));
+    node->boolExp.left = required(reader, exp_at(reader, fields[2]));
+    if (fields[0] > BOOL_OP_LTE)
+      reader->invalid = 1;
+    break;
+  case EXP_TYPE_CALL:
+    node->callExp.name = required_string(reader, string_at(reader, fields[0]));
+    node->callExp.params = required(reader, list_at(reader, fields[1]));
+    node->callExp.symbol = required(reader, symbol_at(reader, fields[2]));
+    // the statements are read by now, so the function's declaration has
+    // its type
+    if (node->callExp.symbol != NULL && !is_function(node->callExp.symbol))
+      reader->invalid = 1;
+    break;
+  case EXP_TYPE_INDEX:
+    node->indExp.id = required_string(reader, string_at(reader, fields[0]));
+    node->indExp.rowIndex = exp_at(reader, fields[1]);
+    node->indExp.colIndex = exp_at(reader, fields[2]);
+    node->indExp.rowEnd = exp_at(reader, fields[3]);
+    node->indExp.colEnd = exp_at(reader, fields[4]);
+    node->indExp.symbol = required(reader, symbol_at(reader, fields[5]));
+    break;
+  case EXP_TYPE_MAT_DEC:
+    node->matDecExp.arr = NULL;
+    node->matDecExp.length = (int)fields[1];
+    if (fields[0] != NONE &&
+        in_table(reader, fields[0], fields[1],
+                 reader->tables.header->floatsLength)) {
+      node->matDecExp.arr =
+          clm_alloc(reader->compiler, fields[1] * sizeof(float));
+      memcpy(node->matDecExp.arr, reader->tables.floats + fields[0],
+             fields[1] * sizeof(float));
+    }
+    read_size(reader, fields + 2, &node->matDecExp.size);
+    break;
+  case EXP_TYPE_PARAM:
+    node->paramExp.name = required_string(reader, string_at(reader, fields[0]));
+    node->paramExp.type = (ClmType)fields[1];
+    read_size(reader, fields + 2, &node->paramExp.size);
+    if (fields[1] > CLM_TYPE_NONE)
+      reader->invalid = 1;
+    break;
+  case EXP_TYPE_UNARY:
+    node->unaryExp.operand = (UnaryOp)fields[0];
+    node->unaryExp.node = required(reader, exp_at(reader, fields[1]));
+    if (fields[0] > UNARY_OP_NOT)
+      reader->invalid = 1;
+    break;
+  default:
+    reader->invalid = 1;
+    break;
+  }
+}
+
+// a scope's parent is made before it, and a scope is put in its parent's
+// children as it is made
+static void read_scopes(AstReader *reader) {
+  const AstHeader *header = reader->tables.header;
+  unsigned int i, j;
+  for (i = 0; i < header->scopesLength; i++) {
+    const ScopeRecord *record = &reader->tables.scopes[i];
+    ClmScope *parent = NULL;
+    if (record->parent != NONE && record->parent >= i)
+      reader->invalid = 1;
+    else
+      parent = scope_at(reader, record->parent);
+    reader->scopes[i] = clm_scope_new(reader->compiler, parent, NULL);
+  }
+  for (i = 0; i < header->scopesLength; i++) {
+    const ScopeRecord *record = &reader->tables.scopes[i];
+    if (!in_table(reader, record->firstSymbol, record->symbolsLength,
+                  header->itemsLength))
+      continue;
+    for (j = 0; j < record->symbolsLength; j++) {
+      ClmSymbol *symbol =
+          symbol_at(reader, reader->tables.items[record->firstSymbol + j]);
+      if (symbol == NULL)
+        reader->invalid = 1;
+      else
+        clm_scope_push(reader->scopes[i], symbol);
+    }
+  }
+}
+
+static int valid_ast(const char *data, size_t length) {
+  AstTables tables;
+  if (!clm_ast_is_binary(data, length) || ((uintptr_t)data & 3) != 0)
+    return 0;
+  const AstHeader *header = (const AstHeader *)data;
+  if (header->format != AST_FORMAT || ast_tables(data, &tables) != length ||
+      header->stringsLength == 0 ||
+      tables.strings[header->stringsLength - 1] != '\0' ||
+      header->version >= header->stringsLength)
+    return 0;
+  return strcmp(tables.strings + header->version, CLM_VERSION) == 0;
+}
+
+static void *table_new(unsigned int length, size_t size) {
+  return malloc(length > 0 ? length * size : 1);
+}
+
+ArrayList *clm_ast_load(ClmCompiler *compiler, const char *data,
+                        size_t length, ClmScope **out_scope) {
+  AstReader reader;
+  unsigned int i;
+  if (!valid_ast(data, length))
+    return NULL;
+
+  memset(&reader, 0, sizeof(reader));
+  reader.compiler = compiler;
+  ast_tables(data, &reader.tables);
+  const AstHeader *header = reader.tables.header;
+  reader.stmts = table_new(header->stmtsLength, sizeof(ClmStmtNode *));
+  reader.exps = table_new(header->expsLength, sizeof(ClmExpNode *));
+  reader.lists = table_new(header->listsLength, sizeof(ArrayList *));
+  reader.symbols = table_new(header->symbolsLength, sizeof(ClmSymbol *));
+  reader.scopes = table_new(header->scopesLength, sizeof(ClmScope *));
+
+  // nothing about the type or size of a node is cached yet
+  for (i = 0; i < header->stmtsLength; i++) {
+    reader.stmts[i] = clm_alloc(compiler, sizeof(ClmStmtNode));
+    memset(reader.stmts[i], 0, sizeof(ClmStmtNode));
+  }
+  for (i = 0; i < header->expsLength; i++) {
+    reader.exps[i] = clm_alloc(compiler, sizeof(ClmExpNode));
+    memset(reader.exps[i], 0, sizeof(ClmExpNode));
+  }
+  clm_count(compiler, CLM_COUNTER_AST_NODES,
+            (long long)header->stmtsLength + header->expsLength);
+  for (i = 0; i < header->listsLength; i++)
+    reader.lists[i] = array_list_new_arena(compiler->arena);
+  for (i = 0; i < header->symbolsLength; i++)
+    reader.symbols[i] = clm_alloc(compiler, sizeof(ClmSymbol));
+
+  for (i = 0; i < header->listsLength; i++)
+    read_list(&reader, &reader.tables.lists[i], reader.lists[i]);
+  for (i = 0; i < header->symbolsLength; i++)
+    read_symbol(&reader, &reader.tables.symbols[i], reader.symbols[i]);
+  read_scopes(&reader);
+  for (i = 0; i < header->stmtsLength; i++)
+    read_stmt(&reader, &reader.tables.stmts[i], reader.stmts[i]);
+  for (i = 0; i < header->expsLength; i++)
+    read_exp(&reader, &reader.tables.exps[i], reader.exps[i]);
+
+  ArrayList *statements = list_at(&reader, header->statements);
+  *out_scope = scope_at(&reader, header->globalScope);
+  if (statements == NULL || *out_scope == NULL)
+    reader.invalid = 1;
+
+  free(reader.stmts);
+  free(reader.exps);
+  free(reader.lists);
+  free(reader.symbols);
+  free(reader.scopes);
+  // what was made goes away with the compiler's arena
+  if (reader.invalid)
+    return NULL;
+
+  // the code of the functions it uses from modules comes from their
+  // interfaces, which are found again
+  for (i = 0; i < (unsigned int)statements->length; i++) {
+    ClmStmtNode *node = statements->data[i];
+    if (node->type == STMT_TYPE_IMPORT)
+      clm_module_import(compiler, node);
+  }
+  return statements;
+}
@@ -0,0 +1,37 @@
+#ifndef CLM_AST_BIN_H
+#define CLM_AST_BIN_H
+
+#include "clm.h"
+#include "clm_ast.h"
+
+//
+// Binary ASTs
+//
+// the checked and optimized tree of a program, with its scopes and symbols,
+// written out so code can be generated from it again without lexing, parsing
+// or checking anything. nodes, lists, symbols and scopes are records in
+// tables, and they refer to each other and to the strings by their index in
+// a table instead of by address, so a file can be mapped anywhere and read
+// where it is. loading one builds the tree in the current compiler's arena in
+// one pass over the tables
+//
+// like module interfaces, they are in the byte order of the machine and are
+// only read by the same version of clm
+//
+
+// what a binary AST starts with, a source file never does
+#define CLM_AST_MAGIC "CLMA"
+
+int clm_ast_is_binary(const char *data, size_t length);
+
+// the tree of a program after clm_optimizer_main, as a binary AST
+StringBuffer *clm_ast_serialize(ArrayList *statements, ClmScope *globalScope);
+
+// the program in a binary AST of length bytes, aligned to 4 bytes, and its
+// global scope in out_scope. the modules it imports are imported again, so
+// what it uses from them is generated with it. returns NULL if data isn't a
+// binary AST written by this version of clm
+ArrayList *clm_ast_load(ClmCompiler *compiler, const char *data,
+                        size_t length, ClmScope **out_scope);
+
+#endif
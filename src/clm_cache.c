@@ -0,0 +1,515 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <io.h>
+#include <process.h>
+#include <sys/utime.h>
+#include <windows.h>
+#define getpid _getpid
+#else
+#include <dirent.h>
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+#include "clm.h"
+#include "clm_ast.h"
+#include "clm_cache.h"
+#include "clm_scope.h"
+#include "clm_type.h"
+
+#ifndef CLM_VERSION
+#define CLM_VERSION "unknown"
+#endif
+
+#define CACHE_PATH_SIZE 1024
+
+/*
+ *
+ *  KEYS
+ *
+ */
+
+// two 64 bit hashes that mix the bytes differently, 128 bits between them
+typedef struct {
+  unsigned long long a;
+  unsigned long long b;
+  ClmCompiler *compiler; // the types of the expressions are in it
+} CacheHash;
+
+static void hash_bytes(CacheHash *hash, const void *bytes, size_t n) {
+  const unsigned char *p = bytes;
+  size_t i;
+  for (i = 0; i < n; i++) {
+    hash->a = (hash->a ^ p[i]) * 1099511628211ull;
+    hash->b = ((hash->b << 5) | (hash->b >> 59)) ^ p[i];
+    hash->b *= 0x9e3779b97f4a7c15ull;
+  }
+}
+
+static void hash_int(CacheHash *hash, int value) {
+  hash_bytes(hash, &value, sizeof(value));
+}
+
+// spreads every bit of the hash over the whole word
+static unsigned long long hash_finish(unsigned long long x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ull;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebull;
+  x ^= x >> 31;
+  return x;
+}
+
+void clm_cache_key(ClmCompiler *compiler, ClmTokens *tokens, char *out_key) {
+  CacheHash hash = {14695981039346656037ull, 0x243f6a8885a308d3ull,
+                    compiler};
+  hash_bytes(&hash, CLM_VERSION, strlen(CLM_VERSION) + 1);
+  hash_int(&hash, (int)compiler->target);
+  hash_int(&hash, (int)compiler->simd);
+  hash_int(&hash, (int)compiler->disabledPasses);
+
+  // the symbol and text of every token, the length keeps two tokens from
+  // reading the same as one
+  int i;
+  for (i = 0; i < tokens->length; i++) {
+    ClmLexerToken *token = &tokens->data[i];
+    hash_int(&hash, (int)token->sym);
+    hash_int(&hash, token->length);
+    hash_bytes(&hash, tokens->source + token->offset, token->length);
+  }
+
+  sprintf(out_key, "%016llx%016llx", hash_finish(hash.a), hash_finish(hash.b));
+}
+
+/*
+ *
+ *  FUNCTION KEYS
+ *
+ */
+
+static void hash_string(CacheHash *hash, const char *string) {
+  if (string == NULL)
+    hash_int(hash, -1);
+  else
+    hash_bytes(hash, string, strlen(string) + 1);
+}
+
+static void hash_size(CacheHash *hash, MatrixSize size) {
+  hash_int(hash, size.rows);
+  hash_int(hash, size.cols);
+  hash_string(hash, size.rowVar);
+  hash_string(hash, size.colVar);
+}
+
+// where a variable is decides the code that reads it
+static void hash_symbol(CacheHash *hash, ClmSymbol *symbol) {
+  if (symbol == NULL) {
+    hash_int(hash, -1);
+    return;
+  }
+  hash_string(hash, symbol->name);
+  hash_int(hash, (int)symbol->type);
+  hash_int(hash, (int)symbol->location);
+  hash_int(hash, symbol->offset);
+}
+
+// the signature of a function as it was declared. the nodes belong to that
+// function, which may be generated on another thread, so their cached types
+// aren't read
+static void hash_signature(CacheHash *hash, ClmStmtNode *function) {
+  hash_string(hash, function->funcDecStmt.name);
+  hash_int(hash, (int)function->funcDecStmt.returnType);
+  hash_size(hash, function->funcDecStmt.returnSize);
+  ArrayList *params = function->funcDecStmt.parameters;
+  int i;
+  hash_int(hash, params->length);
+  for (i = 0; i < params->length; i++) {
+    ClmExpNode *param = params->data[i];
+    hash_string(hash, param->paramExp.name);
+    hash_int(hash, (int)param->paramExp.type);
+    hash_size(hash, param->paramExp.size);
+  }
+}
+
+static void hash_exp(CacheHash *hash, ClmExpNode *node, ClmScope *scope) {
+  if (node == NULL) {
+    hash_int(hash, -1);
+    return;
+  }
+  int i;
+  hash_int(hash, (int)node->type);
+  switch (node->type) {
+  case EXP_TYPE_INT:
+    hash_int(hash, node->ival);
+    break;
+  case EXP_TYPE_FLOAT:
+    hash_bytes(hash, &node->fval, sizeof(node->fval));
+    break;
+  case EXP_TYPE_STRING:
+    hash_string(hash, node->str);
+    break;
+  case EXP_TYPE_ARITH:
+    hash_int(hash, (int)node->arithExp.operand);
+    hash_exp(hash, node->arithExp.left, scope);
+    hash_exp(hash, node->arithExp.right, scope);
+    break;
+  case EXP_TYPE_BOOL:
+    hash_int(hash, (int)node->boolExp.operand);
+    hash_exp(hash, node->boolExp.left, scope);
+    hash_exp(hash, node->boolExp.right, scope);
+    break;
+  case EXP_TYPE_CALL:
+    hash_signature(hash, node->callExp.symbol->declaration);
+    hash_int(hash, node->callExp.params->length);
+    for (i = 0; i < node->callExp.params->length; i++)
+      hash_exp(hash, node->callExp.params->data[i], scope);
+    break;
+  case EXP_TYPE_INDEX:
+    hash_symbol(hash, node->indExp.symbol);
+    hash_exp(hash, node->indExp.rowIndex, scope);
+    hash_exp(hash, node->indExp.colIndex, scope);
+    hash_exp(hash, node->indExp.rowEnd, scope);
+    hash_exp(hash, node->indExp.colEnd, scope);
+    break;
+  case EXP_TYPE_MAT_DEC:
+    hash_size(hash, node->matDecExp.size);
+    hash_int(hash, node->matDecExp.length);
+    if (node->matDecExp.arr != NULL)
+      hash_bytes(hash, node->matDecExp.arr,
+                 node->matDecExp.length * sizeof(float));
+    break;
+  case EXP_TYPE_PARAM:
+    hash_string(hash, node->paramExp.name);
+    hash_int(hash, (int)node->paramExp.type);
+    hash_size(hash, node->paramExp.size);
+    break;
+  case EXP_TYPE_UNARY:
+    hash_int(hash, (int)node->unaryExp.operand);
+    hash_exp(hash, node->unaryExp.node, scope);
+    break;
+  }
+
+  // the type and size take in everything the expression uses from outside
+  // the function, like the size of a global matrix
+  int rows, cols;
+  hash_int(hash, (int)clm_type_of_exp(hash->compiler, node, scope));
+  clm_size_of_exp(hash->compiler, node, scope, &rows, &cols);
+  hash_int(hash, rows);
+  hash_int(hash, cols);
+}
+
+static void hash_statements(CacheHash *hash, ArrayList *statements,
+                            ClmScope *scope);
+
+static void hash_statement(CacheHash *hash, ClmStmtNode *node,
+                           ClmScope *scope) {
+  int i;
+  hash_int(hash, (int)node->type);
+  switch (node->type) {
+  case STMT_TYPE_ASSIGN:
+    hash_exp(hash, node->assignStmt.lhs, scope);
+    hash_exp(hash, node->assignStmt.rhs, scope);
+    break;
+  case STMT_TYPE_CALL:
+    hash_exp(hash, node->callExpr, scope);
+    break;
+  case STMT_TYPE_CONDITIONAL:
+    hash_exp(hash, node->conditionStmt.condition, scope);
+    hash_statements(hash, node->conditionStmt.trueBody, scope);
+    hash_statements(hash, node->conditionStmt.falseBody, scope);
+    break;
+  case STMT_TYPE_FUNC_DEC: {
+    ClmScope *funcScope = node->funcDecStmt.scope;
+    hash_signature(hash, node);
+    // the frame holds every variable of the function
+    hash_int(hash, funcScope->symbols->length);
+    for (i = 0; i < funcScope->symbols->length; i++)
+      hash_symbol(hash, funcScope->symbols->data[i]);
+    hash_statements(hash, node->funcDecStmt.body, funcScope);
+    break;
+  }
+  case STMT_TYPE_FOR_LOOP:
+    hash_symbol(hash, node->forLoopStmt.var);
+    hash_exp(hash, node->forLoopStmt.start, scope);
+    hash_exp(hash, node->forLoopStmt.end, scope);
+    hash_exp(hash, node->forLoopStmt.delta, scope);
+    hash_statements(hash, node->forLoopStmt.body, scope);
+    break;
+  case STMT_TYPE_WHILE_LOOP:
+    hash_exp(hash, node->whileLoopStmt.condition, scope);
+    hash_statements(hash, node->whileLoopStmt.body, scope);
+    break;
+  case STMT_TYPE_PRINT:
+    hash_int(hash, node->printStmt.appendNewline);
+    hash_exp(hash, node->printStmt.expression, scope);
+    break;
+  case STMT_TYPE_RET:
+    hash_exp(hash, node->returnExpr, scope);
+    break;
+  case STMT_TYPE_IMPORT:
+    break;
+  }
+}
+
+static void hash_statements(CacheHash *hash, ArrayList *statements,
+                            ClmScope *scope) {
+  if (statements == NULL) {
+    hash_int(hash, -1);
+    return;
+  }
+  int i;
+  hash_int(hash, statements->length);
+  for (i = 0; i < statements->length; i++)
+    hash_statement(hash, statements->data[i], scope);
+}
+
+void clm_cache_function_key(ClmCompiler *compiler, ClmStmtNode *function,
+                            char *out_key) {
+  // a different start than a program's key, so the two never meet
+  CacheHash hash = {0x6a09e667f3bcc908ull, 0xbb67ae8584caa73bull, compiler};
+  hash_bytes(&hash, CLM_VERSION, strlen(CLM_VERSION) + 1);
+  hash_int(&hash, (int)compiler->target);
+  hash_int(&hash, (int)compiler->simd);
+  hash_int(&hash, (int)compiler->disabledPasses);
+  hash_statement(&hash, function, function->funcDecStmt.scope);
+
+  sprintf(out_key, "%016llx%016llx", hash_finish(hash.a), hash_finish(hash.b));
+}
+
+/*
+ *
+ *  FILES
+ *
+ */
+
+static int make_dir(const char *path) {
+#ifdef _WIN32
+  int result = _mkdir(path);
+#else
+  int result = mkdir(path, 0755);
+#endif
+  return result == 0 || errno == EEXIST;
+}
+
+int clm_cache_dir(char *out_dir, size_t size) {
+  const char *dir = getenv("CLM_CACHE_DIR");
+  if (dir != NULL && dir[0] != '\0') {
+    if ((size_t)snprintf(out_dir, size, "%s", dir) >= size)
+      return 0;
+    return make_dir(out_dir);
+  }
+
+#ifdef _WIN32
+  const char *base = getenv("LOCALAPPDATA");
+  const char *sub = "";
+#else
+  const char *base = getenv("XDG_CACHE_HOME");
+  const char *sub = "";
+  if (base == NULL || base[0] == '\0') {
+    base = getenv("HOME");
+    sub = "/.cache";
+  }
+#endif
+  if (base == NULL || base[0] == '\0')
+    return 0;
+
+  // the user's cache directory may not be there yet either
+  if ((size_t)snprintf(out_dir, size, "%s%s", base, sub) >= size ||
+      !make_dir(out_dir))
+    return 0;
+  if ((size_t)snprintf(out_dir, size, "%s%s/clm", base, sub) >= size)
+    return 0;
+  return make_dir(out_dir);
+}
+
+static int entry_path(char *out_path, const char *dir, const char *key) {
+  return (size_t)snprintf(out_path, CACHE_PATH_SIZE, "%s/%s", dir, key) <
+         CACHE_PATH_SIZE;
+}
+
+static int append_file(const char *path, StringBuffer *out) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL)
+    return 0;
+  char chunk[64 * 1024];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0)
+    string_buffer_append_n(out, chunk, n);
+  fclose(file);
+  return 1;
+}
+
+int clm_cache_lookup(const char *dir, const char *key, StringBuffer *out) {
+  char path[CACHE_PATH_SIZE];
+  if (!entry_path(path, dir, key) || !append_file(path, out))
+    return 0;
+  // the modification time is when the entry was last used
+  utime(path, NULL);
+  return 1;
+}
+
+static int copy_file(const char *from, const char *to) {
+  FILE *in = fopen(from, "rb");
+  if (in == NULL)
+    return 0;
+  FILE *out = fopen(to, "wb");
+  if (out == NULL) {
+    fclose(in);
+    return 0;
+  }
+
+  char chunk[64 * 1024];
+  size_t n;
+  int ok = 1;
+  while (ok && (n = fread(chunk, 1, sizeof(chunk), in)) > 0)
+    ok = fwrite(chunk, 1, n, out) == n;
+  ok = !ferror(in) && ok;
+  fclose(in);
+  return fclose(out) == 0 && ok;
+}
+
+static int replace_file(const char *from, const char *to) {
+#ifdef _WIN32
+  return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+  return rename(from, to) == 0;
+#endif
+}
+
+/*
+ *
+ *  EVICTION
+ *
+ */
+
+typedef struct {
+  char name[CLM_CACHE_KEY_SIZE];
+  size_t size;
+  time_t used;
+} CacheEntry;
+
+// only names that are keys are entries, temporary files are left alone
+static int is_key(const char *name) {
+  size_t i;
+  for (i = 0; name[i] != '\0'; i++) {
+    char c = name[i];
+    if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f')))
+      return 0;
+  }
+  return i == CLM_CACHE_KEY_SIZE - 1;
+}
+
+static void push_entry(CacheEntry **entries, int *length, int *capacity,
+                       const char *name, size_t size, time_t used) {
+  if (*length == *capacity) {
+    *capacity = *capacity == 0 ? 64 : 2 * *capacity;
+    *entries = realloc(*entries, *capacity * sizeof(**entries));
+  }
+  CacheEntry *entry = &(*entries)[(*length)++];
+  strcpy(entry->name, name);
+  entry->size = size;
+  entry->used = used;
+}
+
+static int list_entries(const char *dir, CacheEntry **out_entries) {
+  CacheEntry *entries = NULL;
+  int length = 0, capacity = 0;
+#ifdef _WIN32
+  char pattern[CACHE_PATH_SIZE];
+  struct _finddata_t found;
+  snprintf(pattern, sizeof(pattern), "%s/*", dir);
+  intptr_t handle = _findfirst(pattern, &found);
+  if (handle != -1) {
+    do {
+      if (is_key(found.name))
+        push_entry(&entries, &length, &capacity, found.name, found.size,
+                   found.time_write);
+    } while (_findnext(handle, &found) == 0);
+    _findclose(handle);
+  }
+#else
+  DIR *d = opendir(dir);
+  if (d != NULL) {
+    struct dirent *file;
+    char path[CACHE_PATH_SIZE];
+    struct stat info;
+    while ((file = readdir(d)) != NULL) {
+      if (is_key(file->d_name) && entry_path(path, dir, file->d_name) &&
+          stat(path, &info) == 0)
+        push_entry(&entries, &length, &capacity, file->d_name, info.st_size,
+                   info.st_mtime);
+    }
+    closedir(d);
+  }
+#endif
+  *out_entries = entries;
+  return length;
+}
+
+static int least_recent_first(const void *a, const void *b) {
+  const CacheEntry *x = a, *y = b;
+  if (x->used != y->used)
+    return x->used < y->used ? -1 : 1;
+  return strcmp(x->name, y->name);
+}
+
+void clm_cache_evict(const char *dir, size_t maxSize) {
+  CacheEntry *entries;
+  int length = list_entries(dir, &entries);
+  size_t total = 0;
+  int i;
+  for (i = 0; i < length; i++)
+    total += entries[i].size;
+
+  qsort(entries, length, sizeof(*entries), least_recent_first);
+  char path[CACHE_PATH_SIZE];
+  for (i = 0; i < length && total > maxSize; i++) {
+    if (entry_path(path, dir, entries[i].name) && remove(path) == 0)
+      total -= entries[i].size;
+  }
+  free(entries);
+}
+
+static int temp_path(char *out_path, const char *dir, const char *key) {
+  return (size_t)snprintf(out_path, CACHE_PATH_SIZE, "%s/%s.%d.tmp", dir, key,
+                          (int)getpid()) < CACHE_PATH_SIZE;
+}
+
+int clm_cache_store_file(const char *dir, const char *key, const char *path,
+                         size_t maxSize) {
+  char temp[CACHE_PATH_SIZE], entry[CACHE_PATH_SIZE];
+  if (!temp_path(temp, dir, key) || !entry_path(entry, dir, key))
+    return 0;
+
+  if (!copy_file(path, temp) || !replace_file(temp, entry)) {
+    remove(temp);
+    return 0;
+  }
+  clm_cache_evict(dir, maxSize);
+  return 1;
+}
+
+int clm_cache_store(const char *dir, const char *key, const char *data,
+                    size_t length) {
+  char temp[CACHE_PATH_SIZE], entry[CACHE_PATH_SIZE];
+  if (!temp_path(temp, dir, key) || !entry_path(entry, dir, key))
+    return 0;
+
+  FILE *file = fopen(temp, "wb");
+  if (file == NULL)
+    return 0;
+  int ok = fwrite(data, 1, length, file) == length;
+  ok = fclose(file) == 0 && ok;
+  if (!ok || !replace_file(temp, entry)) {
+    remove(temp);
+    return 0;
+  }
+  return 1;
+}
@@ -0,0 +1,61 @@
+#ifndef CLM_CACHE_H
+#define CLM_CACHE_H
+
+#include "clm.h"
+
+struct ClmStmtNode;
+
+//
+// Compilation cache
+//
+// the generated code of a program is stored on disk under a key made from
+// its tokens, the version of the compiler and the options that change the
+// code. whitespace and comments aren't tokens, so reformatting a program
+// doesn't miss. entries are written to a temporary file and renamed into
+// place, so a reader never sees half of one, and the least recently used
+// entries are removed once the cache is bigger than its limit
+//
+// the code of each function is stored too, under a key made from its checked
+// and optimized tree. a program that misses reuses the functions that didn't
+// change, so editing one function only generates that one again
+//
+
+// 128 bits in hex, and a null
+#define CLM_CACHE_KEY_SIZE 33
+
+// the default limit of the cache in bytes
+#define CLM_CACHE_MAX_SIZE (256 * 1024 * 1024)
+
+// where the cache is, $CLM_CACHE_DIR or clm in the user's cache directory
+// (~/.cache/clm). the directory is made if it doesn't exist, returns 0 if
+// there is nowhere for it
+int clm_cache_dir(char *out_dir, size_t size);
+
+// a program with imports isn't keyed by them, so it shouldn't be cached
+void clm_cache_key(ClmCompiler *compiler, ClmTokens *tokens, char *out_key);
+
+// the key of one function: its statements, the type and size of every
+// expression in them, where each variable they use is, and the signatures of
+// the functions they call. it reads the function's cached types, so it is
+// taken on the thread generating the function
+void clm_cache_function_key(ClmCompiler *compiler,
+                            struct ClmStmtNode *function,
+                            char *out_key);
+
+// appends the code stored under key to out, returns 0 if there is none
+int clm_cache_lookup(const char *dir, const char *key, StringBuffer *out);
+
+// stores the contents of the file at path under key, and evicts entries
+// until the cache is at most maxSize bytes. returns 0 if it couldn't
+int clm_cache_store_file(const char *dir, const char *key, const char *path,
+                         size_t maxSize);
+
+// stores length bytes of data under key without evicting anything, for
+// entries that are stored many at a time. returns 0 if it couldn't
+int clm_cache_store(const char *dir, const char *key, const char *data,
+                    size_t length);
+
+// removes the least recently used entries until the rest fit in maxSize
+void clm_cache_evict(const char *dir, size_t maxSize);
+
+#endif
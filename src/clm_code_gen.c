@@ -3,83 +3,113 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef _WIN32
+#include <io.h>
+#define write _write
+#else
+#include <unistd.h>
+#endif
+
 #include "clm.h"
 #include "clm_asm.h"
 #include "clm_ast.h"
+#include "clm_cache.h"
+#include "clm_code_gen.h"
+#include "clm_gemm_gen.h"
+#include "clm_fuse_gen.h"
+#include "clm_module.h"
+#include "clm_reg_gen.h"
 #include "clm_scope.h"
 #include "clm_type.h"
 #include "clm_type_gen.h"
 
-typedef struct {
-  char *code;
-  int size;
-  int capacity;
-
-  ClmScope *scope;
-  int labelID;
-  int inFunction;
-
-  int temporaryID;
-} CodeGenData;
-
-static CodeGenData data;
-
-void next_label(char *buffer) {
-  int id = data.labelID++;
-  sprintf(buffer, "label%d", id);
+// when streaming, the code is written to the output once this much is buffered
+#define CODE_FLUSH_SIZE (64 * 1024)
+
+// labels are numbered from 0 in each function and named after it, so the
+// code of a function is the same whichever thread generates it and wherever
+// it is in the program. names start with a letter and function labels with
+// an underscore, so name__label<n> can't be any other label
+void next_label(ClmCodeGen *gen, char *buffer) {
+  int id = gen->labelID++;
+  if (gen->function != NULL)
+    sprintf(buffer, "%s__label%d", gen->function, id);
+  else
+    sprintf(buffer, "label%d", id);
 }
 
-void next_temporary(char *buffer) {
-  int id = ++data.temporaryID;
-  sprintf(buffer, "temporary%d", id);
+static void write_all(ClmCodeGen *gen, const char *buffer, size_t length) {
+  clm_count(gen->compiler, CLM_COUNTER_ASM_BYTES, length);
+  while (length > 0) {
+    int written = write(gen->fd, buffer, length);
+    if (written <= 0)
+      clm_error(gen->compiler, 0, 0, "unable to write the output file");
+    buffer += written;
+    length -= written;
+  }
 }
 
-void writeLine(const char *line) {
-  if (data.size == data.capacity) {
-    data.capacity *= 2;
-    data.code = realloc(data.code, data.capacity * sizeof(*data.code));
-  }
-  data.size += strlen(line);
-  strcat(data.code, line);
+static void flush_code(ClmCodeGen *gen) {
+  if (gen->fd < 0)
+    return;
+  write_all(gen, gen->code->data, gen->code->length);
+  string_buffer_clear(gen->code);
 }
 
-#define LOAD_ROWS(sym, out_buffer) load_var_location(sym, out_buffer, 4, NULL)
+// the globals don't grow with the size of the program, so only the program
+// text is flushed as it goes
+static void flush_if_full(ClmCodeGen *gen) {
+  if (gen->section == gen->code && gen->code->length >= CODE_FLUSH_SIZE)
+    flush_code(gen);
+}
 
-#define LOAD_COLS(sym, out_buffer) load_var_location(sym, out_buffer, 8, NULL)
+void writeLine(ClmCodeGen *gen, const char *line) {
+  string_buffer_append(gen->section, line);
+  flush_if_full(gen);
+}
 
-static void load_var_location(ClmSymbol *sym, char *out_buffer, int offset,
-                              const char *offset_loc) {
-  char temp_buffer[64];
+void writeLinef(ClmCodeGen *gen, const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  string_buffer_vappendf(gen->section, fmt, ap);
+  va_end(ap);
+  flush_if_full(gen);
+}
 
-  sprintf(out_buffer, "dword [");
+// every variable starts with its type, followed by its value. for matrices
+// the value is a pointer to the descriptor, see clm_type_gen.h
+// offset is in slots, offset_loc is a register holding an offset in bytes
+void load_var_location(ClmCodeGen *gen, ClmSymbol *sym, char *out_buffer,
+                       int offset, const char *offset_loc) {
+  char global_name[64];
 
   switch(sym->location){
     case LOCATION_GLOBAL:
-      if (offset != 0) {
-        sprintf(temp_buffer, "_%s+%d", sym->name, offset);
-      } else {
-        sprintf(temp_buffer, "_%s", sym->name);
-      }
-      break;
-    case LOCATION_PARAMETER:
-      sprintf(temp_buffer, "ebp+%d", sym->offset + offset);
+      sprintf(global_name, "_%s", sym->name);
+      asm_mem(gen, out_buffer, global_name, SLOT(gen, offset), offset_loc);
       break;
+    case LOCATION_PARAMETER: // fallthrough
     case LOCATION_LOCAL:
-      sprintf(temp_buffer, "ebp+%d", sym->offset + offset);
+      asm_mem(gen, out_buffer, EBP(gen), SLOT(gen, sym->offset + offset),
+              offset_loc);
       break;
     case LOCATION_STACK: //fallthrough
     default:
       //shouldn't get here
       break;
   }
-  strcat(out_buffer, temp_buffer);
+}
 
-  if (offset_loc != NULL) {
-    sprintf(temp_buffer, "+%s", offset_loc);
-    strcat(out_buffer, temp_buffer);
-  }
+// floats are always 32 bits, even when the slot holding them is wider
+void load_float_location(ClmCodeGen *gen, ClmSymbol *sym, char *out_buffer) {
+  char global_name[64];
 
-  strcat(out_buffer, "]");
+  if (sym->location == LOCATION_GLOBAL) {
+    sprintf(global_name, "_%s", sym->name);
+    asm_mem_dword(gen, out_buffer, global_name, SLOT(gen, 1), NULL);
+  } else {
+    asm_mem_dword(gen, out_buffer, EBP(gen), SLOT(gen, sym->offset + 1), NULL);
+  }
 }
 
 /*
@@ -87,42 +117,95 @@ static void load_var_location(ClmSymbol *sym, char *out_buffer, int offset,
  *  FUNCTION FORWARD DECLARATIONS
  *
  */
-static void gen_index_into(const char *dest, ClmExpNode *index);
+static void gen_indices_into(ClmCodeGen *gen, const char *row_dest,
+                             const char *col_dest, ClmExpNode *row_index,
+                             ClmExpNode *col_index);
+
+static void gen_arith(ClmCodeGen *gen, ClmExpNode *node);
+static void gen_bool(ClmCodeGen *gen, ClmExpNode *node);
+static void gen_unary(ClmCodeGen *gen, ClmExpNode *node);
+
+static void pop_into_lhs(ClmCodeGen *gen, ClmExpNode *node, int temps);
+static void gen_exp_size(ClmCodeGen *gen, ClmExpNode *node);
+void push_expression(ClmCodeGen *gen, ClmExpNode *node);
+static const char *gen_int_into_reg(ClmCodeGen *gen, ClmExpNode *node);
+static void gen_statement(ClmCodeGen *gen, ClmStmtNode *node);
+
+static void gen_statements(ClmCodeGen *gen, ArrayList *statements);
+
+// both indices are evaluated before either is popped, evaluating the column
+// index could clobber the register holding the row index otherwise
+static void gen_indices_into(ClmCodeGen *gen, const char *row_dest,
+                             const char *col_dest, ClmExpNode *row_index,
+                             ClmExpNode *col_index) {
+  push_expression(gen, row_index);
+  push_expression(gen, col_index);
+  pop_int_into(gen, col_dest);
+  asm_dec(gen, col_dest);
+  pop_int_into(gen, row_dest);
+  asm_dec(gen, row_dest);
+}
+
+// points edx at the type of the operand that was pushed before the one on top
+// of the stack. pushing an expression can use any register, so this is worked
+// out from the size of the top operand after both have been pushed
+static void load_operand_below(ClmCodeGen *gen, ClmType top_type) {
+  char location[64];
+  switch (top_type) {
+  case CLM_TYPE_FLOAT:
+    // the value is on the fpu stack, only the type is on the stack
+    sprintf(location, "[%s+%d]", ESP(gen), SLOT(gen, 1));
+    asm_lea(gen, EDX(gen), location);
+    break;
+  default:
+    sprintf(location, "[%s+%d]", ESP(gen), SLOT(gen, 2));
+    asm_lea(gen, EDX(gen), location);
+    break;
+  }
+}
 
-static void gen_arith(ClmExpNode *node);
-static void gen_bool(ClmExpNode *node);
-static void gen_unary(ClmExpNode *node);
+// a matrix expression is a temporary unless it is just a variable
+int is_temporary(ClmCodeGen *gen, ClmExpNode *node) {
+  if (clm_type_of_exp(gen->compiler, node, gen->scope) != CLM_TYPE_MATRIX)
+    return 0;
+  return node->type != EXP_TYPE_INDEX || node->indExp.rowIndex != NULL ||
+         node->indExp.colIndex != NULL;
+}
 
-static void pop_into_lhs(ClmExpNode *node);
-static void gen_exp_size(ClmExpNode *node);
-static void push_expression(ClmExpNode *node);
-static void gen_statement(ClmStmtNode *node);
+// a slice of a variable is a temporary view of the variable's elements
+int is_view(ClmCodeGen *gen, ClmExpNode *node) {
+  return is_temporary(gen, node) && node->type == EXP_TYPE_INDEX;
+}
 
-static void gen_functions(ArrayList *statements);
-static void gen_statements(ArrayList *statements);
+// TEMP_LEFT and VIEW_LEFT for node as the only or the left operand
+static int operand_flags(ClmCodeGen *gen, ClmExpNode *node) {
+  return (is_temporary(gen, node) ? TEMP_LEFT : 0) |
+         (is_view(gen, node) ? VIEW_LEFT : 0);
+}
 
-static void gen_index_into(const char *dest, ClmExpNode *index){
-  push_expression(index);
-  pop_int_into(dest);
-  asm_dec(dest);
+static int temporaries(ClmCodeGen *gen, ClmExpNode *left, ClmExpNode *right) {
+  return operand_flags(gen, left) | (operand_flags(gen, right) << 1);
 }
 
-static void gen_arith(ClmExpNode *node) {
-  ClmType left_type = clm_type_of_exp(node->arithExp.left, data.scope);
-  ClmType right_type = clm_type_of_exp(node->arithExp.right, data.scope);
+static void gen_arith(ClmCodeGen *gen, ClmExpNode *node) {
+  ClmType left_type = clm_type_of_exp(gen->compiler, node->arithExp.left,
+                                      gen->scope);
+  ClmType right_type = clm_type_of_exp(gen->compiler, node->arithExp.right,
+                                       gen->scope);
+  int temps = temporaries(gen, node->arithExp.left, node->arithExp.right);
 
   switch (left_type) {
   case CLM_TYPE_INT:
-    gen_int_arith(node->arithExp.operand, right_type);
+    gen_int_arith(gen, node->arithExp.operand, right_type, temps);
     break;
   case CLM_TYPE_FLOAT:
-    gen_float_arith(node->arithExp.operand, right_type);
+    gen_float_arith(gen, node->arithExp.operand, right_type, temps);
     break;
   case CLM_TYPE_STRING:
-    gen_string_arith(node->arithExp.operand, right_type);
+    gen_string_arith(gen, node->arithExp.operand, right_type);
     break;
   case CLM_TYPE_MATRIX:
-    gen_mat_arith(node->arithExp.operand, right_type);
+    gen_mat_arith(gen, node->arithExp.operand, right_type, temps);
     break;
   default:
     // shouldn't get here
@@ -130,22 +213,25 @@ static void gen_arith(ClmExpNode *node) {
   }
 }
 
-static void gen_bool(ClmExpNode *node) {
-  ClmType left_type = clm_type_of_exp(node->arithExp.left, data.scope);
-  ClmType right_type = clm_type_of_exp(node->arithExp.right, data.scope);
+static void gen_bool(ClmCodeGen *gen, ClmExpNode *node) {
+  ClmType left_type = clm_type_of_exp(gen->compiler, node->arithExp.left,
+                                      gen->scope);
+  ClmType right_type = clm_type_of_exp(gen->compiler, node->arithExp.right,
+                                       gen->scope);
 
   switch (left_type) {
   case CLM_TYPE_INT:
-    gen_int_bool(node->boolExp.operand, right_type);
+    gen_int_bool(gen, node->boolExp.operand, right_type);
     break;
   case CLM_TYPE_FLOAT:
-    gen_float_bool(node->boolExp.operand, right_type);
+    gen_float_bool(gen, node->boolExp.operand, right_type);
     break;
   case CLM_TYPE_STRING:
-    gen_string_bool(node->boolExp.operand, right_type);
+    gen_string_bool(gen, node->boolExp.operand, right_type);
     break;
   case CLM_TYPE_MATRIX:
-    gen_mat_bool(node->boolExp.operand, right_type);
+    gen_mat_bool(gen, node->boolExp.operand, right_type,
+                 temporaries(gen, node->boolExp.left, node->boolExp.right));
     break;
   default:
     // shouldn't get here
@@ -153,21 +239,23 @@ static void gen_bool(ClmExpNode *node) {
   }
 }
 
-static void gen_unary(ClmExpNode *node) {
-  ClmType type = clm_type_of_exp(node->unaryExp.node, data.scope);
+static void gen_unary(ClmCodeGen *gen, ClmExpNode *node) {
+  ClmType type = clm_type_of_exp(gen->compiler, node->unaryExp.node,
+                                 gen->scope);
 
   switch (type) {
   case CLM_TYPE_INT:
-    gen_int_unary(node->unaryExp.operand);
+    gen_int_unary(gen, node->unaryExp.operand);
     break;
   case CLM_TYPE_FLOAT:
-    gen_float_unary(node->unaryExp.operand);
+    gen_float_unary(gen, node->unaryExp.operand);
     break;
   case CLM_TYPE_STRING:
-    gen_string_unary(node->unaryExp.operand);
+    gen_string_unary(gen, node->unaryExp.operand);
     break;
   case CLM_TYPE_MATRIX:
-    gen_mat_unary(node->unaryExp.operand);
+    gen_mat_unary(gen, node->unaryExp.operand,
+                  operand_flags(gen, node->unaryExp.node));
     break;
   default:
     // shouldn't get here
@@ -176,15 +264,15 @@ static void gen_unary(ClmExpNode *node) {
 }
 
 /* pushes the number of column and then the number of rows */
-static void gen_exp_size(ClmExpNode *node) {
-  char index_str[32];
+static void gen_exp_size(ClmCodeGen *gen, ClmExpNode *node) {
+  char index_str[64];
 
   switch (node->type) {
   case EXP_TYPE_INT: // falthrough
   case EXP_TYPE_FLOAT: // fallthrough
   case EXP_TYPE_BOOL:
-    asm_push_const_i(1);
-    asm_push_const_i(1);
+    asm_push_const_i(gen, 1);
+    asm_push_const_i(gen, 1);
     break;
   case EXP_TYPE_STRING:
     // TODO
@@ -204,305 +292,234 @@ static void gen_exp_size(ClmExpNode *node) {
     } else if (node->type == EXP_TYPE_PARAM) {
       size = node->paramExp.size;
     } else if (node->type == EXP_TYPE_CALL) {
-      ClmSymbol *sym = clm_scope_find(data.scope, node->callExp.name);
+      ClmSymbol *sym = node->callExp.symbol;
       ClmStmtNode *decl = sym->declaration;
       size = decl->funcDecStmt.returnSize;
     }
 
     if (size.colVar != NULL) {
       // push dword [ebp+offset]
-      ClmSymbol *sym = clm_scope_find(data.scope, size.colVar);
-      load_var_location(sym, index_str, 8, NULL);
-      asm_push(index_str);
+      ClmSymbol *sym = clm_scope_find(gen->compiler, gen->scope, size.colVar);
+      load_var_location(gen, sym, index_str, 1, NULL);
+      asm_push(gen, index_str);
     } else {
       // push $colInd
-      asm_push_const_i(size.cols);
+      asm_push_const_i(gen, size.cols);
     }
 
     if (size.rowVar != NULL) {
       // push dword [ebp+offset]
-      ClmSymbol *sym = clm_scope_find(data.scope, size.rowVar);
-      load_var_location(sym, index_str, 4, NULL);
-      asm_push(index_str);
+      ClmSymbol *sym = clm_scope_find(gen->compiler, gen->scope, size.rowVar);
+      load_var_location(gen, sym, index_str, 1, NULL);
+      asm_push(gen, index_str);
     } else {
       // push $rowInd
-      asm_push_const_i(size.rows);
+      asm_push_const_i(gen, size.rows);
     }
     break;
   }
   case EXP_TYPE_UNARY:
-    gen_exp_size(node->unaryExp.node);
+    gen_exp_size(gen, node->unaryExp.node);
     break;
   default:
     break;
   }
 }
 
+// replaces the matrix on top of the stack with a copy of it, a temporary. the
+// matrix is freed if it was a temporary, which for a view is its descriptor
+static void push_copy(ClmCodeGen *gen, int temps) {
+  asm_pop(gen, ESI(gen)); // pop type
+  asm_pop(gen, ESI(gen));
+  asm_push(gen, ESI(gen));
+  gen_mat_clone(gen, ESI(gen));
+  asm_pop(gen, ESI(gen));
+  asm_push(gen, EAX(gen));
+  if (temps & TEMP_LEFT)
+    asm_free(gen, ESI(gen));
+  asm_push_const_i(gen, (int)CLM_TYPE_MATRIX);
+}
+
 // pops a matrix that is on the stack, into the variable contained in node
-static void pop_into_whole_matrix(ClmExpNode *node) {
-  // TODO case where matrix on stack is actually a pointer
+static void pop_into_whole_matrix(ClmCodeGen *gen, ClmExpNode *node,
+                                  int temps) {
   char index_str[64];
-  ClmSymbol *var = clm_scope_find(data.scope, node->indExp.id);
-  char cmp_label[LABEL_SIZE];
-  char end_label[LABEL_SIZE];
-  next_label(cmp_label);
-  next_label(end_label);
-
-  asm_pop(EAX); // pop type
-  asm_pop(ECX); // pop rows
-  asm_pop(EBX); // pop cols;
-  // todo assert rows == A.rows && cols == A.cols
-  asm_imul(ECX, EBX); // ecx now contains rows * cols
-  asm_dec(ECX);
-
-  asm_label(cmp_label);
-  asm_cmp(ECX, "0");
-  asm_jmp_l(end_label);
-
-  asm_mov(EAX, ECX);
-  asm_imul(EAX, "4");
-
-  load_var_location(var, index_str, 12, EAX);
-  asm_pop(index_str);
-
-  asm_dec(ECX);
-  asm_jmp(cmp_label);
-  asm_label(end_label);
+  ClmSymbol *var = node->indExp.symbol;
+  load_var_location(gen, var, index_str, 1, NULL);
+
+  // a variable's matrix is never shared with another variable, and a view is
+  // copied out of the matrix it is taken from
+  if (!(temps & TEMP_LEFT) || (temps & VIEW_LEFT))
+    push_copy(gen, temps);
+  asm_pop(gen, EAX(gen)); // pop type
+  asm_pop(gen, EAX(gen));
+  asm_mov(gen, ESI(gen), EAX(gen));
+  // parameters are borrowed from the caller
+  if (var->location != LOCATION_PARAMETER)
+    asm_free(gen, index_str);
+  asm_mov(gen, index_str, ESI(gen));
 }
 
 // pushes a matrix identified by the node onto the stack
-static void push_whole_matrix(ClmExpNode *node) {
-  // TODO case where matrix on stack is actually a pointer
+static void push_whole_matrix(ClmCodeGen *gen, ClmExpNode *node) {
   char index_str[64];
-  ClmSymbol *var = clm_scope_find(data.scope, node->indExp.id);
-  char cmp_label[LABEL_SIZE];
-  char end_label[LABEL_SIZE];
-  next_label(cmp_label);
-  next_label(end_label);
-
-  LOAD_COLS(var, index_str);
-  asm_mov(EDX, index_str); // edx = cols
-  LOAD_ROWS(var, index_str);
-  asm_mov(EBX, index_str); // ebx = rows
-  asm_mov(ECX, EBX);
-  asm_imul(ECX, EDX);
-  asm_dec(ECX); // ecx = rows * cols - 1
-
-  asm_label(cmp_label);
-  asm_cmp(ECX, "0");
-  asm_jmp_l(end_label);
-
-  asm_mov(EAX, ECX);
-  asm_imul(EAX, "4");
-
-  load_var_location(var, index_str, 12, EAX);
-  asm_push(index_str);
-
-  asm_dec(ECX);
-  asm_jmp(cmp_label);
-  asm_label(end_label);
-
-  // push type info
-  asm_push(EDX); // cols
-  asm_push(EBX); // rows
-  asm_push_const_i((int)CLM_TYPE_MATRIX);
+  ClmSymbol *var = node->indExp.symbol;
+  load_var_location(gen, var, index_str, 1, NULL);
+  asm_push(gen, index_str);
+  asm_push_const_i(gen, (int)CLM_TYPE_MATRIX);
 }
 
-// pops a matrix from the stack into a row or column of a matrix identified by
-// node
-static void pop_into_row_or_col(ClmExpNode *node) {
-  // TODO case where matrix on stack is actually a pointer
-  char index_str[64];
-  ClmSymbol *var = clm_scope_find(data.scope, node->indExp.id);
-  char cmp_label[LABEL_SIZE];
-  char end_label[LABEL_SIZE];
-  next_label(cmp_label);
-  next_label(end_label);
-
-  // put index value into EDX
-  if(node->indExp.rowIndex != NULL){
-    gen_index_into(EDX, node->indExp.rowIndex);
-  }else{
-    gen_index_into(EDX, node->indExp.colIndex);
-  }
-
-  asm_pop(EAX); // pop type
-  asm_pop(EAX); // pop rows
-  asm_pop(EBX); // pop cols
-  // todo assert rows == A.rows or cols == A.cols
-
-  asm_mov(ECX, "0");
-
-  if (node->indExp.rowIndex != NULL) {
-    /*
-      A[x,]
-      for i in 1..A.cols do
-        A[x * A.cols + i] = pop
-      end
-    */
-    LOAD_COLS(var, index_str);
-    asm_imul(EDX, index_str);
-
-    asm_label(cmp_label);
-    asm_cmp(ECX, index_str);
-    asm_jmp_eq(end_label);
-
-    asm_mov(EAX, EDX);
-    asm_add(EAX, ECX); // eax now contains rowIndex * A.cols + i
-    asm_imul(EAX, "4");
-    load_var_location(var, index_str, 12, EAX);
-    asm_pop(index_str);
-  } else {
-    /*
-      A[,y]
-      for i in 1..A.rows do
-        A[i * A.cols + y] = pop
-      end
-    */
-    LOAD_ROWS(var, index_str);
-
-    asm_label(cmp_label);
-    asm_cmp(ECX, index_str);
-    asm_jmp_eq(end_label);
-
-    asm_mov(EAX, ECX);
-    asm_imul(EAX, index_str);
-    asm_add(EAX, EDX);
-    asm_imul(EAX, "4");
-    load_var_location(var, index_str, 12, EAX);
-    asm_pop(index_str);
+// turns the popped index and end of a range, in start and count, into the
+// first row or col counting from 0 and how many there are. whole is the size
+// of the matrix, for when there is no index
+static void gen_slice_range(ClmCodeGen *gen, const char *start,
+                            const char *count, ClmExpNode *index,
+                            ClmExpNode *end, const char *whole) {
+  if (index == NULL) {
+    asm_mov_i(gen, start, 0);
+    asm_mov(gen, count, whole);
+    return;
   }
-
-  asm_inc(ECX);
-  asm_jmp(cmp_label);
-  asm_label(end_label);
+  asm_dec(gen, start);
+  if (end != NULL)
+    asm_sub(gen, count, start);
+  else
+    asm_mov_i(gen, count, 1);
 }
 
-// pushes a row or col of the matrix identified by node onto the stack
-static void push_row_or_col(ClmExpNode *node) {
-  // TODO case where matrix on stack is actually a pointer
-  char index_str[64];
-  ClmSymbol *var = clm_scope_find(data.scope, node->indExp.id);
-  char cmp_label[LABEL_SIZE];
-  char end_label[LABEL_SIZE];
-  next_label(cmp_label);
-  next_label(end_label);
-
-  // put index value into EDX
-  if(node->indExp.rowIndex != NULL){
-    gen_index_into(EDX, node->indExp.rowIndex);
-  }else{
-    gen_index_into(EDX, node->indExp.colIndex);
-  }
-
-  if (node->indExp.rowIndex != NULL) {
-    /*
-      push A[x,]
-      for i in A.cols,-1..1 do
-        push A[x * A.cols + i]
-      end
-    */
-    LOAD_COLS(var, index_str);
-    asm_mov(ECX, index_str);
-    asm_imul(EDX, ECX);
-    asm_dec(ECX);
-
-    asm_label(cmp_label);
-    asm_cmp(ECX, "0");
-    asm_jmp_l(end_label);
-
-    asm_mov(EAX, EDX);
-    asm_add(EAX, ECX); // eax = rowIndex * A.cols + i
-    asm_imul(EAX, "4");
-    load_var_location(var, index_str, 12, EAX);
-    asm_push(index_str);
-  } else {
-    /*
-      push A[,y]
-      for i in A.rows,-1..1 do
-        push A[i * A.cols + y]
-      end
-    */
-    LOAD_ROWS(var, index_str);
-    asm_mov(ECX, index_str);
-    asm_dec(ECX);
-
-    asm_label(cmp_label);
-    asm_cmp(ECX, "0");
-    asm_jmp_l(end_label);
-
-    asm_mov(EAX, ECX);
-    asm_imul(EAX, index_str);
-    asm_add(EAX, EDX); // eax = i * A.cols + y
-    asm_imul(EAX, "4");
-    load_var_location(var, index_str, 12, EAX);
-    asm_push(index_str);
-  }
-
-  asm_inc(ECX);
-  asm_jmp(cmp_label);
-  asm_label(end_label);
+/*
+        pushes a view of the slice of the variable identified by node
+
+        A[r0..r1, c0..c1], a missing index is every row or col and a missing
+        end is the same as the start
+
+        view = a new descriptor
+        view.rows = r1 - r0 + 1
+        view.cols = c1 - c0 + 1
+        view.stride = A.stride
+        view.data = A.data + (r0 - 1) * A.stride + (c0 - 1)
+*/
+static void push_view(ClmCodeGen *gen, ClmExpNode *node) {
+  char index_str[64], location[64], size[16];
+  ClmSymbol *var = node->indExp.symbol;
+
+  // the indices are all evaluated before any is popped, evaluating one could
+  // clobber the registers holding the others otherwise
+  push_expression(gen, node->indExp.rowIndex);
+  push_expression(gen, node->indExp.rowEnd);
+  push_expression(gen, node->indExp.colIndex);
+  push_expression(gen, node->indExp.colEnd);
+  if (node->indExp.colEnd != NULL)
+    pop_int_into(gen, EDI(gen));
+  if (node->indExp.colIndex != NULL)
+    pop_int_into(gen, EDX(gen));
+  if (node->indExp.rowEnd != NULL)
+    pop_int_into(gen, ECX(gen));
+  if (node->indExp.rowIndex != NULL)
+    pop_int_into(gen, EBX(gen));
+
+  load_var_location(gen, var, index_str, 1, NULL);
+  asm_mov(gen, ESI(gen), index_str);
+
+  // ebx = r0, ecx = the rows, edx = c0, edi = the cols
+  matrix_field(gen, location, ESI(gen), MAT_ROWS);
+  gen_slice_range(gen, EBX(gen), ECX(gen), node->indExp.rowIndex,
+                  node->indExp.rowEnd, location);
+  matrix_field(gen, location, ESI(gen), MAT_COLS);
+  gen_slice_range(gen, EDX(gen), EDI(gen), node->indExp.colIndex,
+                  node->indExp.colEnd, location);
+
+  sprintf(size, "%d", SLOT(gen, MAT_DESCRIPTOR_SLOTS));
+  asm_malloc(gen, size);
+  matrix_field(gen, location, EAX(gen), MAT_ROWS);
+  asm_mov(gen, location, ECX(gen));
+  matrix_field(gen, location, EAX(gen), MAT_COLS);
+  asm_mov(gen, location, EDI(gen));
+  matrix_field(gen, location, ESI(gen), MAT_STRIDE);
+  asm_mov(gen, ECX(gen), location);
+  matrix_field(gen, location, EAX(gen), MAT_STRIDE);
+  asm_mov(gen, location, ECX(gen));
+  asm_imul(gen, EBX(gen), ECX(gen));
+  asm_add(gen, EBX(gen), EDX(gen));
+  asm_imul_i(gen, EBX(gen), MAT_ELEMENT_SIZE);
+  matrix_field(gen, location, ESI(gen), MAT_DATA);
+  asm_add(gen, EBX(gen), location);
+  matrix_field(gen, location, EAX(gen), MAT_DATA);
+  asm_mov(gen, location, EBX(gen));
+
+  asm_push(gen, EAX(gen));
+  asm_push_const_i(gen, (int)CLM_TYPE_MATRIX);
 }
 
-static void pop_matrix(ClmExpNode *node) {
+static void pop_matrix(ClmCodeGen *gen, ClmExpNode *node, int temps) {
   if (node->indExp.rowIndex == NULL && node->indExp.colIndex == NULL) {
-    pop_into_whole_matrix(node);
-  } else if (node->indExp.rowIndex == NULL || node->indExp.colIndex == NULL) {
-    pop_into_row_or_col(node);
+    pop_into_whole_matrix(gen, node, temps);
+  } else if (!clm_exp_is_element(node)) {
+    // the matrix is copied into the slice of the variable
+    push_view(gen, node);
+    gen_mat_copy_into(gen, temps);
   } else {
     char index_str[64];
-    ClmSymbol *var = clm_scope_find(data.scope, node->indExp.id);
-    gen_index_into(EAX, node->indExp.rowIndex);
-    gen_index_into(EBX, node->indExp.colIndex);
-
-    LOAD_COLS(var, index_str);
-    asm_mov(ECX, index_str); // mov number of columns into ecx
-    asm_imul(EAX, ECX);      // eax = nc * row
-    asm_add(EAX, EBX);       // eax = nc * row + col
-    asm_imul(EAX, "4");      // eax = 4 * (row * nc + col)
-    load_var_location(var, index_str, 12, EAX);
-    pop_int_into(index_str);
+    ClmSymbol *var = node->indExp.symbol;
+    gen_indices_into(gen, EAX(gen), EBX(gen), node->indExp.rowIndex,
+                     node->indExp.colIndex);
+
+    load_var_location(gen, var, index_str, 1, NULL);
+    asm_mov(gen, ECX(gen), index_str);
+    matrix_field(gen, index_str, ECX(gen), MAT_STRIDE);
+    asm_imul(gen, EAX(gen), index_str); // eax = stride * row
+    asm_add(gen, EAX(gen), EBX(gen));        // eax = stride * row + col
+    matrix_field(gen, index_str, ECX(gen), MAT_DATA);
+    asm_mov(gen, ECX(gen), index_str);
+    pop_int_into(gen, EDX(gen));
+    matrix_element(gen, index_str, ECX(gen), EAX(gen));
+    asm_mov(gen, index_str, asm_reg_dword(REG_D));
   }
 }
 
-static void push_matrix(ClmExpNode *node) {
+static void push_matrix(ClmCodeGen *gen, ClmExpNode *node) {
   if (node->indExp.rowIndex == NULL && node->indExp.colIndex == NULL) {
-    push_whole_matrix(node);
-  } else if (node->indExp.rowIndex == NULL || node->indExp.colIndex == NULL) {
-    push_row_or_col(node);
+    push_whole_matrix(gen, node);
+  } else if (!clm_exp_is_element(node)) {
+    push_view(gen, node);
   } else {
     char index_str[64];
-    ClmSymbol *var = clm_scope_find(data.scope, node->indExp.id);
-    // A[x * nc + y]
-    gen_index_into(EAX, node->indExp.rowIndex);
-    gen_index_into(EBX, node->indExp.colIndex);
-
-    LOAD_COLS(var, index_str);
-    asm_imul(EAX, index_str); // EAX = rowIndex * nc
-    asm_add(EAX, EBX);        // EAX = rowIndex * nc + colIndex
-    asm_imul(EAX, "4");       // EAX = 4 * rowIndex * nc + colIndex
-    load_var_location(var, index_str, 12, EAX);
-    asm_push(index_str);
-    asm_push_const_i((int)CLM_TYPE_INT);
+    ClmSymbol *var = node->indExp.symbol;
+    // A.data[x * stride + y]
+    gen_indices_into(gen, EAX(gen), EBX(gen), node->indExp.rowIndex,
+                     node->indExp.colIndex);
+
+    load_var_location(gen, var, index_str, 1, NULL);
+    asm_mov(gen, ECX(gen), index_str);
+    matrix_field(gen, index_str, ECX(gen), MAT_STRIDE);
+    asm_imul(gen, EAX(gen), index_str); // EAX = rowIndex * stride
+    asm_add(gen, EAX(gen),
+            EBX(gen));        // EAX = rowIndex * stride + colIndex
+    matrix_field(gen, index_str, ECX(gen), MAT_DATA);
+    asm_mov(gen, ECX(gen), index_str);
+    matrix_element(gen, index_str, ECX(gen), EAX(gen));
+    asm_movsx_dword(gen, EAX(gen), index_str);
+    asm_push(gen, EAX(gen));
+    asm_push_const_i(gen, (int)CLM_TYPE_INT);
   }
 }
 
-static void pop_into_lhs(ClmExpNode *node) {
+static void pop_into_lhs(ClmCodeGen *gen, ClmExpNode *node, int temps) {
   // it is an index node - otherwise it is a type check fail
   char index_str[64];
-  ClmSymbol *var = clm_scope_find(data.scope, node->indExp.id);
+  ClmSymbol *var = node->indExp.symbol;
 
   switch (var->type) {
   case CLM_TYPE_INT:
-    load_var_location(var, index_str, 4, NULL);
-    pop_int_into(index_str);
+    load_var_location(gen, var, index_str, 1, NULL);
+    pop_int_into(gen, index_str);
     break;
   case CLM_TYPE_FLOAT:
-    load_var_location(var, index_str, 4, NULL);
-    pop_float_into(index_str);
+    load_float_location(gen, var, index_str);
+    pop_float_into(gen, index_str);
     break;
   case CLM_TYPE_MATRIX:
-    pop_matrix(node);
+    pop_matrix(gen, node, temps);
     break;
   case CLM_TYPE_STRING:
     // uhh
@@ -514,22 +531,22 @@ static void pop_into_lhs(ClmExpNode *node) {
   }
 }
 
-static void push_index(ClmExpNode *node) {
+static void push_index(ClmCodeGen *gen, ClmExpNode *node) {
   char index_str[64];
-  ClmSymbol *var = clm_scope_find(data.scope, node->indExp.id);
+  ClmSymbol *var = node->indExp.symbol;
   switch (var->type) {
   case CLM_TYPE_INT:
-    load_var_location(var, index_str, 4, NULL);
-    asm_push(index_str);
-    asm_push_const_i((int)var->type);
+    load_var_location(gen, var, index_str, 1, NULL);
+    asm_push(gen, index_str);
+    asm_push_const_i(gen, (int)var->type);
     break;
   case CLM_TYPE_FLOAT:
-    load_var_location(var, index_str, 4, NULL);
-    asm_push_f(index_str);
-    asm_push_const_i((int)var->type);
+    load_float_location(gen, var, index_str);
+    asm_push_f(gen, index_str);
+    asm_push_const_i(gen, (int)var->type);
     break;
   case CLM_TYPE_MATRIX:
-    push_matrix(node);
+    push_matrix(gen, node);
     break;
   case CLM_TYPE_STRING:
     // uhh
@@ -540,29 +557,139 @@ static void push_index(ClmExpNode *node) {
   }
 }
 
+// evaluates an int expression into a register, scalar expressions are
+// generated in registers and anything else is popped off the typed stack
+static const char *gen_int_into_reg(ClmCodeGen *gen, ClmExpNode *node) {
+  if (gen_scalar_supported(gen, node, gen->scope))
+    return gen_scalar_expression(gen, node, gen->scope);
+  push_expression(gen, node);
+  pop_int_into(gen, EAX(gen));
+  return EAX(gen);
+}
+
+// pushes the result of a scalar expression in the same form as the typed
+// stack, for whatever consumes it from there
+static void push_scalar(ClmCodeGen *gen, ClmExpNode *node) {
+  const char *result = gen_scalar_expression(gen, node, gen->scope);
+  if (clm_type_of_exp(gen->compiler, node, gen->scope) == CLM_TYPE_FLOAT) {
+    char location[64];
+    asm_mem_dword(gen, location, FLOAT_CONST, 0, NULL);
+    asm_movss(gen, location, result);
+    asm_push_f(gen, location);
+    asm_push_const_i(gen, (int)CLM_TYPE_FLOAT);
+  } else {
+    asm_push(gen, result);
+    asm_push_const_i(gen, (int)CLM_TYPE_INT);
+  }
+}
+
+// an argument has its value in the slot above its type like any other, but
+// on the typed stack a float's value is on the fpu stack
+static void push_argument(ClmCodeGen *gen, ClmExpNode *node) {
+  char location[64];
+  if (clm_type_of_exp(gen->compiler, node, gen->scope) != CLM_TYPE_FLOAT) {
+    push_expression(gen, node);
+    return;
+  }
+
+  asm_mem_dword(gen, location, ESP(gen), 0, NULL);
+  if (gen_scalar_supported(gen, node, gen->scope)) {
+    const char *result = gen_scalar_expression(gen, node, gen->scope);
+    asm_sub_i(gen, ESP(gen), SLOT(gen, 1));
+    asm_movss(gen, location, result);
+  } else {
+    push_expression(gen, node);
+    asm_pop_f(gen, location); // over its type
+  }
+  asm_push_const_i(gen, (int)CLM_TYPE_FLOAT);
+}
+
+// matrices are passed as their pointer, the function borrows them and pops
+// the arguments when it returns. the caller owns the temporaries it passes,
+// so their pointers are kept in slots below the arguments and freed once the
+// function has returned. for a slice that is only its view descriptor
+static void gen_call(ClmCodeGen *gen, ClmExpNode *node) {
+  char from[64], to[64];
+  ArrayList *params = node->callExp.params;
+  int i, temps = 0;
+  for (i = 0; i < params->length; i++)
+    temps += is_temporary(gen, params->data[i]);
+
+  if (temps > 0)
+    asm_sub_i(gen, ESP(gen), SLOT(gen, temps));
+  for (i = params->length - 1; i >= 0; i--)
+    push_argument(gen, params->data[i]);
+
+  // each argument is a value over its type, the first one on top
+  temps = 0;
+  for (i = 0; i < params->length; i++) {
+    if (!is_temporary(gen, params->data[i]))
+      continue;
+    asm_mem(gen, from, ESP(gen), SLOT(gen, 2 * i + 1), NULL);
+    asm_mem(gen, to, ESP(gen), SLOT(gen, 2 * params->length + temps++), NULL);
+    asm_mov(gen, EBX(gen), from);
+    asm_mov(gen, to, EBX(gen));
+  }
+
+  asm_call(gen, node->callExp.name);
+  if (temps == 0)
+    return;
+
+  // the return value is pushed back over the freed slots
+  ClmType type = clm_type_of_exp(gen->compiler, node, gen->scope);
+  if (type != CLM_TYPE_NONE)
+    asm_pop(gen, ECX(gen)); // pop type
+  if (type != CLM_TYPE_NONE && type != CLM_TYPE_FLOAT)
+    asm_pop(gen, EDX(gen)); // floats are on the fpu stack
+  for (i = 0; i < temps; i++) {
+    asm_pop(gen, ESI(gen));
+    asm_free(gen, ESI(gen));
+  }
+  if (type != CLM_TYPE_NONE && type != CLM_TYPE_FLOAT)
+    asm_push(gen, EDX(gen));
+  if (type != CLM_TYPE_NONE)
+    asm_push(gen, ECX(gen));
+}
+
 // stack should look like this:
 // val
 // type
-static void push_expression(ClmExpNode *node) {
+void push_expression(ClmCodeGen *gen, ClmExpNode *node) {
   if (node == NULL)
     return;
 
-  ClmType expression_type = clm_type_of_exp(node, data.scope);
+  // literals and variables are pushed directly, there is nothing to gain
+  if ((node->type == EXP_TYPE_ARITH || node->type == EXP_TYPE_BOOL ||
+       node->type == EXP_TYPE_UNARY) &&
+      gen_scalar_supported(gen, node, gen->scope)) {
+    push_scalar(gen, node);
+    return;
+  }
+
+  if ((node->type == EXP_TYPE_ARITH || node->type == EXP_TYPE_UNARY) &&
+      gen_fused_supported(gen, node, gen->scope)) {
+    gen_fused_expression(gen, node, gen->scope);
+    return;
+  }
+
+  ClmType expression_type = clm_type_of_exp(gen->compiler, node, gen->scope);
   switch (node->type) {
   case EXP_TYPE_INT:
-    asm_push_const_i(node->ival);
-    asm_push_const_i((int)expression_type);
+    asm_push_const_i(gen, node->ival);
+    asm_push_const_i(gen, (int)expression_type);
     break;
   case EXP_TYPE_FLOAT:
-    asm_push_const_f(node->fval);
-    asm_push_const_i((int)expression_type);
+    asm_push_const_f(gen, node->fval);
+    asm_push_const_i(gen, (int)expression_type);
     break;
   case EXP_TYPE_STRING:
     // TODO push a string onto the stack
     break;
   case EXP_TYPE_ARITH: {
-    ClmType right_type = clm_type_of_exp(node->arithExp.right, data.scope);
-    ClmType left_type = clm_type_of_exp(node->arithExp.left, data.scope);
+    ClmType right_type = clm_type_of_exp(gen->compiler, node->arithExp.right,
+                                         gen->scope);
+    ClmType left_type = clm_type_of_exp(gen->compiler, node->arithExp.left,
+                                        gen->scope);
     if (left_type == CLM_TYPE_MATRIX && clm_type_is_number(right_type)) {
       // here the only ops are mul & div... we are scaling matrix
       // gen left and then right here... if we don't then we have
@@ -578,463 +705,753 @@ static void push_expression(ClmExpNode *node) {
       // gen the matrix first and then the int, so we just have to pop two
       // values
       // in total
-      push_expression(node->arithExp.left);
-      asm_mov(EDX, ESP);
-      push_expression(node->arithExp.right);
-      gen_arith(node);
+      push_expression(gen, node->arithExp.left);
+      push_expression(gen, node->arithExp.right);
+      load_operand_below(gen, right_type);
+      gen_arith(gen, node);
     } else {
-      push_expression(node->arithExp.right);
-      asm_mov(EDX, ESP);
-      push_expression(node->arithExp.left);
-      gen_arith(node);
+      push_expression(gen, node->arithExp.right);
+      push_expression(gen, node->arithExp.left);
+      load_operand_below(gen, left_type);
+      gen_arith(gen, node);
     }
     break;
   }
   case EXP_TYPE_BOOL:
-    push_expression(node->boolExp.right);
-    asm_mov(EDX, ESP);
-    push_expression(node->boolExp.left);
-    gen_bool(node);
+    push_expression(gen, node->boolExp.right);
+    push_expression(gen, node->boolExp.left);
+    load_operand_below(gen, clm_type_of_exp(gen->compiler, node->boolExp.left,
+                                            gen->scope));
+    gen_bool(gen, node);
     break;
-  case EXP_TYPE_CALL: {
-    // first push everything thats not a matrix... and for matrices push a pointer
-    int tempStartID = data.temporaryID;
-    int i;
-    ClmExpNode *param;
-    char temporary[256];
-
-    // first for any matrices that are parameters that will be pushed through
-    // the stack, push them on the stack and save their location into a temporary
-    // global
-    for (i = node->callExp.params->length - 1; i >= 0; i--) {
-      param = node->callExp.params->data[i];
-      if(param->type == CLM_TYPE_MATRIX){
-        ClmLocation location = clm_location_of_exp(param, data.scope);
-        switch(location){
-            case LOCATION_STACK:
-              push_expression(param);
-              next_temporary(temporary);
-              asm_mov(temporary, ESP);
-              break;
-            default:
-              break;
-        }
-      }
-    }
-
-    // then push every expression.. when we get to a matrix, push the pointer
-    // to its location
-    int tempOffset = 1;
-    char index_str[256];
-    for (i = node->callExp.params->length - 1; i >= 0; i--) {
-      param = node->callExp.params->data[i];
-      if(param->type == CLM_TYPE_MATRIX){
-        ClmLocation location = clm_location_of_exp(param, data.scope);
-        switch(location){
-            case LOCATION_STACK:
-              sprintf(temporary, "dword [temporary%d]", tempStartID + tempOffset);
-              asm_push(temporary);
-              tempOffset++;
-              break;
-            default:
-            {
-              // the only way its a matrix and not on the stack is if its an
-              // ind exp with no indices
-              ClmSymbol *symbol = clm_scope_find(data.scope, param->indExp.id);
-              load_var_location(symbol, index_str, 0, NULL);
-              asm_push(index_str);
-              break;
-            }
-        }
-        asm_push_const_i((int) CLM_TYPE_MATRIX);
-      }else{
-        push_expression(param);
-      }
-    }
-
-    asm_call(node->callExp.name);
-
-    // TODO pop off arguments from the stack
+  case EXP_TYPE_CALL:
+    gen_call(gen, node);
     break;
-  }
   case EXP_TYPE_INDEX:
-    push_index(node);
+    push_index(gen, node);
     break;
   case EXP_TYPE_MAT_DEC: {
     int i;
+    char rows[16], cols[16], location[64];
     if (node->matDecExp.arr != NULL) {
-      for (i = node->matDecExp.length - 1; i >= 0; i--) {
+      sprintf(rows, "%d", node->matDecExp.size.rows);
+      sprintf(cols, "%d", node->matDecExp.size.cols);
+      gen_mat_new(gen, rows, cols, 0);
+      matrix_field(gen, location, EAX(gen), MAT_DATA);
+      asm_mov(gen, EDX(gen), location);
+      for (i = 0; i < node->matDecExp.length; i++) {
         // TODO... push f or push i?
-        asm_push_const_i((int)node->matDecExp.arr[i]);
+        asm_mem_dword(gen, location, EDX(gen), i * MAT_ELEMENT_SIZE, NULL);
+        asm_mov_i(gen, location, (int)node->matDecExp.arr[i]);
       }
-      asm_push_const_i(node->matDecExp.size.cols);
-      asm_push_const_i(node->matDecExp.size.rows);
-      asm_push_const_i((int)CLM_TYPE_MATRIX);
+      asm_push(gen, EAX(gen));
+      asm_push_const_i(gen, (int)CLM_TYPE_MATRIX);
     } else {
-      // push a matrix onto the stack with all 0s
-      char cmp_label[LABEL_SIZE];
-      char end_label[LABEL_SIZE];
-      next_label(cmp_label);
-      next_label(end_label);
-
-      gen_exp_size(node);
-      asm_pop(EAX); // # rows
-      asm_pop(EBX); // # cols
-
-      asm_mov(ECX, EAX);
-      asm_imul(ECX, EBX);
-      asm_dec(ECX);
-      asm_label(cmp_label);
-      asm_cmp(ECX, "0");
-      asm_jmp_l(end_label);
-      asm_push_const_i(0);
-      asm_dec(ECX);
-      asm_jmp(cmp_label);
-      asm_label(end_label);
-      asm_push(EBX);
-      asm_push(EAX);
-      asm_push_const_i((int)CLM_TYPE_MATRIX);
+      // a matrix with all 0s
+      gen_exp_size(gen, node);
+      asm_pop(gen, EBX(gen)); // # rows
+      asm_pop(gen, ECX(gen)); // # cols
+      gen_mat_new(gen, EBX(gen), ECX(gen), 1);
+      asm_push(gen, EAX(gen));
+      asm_push_const_i(gen, (int)CLM_TYPE_MATRIX);
     }
     break;
   }
   case EXP_TYPE_PARAM:
     break;
   case EXP_TYPE_UNARY:
-    push_expression(node->unaryExp.node);
-    gen_unary(node);
+    push_expression(gen, node->unaryExp.node);
+    gen_unary(gen, node);
     break;
   }
 }
 
-static void gen_conditional(ClmStmtNode *node) {
-  push_expression(node->conditionStmt.condition);
+static void gen_conditional(ClmCodeGen *gen, ClmStmtNode *node) {
+  // the optimizer leaves conditions that are always true as a literal 1
+  if (node->conditionStmt.condition->type == EXP_TYPE_INT &&
+      node->conditionStmt.condition->ival == 1 &&
+      node->conditionStmt.falseBody == NULL) {
+    gen->scope = node->conditionStmt.trueScope;
+    gen_statements(gen, node->conditionStmt.trueBody);
+    gen->scope = gen->scope->parent;
+    return;
+  }
+
+  const char *condition = gen_int_into_reg(gen, node->conditionStmt.condition);
 
   if (node->conditionStmt.falseBody == NULL) {
     char end_label[LABEL_SIZE];
-    next_label(end_label);
+    next_label(gen, end_label);
 
-    ClmScope *trueScope =
-        clm_scope_find_child(data.scope, node->conditionStmt.trueBody);
+    ClmScope *trueScope = node->conditionStmt.trueScope;
 
-    asm_pop(EAX);
-    asm_cmp(EAX, "1");
-    asm_jmp_neq(end_label);
-    data.scope = trueScope;
-    gen_statements(node->conditionStmt.trueBody);
-    asm_label(end_label);
+    asm_cmp(gen, condition, "1");
+    asm_jmp_neq(gen, end_label);
+    gen->scope = trueScope;
+    gen_statements(gen, node->conditionStmt.trueBody);
+    asm_label(gen, end_label);
 
-    data.scope = trueScope->parent;
+    gen->scope = trueScope->parent;
   } else {
     char end_label[LABEL_SIZE];
     char false_label[LABEL_SIZE];
-    next_label(end_label);
-    next_label(false_label);
-
-    ClmScope *trueScope =
-        clm_scope_find_child(data.scope, node->conditionStmt.trueBody);
-    ClmScope *falseScope =
-        clm_scope_find_child(data.scope, node->conditionStmt.falseBody);
-
-    asm_pop(EAX);
-    asm_cmp(EAX, "1");
-    asm_jmp_neq(false_label);
-    data.scope = trueScope;
-    gen_statements(node->conditionStmt.trueBody);
-    asm_jmp(end_label);
-    asm_label(false_label);
-    data.scope = falseScope;
-    gen_statements(node->conditionStmt.falseBody);
-    asm_label(end_label);
-
-    data.scope = falseScope->parent;
+    next_label(gen, end_label);
+    next_label(gen, false_label);
+
+    ClmScope *trueScope = node->conditionStmt.trueScope;
+    ClmScope *falseScope = node->conditionStmt.falseScope;
+
+    asm_cmp(gen, condition, "1");
+    asm_jmp_neq(gen, false_label);
+    gen->scope = trueScope;
+    gen_statements(gen, node->conditionStmt.trueBody);
+    asm_jmp(gen, end_label);
+    asm_label(gen, false_label);
+    gen->scope = falseScope;
+    gen_statements(gen, node->conditionStmt.falseBody);
+    asm_label(gen, end_label);
+
+    gen->scope = falseScope->parent;
   }
 }
 
-static void gen_func_dec(ClmStmtNode *node) {
+// frees the matrices owned by the locals of the current function, except for
+// keep which is being returned
+static void free_local_matrices(ClmCodeGen *gen, ClmSymbol *keep) {
+  int i;
+  ClmSymbol *sym;
+  char index_str[64];
+  if (gen->functionScope == NULL)
+    return;
+  for (i = 0; i < gen->functionScope->symbols->length; i++) {
+    sym = gen->functionScope->symbols->data[i];
+    if (sym->location == LOCATION_LOCAL && sym->type == CLM_TYPE_MATRIX &&
+        sym != keep) {
+      load_var_location(gen, sym, index_str, 1, NULL);
+      asm_free(gen, index_str);
+    }
+  }
+}
+
+static void gen_func_dec(ClmCodeGen *gen, ClmStmtNode *node) {
   int i;
   char func_label[LABEL_SIZE];
 
   sprintf(func_label, "_%s", node->funcDecStmt.name);
-  ClmScope *funcScope = clm_scope_find_child(data.scope, node);
+  ClmScope *funcScope = node->funcDecStmt.scope;
 
-  asm_label(func_label);
-  asm_push(EBP);
-  asm_mov(EBP, ESP);
+  asm_label(gen, func_label);
+  asm_push(gen, EBP(gen));
+  asm_mov(gen, EBP(gen), ESP(gen));
+  gen->argumentSize = SLOT(gen, 2 * node->funcDecStmt.parameters->length);
 
-  int local_var_size = 2 * 4 * (funcScope->symbols->length -
-                                node->funcDecStmt.parameters->length);
-  char local_var_size_str[32];
-  sprintf(local_var_size_str, "%d", local_var_size);
-  asm_sub(ESP, local_var_size_str);
+  int local_var_size = SLOT(gen, 2 * (funcScope->symbols->length -
+                                 node->funcDecStmt.parameters->length));
+  asm_sub_i(gen, ESP(gen), local_var_size);
 
   // each local var has 2 slots on the stack, their type and the value
-  // for matrices, the value is a pointer to the location on the stack
-  // these are all declared below the local variables
+  // for matrices, the value is a pointer to the descriptor, which is null
+  // until the variable is first assigned
   ClmSymbol *sym;
-  ClmExpNode *dec;
-  char cmp_label[LABEL_SIZE];
-  char end_label[LABEL_SIZE];
-  char index_str[32];
+  char index_str[64];
   for (i = 0; i < funcScope->symbols->length; i++) {
     sym = funcScope->symbols->data[i];
-    dec = sym->declaration;
 
     if (sym->location == LOCATION_PARAMETER)
       continue;
 
     // setting the type of the local var
-    load_var_location(sym, index_str, 0, NULL);
-    asm_mov_i(index_str, (int)sym->type);
+    load_var_location(gen, sym, index_str, 0, NULL);
+    asm_mov_i(gen, index_str, (int)sym->type);
 
     // setting the value of the local var
-    load_var_location(sym, index_str, 4, NULL);
-    asm_mov_i(index_str, 0);
-
-    if (sym->type == CLM_TYPE_MATRIX) {
-      // TODO what does this do? does it work?
-      next_label(cmp_label);
-      next_label(end_label);
-
-      gen_exp_size(dec);
-      asm_pop(EAX); // eax contains num of rows
-      asm_pop(EBX); // ebx contains num of cols
-      asm_mov(ECX, EAX);
-      asm_imul(ECX, EBX);
-      asm_label(cmp_label);
-      asm_dec(ECX);
-      asm_cmp(ECX, "0");
-      asm_jmp_eq(end_label);
-      asm_push_const_i(0);
-      asm_jmp(cmp_label);
-      asm_label(end_label);
-      asm_push(EBX); // cols
-
-      // setting the pointer to point at the rows
-      // note: push changes the value at esp and THEN
-      // decrements it
-      load_var_location(sym, index_str, 4, NULL);
-      asm_mov(index_str, ESP);
-
-      asm_push(EAX); // rows
-    }
+    load_var_location(gen, sym, index_str, 1, NULL);
+    asm_mov_i(gen, index_str, 0);
   }
   // TODO figure out strings though!
 
-  data.inFunction = 1;
-  data.scope = funcScope;
-  gen_statements(node->funcDecStmt.body);
-  data.scope = funcScope->parent;
-  data.inFunction = 0;
+  gen->functionScope = funcScope;
+  gen->scope = funcScope;
+  gen_statements(gen, node->funcDecStmt.body);
+  gen->scope = funcScope->parent;
 
   if (node->funcDecStmt.returnSize.rows == -1) {
     // no return value!
-    asm_mov(ESP, EBP);
-    asm_pop(EBP);
+    free_local_matrices(gen, NULL);
+    asm_mov(gen, ESP(gen), EBP(gen));
+    asm_pop(gen, EBP(gen));
   }
-  asm_ret();
+  gen->functionScope = NULL;
+  asm_ret_i(gen, gen->argumentSize);
+  gen->argumentSize = 0;
 }
 
-static void gen_for_loop(ClmStmtNode *node) {
+static void gen_for_loop(ClmCodeGen *gen, ClmStmtNode *node) {
   char cmp_label[LABEL_SIZE];
   char end_label[LABEL_SIZE];
-  next_label(cmp_label);
-  next_label(end_label);
+  next_label(gen, cmp_label);
+  next_label(gen, end_label);
 
-  ClmSymbol *var = clm_scope_find(data.scope, node->forLoopStmt.varId);
-  char loop_var[32];
-  load_var_location(var, loop_var, 4, NULL);
+  ClmSymbol *var = node->forLoopStmt.var;
+  char loop_var[64];
+  load_var_location(gen, var, loop_var, 1, NULL);
 
   // don't need to store this - just evaluate and put into loop var
-  push_expression(node->forLoopStmt.start);  
-  pop_int_into(loop_var);
+  asm_mov(gen, loop_var, gen_int_into_reg(gen, node->forLoopStmt.start));
 
-  asm_label(cmp_label);
+  asm_label(gen, cmp_label);
 
   // don't need to store this - just evaulate every loop
-  push_expression(node->forLoopStmt.end);
-  pop_int_into(EAX);
-  asm_cmp(loop_var, EAX);
-  asm_jmp_g(end_label);
+  asm_cmp(gen, loop_var, gen_int_into_reg(gen, node->forLoopStmt.end));
+  asm_jmp_g(gen, end_label);
 
-  gen_statements(node->forLoopStmt.body);
+  gen_statements(gen, node->forLoopStmt.body);
 
   if (node->forLoopStmt.delta->type == EXP_TYPE_INT &&
       node->forLoopStmt.delta->ival == 1) {
-    asm_inc(loop_var);
+    asm_inc(gen, loop_var);
   } else if (node->forLoopStmt.delta->type == EXP_TYPE_INT &&
              node->forLoopStmt.delta->ival == -1) {
-    asm_dec(loop_var);
+    asm_dec(gen, loop_var);
   } else if (node->forLoopStmt.delta->type == EXP_TYPE_INT) {
-    asm_add_i(loop_var, node->forLoopStmt.delta->ival);
+    asm_add_i(gen, loop_var, node->forLoopStmt.delta->ival);
   } else {
-    push_expression(node->forLoopStmt.delta);
-    asm_pop(EAX);
-    asm_add(loop_var, EAX);
+    asm_add(gen, loop_var, gen_int_into_reg(gen, node->forLoopStmt.delta));
   }
 
-  asm_jmp(cmp_label);
-  asm_label(end_label);
+  asm_jmp(gen, cmp_label);
+  asm_label(gen, end_label);
 }
 
-static void gen_while_loop(ClmStmtNode *node) {
+static void gen_while_loop(ClmCodeGen *gen, ClmStmtNode *node) {
   char cmp_label[LABEL_SIZE];
   char end_label[LABEL_SIZE];
-  next_label(cmp_label);
-  next_label(end_label);
+  next_label(gen, cmp_label);
+  next_label(gen, end_label);
 
-  asm_label(cmp_label);
+  asm_label(gen, cmp_label);
 
   // don't need to store this - just evaulate every loop
-  push_expression(node->whileLoopStmt.condition);
-  pop_int_into(EAX);
-  asm_cmp(EAX, "0");
-  asm_jmp_eq(end_label);
+  asm_cmp(gen, gen_int_into_reg(gen, node->whileLoopStmt.condition), "0");
+  asm_jmp_eq(gen, end_label);
 
-  gen_statements(node->whileLoopStmt.body);
+  gen_statements(gen, node->whileLoopStmt.body);
 
-  asm_jmp(cmp_label);
-  asm_label(end_label);
+  asm_jmp(gen, cmp_label);
+  asm_label(gen, end_label);
 }
 
-static void gen_statement(ClmStmtNode *node) {
+// assigning a scalar expression to a scalar variable stores the register
+// holding the result straight into the variable
+static int gen_scalar_assign(ClmCodeGen *gen, ClmStmtNode *node) {
+  char location[64];
+  ClmExpNode *lhs = node->assignStmt.lhs;
+  ClmSymbol *var = lhs->indExp.symbol;
+
+  if (lhs->indExp.rowIndex != NULL || lhs->indExp.colIndex != NULL ||
+      var->type != clm_type_of_exp(gen->compiler, node->assignStmt.rhs,
+                                   gen->scope) ||
+      !gen_scalar_supported(gen, node->assignStmt.rhs, gen->scope))
+    return 0;
+
+  const char *result = gen_scalar_expression(gen, node->assignStmt.rhs,
+                                             gen->scope);
+  if (var->type == CLM_TYPE_FLOAT) {
+    load_float_location(gen, var, location);
+    asm_movss(gen, location, result);
+  } else {
+    load_var_location(gen, var, location, 1, NULL);
+    asm_mov(gen, location, result);
+  }
+  return 1;
+}
+
+static void gen_statement(ClmCodeGen *gen, ClmStmtNode *node) {
   switch (node->type) {
   case STMT_TYPE_ASSIGN:
-    push_expression(node->assignStmt.rhs);
-    pop_into_lhs(node->assignStmt.lhs);
+    if (!gen_scalar_assign(gen, node)) {
+      ClmExpNode *lhs = node->assignStmt.lhs;
+      ClmExpNode *rhs = node->assignStmt.rhs;
+      int temps = operand_flags(gen, rhs);
+      push_expression(gen, rhs);
+      if (is_view(gen, lhs) && rhs->type == EXP_TYPE_INDEX &&
+          strcmp(lhs->indExp.id, rhs->indExp.id) == 0) {
+        // copying the variable into a slice of itself could overwrite
+        // elements before they are read
+        push_copy(gen, temps);
+        temps = TEMP_LEFT;
+      }
+      pop_into_lhs(gen, lhs, temps);
+    }
     break;
   case STMT_TYPE_CALL:
-    push_expression(node->callExpr);
+    push_expression(gen, node->callExpr);
     break;
   case STMT_TYPE_CONDITIONAL:
-    gen_conditional(node);
+    gen_conditional(gen, node);
     break;
   case STMT_TYPE_FUNC_DEC:
-    gen_func_dec(node);
+    gen_func_dec(gen, node);
     break;
   case STMT_TYPE_FOR_LOOP:
-    gen_for_loop(node);
+    gen_for_loop(gen, node);
     break;
   case STMT_TYPE_WHILE_LOOP:
-    gen_while_loop(node);
+    gen_while_loop(gen, node);
     break;
   case STMT_TYPE_PRINT:
-    push_expression(node->printStmt.expression);
-    gen_print_type(clm_type_of_exp(node->printStmt.expression, data.scope),
-                   node->printStmt.appendNewline);
+    push_expression(gen, node->printStmt.expression);
+    gen_print_type(gen, clm_type_of_exp(gen->compiler,
+                                        node->printStmt.expression, gen->scope),
+                   node->printStmt.appendNewline,
+                   operand_flags(gen, node->printStmt.expression));
     break;
-  case STMT_TYPE_RET:
+  case STMT_TYPE_RET: {
+    // evaluate the return expression, free the locals,
     // reset the stack pointer,
     // save the frame pointer & the stack address
-    // push the return expression onto the stack so the stack looks like this
-    // on return:
+    // pop the arguments and push the return value back onto the stack so the
+    // stack looks like this on return:
     //
     // return val
     // return type
     // <- esp
 
     // note: T_EAX and T_EBX are globals defined in clm_asm.h
-    asm_mov(ESP, EBP);      // reset stack pointer to above the function
-    asm_pop("[" T_EBX "]"); // pop the old frame pointer into t_ebx
-    asm_pop("[" T_EAX "]"); // pop the stack address of the next instruction to
+    char t_eax[32], t_ebx[32];
+    asm_mem(gen, t_eax, T_EAX, 0, NULL);
+    asm_mem(gen, t_ebx, T_EBX, 0, NULL);
+
+    ClmExpNode *ret = node->returnExpr;
+    ClmType ret_type = CLM_TYPE_NONE;
+    ClmSymbol *keep = NULL;
+    if (ret != NULL) {
+      ret_type = clm_type_of_exp(gen->compiler, ret, gen->scope);
+      push_expression(gen, ret);
+      if (ret_type == CLM_TYPE_MATRIX && !is_temporary(gen, ret)) {
+        // a local's matrix can be handed to the caller, anything else the
+        // caller would be sharing
+        ClmSymbol *sym = ret->indExp.symbol;
+        if (sym->location == LOCATION_LOCAL)
+          keep = sym;
+        else
+          push_copy(gen, 0);
+      } else if (is_view(gen, ret)) {
+        // the matrix it views is freed with the locals
+        push_copy(gen, TEMP_LEFT | VIEW_LEFT);
+      }
+    }
+    free_local_matrices(gen, keep);
+    if (ret != NULL) {
+      asm_pop(gen, ECX(gen)); // pop type
+      if (ret_type != CLM_TYPE_FLOAT)
+        asm_pop(gen, EDX(gen)); // floats are on the fpu stack
+    }
+
+    asm_mov(gen, ESP(gen),
+            EBP(gen)); // reset stack pointer to above the function
+    asm_pop(gen, t_ebx);    // pop the old frame pointer into t_ebx
+    asm_pop(gen, t_eax);    // pop the stack address of the next instruction to
     // execute after call finishes
-    push_expression(node->returnExpr);
-    asm_mov(EBP, "[" T_EBX "]"); // move the old frame pointer into ebp
-    asm_push("[" T_EAX
-             "]"); // push the stack address of the next instruction to
+    if (gen->argumentSize > 0)
+      asm_add_i(gen, ESP(gen), gen->argumentSize); // pop the arguments
+    if (ret != NULL) {
+      if (ret_type != CLM_TYPE_FLOAT)
+        asm_push(gen, EDX(gen));
+      asm_push(gen, ECX(gen));
+    }
+    asm_mov(gen, EBP(gen), t_ebx); // move the old frame pointer into ebp
+    asm_push(gen,
+             t_eax);     // push the stack address of the next instruction to
     // execute after call finishes
-    asm_ret(); // return
+    asm_ret(gen); // return
+    break;
+  }
+  case STMT_TYPE_IMPORT:
+    // the imported functions are appended with the program's
     break;
   }
 }
 
-static void gen_globals(ClmScope *globalScope) {
+static void gen_globals(ClmCodeGen *gen, ClmScope *globalScope) {
   int i;
   ClmSymbol *symbol;
-  char buffer[256];
+  char name[256];
+  int words[1];
   for (i = 0; i < globalScope->symbols->length; i++) {
     symbol = globalScope->symbols->data[i];
+    sprintf(name, "_%s", symbol->name);
     switch (symbol->type) {
     case CLM_TYPE_INT:
-      sprintf(buffer, "_%s dd %d, 0\n", symbol->name, (int)CLM_TYPE_INT);
-      writeLine(buffer);
+      words[0] = (int)CLM_TYPE_INT;
+      asm_data(gen, name, words, 1, 1);
       break;
     case CLM_TYPE_FLOAT:
-      sprintf(buffer, "_%s dd %d, 0\n", symbol->name, (int)CLM_TYPE_FLOAT);
-      writeLine(buffer);
+      words[0] = (int)CLM_TYPE_FLOAT;
+      asm_data(gen, name, words, 1, 1);
       break;
     case CLM_TYPE_STRING:
       // TODO gen global string
       break;
-    case CLM_TYPE_MATRIX: {
-      ClmStmtNode *node = symbol->declaration;
-      ClmExpNode *val = node->assignStmt.rhs;
-      int rows, cols;
-      if (clm_size_of_exp(val, globalScope, &rows, &cols)) {
-        int i;
-        sprintf(buffer, "_%s dd %d, %d, %d", symbol->name, (int)CLM_TYPE_MATRIX,
-                rows, cols);
-        for (i = 0; i < rows * cols; i++) {
-          strcat(buffer, ", 0");
-        }
-        strcat(buffer, "\n");
-        writeLine(buffer);
-      }
+    case CLM_TYPE_MATRIX:
+      // the pointer to its descriptor, null until it is first assigned
+      words[0] = (int)CLM_TYPE_MATRIX;
+      asm_data(gen, name, words, 1, 1);
       break;
-    }
     default:
       break;
     }
   }
 
-  // temporaries are integers used for pushing matrices into functions
-  while(data.temporaryID > 0){
-    sprintf(buffer, "temporary%d dd %d, 0\n", data.temporaryID, (int)CLM_TYPE_INT);
-    writeLine(buffer);
-    data.temporaryID--;
+  // values the register allocator couldn't keep in registers
+  if (gen_scalar_spill_slots(gen) > 0) {
+    words[0] = 0;
+    asm_data(gen, SPILL, words, 1, gen_scalar_spill_slots(gen) - 1);
   }
 }
 
-static void gen_functions(ArrayList *statements) {
+// an imported function leaves the scope at the top of its own compilation,
+// so the scope is put back as well as the labels
+static void gen_function(ClmCodeGen *gen, ClmStmtNode *node) {
+  ClmScope *scope = gen->scope;
+  int labelID = gen->labelID;
+  gen->function = node->funcDecStmt.name;
+  gen->labelID = 0;
+  gen_statement(gen, node);
+  gen->function = NULL;
+  gen->labelID = labelID;
+  gen->scope = scope;
+}
+
+// the imported functions followed by the ones the program declares
+static ArrayList *program_functions(ClmCompiler *compiler,
+                                    ArrayList *statements) {
+  ArrayList *functions = array_list_new(NULL);
   int i;
+  if (compiler->imports != NULL && compiler->importsCode == NULL) {
+    for (i = 0; i < compiler->imports->length; i++)
+      array_list_push(functions, compiler->imports->data[i]);
+  }
   for (i = 0; i < statements->length; i++) {
     ClmStmtNode *node = statements->data[i];
-    if (node->type == STMT_TYPE_FUNC_DEC) {
-      gen_statement(node);
+    if (node->type == STMT_TYPE_FUNC_DEC)
+      array_list_push(functions, node);
+  }
+  return functions;
+}
+
+static void gen_functions(ClmCodeGen *gen, ArrayList *functions) {
+  int i;
+  for (i = 0; i < functions->length; i++) {
+    gen_function(gen, functions->data[i]);
+  }
+}
+
+/*
+ *
+ *  PARALLEL FUNCTIONS
+ *
+ */
+
+// how many functions each thread generates before they are appended, which
+// bounds how many are held in buffers of their own at once
+#define FUNCTIONS_PER_THREAD 4
+
+// the code of a function generated on a worker thread, and what it needs from
+// the rest of the program
+typedef struct {
+  ClmStmtNode *node;
+  StringBuffer *code;
+  int spillSlots;
+  int gemmUsed;
+} GeneratedFunction;
+
+typedef struct {
+  ClmCompiler *compiler;
+  ClmScope *globalScope;
+  GeneratedFunction *functions;
+} FunctionsWork;
+
+// functions can use globals, whose sizes come from the expressions they are
+// assigned. those nodes are shared by every function, so they are typed
+// before the threads start and the threads only read their cache
+static void cache_global_types(ClmCompiler *compiler, ClmScope *globalScope) {
+  int i, rows, cols;
+  for (i = 0; i < globalScope->symbols->length; i++) {
+    ClmSymbol *symbol = globalScope->symbols->data[i];
+    ClmStmtNode *declaration = symbol->declaration;
+    if (symbol->type == CLM_TYPE_FUNCTION || declaration == NULL ||
+        declaration->type != STMT_TYPE_ASSIGN)
+      continue;
+    clm_type_of_exp(compiler, declaration->assignStmt.rhs, globalScope);
+    clm_size_of_exp(compiler, declaration->assignStmt.rhs, globalScope, &rows,
+                    &cols);
+  }
+}
+
+// a cached function is a line with its spill slots and whether it uses the
+// GEMM routine, followed by its code
+static int load_function(const char *dir, const char *key,
+                         GeneratedFunction *function) {
+  StringBuffer *entry = string_buffer_new();
+  int spillSlots, gemmUsed;
+  char *code;
+  if (!clm_cache_lookup(dir, key, entry) ||
+      sscanf(entry->data, "%d %d", &spillSlots, &gemmUsed) != 2 ||
+      (code = strchr(entry->data, '\n')) == NULL) {
+    string_buffer_free(entry);
+    return 0;
+  }
+  code++;
+  function->code = string_buffer_new();
+  string_buffer_append_n(function->code, code,
+                         entry->length - (code - entry->data));
+  function->spillSlots = spillSlots;
+  function->gemmUsed = gemmUsed;
+  string_buffer_free(entry);
+  return 1;
+}
+
+static void store_function(const char *dir, const char *key,
+                           GeneratedFunction *function) {
+  StringBuffer *entry = string_buffer_new();
+  string_buffer_appendf(entry, "%d %d\n", function->spillSlots,
+                        function->gemmUsed);
+  string_buffer_append_n(entry, function->code->data, function->code->length);
+  clm_cache_store(dir, key, entry->data, entry->length);
+  string_buffer_free(entry);
+}
+
+// a code generator with nothing generated yet, writing to a new code buffer
+static void gen_start(ClmCodeGen *gen, ClmCompiler *compiler,
+                      ClmScope *globalScope, int fd) {
+  memset(gen, 0, sizeof(*gen));
+  gen->compiler = compiler;
+  asm_set_target(gen, compiler->target);
+  asm_set_simd(gen, compiler->simd);
+  gen->scope = globalScope;
+  gen->fd = fd;
+  gen->code = string_buffer_new();
+  gen->section = gen->code;
+}
+
+// frees what the generators keep while generating, which an error can leave
+// in the middle of an expression. the code buffers are the caller's
+static void gen_end(ClmCodeGen *gen) {
+  array_list_free(gen->reg.instrs);
+  gen->reg.instrs = NULL;
+  array_list_free(gen->fuse.leaves);
+  gen->fuse.leaves = NULL;
+}
+
+// generates a function into its own buffer, with a code generator of its own
+static void gen_function_alone(ClmCompiler *compiler, ClmScope *globalScope,
+                               GeneratedFunction *function) {
+  ClmCodeGen gen;
+  gen_start(&gen, compiler, globalScope, -1);
+  gen_function(&gen, function->node);
+  gen_end(&gen);
+
+  function->code = gen.code;
+  function->spillSlots = gen_scalar_spill_slots(&gen);
+  function->gemmUsed = gen_gemm_used(&gen);
+}
+
+static void gen_function_work(void *arg, int index) {
+  FunctionsWork *work = arg;
+  GeneratedFunction *function = &work->functions[index];
+  const char *cache = work->compiler->functionCache;
+  char key[CLM_CACHE_KEY_SIZE];
+
+  if (cache != NULL) {
+    clm_cache_function_key(work->compiler, function->node, key);
+    if (load_function(cache, key, function))
+      return;
+  }
+
+  gen_function_alone(work->compiler, work->globalScope, function);
+  if (cache != NULL)
+    store_function(cache, key, function);
+}
+
+// appends the functions in the order they were declared
+static void append_functions(ClmCodeGen *gen, GeneratedFunction *functions,
+                             int count) {
+  int i;
+  for (i = 0; i < count; i++) {
+    StringBuffer *code = functions[i].code;
+    string_buffer_append_n(gen->code, code->data, code->length);
+    flush_if_full(gen);
+    gen_scalar_reserve_spill_slots(gen, functions[i].spillSlots);
+    if (functions[i].gemmUsed)
+      gen_gemm_set_used(gen);
+    string_buffer_free(code);
+  }
+}
+
+// generates the functions into buffers of their own on up to threads threads,
+// a batch at a time, and appends each batch in order as soon as it is done
+static void gen_functions_parallel(ClmCodeGen *gen, ArrayList *nodes,
+                                   ClmScope *globalScope, int threads) {
+  int batch = threads * FUNCTIONS_PER_THREAD;
+  GeneratedFunction *functions = malloc(batch * sizeof(*functions));
+  FunctionsWork work = {gen->compiler, globalScope, functions};
+  int first, i;
+
+  cache_global_types(gen->compiler, globalScope);
+  for (first = 0; first < nodes->length; first += batch) {
+    int count = nodes->length - first < batch ? nodes->length - first : batch;
+    memset(functions, 0, count * sizeof(*functions));
+    for (i = 0; i < count; i++)
+      functions[i].node = nodes->data[first + i];
+    clm_parallel_for(count, threads, gen_function_work, &work);
+    append_functions(gen, functions, count);
+  }
+  free(functions);
+}
+
+// the imported functions, when they were generated ahead of time
+static void append_imports(ClmCodeGen *gen, const ClmGeneratedCode *imports) {
+  if (imports == NULL)
+    return;
+  string_buffer_append_n(gen->code, imports->code->data,
+                         imports->code->length);
+  flush_if_full(gen);
+  gen_scalar_reserve_spill_slots(gen, imports->spillSlots);
+  if (imports->gemmUsed)
+    gen_gemm_set_used(gen);
+}
+
+// the functions of imported modules that the program uses, as they were
+// generated with their module
+static void append_module_functions(ClmCodeGen *gen, ClmCompiler *compiler) {
+  int i, j;
+  if (compiler->modules == NULL)
+    return;
+  for (i = 0; i < compiler->modules->length; i++) {
+    ClmModule *module = compiler->modules->data[i];
+    for (j = 0; j < module->functionsLength; j++) {
+      ClmModuleFunction *function = &module->functions[j];
+      if (!function->used)
+        continue;
+      string_buffer_append_n(gen->code, function->code, function->codeLength);
+      flush_if_full(gen);
+      gen_scalar_reserve_spill_slots(gen, function->spillSlots);
+      if (function->gemmUsed)
+        gen_gemm_set_used(gen);
     }
   }
 }
 
-static void gen_statements(ArrayList *statements) {
+static void gen_statements(ClmCodeGen *gen, ArrayList *statements) {
   int i;
   for (i = 0; i < statements->length; i++) {
     ClmStmtNode *node = statements->data[i];
     if (node->type != STMT_TYPE_FUNC_DEC) {
-      gen_statement(node);
+      gen_statement(gen, node);
     }
   }
 }
 
 static void gen_macros() {}
 
-const char *clm_code_gen_main(ArrayList *statements, ClmScope *globalScope) {
-  data.scope = globalScope;
-  data.labelID = 0;
-  data.temporaryID = 0;
-  data.inFunction = 0;
-  data.size = strlen(ASM_HEADER) + 1;
-  data.capacity = data.size;
-  data.code = malloc(strlen(ASM_HEADER) + 1);
-  strcpy(data.code, ASM_HEADER);
+// a program being generated, and what it is generated from
+typedef struct {
+  ClmCodeGen gen;
+  ArrayList *statements;
+  ArrayList *functions; // see program_functions
+  ClmScope *globalScope;
+} ProgramWork;
+
+static void gen_program_text(void *arg) {
+  ProgramWork *work = arg;
+  ClmCodeGen *gen = &work->gen;
+  ClmCompiler *compiler = gen->compiler;
+  ArrayList *nodes = work->functions;
+  asm_header(gen);
+
+  // with more than one thread, or a cache to reuse them from, the functions
+  // are generated a batch at a time, each into its own buffer. otherwise they
+  // are streamed like the rest of the program. errors can't jump between
+  // threads, so when they are recovered from the functions are generated here
+  int threads = compiler->threads > 0 ? compiler->threads : clm_cpu_count();
+  append_module_functions(gen, compiler);
+  append_imports(gen, compiler->importsCode);
+  if (compiler->recover == NULL &&
+      ((threads > 1 && nodes->length > 1) ||
+       (compiler->functionCache != NULL && nodes->length > 0)))
+    gen_functions_parallel(gen, nodes, work->globalScope, threads);
+  else
+    gen_functions(gen, nodes);
+
+  asm_start(gen);
+  gen_statements(gen, work->statements);
+
+  asm_exit_process(gen);
+  gen_gemm_routine(gen);
+
+  gen->section = gen->globals;
+  asm_data_section(gen);
+  gen_globals(gen, work->globalScope);
+  gen->section = gen->code;
+
+  // the data section goes after the program text
+  string_buffer_append_n(gen->code, gen->globals->data, gen->globals->length);
+  string_buffer_free(gen->globals);
+  gen->globals = NULL;
+  gen->section = NULL;
+  if (gen->fd < 0)
+    clm_count(compiler, CLM_COUNTER_ASM_BYTES, gen->code->length);
+  flush_code(gen);
+}
 
-  gen_functions(statements);
+// an error that is recovered from leaves the program half generated
+static void gen_program_error(void *arg) {
+  ProgramWork *work = arg;
+  gen_end(&work->gen);
+  string_buffer_free(work->gen.code);
+  string_buffer_free(work->gen.globals);
+  array_list_free(work->functions);
+}
 
-  writeLine(ASM_START);
-  gen_statements(statements);
+// returns the code buffer, which holds the whole program unless it was
+// streamed to fd
+static StringBuffer *gen_program(ClmCompiler *compiler, ArrayList *statements,
+                                 ClmScope *globalScope, int fd) {
+  ProgramWork work;
+  gen_start(&work.gen, compiler, globalScope, fd);
+  work.gen.globals = string_buffer_new();
+  work.statements = statements;
+  work.functions = program_functions(compiler, statements);
+  work.globalScope = globalScope;
+  clm_recover_with(compiler, gen_program_text, gen_program_error, &work);
+
+  gen_end(&work.gen);
+  array_list_free(work.functions);
+  return work.gen.code;
+}
 
-  writeLine(ASM_EXIT_PROCESS);
-  writeLine(ASM_DATA);
+char *clm_code_gen_main(ClmCompiler *compiler, ArrayList *statements,
+                        ClmScope *globalScope) {
+  StringBuffer *buffer = gen_program(compiler, statements, globalScope, -1);
+  // the buffer's string is handed over
+  char *code = buffer->data;
+  free(buffer);
+  return code;
+}
 
-  gen_globals(globalScope);
+void clm_code_gen_stream(ClmCompiler *compiler, ArrayList *statements,
+                         ClmScope *globalScope, int fd) {
+  string_buffer_free(gen_program(compiler, statements, globalScope, fd));
+}
 
-  return data.code;
+StringBuffer *clm_code_gen_function(ClmCompiler *compiler,
+                                    ClmStmtNode *function,
+                                    ClmScope *globalScope,
+                                    int *out_spill_slots, int *out_gemm_used) {
+  GeneratedFunction generated = {function, NULL, 0, 0};
+  gen_function_alone(compiler, globalScope, &generated);
+  *out_spill_slots = generated.spillSlots;
+  *out_gemm_used = generated.gemmUsed;
+  return generated.code;
 }
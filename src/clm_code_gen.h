@@ -0,0 +1,43 @@
+#ifndef CLM_CODE_GEN_H_
+#define CLM_CODE_GEN_H_
+
+#include "clm.h"
+#include "clm_asm.h"
+#include "clm_fuse_gen.h"
+#include "clm_gemm_gen.h"
+#include "clm_reg_gen.h"
+#include "clm_scope.h"
+
+//
+// Code generation
+//
+// everything the code generator keeps while it generates a program, or a
+// function on a worker thread. each is generated with its own, which is
+// passed to every generator and asm_* emitter, so generating two programs
+// at once shares nothing but the compiler's read-only tree
+//
+struct ClmCodeGen {
+  ClmCompiler *compiler;
+
+  // what the assembly is for, see asm_set_target and asm_set_simd
+  ClmTarget target;
+  ClmSimd simd;
+  const AsmTargetInfo *info;
+
+  StringBuffer *code;    // the program text
+  StringBuffer *globals; // the data section, emitted after the program text
+  StringBuffer *section; // the one being written to, code or globals
+  int fd;                // where code is streamed to, -1 to keep it in memory
+
+  ClmScope *scope;
+  ClmScope *functionScope; // the function being generated, NULL at the top
+  const char *function;    // the name of that function, NULL at the top
+  int argumentSize;        // bytes of arguments it pops when it returns
+  int labelID;
+
+  ClmRegGen reg;
+  ClmFuseGen fuse;
+  ClmGemmGen gemm;
+};
+
+#endif
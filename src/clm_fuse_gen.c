@@ -0,0 +1,433 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "clm_asm.h"
+#include "clm_code_gen.h"
+#include "clm_fuse_gen.h"
+#include "clm_type.h"
+#include "clm_type_gen.h"
+
+extern void next_label(ClmCodeGen *gen, char *buffer);
+extern void push_expression(ClmCodeGen *gen, ClmExpNode *node);
+extern int is_temporary(ClmCodeGen *gen, ClmExpNode *node);
+extern int is_view(ClmCodeGen *gen, ClmExpNode *node);
+
+// the expression is evaluated in xmm0 - xmm7 (or ymm), which exist on every
+// target. anything that needs more is generated an operator at a time
+#define FUSE_REGS 8
+
+// the slots between dest and the data of the matrix leaves
+#define ROWS_SLOT(gen, m) SLOT(gen, 2 * (m) + 1)
+#define COLS_SLOT(gen, m) SLOT(gen, 2 * (m))
+#define STRIDE_SLOT(gen, m, matrix) SLOT(gen, 2 * (m) - 1 - (matrix))
+
+static int is_elementwise(ClmCodeGen *gen, ClmExpNode *node) {
+  ClmType left, right;
+  switch (node->type) {
+  case EXP_TYPE_ARITH:
+    left = clm_type_of_exp(gen->compiler, node->arithExp.left, gen->fuse.scope);
+    right = clm_type_of_exp(gen->compiler, node->arithExp.right,
+                            gen->fuse.scope);
+    switch (node->arithExp.operand) {
+    case ARITH_OP_ADD:
+    case ARITH_OP_SUB:
+      return left == CLM_TYPE_MATRIX && right == CLM_TYPE_MATRIX;
+    case ARITH_OP_MULT:
+      return (left == CLM_TYPE_MATRIX && right == CLM_TYPE_INT) ||
+             (left == CLM_TYPE_INT && right == CLM_TYPE_MATRIX);
+    default:
+      return 0;
+    }
+  case EXP_TYPE_UNARY:
+    return node->unaryExp.operand == UNARY_OP_MINUS &&
+           clm_type_of_exp(gen->compiler, node->unaryExp.node,
+                           gen->fuse.scope) ==
+               CLM_TYPE_MATRIX;
+  default:
+    return 0;
+  }
+}
+
+// the matrix operand of a scaling
+static ClmExpNode *scaled_matrix(ClmCodeGen *gen, ClmExpNode *node) {
+  if (clm_type_of_exp(gen->compiler, node->arithExp.left,
+                      gen->fuse.scope) == CLM_TYPE_MATRIX)
+    return node->arithExp.left;
+  return node->arithExp.right;
+}
+
+static ClmExpNode *scale(ClmCodeGen *gen, ClmExpNode *node) {
+  if (clm_type_of_exp(gen->compiler, node->arithExp.left,
+                      gen->fuse.scope) == CLM_TYPE_MATRIX)
+    return node->arithExp.right;
+  return node->arithExp.left;
+}
+
+static int max(int a, int b) { return a > b ? a : b; }
+
+// how many vector registers evaluating node takes, when the operand that
+// needs more of them is evaluated first
+static int registers_needed(ClmCodeGen *gen, ClmExpNode *node) {
+  int left, right;
+  if (!is_elementwise(gen, node))
+    return 1;
+
+  if (node->type == EXP_TYPE_UNARY)
+    return max(registers_needed(gen, node->unaryExp.node), 2);
+
+  if (node->arithExp.operand == ARITH_OP_MULT) {
+    // the scale and sse2's scratch register
+    int scaling = asm_get_simd(gen) == CLM_SIMD_AVX2 ? 2 : 3;
+    return max(registers_needed(gen, scaled_matrix(gen, node)), scaling);
+  }
+
+  left = registers_needed(gen, node->arithExp.left);
+  right = registers_needed(gen, node->arithExp.right);
+  return left == right ? left + 1 : max(left, right);
+}
+
+int gen_fused_supported(ClmCodeGen *gen, ClmExpNode *node, ClmScope *scope) {
+  gen->fuse.scope = scope;
+  if (!is_elementwise(gen, node))
+    return 0;
+  if (registers_needed(gen, node) > FUSE_REGS)
+    return 0;
+
+  // a single operator is already one pass
+  if (node->type == EXP_TYPE_UNARY)
+    return is_elementwise(gen, node->unaryExp.node);
+  return is_elementwise(gen, node->arithExp.left) ||
+         is_elementwise(gen, node->arithExp.right);
+}
+
+// the leaves of the expression being generated are the end of the list, from
+// first on. the ones before are the leaves of the expressions it is inside
+static int leaf_count(ClmCodeGen *gen) {
+  return gen->fuse.leaves->length - gen->fuse.first;
+}
+
+static ClmExpNode *leaf_node(ClmCodeGen *gen, int leaf) {
+  return gen->fuse.leaves->data[gen->fuse.first + leaf];
+}
+
+static void collect_leaves(ClmCodeGen *gen, ClmExpNode *node) {
+  if (!is_elementwise(gen, node)) {
+    array_list_push(gen->fuse.leaves, node);
+    if (clm_type_of_exp(gen->compiler, node,
+                        gen->fuse.scope) == CLM_TYPE_MATRIX)
+      gen->fuse.matrices++;
+    return;
+  }
+
+  if (node->type == EXP_TYPE_UNARY) {
+    collect_leaves(gen, node->unaryExp.node);
+  } else {
+    collect_leaves(gen, node->arithExp.left);
+    collect_leaves(gen, node->arithExp.right);
+  }
+}
+
+/*
+        once the loop is set up the stack looks like this
+
+        leaf 0
+        leaf 0 type
+        ...
+        leaf n - 1
+        leaf n - 1 type
+        dest
+        rows
+        cols
+        stride of matrix leaf 0, in bytes
+        ...
+        stride of matrix leaf m - 1
+        data of matrix leaf 0
+        ...
+        data of matrix leaf m - 1 <- esp
+
+        extra is the number of slots above dest that are pushed so far
+*/
+static int leaf_offset(ClmCodeGen *gen, int leaf, int extra) {
+  return SLOT(gen, extra + 1 + 2 * (leaf_count(gen) - 1 - leaf) + 1);
+}
+
+// the index of the leaf among the matrix leaves
+static int matrix_index(ClmCodeGen *gen, int leaf) {
+  int i, index = 0;
+  for (i = 0; i < leaf; i++) {
+    if (clm_type_of_exp(gen->compiler, leaf_node(gen, i), gen->fuse.scope) ==
+        CLM_TYPE_MATRIX)
+      index++;
+  }
+  return index;
+}
+
+static int leaf_index(ClmCodeGen *gen, ClmExpNode *node) {
+  int i;
+  for (i = 0; i < leaf_count(gen); i++) {
+    if (leaf_node(gen, i) == node)
+      return i;
+  }
+  return -1;
+}
+
+// formats [base+ecx*4]
+static void vector_element(ClmCodeGen *gen, char *out, const char *base) {
+  sprintf(out, "[%s+%s*%d]", base, ECX(gen), MAT_ELEMENT_SIZE);
+}
+
+// loads element ecx of a leaf into vector register reg, or just its lowest
+// lane. an int is copied into every lane
+static void gen_leaf(ClmCodeGen *gen, ClmExpNode *node, int reg, int lane) {
+  char location[64];
+  int leaf = leaf_index(gen, node);
+
+  if (clm_type_of_exp(gen->compiler, node, gen->fuse.scope) == CLM_TYPE_INT) {
+    asm_mem_dword(gen, location, ESP(gen),
+                  leaf_offset(gen, leaf, 2 * gen->fuse.matrices + 2), NULL);
+    asm_pbroadcastd(gen, asm_vector_reg(gen, reg), location);
+    return;
+  }
+
+  asm_mem(gen, location, ESP(gen),
+          SLOT(gen, gen->fuse.matrices - 1 - matrix_index(gen, leaf)), NULL);
+  asm_mov(gen, EAX(gen), location);
+  if (lane) {
+    matrix_element(gen, location, EAX(gen), ECX(gen));
+    asm_movd_lane(gen, asm_xmm_reg(reg), location);
+  } else {
+    vector_element(gen, location, EAX(gen));
+    asm_movdqu(gen, asm_vector_reg(gen, reg), location);
+  }
+}
+
+// evaluates node into vector register reg, using the registers after it
+static void gen_node(ClmCodeGen *gen, ClmExpNode *node, int reg, int lane) {
+  const char *value = asm_vector_reg(gen, reg);
+  const char *other = asm_vector_reg(gen, reg + 1);
+
+  if (!is_elementwise(gen, node)) {
+    gen_leaf(gen, node, reg, lane);
+    return;
+  }
+
+  if (node->type == EXP_TYPE_UNARY) {
+    gen_node(gen, node->unaryExp.node, reg, lane);
+    gen_vector_neg(gen, value, other);
+    return;
+  }
+
+  if (node->arithExp.operand == ARITH_OP_MULT) {
+    gen_node(gen, scaled_matrix(gen, node), reg, lane);
+    gen_leaf(gen, scale(gen, node), reg + 1, lane);
+    gen_vector_mul_int(gen, value, other, asm_vector_reg(gen, reg + 2));
+    return;
+  }
+
+  if (registers_needed(gen, node->arithExp.left) >=
+      registers_needed(gen, node->arithExp.right)) {
+    gen_node(gen, node->arithExp.left, reg, lane);
+    gen_node(gen, node->arithExp.right, reg + 1, lane);
+    if (node->arithExp.operand == ARITH_OP_ADD)
+      asm_paddd(gen, value, other);
+    else
+      asm_psubd(gen, value, other);
+  } else {
+    gen_node(gen, node->arithExp.right, reg, lane);
+    gen_node(gen, node->arithExp.left, reg + 1, lane);
+    if (node->arithExp.operand == ARITH_OP_ADD) {
+      asm_paddd(gen, value, other);
+    } else {
+      asm_psubd(gen, other, value);
+      asm_movdqa(gen, value, other);
+    }
+  }
+}
+
+/*
+        push every leaf
+        dest = the first temporary matrix leaf that isn't a view, otherwise a
+               new matrix
+        push dest, its rows and cols
+        push the stride and then the data of every matrix leaf
+
+        if every matrix leaf is contiguous
+                rows = 1, cols = rows * cols
+        ebx = dest.data
+        while rows != 0
+                ecx = cols
+                while ecx % lanes != 0
+                        ecx--
+                        dest.data[ecx] = node, in the lowest lane
+                while ecx != 0
+                        ecx -= lanes
+                        dest.data[ecx:ecx + lanes] = node
+                ebx += cols
+                the data of every matrix leaf += its stride
+                rows--
+
+        pop the data, strides, rows, cols and dest
+        free the temporary leaves other than dest
+        pop the leaves
+        push dest
+*/
+void gen_fused_expression(ClmCodeGen *gen, ClmExpNode *node, ClmScope *scope) {
+  char strided_label[LABEL_SIZE], row_label[LABEL_SIZE], row_end[LABEL_SIZE];
+  char tail_label[LABEL_SIZE], vector_label[LABEL_SIZE], end_label[LABEL_SIZE];
+  char location[64], rows[64], cols[64], mask[16];
+  int i, j, m, dest = -1, first_matrix = -1;
+  int lanes = asm_vector_lanes(gen);
+  next_label(gen, strided_label);
+  next_label(gen, row_label);
+  next_label(gen, row_end);
+  next_label(gen, tail_label);
+  next_label(gen, vector_label);
+  next_label(gen, end_label);
+
+  // pushing a leaf can generate another fused expression, whose leaves go
+  // after these
+  ClmFuseGen enclosing = gen->fuse;
+  if (gen->fuse.leaves == NULL)
+    gen->fuse.leaves = array_list_new(NULL);
+  gen->fuse.scope = scope;
+  gen->fuse.first = gen->fuse.leaves->length;
+  gen->fuse.matrices = 0;
+  collect_leaves(gen, node);
+  m = gen->fuse.matrices;
+
+  for (i = 0; i < leaf_count(gen); i++) {
+    ClmExpNode *leaf = leaf_node(gen, i);
+    push_expression(gen, leaf);
+    if (clm_type_of_exp(gen->compiler, leaf, scope) != CLM_TYPE_MATRIX)
+      continue;
+    if (first_matrix == -1)
+      first_matrix = i;
+    if (dest == -1 && is_temporary(gen, leaf) && !is_view(gen, leaf))
+      dest = i;
+  }
+
+  if (dest != -1) {
+    asm_mem(gen, location, ESP(gen), leaf_offset(gen, dest, -1), NULL);
+    asm_push(gen, location);
+  } else {
+    asm_mem(gen, location, ESP(gen), leaf_offset(gen, first_matrix, -1), NULL);
+    asm_mov(gen, ESI(gen), location);
+    matrix_field(gen, rows, ESI(gen), MAT_ROWS);
+    matrix_field(gen, cols, ESI(gen), MAT_COLS);
+    gen_mat_new(gen, rows, cols, 0);
+    asm_push(gen, EAX(gen));
+  }
+
+  asm_mem(gen, location, ESP(gen), 0, NULL);
+  asm_mov(gen, EAX(gen), location);
+  matrix_field(gen, location, EAX(gen), MAT_ROWS);
+  asm_push(gen, location);
+  matrix_field(gen, location, EAX(gen), MAT_COLS);
+  asm_push(gen, location);
+
+  for (i = 0, j = 0; i < leaf_count(gen); i++) {
+    if (clm_type_of_exp(gen->compiler, leaf_node(gen, i), scope) !=
+        CLM_TYPE_MATRIX)
+      continue;
+    asm_mem(gen, location, ESP(gen), leaf_offset(gen, i, 2 + j), NULL);
+    asm_mov(gen, EAX(gen), location);
+    matrix_field(gen, location, EAX(gen), MAT_STRIDE);
+    asm_mov(gen, EAX(gen), location);
+    asm_imul_i(gen, EAX(gen), MAT_ELEMENT_SIZE);
+    asm_push(gen, EAX(gen));
+    j++;
+  }
+
+  for (i = 0, j = 0; i < leaf_count(gen); i++) {
+    if (clm_type_of_exp(gen->compiler, leaf_node(gen, i), scope) !=
+        CLM_TYPE_MATRIX)
+      continue;
+    asm_mem(gen, location, ESP(gen), leaf_offset(gen, i, 2 + m + j), NULL);
+    asm_mov(gen, EAX(gen), location);
+    matrix_field(gen, location, EAX(gen), MAT_DATA);
+    asm_push(gen, location);
+    j++;
+  }
+
+  // dest is contiguous, so every leaf has to be for the rows to be one
+  asm_mem(gen, rows, ESP(gen), ROWS_SLOT(gen, m), NULL);
+  asm_mem(gen, cols, ESP(gen), COLS_SLOT(gen, m), NULL);
+  asm_mov(gen, EDX(gen), cols);
+  asm_imul_i(gen, EDX(gen), MAT_ELEMENT_SIZE);
+  for (j = 0; j < m; j++) {
+    asm_mem(gen, location, ESP(gen), STRIDE_SLOT(gen, m, j), NULL);
+    asm_cmp(gen, EDX(gen), location);
+    asm_jmp_neq(gen, strided_label);
+  }
+  asm_mov(gen, EAX(gen), rows);
+  asm_imul(gen, EAX(gen), cols);
+  asm_mov(gen, cols, EAX(gen));
+  asm_mov_i(gen, rows, 1);
+
+  // edx = the size of a row of dest in bytes
+  asm_label(gen, strided_label);
+  asm_mem(gen, location, ESP(gen), SLOT(gen, 2 * m + 2), NULL);
+  asm_mov(gen, EAX(gen), location);
+  matrix_field(gen, location, EAX(gen), MAT_DATA);
+  asm_mov(gen, EBX(gen), location);
+  asm_mov(gen, EDX(gen), cols);
+  asm_imul_i(gen, EDX(gen), MAT_ELEMENT_SIZE);
+
+  sprintf(mask, "%d", lanes - 1);
+  asm_label(gen, row_label);
+  asm_cmp(gen, rows, "0");
+  asm_jmp_eq(gen, end_label);
+  asm_mov(gen, ECX(gen), cols);
+
+  asm_label(gen, tail_label);
+  asm_mov(gen, EAX(gen), ECX(gen));
+  asm_and(gen, EAX(gen), mask);
+  asm_cmp(gen, EAX(gen), "0");
+  asm_jmp_eq(gen, vector_label);
+  asm_dec(gen, ECX(gen));
+  gen_node(gen, node, 0, 1);
+  matrix_element(gen, location, EBX(gen), ECX(gen));
+  asm_movd_lane(gen, location, asm_xmm_reg(0));
+  asm_jmp(gen, tail_label);
+
+  asm_label(gen, vector_label);
+  asm_cmp(gen, ECX(gen), "0");
+  asm_jmp_eq(gen, row_end);
+  asm_sub_i(gen, ECX(gen), lanes);
+  gen_node(gen, node, 0, 0);
+  vector_element(gen, location, EBX(gen));
+  asm_movdqu(gen, location, asm_vector_reg(gen, 0));
+  asm_jmp(gen, vector_label);
+
+  asm_label(gen, row_end);
+  asm_add(gen, EBX(gen), EDX(gen));
+  for (j = 0; j < m; j++) {
+    asm_mem(gen, location, ESP(gen), STRIDE_SLOT(gen, m, j), NULL);
+    asm_mov(gen, EAX(gen), location);
+    asm_mem(gen, location, ESP(gen), SLOT(gen, m - 1 - j), NULL);
+    asm_add(gen, location, EAX(gen));
+  }
+  asm_dec(gen, rows);
+  asm_jmp(gen, row_label);
+
+  asm_label(gen, end_label);
+  if (asm_get_simd(gen) == CLM_SIMD_AVX2)
+    asm_vzeroupper(gen);
+
+  asm_add_i(gen, ESP(gen), SLOT(gen, 2 * m + 2));
+  asm_pop(gen, EBX(gen));
+  for (i = 0; i < leaf_count(gen); i++) {
+    if (i == dest || !is_temporary(gen, leaf_node(gen, i)))
+      continue;
+    asm_mem(gen, location, ESP(gen), leaf_offset(gen, i, -1), NULL);
+    asm_mov(gen, EAX(gen), location);
+    asm_free(gen, EAX(gen));
+  }
+  asm_add_i(gen, ESP(gen), SLOT(gen, 2 * leaf_count(gen)));
+  asm_push(gen, EBX(gen));
+  asm_push_const_i(gen, (int)CLM_TYPE_MATRIX);
+
+  gen->fuse.leaves->length = gen->fuse.first;
+  enclosing.leaves = gen->fuse.leaves;
+  gen->fuse = enclosing;
+}
@@ -0,0 +1,39 @@
+#ifndef CLM_FUSE_GEN_H
+#define CLM_FUSE_GEN_H
+
+#include "clm_asm.h"
+#include "clm_ast.h"
+#include "clm_scope.h"
+
+//
+// Fused matrix expressions
+//
+// a tree of element-wise matrix operations, like A + B - C * 2, would
+// otherwise make a pass over memory and a temporary for every operator. the
+// operands that aren't element-wise operations (variables, calls, products,
+// int scalars...) are evaluated first, and then one loop computes each
+// element of the result from the same element of every operand, in vector
+// registers
+//
+
+// the part of the ClmCodeGen that is the fused generator's
+typedef struct ClmFuseGen {
+  ClmScope *scope;
+  // ArrayList of ClmExpNode, in the order they are pushed. the leaves of the
+  // expression being generated start at first, the ones before are those of
+  // the expressions it is a leaf of. made by the first fused expression and
+  // kept until the code generator is done with
+  ArrayList *leaves;
+  int first;
+  int matrices; // how many of the leaves are matrices
+} ClmFuseGen;
+
+// returns 1 if node is an element-wise operation on matrices with at least
+// one more element-wise operation below it, that gen_fused_expression can
+// generate
+int gen_fused_supported(ClmCodeGen *gen, ClmExpNode *node, ClmScope *scope);
+
+// evaluates node and pushes the resulting matrix, a temporary, and its type
+void gen_fused_expression(ClmCodeGen *gen, ClmExpNode *node, ClmScope *scope);
+
+#endif
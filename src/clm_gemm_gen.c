@@ -0,0 +1,683 @@
+#include <stdio.h>
+
+#include "clm_asm.h"
+#include "clm_code_gen.h"
+#include "clm_gemm_gen.h"
+#include "clm_type_gen.h"
+
+extern void next_label(ClmCodeGen *gen, char *buffer);
+
+// block sizes, in elements. a KC x NR strip of packed B stays in L1 while a
+// tile is computed, MC x KC of packed A stays in L2 and KC x NC of packed B
+// in L3
+#define KC 256
+#define MC 64
+#define NC 1024
+
+// the routine keeps its state in its stack frame, these are the slots
+// below ebp. strides are kept in bytes
+enum {
+  F_A_DATA,
+  F_A_STRIDE,
+  F_B_DATA,
+  F_B_STRIDE,
+  F_C_DATA,
+  F_C_STRIDE,
+  F_M,
+  F_N,
+  F_K,
+  F_A_PACKED,
+  F_B_PACKED,
+  F_JC,
+  F_PC,
+  F_IC,
+  F_NC,
+  F_KC,
+  F_MC,
+  F_JR,
+  F_IR,
+  F_VALID,
+  F_SLOTS
+};
+
+int gen_gemm_used(ClmCodeGen *gen) { return gen->gemm.used; }
+
+void gen_gemm_set_used(ClmCodeGen *gen) { gen->gemm.used = 1; }
+
+void gen_gemm_call(ClmCodeGen *gen) {
+  gen->gemm.used = 1;
+  asm_call_routine(gen, GEMM);
+}
+
+static void frame(ClmCodeGen *gen, char *out, int field) {
+  asm_mem(gen, out, EBP(gen), -SLOT(gen, field + 1), NULL);
+}
+
+// an unsized memory operand, for vector loads and stores
+static void vector_mem(char *out, const char *base, int offset) {
+  sprintf(out, "[%s%+d]", base, offset);
+}
+
+/*
+   sse2 can only multiply the even lanes of two vectors, into 64 bit
+   products. the low halves of those are the 32 bit products, so each row
+   has an accumulator for the even columns and one for the odd columns,
+   which are shifted down into the even lanes, and they are interleaved
+   back together once the tile is done. avx2 has a full 32 bit multiply
+*/
+static void setup_tile(ClmCodeGen *gen) {
+  GemmTile *tile = &gen->gemm.tile;
+  int many = asm_vector_regs(gen) >= 16;
+  if (asm_get_simd(gen) == CLM_SIMD_AVX2) {
+    tile->mr = many ? 4 : 2;
+    tile->vectors = 2;
+    tile->accs = 2;
+  } else {
+    tile->mr = many ? 4 : 2;
+    tile->vectors = 1;
+    tile->accs = 2;
+  }
+  tile->width = asm_vector_lanes(gen) * MAT_ELEMENT_SIZE;
+  tile->nr = tile->vectors * asm_vector_lanes(gen);
+  tile->b = tile->mr * tile->accs;
+  tile->s = tile->b + (asm_get_simd(gen) == CLM_SIMD_AVX2 ? tile->vectors : 2);
+  tile->t = tile->s + 1;
+  tile->tileSize = tile->mr * tile->nr * MAT_ELEMENT_SIZE;
+}
+
+static const char *acc(ClmCodeGen *gen, int row, int n) {
+  return asm_vector_reg(gen, row * gen->gemm.tile.accs + n);
+}
+
+static int tile_offset(ClmCodeGen *gen) {
+  return -(SLOT(gen, F_SLOTS) + gen->gemm.tile.tileSize);
+}
+
+// field = min(block, limit - start)
+static void gen_block_size(ClmCodeGen *gen, int field, int limit, int start,
+                           int block) {
+  char location[64], block_str[16];
+  char end_label[LABEL_SIZE];
+  next_label(gen, end_label);
+  sprintf(block_str, "%d", block);
+
+  frame(gen, location, limit);
+  asm_mov(gen, EAX(gen), location);
+  frame(gen, location, start);
+  asm_sub(gen, EAX(gen), location);
+  asm_cmp(gen, EAX(gen), block_str);
+  asm_jmp_le(gen, end_label);
+  asm_mov_i(gen, EAX(gen), block);
+  asm_label(gen, end_label);
+  frame(gen, location, field);
+  asm_mov(gen, location, EAX(gen));
+}
+
+/*
+   packs B[pc:pc+kc, jc:jc+nc] into strips nr columns wide, each stored a
+   row at a time. columns past the end of B are 0
+
+   for(jr = 0, jr < nc, jr += nr)
+           for(ecx = 0, ecx < kc, ecx++)
+                   for(edx = 0, edx < nr, edx++)
+                           *edi++ = B[pc + ecx, jc + jr + edx]
+*/
+static void gen_pack_b(ClmCodeGen *gen) {
+  char strip_label[LABEL_SIZE], row_label[LABEL_SIZE], col_label[LABEL_SIZE];
+  char store_label[LABEL_SIZE], row_end[LABEL_SIZE], strip_end[LABEL_SIZE];
+  char end_label[LABEL_SIZE];
+  char location[64], element[64], dest[64], nr[16];
+  next_label(gen, strip_label);
+  next_label(gen, row_label);
+  next_label(gen, col_label);
+  next_label(gen, store_label);
+  next_label(gen, row_end);
+  next_label(gen, strip_end);
+  next_label(gen, end_label);
+  sprintf(nr, "%d", gen->gemm.tile.nr);
+  matrix_element(gen, element, ESI(gen), EDX(gen));
+  asm_mem_dword(gen, dest, EDI(gen), 0, NULL);
+
+  frame(gen, location, F_B_PACKED);
+  asm_mov(gen, EDI(gen), location);
+  frame(gen, location, F_JR);
+  asm_mov_i(gen, location, 0);
+
+  asm_label(gen, strip_label);
+  asm_mov(gen, EAX(gen), location);
+  frame(gen, location, F_NC);
+  asm_cmp(gen, EAX(gen), location);
+  asm_jmp_ge(gen, end_label);
+
+  // the number of columns left in B
+  frame(gen, location, F_N);
+  asm_mov(gen, EAX(gen), location);
+  frame(gen, location, F_JC);
+  asm_sub(gen, EAX(gen), location);
+  frame(gen, location, F_JR);
+  asm_sub(gen, EAX(gen), location);
+  frame(gen, location, F_VALID);
+  asm_mov(gen, location, EAX(gen));
+
+  // esi = &B[pc, jc + jr]
+  frame(gen, location, F_PC);
+  asm_mov(gen, ESI(gen), location);
+  frame(gen, location, F_B_STRIDE);
+  asm_imul(gen, ESI(gen), location);
+  frame(gen, location, F_JC);
+  asm_mov(gen, EAX(gen), location);
+  frame(gen, location, F_JR);
+  asm_add(gen, EAX(gen), location);
+  asm_imul_i(gen, EAX(gen), MAT_ELEMENT_SIZE);
+  asm_add(gen, ESI(gen), EAX(gen));
+  frame(gen, location, F_B_DATA);
+  asm_add(gen, ESI(gen), location);
+
+  asm_mov_i(gen, ECX(gen), 0);
+  asm_label(gen, row_label);
+  frame(gen, location, F_KC);
+  asm_cmp(gen, ECX(gen), location);
+  asm_jmp_ge(gen, strip_end);
+
+  asm_mov_i(gen, EDX(gen), 0);
+  asm_label(gen, col_label);
+  asm_cmp(gen, EDX(gen), nr);
+  asm_jmp_ge(gen, row_end);
+
+  asm_xor(gen, EAX(gen), EAX(gen));
+  frame(gen, location, F_VALID);
+  asm_cmp(gen, EDX(gen), location);
+  asm_jmp_ge(gen, store_label);
+  asm_mov(gen, asm_reg_dword(REG_A), element);
+  asm_label(gen, store_label);
+  asm_mov(gen, dest, asm_reg_dword(REG_A));
+  asm_add_i(gen, EDI(gen), MAT_ELEMENT_SIZE);
+
+  asm_inc(gen, EDX(gen));
+  asm_jmp(gen, col_label);
+
+  asm_label(gen, row_end);
+  frame(gen, location, F_B_STRIDE);
+  asm_add(gen, ESI(gen), location);
+  asm_inc(gen, ECX(gen));
+  asm_jmp(gen, row_label);
+
+  asm_label(gen, strip_end);
+  frame(gen, location, F_JR);
+  asm_add_i(gen, location, gen->gemm.tile.nr);
+  asm_jmp(gen, strip_label);
+
+  asm_label(gen, end_label);
+}
+
+/*
+   packs A[ic:ic+mc, pc:pc+kc] into strips mr rows tall, each stored a
+   column at a time. rows past the end of the block are 0
+
+   for(ir = 0, ir < mc, ir += mr)
+           for(ecx = 0, ecx < kc, ecx++)
+                   for(edx = 0, edx < mr, edx++)
+                           *edi++ = A[ic + ir + edx, pc + ecx]
+*/
+static void gen_pack_a(ClmCodeGen *gen) {
+  char strip_label[LABEL_SIZE], col_label[LABEL_SIZE], row_label[LABEL_SIZE];
+  char store_label[LABEL_SIZE], col_end[LABEL_SIZE], strip_end[LABEL_SIZE];
+  char end_label[LABEL_SIZE];
+  char location[64], element[64], dest[64], mr[16], column[64];
+  next_label(gen, strip_label);
+  next_label(gen, col_label);
+  next_label(gen, row_label);
+  next_label(gen, store_label);
+  next_label(gen, col_end);
+  next_label(gen, strip_end);
+  next_label(gen, end_label);
+  sprintf(mr, "%d", gen->gemm.tile.mr);
+  asm_mem_dword(gen, element, EBX(gen), 0, NULL);
+  asm_mem_dword(gen, dest, EDI(gen), 0, NULL);
+
+  frame(gen, location, F_A_PACKED);
+  asm_mov(gen, EDI(gen), location);
+  frame(gen, location, F_IR);
+  asm_mov_i(gen, location, 0);
+
+  asm_label(gen, strip_label);
+  asm_mov(gen, EAX(gen), location);
+  frame(gen, location, F_MC);
+  asm_cmp(gen, EAX(gen), location);
+  asm_jmp_ge(gen, end_label);
+
+  // the number of rows left in the block
+  asm_mov(gen, EAX(gen), location);
+  frame(gen, location, F_IR);
+  asm_sub(gen, EAX(gen), location);
+  frame(gen, location, F_VALID);
+  asm_mov(gen, location, EAX(gen));
+
+  // esi = &A[ic + ir, pc]
+  frame(gen, location, F_IC);
+  asm_mov(gen, ESI(gen), location);
+  frame(gen, location, F_IR);
+  asm_add(gen, ESI(gen), location);
+  frame(gen, location, F_A_STRIDE);
+  asm_imul(gen, ESI(gen), location);
+  frame(gen, location, F_PC);
+  asm_mov(gen, EAX(gen), location);
+  asm_imul_i(gen, EAX(gen), MAT_ELEMENT_SIZE);
+  asm_add(gen, ESI(gen), EAX(gen));
+  frame(gen, location, F_A_DATA);
+  asm_add(gen, ESI(gen), location);
+
+  asm_mov_i(gen, ECX(gen), 0);
+  asm_label(gen, col_label);
+  frame(gen, location, F_KC);
+  asm_cmp(gen, ECX(gen), location);
+  asm_jmp_ge(gen, strip_end);
+
+  // ebx walks down the column
+  sprintf(column, "[%s+%s*%d]", ESI(gen), ECX(gen), MAT_ELEMENT_SIZE);
+  asm_lea(gen, EBX(gen), column);
+  asm_mov_i(gen, EDX(gen), 0);
+  asm_label(gen, row_label);
+  asm_cmp(gen, EDX(gen), mr);
+  asm_jmp_ge(gen, col_end);
+
+  asm_xor(gen, EAX(gen), EAX(gen));
+  frame(gen, location, F_VALID);
+  asm_cmp(gen, EDX(gen), location);
+  asm_jmp_ge(gen, store_label);
+  asm_mov(gen, asm_reg_dword(REG_A), element);
+  asm_label(gen, store_label);
+  asm_mov(gen, dest, asm_reg_dword(REG_A));
+  asm_add_i(gen, EDI(gen), MAT_ELEMENT_SIZE);
+  frame(gen, location, F_A_STRIDE);
+  asm_add(gen, EBX(gen), location);
+
+  asm_inc(gen, EDX(gen));
+  asm_jmp(gen, row_label);
+
+  asm_label(gen, col_end);
+  asm_inc(gen, ECX(gen));
+  asm_jmp(gen, col_label);
+
+  asm_label(gen, strip_end);
+  frame(gen, location, F_IR);
+  asm_add_i(gen, location, gen->gemm.tile.mr);
+  asm_jmp(gen, strip_label);
+
+  asm_label(gen, end_label);
+}
+
+/*
+   the tile of C = the packed strip of A at esi * the packed strip of B at
+   edi, over ecx = kc steps
+
+   for(ecx = kc, ecx > 0, ecx--)
+           b = edi[0..nr]
+           for(r = 0, r < mr, r++)
+                   acc[r] += broadcast(esi[r]) * b
+           esi += mr
+           edi += nr
+*/
+static void gen_kernel(ClmCodeGen *gen) {
+  GemmTile *tile = &gen->gemm.tile;
+  char loop_label[LABEL_SIZE];
+  char location[64];
+  int r, v;
+  const char *s = asm_vector_reg(gen, tile->s);
+  const char *t = asm_vector_reg(gen, tile->t);
+  next_label(gen, loop_label);
+
+  for (r = 0; r < tile->mr; r++) {
+    for (v = 0; v < tile->accs; v++)
+      asm_pxor(gen, acc(gen, r, v), acc(gen, r, v));
+  }
+
+  asm_label(gen, loop_label);
+  if (asm_get_simd(gen) == CLM_SIMD_AVX2) {
+    for (v = 0; v < tile->vectors; v++) {
+      vector_mem(location, EDI(gen), v * tile->width);
+      asm_movdqu(gen, asm_vector_reg(gen, tile->b + v), location);
+    }
+    for (r = 0; r < tile->mr; r++) {
+      asm_mem_dword(gen, location, ESI(gen), r * MAT_ELEMENT_SIZE, NULL);
+      asm_pbroadcastd(gen, s, location);
+      for (v = 0; v < tile->vectors; v++) {
+        asm_movdqa(gen, t, s);
+        asm_pmulld(gen, t, asm_vector_reg(gen, tile->b + v));
+        asm_paddd(gen, acc(gen, r, v), t);
+      }
+    }
+  } else {
+    const char *even = asm_vector_reg(gen, tile->b);
+    const char *odd = asm_vector_reg(gen, tile->b + 1);
+    vector_mem(location, EDI(gen), 0);
+    asm_movdqu(gen, even, location);
+    asm_movdqa(gen, odd, even);
+    asm_psrlq(gen, odd, 32);
+    for (r = 0; r < tile->mr; r++) {
+      asm_mem_dword(gen, location, ESI(gen), r * MAT_ELEMENT_SIZE, NULL);
+      asm_pbroadcastd(gen, s, location);
+      asm_movdqa(gen, t, even);
+      asm_pmuludq(gen, t, s);
+      asm_paddd(gen, acc(gen, r, 0), t);
+      asm_movdqa(gen, t, odd);
+      asm_pmuludq(gen, t, s);
+      asm_paddd(gen, acc(gen, r, 1), t);
+    }
+  }
+  asm_add_i(gen, ESI(gen), tile->mr * MAT_ELEMENT_SIZE);
+  asm_add_i(gen, EDI(gen), tile->nr * MAT_ELEMENT_SIZE);
+  asm_dec(gen, ECX(gen));
+  asm_jmp_neq(gen, loop_label);
+
+  if (asm_get_simd(gen) != CLM_SIMD_AVX2) {
+    // interleave the even and odd columns back together
+    for (r = 0; r < tile->mr; r++) {
+      asm_pshufd(gen, acc(gen, r, 0), acc(gen, r, 0), 8);
+      asm_pshufd(gen, acc(gen, r, 1), acc(gen, r, 1), 8);
+      asm_punpckldq(gen, acc(gen, r, 0), acc(gen, r, 1));
+    }
+  }
+}
+
+/*
+   adds the tile to C[ic + ir, jc + jr]. a tile hanging off the edge of C is
+   stored on the stack, and only the part inside C is added
+*/
+static void gen_write_tile(ClmCodeGen *gen) {
+  GemmTile *tile = &gen->gemm.tile;
+  char partial_label[LABEL_SIZE], row_label[LABEL_SIZE], col_label[LABEL_SIZE];
+  char row_end[LABEL_SIZE], end_label[LABEL_SIZE];
+  char location[64], element[64], nr[16], mr[16];
+  int r, v;
+  next_label(gen, partial_label);
+  next_label(gen, row_label);
+  next_label(gen, col_label);
+  next_label(gen, row_end);
+  next_label(gen, end_label);
+  sprintf(mr, "%d", tile->mr);
+  sprintf(nr, "%d", tile->nr);
+
+  // edx = &C[ic + ir, jc + jr]
+  frame(gen, location, F_IC);
+  asm_mov(gen, EDX(gen), location);
+  frame(gen, location, F_IR);
+  asm_add(gen, EDX(gen), location);
+  frame(gen, location, F_C_STRIDE);
+  asm_imul(gen, EDX(gen), location);
+  frame(gen, location, F_JC);
+  asm_mov(gen, EAX(gen), location);
+  frame(gen, location, F_JR);
+  asm_add(gen, EAX(gen), location);
+  asm_imul_i(gen, EAX(gen), MAT_ELEMENT_SIZE);
+  asm_add(gen, EDX(gen), EAX(gen));
+  frame(gen, location, F_C_DATA);
+  asm_add(gen, EDX(gen), location);
+
+  frame(gen, location, F_MC);
+  asm_mov(gen, EAX(gen), location);
+  frame(gen, location, F_IR);
+  asm_sub(gen, EAX(gen), location);
+  asm_cmp(gen, EAX(gen), mr);
+  asm_jmp_l(gen, partial_label);
+  frame(gen, location, F_NC);
+  asm_mov(gen, EAX(gen), location);
+  frame(gen, location, F_JR);
+  asm_sub(gen, EAX(gen), location);
+  asm_cmp(gen, EAX(gen), nr);
+  asm_jmp_l(gen, partial_label);
+
+  for (r = 0; r < tile->mr; r++) {
+    for (v = 0; v < tile->vectors; v++) {
+      const char *t = asm_vector_reg(gen, tile->t);
+      vector_mem(location, EDX(gen), v * tile->width);
+      asm_movdqu(gen, t, location);
+      asm_paddd(gen, t, acc(gen, r, v));
+      asm_movdqu(gen, location, t);
+    }
+    frame(gen, location, F_C_STRIDE);
+    asm_add(gen, EDX(gen), location);
+  }
+  asm_jmp(gen, end_label);
+
+  asm_label(gen, partial_label);
+  for (r = 0; r < tile->mr; r++) {
+    for (v = 0; v < tile->vectors; v++) {
+      vector_mem(location, EBP(gen),
+                 tile_offset(gen) + (r * tile->nr * MAT_ELEMENT_SIZE) +
+                     v * tile->width);
+      asm_movdqu(gen, location, acc(gen, r, v));
+    }
+  }
+  vector_mem(location, EBP(gen), tile_offset(gen));
+  asm_lea(gen, ESI(gen), location);
+  matrix_element(gen, element, ESI(gen), EBX(gen));
+
+  asm_mov_i(gen, ECX(gen), 0);
+  asm_label(gen, row_label);
+  asm_cmp(gen, ECX(gen), mr);
+  asm_jmp_ge(gen, end_label);
+  frame(gen, location, F_MC);
+  asm_mov(gen, EAX(gen), location);
+  frame(gen, location, F_IR);
+  asm_sub(gen, EAX(gen), location);
+  asm_cmp(gen, ECX(gen), EAX(gen));
+  asm_jmp_ge(gen, end_label);
+
+  asm_mov_i(gen, EBX(gen), 0);
+  asm_label(gen, col_label);
+  asm_cmp(gen, EBX(gen), nr);
+  asm_jmp_ge(gen, row_end);
+  frame(gen, location, F_NC);
+  asm_mov(gen, EAX(gen), location);
+  frame(gen, location, F_JR);
+  asm_sub(gen, EAX(gen), location);
+  asm_cmp(gen, EBX(gen), EAX(gen));
+  asm_jmp_ge(gen, row_end);
+
+  asm_mov(gen, asm_reg_dword(REG_A), element);
+  matrix_element(gen, location, EDX(gen), EBX(gen));
+  asm_add(gen, location, asm_reg_dword(REG_A));
+  asm_inc(gen, EBX(gen));
+  asm_jmp(gen, col_label);
+
+  asm_label(gen, row_end);
+  frame(gen, location, F_C_STRIDE);
+  asm_add(gen, EDX(gen), location);
+  asm_add_i(gen, ESI(gen), tile->nr * MAT_ELEMENT_SIZE);
+  asm_inc(gen, ECX(gen));
+  asm_jmp(gen, row_label);
+
+  asm_label(gen, end_label);
+}
+
+/*
+   for(jr = 0, jr < nc, jr += nr)
+           for(ir = 0, ir < mc, ir += mr)
+                   C[ic + ir, jc + jr] += packed A strip ir * packed B strip jr
+*/
+static void gen_tiles(ClmCodeGen *gen) {
+  char jr_label[LABEL_SIZE], ir_label[LABEL_SIZE];
+  char jr_end[LABEL_SIZE], end_label[LABEL_SIZE];
+  char location[64];
+  next_label(gen, jr_label);
+  next_label(gen, ir_label);
+  next_label(gen, jr_end);
+  next_label(gen, end_label);
+
+  frame(gen, location, F_JR);
+  asm_mov_i(gen, location, 0);
+  asm_label(gen, jr_label);
+  frame(gen, location, F_JR);
+  asm_mov(gen, EAX(gen), location);
+  frame(gen, location, F_NC);
+  asm_cmp(gen, EAX(gen), location);
+  asm_jmp_ge(gen, end_label);
+
+  frame(gen, location, F_IR);
+  asm_mov_i(gen, location, 0);
+  asm_label(gen, ir_label);
+  frame(gen, location, F_IR);
+  asm_mov(gen, EAX(gen), location);
+  frame(gen, location, F_MC);
+  asm_cmp(gen, EAX(gen), location);
+  asm_jmp_ge(gen, jr_end);
+
+  // the strips start kc elements per row or column apart
+  frame(gen, location, F_IR);
+  asm_mov(gen, ESI(gen), location);
+  frame(gen, location, F_KC);
+  asm_imul(gen, ESI(gen), location);
+  asm_imul_i(gen, ESI(gen), MAT_ELEMENT_SIZE);
+  frame(gen, location, F_A_PACKED);
+  asm_add(gen, ESI(gen), location);
+  frame(gen, location, F_JR);
+  asm_mov(gen, EDI(gen), location);
+  frame(gen, location, F_KC);
+  asm_imul(gen, EDI(gen), location);
+  asm_imul_i(gen, EDI(gen), MAT_ELEMENT_SIZE);
+  frame(gen, location, F_B_PACKED);
+  asm_add(gen, EDI(gen), location);
+  frame(gen, location, F_KC);
+  asm_mov(gen, ECX(gen), location);
+
+  gen_kernel(gen);
+  gen_write_tile(gen);
+
+  frame(gen, location, F_IR);
+  asm_add_i(gen, location, gen->gemm.tile.mr);
+  asm_jmp(gen, ir_label);
+
+  asm_label(gen, jr_end);
+  frame(gen, location, F_JR);
+  asm_add_i(gen, location, gen->gemm.tile.nr);
+  asm_jmp(gen, jr_label);
+
+  asm_label(gen, end_label);
+}
+
+// jumps to end_label once field reaches limit
+static void gen_block_test(ClmCodeGen *gen, const char *end_label, int field,
+                           int limit) {
+  char location[64];
+  frame(gen, location, field);
+  asm_mov(gen, EAX(gen), location);
+  frame(gen, location, limit);
+  asm_cmp(gen, EAX(gen), location);
+  asm_jmp_ge(gen, end_label);
+}
+
+static void gen_load_matrix(ClmCodeGen *gen, const char *desc, int data_field,
+                            int stride_field) {
+  char location[64], field[64];
+  matrix_field(gen, field, desc, MAT_DATA);
+  asm_mov(gen, EAX(gen), field);
+  frame(gen, location, data_field);
+  asm_mov(gen, location, EAX(gen));
+  matrix_field(gen, field, desc, MAT_STRIDE);
+  asm_mov(gen, EAX(gen), field);
+  asm_imul_i(gen, EAX(gen), MAT_ELEMENT_SIZE);
+  frame(gen, location, stride_field);
+  asm_mov(gen, location, EAX(gen));
+}
+
+/*
+   for(jc = 0, jc < n, jc += NC)
+           for(pc = 0, pc < k, pc += KC)
+                   pack B[pc:pc+KC, jc:jc+NC]
+                   for(ic = 0, ic < m, ic += MC)
+                           pack A[ic:ic+MC, pc:pc+KC]
+                           compute the tiles of C[ic:ic+MC, jc:jc+NC]
+*/
+void gen_gemm_routine(ClmCodeGen *gen) {
+  char jc_label[LABEL_SIZE], pc_label[LABEL_SIZE], ic_label[LABEL_SIZE];
+  char jc_end[LABEL_SIZE], pc_end[LABEL_SIZE], end_label[LABEL_SIZE];
+  char location[64], field[64], size[16];
+
+  if (!gen->gemm.used)
+    return;
+  setup_tile(gen);
+  next_label(gen, jc_label);
+  next_label(gen, pc_label);
+  next_label(gen, ic_label);
+  next_label(gen, jc_end);
+  next_label(gen, pc_end);
+  next_label(gen, end_label);
+
+  asm_label(gen, GEMM);
+  asm_push(gen, EBP(gen));
+  asm_mov(gen, EBP(gen), ESP(gen));
+  asm_sub_i(gen, ESP(gen), SLOT(gen, F_SLOTS) + gen->gemm.tile.tileSize);
+
+  gen_load_matrix(gen, ESI(gen), F_A_DATA, F_A_STRIDE);
+  gen_load_matrix(gen, EDI(gen), F_B_DATA, F_B_STRIDE);
+  gen_load_matrix(gen, EBX(gen), F_C_DATA, F_C_STRIDE);
+  matrix_field(gen, field, ESI(gen), MAT_ROWS);
+  asm_mov(gen, EAX(gen), field);
+  frame(gen, location, F_M);
+  asm_mov(gen, location, EAX(gen));
+  matrix_field(gen, field, ESI(gen), MAT_COLS);
+  asm_mov(gen, EAX(gen), field);
+  frame(gen, location, F_K);
+  asm_mov(gen, location, EAX(gen));
+  matrix_field(gen, field, EDI(gen), MAT_COLS);
+  asm_mov(gen, EAX(gen), field);
+  frame(gen, location, F_N);
+  asm_mov(gen, location, EAX(gen));
+
+  sprintf(size, "%d", MC * KC * MAT_ELEMENT_SIZE);
+  asm_malloc(gen, size);
+  frame(gen, location, F_A_PACKED);
+  asm_mov(gen, location, EAX(gen));
+  sprintf(size, "%d", KC * NC * MAT_ELEMENT_SIZE);
+  asm_malloc(gen, size);
+  frame(gen, location, F_B_PACKED);
+  asm_mov(gen, location, EAX(gen));
+
+  frame(gen, location, F_JC);
+  asm_mov_i(gen, location, 0);
+  asm_label(gen, jc_label);
+  gen_block_test(gen, end_label, F_JC, F_N);
+  gen_block_size(gen, F_NC, F_N, F_JC, NC);
+
+  frame(gen, location, F_PC);
+  asm_mov_i(gen, location, 0);
+  asm_label(gen, pc_label);
+  gen_block_test(gen, jc_end, F_PC, F_K);
+  gen_block_size(gen, F_KC, F_K, F_PC, KC);
+  gen_pack_b(gen);
+
+  frame(gen, location, F_IC);
+  asm_mov_i(gen, location, 0);
+  asm_label(gen, ic_label);
+  gen_block_test(gen, pc_end, F_IC, F_M);
+  gen_block_size(gen, F_MC, F_M, F_IC, MC);
+  gen_pack_a(gen);
+  gen_tiles(gen);
+
+  frame(gen, location, F_IC);
+  asm_add_i(gen, location, MC);
+  asm_jmp(gen, ic_label);
+
+  asm_label(gen, pc_end);
+  frame(gen, location, F_PC);
+  asm_add_i(gen, location, KC);
+  asm_jmp(gen, pc_label);
+
+  asm_label(gen, jc_end);
+  frame(gen, location, F_JC);
+  asm_add_i(gen, location, NC);
+  asm_jmp(gen, jc_label);
+
+  asm_label(gen, end_label);
+  if (asm_get_simd(gen) == CLM_SIMD_AVX2)
+    asm_vzeroupper(gen);
+  frame(gen, location, F_A_PACKED);
+  asm_free(gen, location);
+  frame(gen, location, F_B_PACKED);
+  asm_free(gen, location);
+
+  asm_mov(gen, ESP(gen), EBP(gen));
+  asm_pop(gen, EBP(gen));
+  asm_ret(gen);
+}
@@ -0,0 +1,51 @@
+#ifndef CLM_GEMM_GEN_H
+#define CLM_GEMM_GEN_H
+
+#include "clm_asm.h"
+
+//
+// Matrix multiply
+//
+// C += A * B is a routine that is emitted once, after the program text, by
+// the first program that multiplies two matrices. it works through the
+// matrices in blocks that fit in the caches: a panel of B and a block of A
+// are copied into contiguous buffers (packed), and a register tiled kernel
+// computes each small tile of C from them with the vector instructions
+// picked by asm_set_simd
+//
+
+// the label of the routine. it takes A in esi, B in edi and C in ebx, all
+// descriptors, and clobbers every register except esp and ebp
+#define GEMM "__GEMM__"
+
+// the kernel computes an mr x nr tile of C in vector registers, nr is a
+// multiple of the vector width. the accumulators come first, then the
+// registers holding a row of B, the broadcast element of A and a temporary
+typedef struct GemmTile {
+  int mr;
+  int nr;
+  int vectors;  // vector registers per row of the tile
+  int width;    // bytes in a vector register
+  int accs;     // accumulators per row
+  int b;        // first register holding B
+  int s;        // the broadcast element of A
+  int t;        // a temporary
+  int tileSize; // bytes of stack holding a partial tile
+} GemmTile;
+
+// the part of the ClmCodeGen that is the routine's
+typedef struct ClmGemmGen {
+  int used;
+  GemmTile tile;
+} ClmGemmGen;
+
+// calls the routine, emitting it later if this is its first use
+void gen_gemm_call(ClmCodeGen *gen);
+// emits the routine if gen called it
+void gen_gemm_routine(ClmCodeGen *gen);
+// whether gen called the routine, and for code
+// generated on another thread, noting that it was
+int gen_gemm_used(ClmCodeGen *gen);
+void gen_gemm_set_used(ClmCodeGen *gen);
+
+#endif
@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <string.h>
+
+//
+// Keyword table generator
+//
+// run by the build, writes the lexer's table of the keywords in
+// keywords.inc to the file named by its argument. a keyword is in the entry
+// of a hash of its length and its first and last letters, and the
+// multipliers and the size of the table are searched for so no two keywords
+// share an entry. the build fails if there are none
+//
+
+typedef struct Keyword {
+  const char *sym;
+  const char *str;
+  int length;
+} Keyword;
+
+static const Keyword keywords[] = {
+#define keyword(tok, str) {#tok, str, sizeof(str) - 1},
+#define literal(tok, str)
+#define token(tok, str)
+#include "keywords.inc"
+#undef keyword
+#undef literal
+#undef token
+};
+
+#define NUM_KEYWORDS (int)(sizeof(keywords) / sizeof(keywords[0]))
+#define MAX_MULTIPLIER 32
+#define MAX_TABLE_SIZE 256
+
+typedef struct Hash {
+  int size;
+  int length, first, last; // the multipliers
+} Hash;
+
+static int hash(const Hash *h, const char *word, int length) {
+  return (length * h->length + (unsigned char)word[0] * h->first +
+          (unsigned char)word[length - 1] * h->last) &
+         (h->size - 1);
+}
+
+static int is_perfect(const Hash *h) {
+  int used[MAX_TABLE_SIZE] = {0};
+  int i;
+  for (i = 0; i < NUM_KEYWORDS; i++) {
+    int entry = hash(h, keywords[i].str, keywords[i].length);
+    if (used[entry])
+      return 0;
+    used[entry] = 1;
+  }
+  return 1;
+}
+
+// the smallest table, then the smallest multipliers
+static int find_hash(Hash *h) {
+  for (h->size = 1; h->size < NUM_KEYWORDS; h->size *= 2)
+    ;
+  for (; h->size <= MAX_TABLE_SIZE; h->size *= 2) {
+    for (h->length = 1; h->length < MAX_MULTIPLIER; h->length++) {
+      for (h->first = 1; h->first < MAX_MULTIPLIER; h->first++) {
+        for (h->last = 1; h->last < MAX_MULTIPLIER; h->last++) {
+          if (is_perfect(h))
+            return 1;
+        }
+      }
+    }
+  }
+  return 0;
+}
+
+static void write_table(FILE *out, const Hash *h) {
+  const Keyword *table[MAX_TABLE_SIZE] = {NULL};
+  int i;
+  for (i = 0; i < NUM_KEYWORDS; i++)
+    table[hash(h, keywords[i].str, keywords[i].length)] = &keywords[i];
+
+  fprintf(out, "// generated by clm_keyword_gen from keywords.inc\n\n");
+  fprintf(out, "#define KEYWORD_TABLE_SIZE %d\n", h->size);
+  fprintf(out,
+          "#define keyword_hash(word, length) \\\n"
+          "  (((length) * %d + (unsigned char)(word)[0] * %d + \\\n"
+          "    (unsigned char)(word)[(length) - 1] * %d) & \\\n"
+          "   (KEYWORD_TABLE_SIZE - 1))\n\n",
+          h->length, h->first, h->last);
+  fprintf(out, "static const ClmKeyword keywordTable[KEYWORD_TABLE_SIZE] = {\n");
+  for (i = 0; i < h->size; i++) {
+    if (table[i] != NULL)
+      fprintf(out, "    [%d] = {\"%s\", %d, %s},\n", i, table[i]->str,
+              table[i]->length, table[i]->sym);
+  }
+  fprintf(out, "};\n");
+}
+
+int main(int argc, char **argv) {
+  Hash h;
+  if (argc != 2) {
+    fprintf(stderr, "usage: clm_keyword_gen output.h\n");
+    return 1;
+  }
+  if (!find_hash(&h)) {
+    fprintf(stderr, "clm_keyword_gen: no perfect hash of the keywords\n");
+    return 1;
+  }
+
+  FILE *out = fopen(argv[1], "w");
+  if (out == NULL) {
+    fprintf(stderr, "clm_keyword_gen: can't write %s\n", argv[1]);
+    return 1;
+  }
+  write_table(out, &h);
+  return fclose(out) == 0 ? 0 : 1;
+}
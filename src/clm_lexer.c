@@ -5,20 +5,18 @@
 #include "clm.h"
 
 typedef struct ClmLexerData {
-  const char *programString;
+  const char *programString; // not necessarily null terminated
   int programLength;
   int curInd;
   int lineNo;
   int colNo;
-  int numTokens;
-  ArrayList *tokens; // array list of ClmLexerToken
+  ClmTokens *tokens;
+  ClmCompiler *compiler;
 } ClmLexerData;
 
 #define tok_str_eq(x, s) string_equals_n((x), (s), strlen(s))
 
-static ClmLexerData data;
-
-static ClmLexerToken *get_token();
+static void get_token(ClmLexerData *data);
 
 static int is_pd(char c) { return c == '.'; }
 
@@ -36,218 +34,239 @@ static int is_quote(char c) { return c == '"'; }
 
 static int is_id_char(char c) { return is_letter(c) || is_dig(c) || c == '_'; }
 
-static char consume() { return data.programString[data.curInd++]; }
+static void consume(ClmLexerData *data) { data->curInd++; }
 
-static char next() { return data.programString[data.curInd + 1]; }
+// the source may end right at the end of a mapped page, so nothing past
+// programLength is read
+static char next(ClmLexerData *data) {
+  return data->curInd + 1 < data->programLength
+             ? data->programString[data->curInd + 1]
+             : '\0';
+}
 
-static char curr() { return data.programString[data.curInd]; }
+static char curr(ClmLexerData *data) {
+  return data->programString[data->curInd];
+}
 
-static char prev() { return data.programString[data.curInd - 1]; }
+static char prev(ClmLexerData *data) {
+  return data->programString[data->curInd - 1];
+}
 
-static void reverse() {
-  if (data.curInd > 0)
-    data.curInd--;
+static void reverse(ClmLexerData *data) {
+  if (data->curInd > 0)
+    data->curInd--;
 }
 
-static int valid() { return data.curInd < data.programLength; }
+static int valid(ClmLexerData *data) {
+  return data->curInd < data->programLength;
+}
 
-static void lexer_token_free(void *data) {
+void clm_tokens_free(void *data) {
   if (data == NULL)
     return;
-  ClmLexerToken *token = (ClmLexerToken *)data;
-  free(token->raw);
-  free(token);
+  ClmTokens *tokens = (ClmTokens *)data;
+  free(tokens->data);
+  free(tokens);
 }
 
-static void lexer_token_print(void *data) {
-  ClmLexerToken *token = (ClmLexerToken *)data;
-  printf("%s : { %s }\n", clmLexerSymbolStrings[token->sym], token->raw);
+const char *clm_token_text(ClmCompiler *compiler, ClmTokens *tokens,
+                           ClmLexerToken *token) {
+  return string_intern_n(compiler, tokens->source + token->offset,
+                         token->length);
 }
 
-void clm_print_tokens(ArrayList *tokens) {
-  array_list_foreach(tokens, lexer_token_print);
+void clm_print_tokens(ClmTokens *tokens) {
+  int i;
+  for (i = 0; i < tokens->length; i++) {
+    ClmLexerToken *token = &tokens->data[i];
+    printf("%s : { %.*s }\n", clmLexerSymbolStrings[token->sym], token->length,
+           tokens->source + token->offset);
+  }
 }
 
-ArrayList *clm_lexer_main(const char *file_contents) {
-  data.curInd = 0;
-  data.lineNo = 1;
-  data.colNo = 0;
-  data.numTokens = 0;
-  data.programString = file_contents;
-  data.tokens = array_list_new(lexer_token_free);
+// the token from start to the current character
+static void push_token(ClmLexerData *data, ClmLexerSymbol sym, int start) {
+  ClmTokens *tokens = data->tokens;
+  if (tokens->length == tokens->capacity) {
+    tokens->capacity = 2 * tokens->capacity;
+    tokens->data =
+        realloc(tokens->data, tokens->capacity * sizeof(*tokens->data));
+  }
 
-  data.programLength = strlen(file_contents);
+  ClmLexerToken *token = &tokens->data[tokens->length++];
+  token->sym = sym;
+  token->offset = start;
+  token->length = data->curInd - start;
+  token->lineNo = data->lineNo;
+  token->colNo = data->colNo;
+}
 
-  while (valid() && data.programString[data.curInd] != '\0') {
-    ClmLexerToken *token = get_token();
-    if (token != NULL)
-      array_list_push(data.tokens, token);
+static void lex(void *data) {
+  ClmLexerData *lexer = data;
+  while (valid(lexer) && lexer->programString[lexer->curInd] != '\0') {
+    get_token(lexer);
   }
+}
 
-  ClmLexerToken *end = malloc(sizeof(*end));
-  end->sym = KEYWORD_END;
-  end->raw = string_copy("end");
+static void lex_error(void *data) {
+  ClmLexerData *lexer = data;
+  clm_tokens_free(lexer->tokens);
+}
+
+ClmTokens *clm_lexer_main(ClmCompiler *compiler, const char *source,
+                          size_t length) {
+  ClmLexerData lexer;
+  ClmLexerData *data = &lexer;
+  data->compiler = compiler;
+  data->curInd = 0;
+  data->lineNo = 1;
+  data->colNo = 0;
+  data->programString = source;
+  data->programLength = length;
+
+  // about one token for every 4 characters of source
+  data->tokens = malloc(sizeof(*data->tokens));
+  data->tokens->source = source;
+  data->tokens->length = 0;
+  data->tokens->capacity = data->programLength / 4 + 16;
+  data->tokens->data =
+      malloc(data->tokens->capacity * sizeof(*data->tokens->data));
+
+  clm_recover_with(compiler, lex, lex_error, data);
+
+  // the end of the file is an empty end token
+  push_token(data, KEYWORD_END, data->curInd);
+  ClmLexerToken *end = &data->tokens->data[data->tokens->length - 1];
   end->lineNo = 0;
   end->colNo = 0;
-  array_list_push(data.tokens, end);
 
-  return data.tokens;
+  clm_count(compiler, CLM_COUNTER_TOKENS, data->tokens->length);
+  return data->tokens;
 }
 
 // all numbers will start with a digit, and may optionally contain a period
-static ClmLexerToken *read_number() {
+static void read_number(ClmLexerData *data) {
   char c;
   int num_pds = 0;
-  int start = data.curInd;
+  int start = data->curInd;
 
-  c = curr();
+  c = curr(data);
 
   if (!is_dig(c)) {
-    return NULL;
+    return;
   }
 
-  while (valid() && (is_dig(c = curr()) || is_pd(c))) {
+  while (valid(data) && (is_dig(c = curr(data)) || is_pd(c))) {
+    // 0..5 is a range, not a number with two periods
+    if (is_pd(c) && is_pd(next(data)))
+      break;
     num_pds += is_pd(c);
-    consume();
+    consume(data);
   }
 
   if (num_pds > 1) {
-    clm_error(data.lineNo, data.colNo,
+    clm_error(data->compiler, data->lineNo, data->colNo,
               "found multiple '.' in number declaration");
-    return NULL;
+    return;
   }
 
-  ClmLexerToken *token = malloc(sizeof(*token));
-  token->lineNo = data.lineNo;
-  token->colNo = data.colNo;
-  token->raw = string_copy_n(data.programString + start, data.curInd - start);
+  push_token(data, num_pds > 0 ? LITERAL_FLOAT : LITERAL_INT, start);
+}
+
+// the keywords from keywords.inc, each in the entry of its hash of its length
+// and first and last letters. no two keywords share an entry, so a word is
+// classified with one hash and at most one memcmp. the table and the hash are
+// generated by clm_keyword_gen when keywords.inc changes
+typedef struct ClmKeyword {
+  const char *str;
+  int length;
+  ClmLexerSymbol sym;
+} ClmKeyword;
 
-  if (num_pds > 0)
-    token->sym = LITERAL_FLOAT;
-  else
-    token->sym = LITERAL_INT;
+#include "clm_keywords.h"
 
-  return token;
+static ClmLexerSymbol keyword_or_id(const char *word, int length) {
+  const ClmKeyword *keyword = &keywordTable[keyword_hash(word, length)];
+  if (keyword->length == length && memcmp(keyword->str, word, length) == 0)
+    return keyword->sym;
+  return LITERAL_ID;
 }
 
 // all words must start with [a-zA-Z]
 // a word can either be a keyword or an identifier
-static ClmLexerToken *read_word() {
-  char c;
-  int num_id_chars = 0;
-  int start = data.curInd;
+static void read_word(ClmLexerData *data) {
+  int start = data->curInd;
 
-  c = curr();
-
-  if (!is_letter(c)) {
-    return NULL;
-  }
-
-  while (valid() && is_id_char(c = curr())) {
-    num_id_chars += (c == '_' || is_dig(c));
-    consume();
-  }
-
-  if (num_id_chars > 0) {
-    ClmLexerToken *token = malloc(sizeof(*token));
-    token->lineNo = data.lineNo;
-    token->colNo = data.colNo;
-    token->raw = string_copy_n(data.programString + start, data.curInd - start);
-    token->sym = LITERAL_ID;
-    return token;
+  if (!is_letter(curr(data))) {
+    return;
   }
 
-  ClmLexerSymbol sym;
-  char word_buffer[32];
-  strncpy(word_buffer, data.programString + start, data.curInd - start);
-  word_buffer[data.curInd - start] = '\0';
+  while (valid(data) && is_id_char(curr(data)))
+    consume(data);
 
-  if (0) {
-    // include if branch just for parsing correctly
-    // all the keywords will map to else ifs
-  }
-#define literal(tok, str)
-#define token(tok, str)
-#define keyword(tok, str)                                                      \
-  else if (strcmp(word_buffer, str) == 0) {                                    \
-    sym = tok;                                                                 \
-  }
-#include "keywords.inc"
-#undef literal
-#undef token
-#undef keyword
-  else {
-    // the word in word_buffer didn't match any keywords... its an id
-    sym = LITERAL_ID;
-  }
-
-  ClmLexerToken *token = malloc(sizeof(*token));
-  token->lineNo = data.lineNo;
-  token->colNo = data.colNo;
-  token->raw = string_copy_n(data.programString + start, data.curInd - start);
-  token->sym = sym;
-  return token;
+  push_token(data,
+             keyword_or_id(data->programString + start, data->curInd - start),
+             start);
 }
 
-static ClmLexerToken *read_string_literal() {
+static void read_string_literal(ClmLexerData *data) {
   char c;
-  int start = data.curInd;
+  int start = data->curInd;
 
-  c = curr();
+  c = curr(data);
 
   if (c != '"') {
-    return NULL;
+    return;
   }
 
-  while (valid() && (c = curr()) != '"') {
+  while (valid(data) && (c = curr(data)) != '"') {
     if (c == '\n' || c == '\r') {
-      data.lineNo++;
-      data.colNo = 0;
+      data->lineNo++;
+      data->colNo = 0;
     }
-    if (c == '\\' && next() == '"') {
-      consume();
+    if (c == '\\' && next(data) == '"') {
+      consume(data);
     }
-    consume();
+    consume(data);
   }
 
-  // eat the last quote
-  consume();
+  // eat the last quote, unless the source ended first
+  if (valid(data))
+    consume(data);
 
-  ClmLexerToken *token = malloc(sizeof(*token));
-  token->lineNo = data.lineNo;
-  token->colNo = data.colNo;
-  token->raw = string_copy_n(data.programString + start, data.curInd - start);
-  token->sym = LITERAL_STRING;
-  return token;
+  push_token(data, LITERAL_STRING, start);
 }
 
-static ClmLexerToken *get_token() {
+static void get_token(ClmLexerData *data) {
   char c;
   ClmLexerSymbol sym;
 
-  while (valid() && is_whitespace(c = curr())) {
+  while (valid(data) && is_whitespace(c = curr(data))) {
     if (c == '\n' || c == '\r') {
-      data.lineNo++;
-      data.colNo = 0;
+      data->lineNo++;
+      data->colNo = 0;
     }
-    data.colNo++;
-    consume();
+    data->colNo++;
+    consume(data);
   }
 
   // capture white space at end of file
-  if (!valid()) {
-    return NULL;
+  if (!valid(data)) {
+    return;
   }
 
-  int start = data.curInd;
-  c = curr();
+  int start = data->curInd;
+  c = curr(data);
 
   if (is_dig(c)) {
-    return read_number();
+    read_number(data);
+    return;
   } else if (is_letter(c)) {
-    return read_word();
+    read_word(data);
+    return;
   } else if (c == '"') {
-    return read_string_literal();
+    read_string_literal(data);
+    return;
   } else {
     // read operator
     switch (c) {
@@ -261,9 +280,9 @@ static ClmLexerToken *get_token() {
       sym = TOKEN_COMMA;
       break;
     case '=':
-      if (next() == '=') {
+      if (next(data) == '=') {
         sym = TOKEN_EQEQ;
-        consume();
+        consume(data);
       } else
         sym = TOKEN_EQ;
       break;
@@ -271,9 +290,9 @@ static ClmLexerToken *get_token() {
       sym = TOKEN_FSLASH;
       break;
     case '>':
-      if (next() == '=') {
+      if (next(data) == '=') {
         sym = TOKEN_GTE;
-        consume();
+        consume(data);
       } else
         sym = TOKEN_GT;
       break;
@@ -287,9 +306,9 @@ static ClmLexerToken *get_token() {
       sym = TOKEN_LPAREN;
       break;
     case '<':
-      if (next() == '=') {
+      if (next(data) == '=') {
         sym = TOKEN_LTE;
-        consume();
+        consume(data);
       } else
         sym = TOKEN_LT;
       break;
@@ -297,9 +316,9 @@ static ClmLexerToken *get_token() {
       sym = TOKEN_MINUS;
       break;
     case '!':
-      if (next() == '=') {
+      if (next(data) == '=') {
         sym = TOKEN_BANGEQ;
-        consume();
+        consume(data);
       } else
         sym = TOKEN_BANG;
       break;
@@ -328,20 +347,15 @@ static ClmLexerToken *get_token() {
       sym = TOKEN_TILDA;
       break;
     default:
-      clm_error(data.lineNo, data.colNo, "unknown symbol '%c'", c);
-      return NULL;
+      clm_error(data->compiler, data->lineNo, data->colNo,
+                "unknown symbol '%c'", c);
+      return;
     }
 
-    consume();
+    consume(data);
   }
 
-  ClmLexerToken *token = malloc(sizeof(*token));
-  token->lineNo = data.lineNo;
-  token->colNo = data.colNo;
-  token->sym = sym;
-  token->raw = string_copy_n(data.programString + start, data.curInd - start);
-
-  return token;
+  push_token(data, sym, start);
 }
 
 const char *clm_lexer_sym_to_string(ClmLexerSymbol s) {
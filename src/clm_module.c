@@ -0,0 +1,841 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "clm.h"
+#include "clm_ast.h"
+#include "clm_module.h"
+#include "clm_scope.h"
+
+#ifndef CLM_VERSION
+#define CLM_VERSION "unknown"
+#endif
+
+#define MODULE_PATH_SIZE 1024
+
+/*
+ *
+ *  INTERFACE FILES
+ *
+ */
+
+// an interface is a header, the function records, the parameter records, the
+// callee names, the modules it imported, the strings and the code, one after
+// the other. strings are offsets into the string table, NO_STRING for none
+#define MODULE_MAGIC "CLMI"
+#define MODULE_FORMAT 1
+#define NO_STRING 0xffffffffu
+
+typedef struct {
+  char magic[4];
+  unsigned int format;
+  unsigned int version; // the CLM_VERSION that wrote it
+  unsigned int target;
+  unsigned int simd;
+  unsigned int functionsLength;
+  unsigned int paramsLength;
+  unsigned int callsLength;
+  unsigned int importsLength;
+  unsigned int stringsLength;
+  unsigned int codeLength;
+} ModuleHeader;
+
+typedef struct {
+  unsigned int name;
+  unsigned int exported; // 0 for a function the module imported
+  unsigned int returnType;
+  int returnRows;
+  int returnCols;
+  unsigned int returnRowVar;
+  unsigned int returnColVar;
+  unsigned int firstParam;
+  unsigned int paramsLength;
+  unsigned int firstCall;
+  unsigned int callsLength;
+  unsigned int codeOffset;
+  unsigned int codeLength;
+  int spillSlots;
+  int gemmUsed;
+} FunctionRecord;
+
+typedef struct {
+  unsigned int name;
+  unsigned int type;
+  int rows;
+  int cols;
+  unsigned int rowVar;
+  unsigned int colVar;
+} ParamRecord;
+
+// a module the interface was made with, and a hash of its interface then.
+// the functions it used from it are copied into this one, so this one is out
+// of date once that one changes
+typedef struct {
+  unsigned int name;
+  unsigned int hashLow;
+  unsigned int hashHigh;
+} ImportRecord;
+
+// where the tables of a loaded interface are
+typedef struct {
+  const ModuleHeader *header;
+  const FunctionRecord *functions;
+  const ParamRecord *params;
+  const unsigned int *calls;
+  const ImportRecord *imports;
+  const char *strings;
+  const char *code;
+} ModuleTables;
+
+static void module_tables(const ClmModule *module, ModuleTables *tables) {
+  tables->header = (const ModuleHeader *)module->data;
+  tables->functions = (const FunctionRecord *)(tables->header + 1);
+  tables->params =
+      (const ParamRecord *)(tables->functions +
+                            tables->header->functionsLength);
+  tables->calls =
+      (const unsigned int *)(tables->params + tables->header->paramsLength);
+  tables->imports =
+      (const ImportRecord *)(tables->calls + tables->header->callsLength);
+  tables->strings =
+      (const char *)(tables->imports + tables->header->importsLength);
+  tables->code = tables->strings + tables->header->stringsLength;
+}
+
+static const char *module_string(const ModuleTables *tables,
+                                 unsigned int offset) {
+  return offset == NO_STRING ? NULL : tables->strings + offset;
+}
+
+static int valid_string(const ModuleHeader *header, unsigned int offset) {
+  return offset == NO_STRING || offset < header->stringsLength;
+}
+
+// an interface that is cut short or was written by another version of clm
+// isn't used
+static int valid_interface(const char *data, size_t length) {
+  const ModuleHeader *header = (const ModuleHeader *)data;
+  if (length < sizeof(*header) || memcmp(header->magic, MODULE_MAGIC, 4) != 0 ||
+      header->format != MODULE_FORMAT)
+    return 0;
+
+  size_t expected = sizeof(*header) +
+                    header->functionsLength * sizeof(FunctionRecord) +
+                    header->paramsLength * sizeof(ParamRecord) +
+                    header->callsLength * sizeof(unsigned int) +
+                    header->importsLength * sizeof(ImportRecord) +
+                    header->stringsLength + header->codeLength;
+  if (expected != length || header->stringsLength == 0)
+    return 0;
+
+  ClmModule module = {0};
+  ModuleTables tables;
+  module.data = (char *)data;
+  module_tables(&module, &tables);
+  if (tables.strings[header->stringsLength - 1] != '\0' ||
+      header->version >= header->stringsLength ||
+      strcmp(tables.strings + header->version, CLM_VERSION) != 0)
+    return 0;
+
+  unsigned int i;
+  for (i = 0; i < header->functionsLength; i++) {
+    const FunctionRecord *f = &tables.functions[i];
+    if (f->name == NO_STRING || !valid_string(header, f->name) ||
+        !valid_string(header, f->returnRowVar) ||
+        !valid_string(header, f->returnColVar) ||
+        (size_t)f->firstParam + f->paramsLength > header->paramsLength ||
+        (size_t)f->firstCall + f->callsLength > header->callsLength ||
+        (size_t)f->codeOffset + f->codeLength > header->codeLength)
+      return 0;
+  }
+  for (i = 0; i < header->paramsLength; i++) {
+    const ParamRecord *p = &tables.params[i];
+    if (p->name == NO_STRING || !valid_string(header, p->name) ||
+        !valid_string(header, p->rowVar) || !valid_string(header, p->colVar))
+      return 0;
+  }
+  for (i = 0; i < header->callsLength; i++) {
+    if (tables.calls[i] == NO_STRING || !valid_string(header, tables.calls[i]))
+      return 0;
+  }
+  for (i = 0; i < header->importsLength; i++) {
+    unsigned int name = tables.imports[i].name;
+    if (name == NO_STRING || !valid_string(header, name))
+      return 0;
+  }
+  return 1;
+}
+
+// FNV-1a, over the whole interface
+static unsigned long long module_hash(const ClmModule *module) {
+  unsigned long long hash = 14695981039346656037ull;
+  size_t i;
+  for (i = 0; i < module->length; i++)
+    hash = (hash ^ (unsigned char)module->data[i]) * 1099511628211ull;
+  return hash;
+}
+
+static int find_function(ClmModule *module, const char *name) {
+  int mask = module->tableSize - 1;
+  int i = string_hash(name) & mask;
+  while (module->table[i] >= 0) {
+    if (strcmp(module->functions[module->table[i]].name, name) == 0)
+      return module->table[i];
+    i = (i + 1) & mask;
+  }
+  return -1;
+}
+
+// points the functions of the module into its data, and puts them in a table
+// by name that is kept at most half full
+static void index_functions(ClmModule *module) {
+  ModuleTables tables;
+  module_tables(module, &tables);
+  int length = tables.header->functionsLength;
+  int i;
+
+  module->functionsLength = length;
+  module->functions =
+      calloc(length > 0 ? length : 1, sizeof(ClmModuleFunction));
+  for (i = 0; i < length; i++) {
+    const FunctionRecord *record = &tables.functions[i];
+    ClmModuleFunction *function = &module->functions[i];
+    function->name = module_string(&tables, record->name);
+    function->code = tables.code + record->codeOffset;
+    function->codeLength = record->codeLength;
+    function->spillSlots = record->spillSlots;
+    function->gemmUsed = record->gemmUsed;
+    function->record = record;
+  }
+
+  module->tableSize = 8;
+  while (module->tableSize < 2 * length)
+    module->tableSize *= 2;
+  module->table = malloc(module->tableSize * sizeof(int));
+  memset(module->table, -1, module->tableSize * sizeof(int));
+  int mask = module->tableSize - 1;
+  for (i = 0; i < length; i++) {
+    int h = string_hash(module->functions[i].name) & mask;
+    while (module->table[h] >= 0)
+      h = (h + 1) & mask;
+    module->table[h] = i;
+  }
+}
+
+void clm_module_free(void *data) {
+  ClmModule *module = data;
+  if (module == NULL)
+    return;
+  clm_tokens_free(module->tokens);
+  clm_compiler_free(module->compiler);
+  free(module->data);
+  free(module->functions);
+  free(module->table);
+  free(module);
+}
+
+/*
+ *
+ *  WRITING
+ *
+ */
+
+typedef struct {
+  StringBuffer *functions;
+  StringBuffer *params;
+  StringBuffer *calls;
+  StringBuffer *imports;
+  StringBuffer *strings;
+  StringBuffer *code;
+  int functionsLength;
+} ModuleWriter;
+
+static unsigned int add_string(ModuleWriter *writer, const char *string) {
+  if (string == NULL)
+    return NO_STRING;
+  unsigned int offset = writer->strings->length;
+  string_buffer_append_n(writer->strings, string, strlen(string) + 1);
+  return offset;
+}
+
+static void add_call(ModuleWriter *writer, const char *name) {
+  unsigned int offset = add_string(writer, name);
+  string_buffer_append_n(writer->calls, (const char *)&offset, sizeof(offset));
+}
+
+static void add_param(ModuleWriter *writer, const char *name, ClmType type,
+                      MatrixSize size) {
+  ParamRecord record;
+  record.name = add_string(writer, name);
+  record.type = (unsigned int)type;
+  record.rows = size.rows;
+  record.cols = size.cols;
+  record.rowVar = add_string(writer, size.rowVar);
+  record.colVar = add_string(writer, size.colVar);
+  string_buffer_append_n(writer->params, (const char *)&record, sizeof(record));
+}
+
+static void add_function(ModuleWriter *writer, FunctionRecord *record,
+                         const char *code, size_t codeLength) {
+  record->codeOffset = writer->code->length;
+  record->codeLength = codeLength;
+  string_buffer_append_n(writer->code, code, codeLength);
+  string_buffer_append_n(writer->functions, (const char *)record,
+                         sizeof(*record));
+  writer->functionsLength++;
+}
+
+static void add_exp_calls(ModuleWriter *writer, ClmExpNode *node);
+static void add_statement_calls(ModuleWriter *writer, ArrayList *statements);
+
+static void add_exp_calls(ModuleWriter *writer, ClmExpNode *node) {
+  int i;
+  if (node == NULL)
+    return;
+  switch (node->type) {
+  case EXP_TYPE_ARITH:
+    add_exp_calls(writer, node->arithExp.left);
+    add_exp_calls(writer, node->arithExp.right);
+    break;
+  case EXP_TYPE_BOOL:
+    add_exp_calls(writer, node->boolExp.left);
+    add_exp_calls(writer, node->boolExp.right);
+    break;
+  case EXP_TYPE_CALL:
+    add_call(writer, node->callExp.name);
+    for (i = 0; i < node->callExp.params->length; i++)
+      add_exp_calls(writer, node->callExp.params->data[i]);
+    break;
+  case EXP_TYPE_INDEX:
+    add_exp_calls(writer, node->indExp.rowIndex);
+    add_exp_calls(writer, node->indExp.colIndex);
+    add_exp_calls(writer, node->indExp.rowEnd);
+    add_exp_calls(writer, node->indExp.colEnd);
+    break;
+  case EXP_TYPE_UNARY:
+    add_exp_calls(writer, node->unaryExp.node);
+    break;
+  default:
+    break;
+  }
+}
+
+static void add_statement_calls(ModuleWriter *writer, ArrayList *statements) {
+  int i;
+  if (statements == NULL)
+    return;
+  for (i = 0; i < statements->length; i++) {
+    ClmStmtNode *node = statements->data[i];
+    switch (node->type) {
+    case STMT_TYPE_ASSIGN:
+      add_exp_calls(writer, node->assignStmt.lhs);
+      add_exp_calls(writer, node->assignStmt.rhs);
+      break;
+    case STMT_TYPE_CALL:
+      add_exp_calls(writer, node->callExpr);
+      break;
+    case STMT_TYPE_CONDITIONAL:
+      add_exp_calls(writer, node->conditionStmt.condition);
+      add_statement_calls(writer, node->conditionStmt.trueBody);
+      add_statement_calls(writer, node->conditionStmt.falseBody);
+      break;
+    case STMT_TYPE_FOR_LOOP:
+      add_exp_calls(writer, node->forLoopStmt.start);
+      add_exp_calls(writer, node->forLoopStmt.end);
+      add_exp_calls(writer, node->forLoopStmt.delta);
+      add_statement_calls(writer, node->forLoopStmt.body);
+      break;
+    case STMT_TYPE_WHILE_LOOP:
+      add_exp_calls(writer, node->whileLoopStmt.condition);
+      add_statement_calls(writer, node->whileLoopStmt.body);
+      break;
+    case STMT_TYPE_PRINT:
+      add_exp_calls(writer, node->printStmt.expression);
+      break;
+    case STMT_TYPE_RET:
+      add_exp_calls(writer, node->returnExpr);
+      break;
+    default:
+      break;
+    }
+  }
+}
+
+// a function declared by the module, with its code generated now
+static void add_declared_function(ModuleWriter *writer, ClmCompiler *compiler,
+                                  ClmScope *globalScope, ClmStmtNode *node) {
+  FunctionRecord record;
+  int i;
+  record.name = add_string(writer, node->funcDecStmt.name);
+  record.exported = 1;
+  record.returnType = (unsigned int)node->funcDecStmt.returnType;
+  record.returnRows = node->funcDecStmt.returnSize.rows;
+  record.returnCols = node->funcDecStmt.returnSize.cols;
+  record.returnRowVar = add_string(writer, node->funcDecStmt.returnSize.rowVar);
+  record.returnColVar = add_string(writer, node->funcDecStmt.returnSize.colVar);
+
+  ArrayList *params = node->funcDecStmt.parameters;
+  record.firstParam = writer->params->length / sizeof(ParamRecord);
+  record.paramsLength = params->length;
+  for (i = 0; i < params->length; i++) {
+    ClmExpNode *param = params->data[i];
+    add_param(writer, param->paramExp.name, param->paramExp.type,
+              param->paramExp.size);
+  }
+
+  record.firstCall = writer->calls->length / sizeof(unsigned int);
+  add_statement_calls(writer, node->funcDecStmt.body);
+  record.callsLength =
+      writer->calls->length / sizeof(unsigned int) - record.firstCall;
+
+  StringBuffer *code = clm_code_gen_function(
+      compiler, node, globalScope, &record.spillSlots, &record.gemmUsed);
+  add_function(writer, &record, code->data, code->length);
+  string_buffer_free(code);
+}
+
+// a function the module imported and uses, copied from its interface
+static void add_imported_function(ModuleWriter *writer, ClmModule *module,
+                                  ClmModuleFunction *function) {
+  ModuleTables tables;
+  module_tables(module, &tables);
+  const FunctionRecord *from = function->record;
+  FunctionRecord record = *from;
+  unsigned int i;
+
+  record.name = add_string(writer, function->name);
+  record.exported = 0;
+  record.returnRowVar =
+      add_string(writer, module_string(&tables, from->returnRowVar));
+  record.returnColVar =
+      add_string(writer, module_string(&tables, from->returnColVar));
+
+  record.firstParam = writer->params->length / sizeof(ParamRecord);
+  for (i = 0; i < from->paramsLength; i++) {
+    const ParamRecord *param = &tables.params[from->firstParam + i];
+    MatrixSize size = {param->rows, param->cols,
+                       module_string(&tables, param->rowVar),
+                       module_string(&tables, param->colVar)};
+    add_param(writer, module_string(&tables, param->name),
+              (ClmType)param->type, size);
+  }
+
+  record.firstCall = writer->calls->length / sizeof(unsigned int);
+  for (i = 0; i < from->callsLength; i++)
+    add_call(writer, module_string(&tables, tables.calls[from->firstCall + i]));
+
+  add_function(writer, &record, function->code, function->codeLength);
+}
+
+// the whole interface, in a buffer
+static StringBuffer *module_interface(ClmCompiler *compiler,
+                                      ArrayList *statements,
+                                      ClmScope *globalScope) {
+  ModuleWriter writer = {string_buffer_new(), string_buffer_new(),
+                         string_buffer_new(), string_buffer_new(),
+                         string_buffer_new(), string_buffer_new(), 0};
+  int i, j;
+
+  for (i = 0; i < statements->length; i++) {
+    ClmStmtNode *node = statements->data[i];
+    if (node->type != STMT_TYPE_FUNC_DEC && node->type != STMT_TYPE_IMPORT)
+      clm_error(compiler, node->lineNo, node->colNo,
+                "Only functions are declared in a module");
+  }
+
+  ModuleHeader header;
+  memcpy(header.magic, MODULE_MAGIC, 4);
+  header.format = MODULE_FORMAT;
+  header.version = add_string(&writer, CLM_VERSION);
+  header.target = (unsigned int)compiler->target;
+  header.simd = (unsigned int)compiler->simd;
+
+  if (compiler->modules != NULL) {
+    for (i = 0; i < compiler->modules->length; i++) {
+      ClmModule *module = compiler->modules->data[i];
+      unsigned long long hash = module_hash(module);
+      ImportRecord record = {add_string(&writer, module->name),
+                             (unsigned int)hash, (unsigned int)(hash >> 32)};
+      string_buffer_append_n(writer.imports, (const char *)&record,
+                             sizeof(record));
+      for (j = 0; j < module->functionsLength; j++) {
+        if (module->functions[j].used)
+          add_imported_function(&writer, module, &module->functions[j]);
+      }
+    }
+  }
+  for (i = 0; i < statements->length; i++) {
+    ClmStmtNode *node = statements->data[i];
+    if (node->type == STMT_TYPE_FUNC_DEC)
+      add_declared_function(&writer, compiler, globalScope, node);
+  }
+
+  header.functionsLength = writer.functionsLength;
+  header.paramsLength = writer.params->length / sizeof(ParamRecord);
+  header.callsLength = writer.calls->length / sizeof(unsigned int);
+  header.importsLength = writer.imports->length / sizeof(ImportRecord);
+  header.stringsLength = writer.strings->length;
+  header.codeLength = writer.code->length;
+
+  StringBuffer *out = string_buffer_new();
+  string_buffer_append_n(out, (const char *)&header, sizeof(header));
+  string_buffer_append_n(out, writer.functions->data, writer.functions->length);
+  string_buffer_append_n(out, writer.params->data, writer.params->length);
+  string_buffer_append_n(out, writer.calls->data, writer.calls->length);
+  string_buffer_append_n(out, writer.imports->data, writer.imports->length);
+  string_buffer_append_n(out, writer.strings->data, writer.strings->length);
+  string_buffer_append_n(out, writer.code->data, writer.code->length);
+
+  string_buffer_free(writer.functions);
+  string_buffer_free(writer.params);
+  string_buffer_free(writer.calls);
+  string_buffer_free(writer.imports);
+  string_buffer_free(writer.strings);
+  string_buffer_free(writer.code);
+  return out;
+}
+
+static int write_file(const char *path, const char *data, size_t length) {
+  FILE *file = fopen(path, "wb");
+  if (file == NULL)
+    return 0;
+  int ok = fwrite(data, 1, length, file) == length;
+  return fclose(file) == 0 && ok;
+}
+
+int clm_module_write(ClmCompiler *compiler, ArrayList *statements,
+                     ClmScope *globalScope, const char *path) {
+  StringBuffer *interface = module_interface(compiler, statements, globalScope);
+  int ok = write_file(path, interface->data, interface->length);
+  string_buffer_free(interface);
+  return ok;
+}
+
+/*
+ *
+ *  IMPORTING
+ *
+ */
+
+static char *read_file(const char *path, size_t *out_length) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL)
+    return NULL;
+  StringBuffer *buffer = string_buffer_new();
+  char chunk[64 * 1024];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0)
+    string_buffer_append_n(buffer, chunk, n);
+  fclose(file);
+
+  char *data = buffer->data;
+  *out_length = buffer->length;
+  free(buffer);
+  return data;
+}
+
+// a module is compiled with the options of the program importing it, and its
+// errors are the program's
+static ClmModule *compile_module(ClmCompiler *importer, ClmStmtNode *node,
+                                 const char *sourcePath,
+                                 const char *interfacePath) {
+  ClmCompiler *c;
+  for (c = importer; c != NULL; c = c->importer) {
+    if (c->fileName != NULL && strcmp(c->fileName, sourcePath) == 0) {
+      clm_error(importer, node->lineNo, node->colNo,
+                "Module %s imports itself", node->importStmt.module);
+      return NULL;
+    }
+  }
+
+  ClmModule *module = calloc(1, sizeof(*module));
+  module->name = node->importStmt.module;
+  module->data = read_file(sourcePath, &module->length);
+  if (module->data == NULL) {
+    free(module);
+    clm_error(importer, node->lineNo, node->colNo, "Unable to read %s",
+              sourcePath);
+    return NULL;
+  }
+  // freed with the importer if the module has an error
+  array_list_push(importer->modules, module);
+
+  ClmCompiler *compiler = clm_compiler_new(importer->target);
+  module->compiler = compiler;
+  compiler->simd = importer->simd;
+  compiler->disabledPasses = importer->disabledPasses;
+  compiler->modulePath = importer->modulePath;
+  compiler->recover = importer->recover;
+  compiler->diagnostics = importer->diagnostics;
+  compiler->importer = importer;
+  compiler->fileName = string_intern(compiler, sourcePath);
+
+  module->tokens = clm_lexer_main(compiler, module->data, module->length);
+  ArrayList *statements = clm_parser_main(compiler, module->tokens);
+  clm_tokens_free(module->tokens);
+  module->tokens = NULL;
+  ClmScope *globalScope = clm_symbol_gen_main(compiler, statements);
+  clm_type_check_main(compiler, statements, globalScope);
+  clm_optimizer_main(compiler, statements, globalScope);
+  StringBuffer *interface = module_interface(compiler, statements, globalScope);
+
+  clm_compiler_free(compiler);
+  module->compiler = NULL;
+  free(module->data);
+  module->data = interface->data;
+  module->length = interface->length;
+  free(interface);
+  index_functions(module);
+
+  // the next import reads it instead, if the directory can be written to
+  write_file(interfacePath, module->data, module->length);
+  return module;
+}
+
+// returns NULL if the interface can't be used
+static ClmModule *load_module(ClmCompiler *compiler, ClmStmtNode *node,
+                              const char *interfacePath) {
+  ClmModule *module = calloc(1, sizeof(*module));
+  module->name = node->importStmt.module;
+  module->data = read_file(interfacePath, &module->length);
+  if (module->data == NULL || !valid_interface(module->data, module->length)) {
+    clm_module_free(module);
+    return NULL;
+  }
+
+  const ModuleHeader *header = (const ModuleHeader *)module->data;
+  if (header->target != (unsigned int)compiler->target ||
+      header->simd != (unsigned int)compiler->simd) {
+    clm_module_free(module);
+    return NULL;
+  }
+  index_functions(module);
+  return module;
+}
+
+static ClmModule *find_module(ClmCompiler *compiler, const char *name);
+static ClmModule *open_module(ClmCompiler *compiler, ClmStmtNode *node);
+
+// whether the modules the interface was made with are the same now
+static int imports_current(ClmCompiler *compiler, ClmStmtNode *node,
+                           ClmModule *module) {
+  ModuleTables tables;
+  module_tables(module, &tables);
+  unsigned int i;
+  for (i = 0; i < tables.header->importsLength; i++) {
+    const ImportRecord *record = &tables.imports[i];
+    ClmStmtNode import = *node;
+    import.importStmt.module =
+        string_intern(compiler, module_string(&tables, record->name));
+    ClmModule *imported = find_module(compiler, import.importStmt.module);
+    if (imported == NULL)
+      imported = open_module(compiler, &import);
+    if (imported == NULL)
+      return 0;
+    unsigned long long hash = module_hash(imported);
+    if (record->hashLow != (unsigned int)hash ||
+        record->hashHigh != (unsigned int)(hash >> 32))
+      return 0;
+  }
+  return 1;
+}
+
+static int modified_time(const char *path, time_t *out_time) {
+  struct stat info;
+  if (stat(path, &info) != 0)
+    return 0;
+  *out_time = info.st_mtime;
+  return 1;
+}
+
+// looks for the module in dir, returns NULL if it isn't there
+static ClmModule *open_module_in(ClmCompiler *compiler, ClmStmtNode *node,
+                                 const char *dir, size_t dirLength) {
+  const char *name = node->importStmt.module;
+  char sourcePath[MODULE_PATH_SIZE], interfacePath[MODULE_PATH_SIZE];
+  if ((size_t)snprintf(sourcePath, sizeof(sourcePath), "%.*s/%s.clm",
+                       (int)dirLength, dir, name) >= sizeof(sourcePath) ||
+      (size_t)snprintf(interfacePath, sizeof(interfacePath), "%.*s/%s%s",
+                       (int)dirLength, dir, name,
+                       CLM_MODULE_EXTENSION) >= sizeof(interfacePath))
+    return NULL;
+
+  time_t sourceTime, interfaceTime;
+  int hasSource = modified_time(sourcePath, &sourceTime);
+  int hasInterface = modified_time(interfacePath, &interfaceTime);
+  if (hasInterface && (!hasSource || interfaceTime >= sourceTime)) {
+    ClmModule *module = load_module(compiler, node, interfacePath);
+    if (module != NULL && imports_current(compiler, node, module)) {
+      array_list_push(compiler->modules, module);
+      return module;
+    }
+    clm_module_free(module);
+    if (!hasSource) {
+      clm_error(compiler, node->lineNo, node->colNo,
+                "%s is out of date, and there is no %s.clm to remake it from",
+                interfacePath, name);
+      return NULL;
+    }
+  }
+  if (hasSource)
+    return compile_module(compiler, node, sourcePath, interfacePath);
+  return NULL;
+}
+
+// the directory of the program, then the module path
+static ClmModule *open_module(ClmCompiler *compiler, ClmStmtNode *node) {
+  const char *fileName = compiler->fileName;
+  const char *slash = fileName != NULL ? strrchr(fileName, '/') : NULL;
+#ifdef _WIN32
+  const char *backslash = fileName != NULL ? strrchr(fileName, '\\') : NULL;
+  if (backslash != NULL && (slash == NULL || backslash > slash))
+    slash = backslash;
+#endif
+  ClmModule *module = slash != NULL
+                          ? open_module_in(compiler, node, fileName,
+                                           slash - fileName)
+                          : open_module_in(compiler, node, ".", 1);
+
+  const char *dir = compiler->modulePath;
+  while (module == NULL && dir != NULL && *dir != '\0') {
+    const char *end = strchr(dir, CLM_PATH_SEPARATOR);
+    size_t length = end != NULL ? (size_t)(end - dir) : strlen(dir);
+    if (length > 0)
+      module = open_module_in(compiler, node, dir, length);
+    dir = end != NULL ? end + 1 : NULL;
+  }
+
+  if (module == NULL)
+    clm_error(compiler, node->lineNo, node->colNo,
+              "Unable to find module %s", node->importStmt.module);
+  return module;
+}
+
+static ClmModule *find_module(ClmCompiler *compiler, const char *name) {
+  int i;
+  for (i = 0; i < compiler->modules->length; i++) {
+    ClmModule *module = compiler->modules->data[i];
+    if (module->compiler == NULL && strcmp(module->name, name) == 0)
+      return module;
+  }
+  return NULL;
+}
+
+// the function generated with the program under name, if there is one
+static ClmModuleFunction *used_function(ClmCompiler *compiler,
+                                        const char *name) {
+  int i, index;
+  if (compiler->modules == NULL)
+    return NULL;
+  for (i = 0; i < compiler->modules->length; i++) {
+    ClmModule *module = compiler->modules->data[i];
+    if (module->functions != NULL && (index = find_function(module, name)) >= 0 &&
+        module->functions[index].used)
+      return &module->functions[index];
+  }
+  return NULL;
+}
+
+int clm_module_uses(ClmCompiler *compiler, const char *name) {
+  return used_function(compiler, name) != NULL;
+}
+
+// every function has one label, so a function two modules have is generated
+// once, and only if they have the same code
+static void use_function(ClmCompiler *compiler, ClmStmtNode *node,
+                         ClmModule *module, int index) {
+  ClmModuleFunction *function = &module->functions[index];
+  if (function->used)
+    return;
+  ClmModuleFunction *other = used_function(compiler, function->name);
+  if (other != NULL) {
+    if (other->codeLength != function->codeLength ||
+        memcmp(other->code, function->code, function->codeLength) != 0)
+      clm_error(compiler, node->lineNo, node->colNo,
+                "Function %s is in two modules and they differ",
+                function->name);
+    return;
+  }
+  function->used = 1;
+
+  ModuleTables tables;
+  module_tables(module, &tables);
+  const FunctionRecord *record = function->record;
+  unsigned int i;
+  for (i = 0; i < record->callsLength; i++) {
+    int callee = find_function(
+        module, module_string(&tables, tables.calls[record->firstCall + i]));
+    if (callee >= 0)
+      use_function(compiler, node, module, callee);
+  }
+}
+
+// the signature of the function as a declaration with no body, in the
+// importing compiler's arena
+static ClmStmtNode *declaration_of(ClmCompiler *compiler, ClmModule *module,
+                                   ClmModuleFunction *function) {
+  if (function->declaration != NULL)
+    return function->declaration;
+
+  ModuleTables tables;
+  module_tables(module, &tables);
+  const FunctionRecord *record = function->record;
+  ArrayList *params = array_list_new_arena(compiler->arena);
+  unsigned int i;
+  for (i = 0; i < record->paramsLength; i++) {
+    const ParamRecord *param = &tables.params[record->firstParam + i];
+    const char *name = module_string(&tables, param->name);
+    const char *rowVar = module_string(&tables, param->rowVar);
+    const char *colVar = module_string(&tables, param->colVar);
+    array_list_push(
+        params,
+        clm_exp_new_param(compiler, string_intern(compiler, name),
+                          (ClmType)param->type, param->rows, param->cols,
+                          rowVar != NULL ? string_intern(compiler, rowVar)
+                                         : NULL,
+                          colVar != NULL ? string_intern(compiler, colVar)
+                                         : NULL));
+  }
+
+  const char *rowVar = module_string(&tables, record->returnRowVar);
+  const char *colVar = module_string(&tables, record->returnColVar);
+  function->declaration = clm_stmt_new_dec(
+      compiler, string_intern(compiler, function->name), params,
+      (ClmType)record->returnType, record->returnRows, record->returnCols,
+      rowVar != NULL ? string_intern(compiler, rowVar) : NULL,
+      colVar != NULL ? string_intern(compiler, colVar) : NULL,
+      array_list_new_arena(compiler->arena));
+  return function->declaration;
+}
+
+ArrayList *clm_module_import(ClmCompiler *compiler, ClmStmtNode *node) {
+  if (compiler->modules == NULL)
+    compiler->modules = array_list_new(clm_module_free);
+
+  ClmModule *module = find_module(compiler, node->importStmt.module);
+  if (module == NULL)
+    module = open_module(compiler, node);
+
+  ArrayList *declarations = array_list_new_arena(compiler->arena);
+  if (module == NULL)
+    return declarations;
+  ArrayList *names = node->importStmt.names;
+  int i;
+  for (i = 0; i < names->length; i++) {
+    const char *name = names->data[i];
+    int index = find_function(module, name);
+    if (index < 0 ||
+        !((const FunctionRecord *)module->functions[index].record)->exported) {
+      clm_error(compiler, node->lineNo, node->colNo,
+                "Module %s has no function %s", node->importStmt.module, name);
+      continue;
+    }
+    use_function(compiler, node, module, index);
+    array_list_push(
+        declarations,
+        declaration_of(compiler, module, &module->functions[index]));
+  }
+  return declarations;
+}
@@ -0,0 +1,73 @@
+#ifndef CLM_MODULE_H
+#define CLM_MODULE_H
+
+#include "clm.h"
+#include "clm_ast.h"
+
+//
+// Modules
+//
+// import a, b from name looks for name.clmi, the binary interface of a
+// module, in the directory of the importing file and then in each directory
+// of the compiler's modulePath. an interface has the signature of every
+// function of the module, the names of the functions each of them calls, and
+// their generated code, so importing a module reads one file and parses
+// nothing. if only name.clm is there, or it changed after its interface was
+// written, the module is compiled and its interface is written next to it
+//
+// a module only declares functions. the functions it imports from other
+// modules are kept in its interface too, so a program that imports it has
+// everything it calls. only the functions a program imports, and the ones
+// they call, are generated with it
+//
+// interfaces are written in the byte order of the machine, they are made and
+// read by the same compiler
+//
+
+// the extension of an interface file
+#define CLM_MODULE_EXTENSION ".clmi"
+
+typedef struct ClmModuleFunction {
+  const char *name; // in the module's data
+  const char *code;
+  size_t codeLength;
+  int spillSlots;
+  int gemmUsed;
+  const void *record; // the rest of it, in the module's data
+
+  // set by the program importing it
+  int used; // generated with the program
+  ClmStmtNode *declaration; // made the first time it is imported
+} ClmModuleFunction;
+
+typedef struct ClmModule {
+  const char *name; // interned by the importing compiler
+  char *data;       // the interface file
+  size_t length;
+  ClmModuleFunction *functions;
+  int functionsLength;
+  int *table; // indices of functions by name, -1 where empty
+  int tableSize;
+  // while the module is compiled from source
+  ClmCompiler *compiler;
+  ClmTokens *tokens;
+} ClmModule;
+
+void clm_module_free(void *module);
+
+// resolves an import statement of the current compiler: finds or compiles the
+// module, marks the functions it names and the ones they call as used, and
+// returns the declarations of the ones it names, in order, as
+// STMT_TYPE_FUNC_DEC nodes without bodies
+ArrayList *clm_module_import(ClmCompiler *compiler, ClmStmtNode *node);
+
+// whether a function named name is generated with the program because a
+// module it imported uses it
+int clm_module_uses(ClmCompiler *compiler, const char *name);
+
+// writes the interface of a checked and optimized module. returns 0 if it
+// couldn't be written
+int clm_module_write(ClmCompiler *compiler, ArrayList *statements,
+                     ClmScope *globalScope, const char *path);
+
+#endif
@@ -1,26 +1,933 @@
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+
 #include "clm.h"
 #include "clm_ast.h"
+#include "clm_scope.h"
+
+// constant matrices bigger than this are left for the runtime, folding them
+// would only trade a loop for a very long run of pushes
+#define MAX_FOLDED_MATRIX_SIZE 1024
+
+// the passes keep running until none of them change anything, this is just a
+// guard against passes undoing each other forever
+#define MAX_OPTIMIZER_ITERATIONS 32
+
+typedef enum OptimizerPassKind {
+  PASS_EXPRESSION, // runs on every expression, children first
+  PASS_STATEMENTS, // runs on every list of statements, nested lists first
+  PASS_PROGRAM     // runs once on the top level statements
+} OptimizerPassKind;
+
+typedef struct {
+  ClmCompiler *compiler;
+  ClmScope *globalScope;
+} OptimizerData;
+
+typedef struct OptimizerPass {
+  const char *name;
+  OptimizerPassKind kind;
+  union {
+    void (*expression)(OptimizerData *data, ClmExpNode *node, int *changed);
+    void (*statements)(OptimizerData *data, ArrayList *statements,
+                       int *changed);
+  };
+} OptimizerPass;
+
+static void foldConstants(OptimizerData *data, ClmExpNode *node, int *changed);
+static void foldMatrices(OptimizerData *data, ClmExpNode *node, int *changed);
+static void reduceDoubleUnary(OptimizerData *data, ClmExpNode *node,
+                              int *changed);
+static void reduceIdArithmetic(OptimizerData *data, ClmExpNode *node,
+                               int *changed);
+static void eliminateDeadCode(OptimizerData *data, ArrayList *statements,
+                              int *changed);
+static void reduceConditionals(OptimizerData *data, ArrayList *statements,
+                               int *changed);
+static void propagateConstants(OptimizerData *data, ArrayList *statements,
+                               int *changed);
+
+// at most CLM_MAX_OPTIMIZER_PASSES, the compiler has a bit for each
+static const OptimizerPass passes[] = {
+    {"fold-constants", PASS_EXPRESSION, {.expression = foldConstants}},
+    {"fold-matrices", PASS_EXPRESSION, {.expression = foldMatrices}},
+    {"reduce-double-unary", PASS_EXPRESSION, {.expression = reduceDoubleUnary}},
+    {"reduce-id-arithmetic", PASS_EXPRESSION,
+     {.expression = reduceIdArithmetic}},
+    {"propagate-constants", PASS_PROGRAM, {.statements = propagateConstants}},
+    {"reduce-conditionals", PASS_STATEMENTS,
+     {.statements = reduceConditionals}},
+    {"eliminate-dead-code", PASS_STATEMENTS, {.statements = eliminateDeadCode}},
+};
+
+#define NUM_PASSES ((int)(sizeof(passes) / sizeof(passes[0])))
+
+/*
+ *
+ *  HELPERS
+ *
+ */
+
+// replaces node with replacement in place, so whatever points to node now
+// points to the replacement. node's old children are left in the arena
+static void replace_exp(ClmExpNode *node, ClmExpNode *replacement) {
+  int lineNo = node->lineNo, colNo = node->colNo;
+  *node = *replacement;
+  node->lineNo = lineNo;
+  node->colNo = colNo;
+}
+
+static int is_number(ClmExpNode *node) {
+  return node->type == EXP_TYPE_INT || node->type == EXP_TYPE_FLOAT;
+}
+
+static float number_value(ClmExpNode *node) {
+  return node->type == EXP_TYPE_INT ? (float)node->ival : node->fval;
+}
+
+static int is_int_value(ClmExpNode *node, int val) {
+  return node->type == EXP_TYPE_INT && node->ival == val;
+}
+
+// conditions are only taken when they are exactly 1, see gen_conditional
+static int is_true(ClmExpNode *node) { return is_int_value(node, 1); }
+
+static int is_constant_matrix(ClmExpNode *node) {
+  return node->type == EXP_TYPE_MAT_DEC &&
+         node->matDecExp.size.rowVar == NULL &&
+         node->matDecExp.size.colVar == NULL &&
+         node->matDecExp.size.rows > 0 && node->matDecExp.size.cols > 0;
+}
+
+// matrices hold ints at runtime, so elements are truncated the same way
+// they are when the matrix is pushed
+static int matrix_element(ClmExpNode *node, int i) {
+  return node->matDecExp.arr == NULL ? 0 : (int)node->matDecExp.arr[i];
+}
+
+static void optimize_expression(OptimizerData *data, ClmExpNode *node,
+                                const OptimizerPass *pass, int *changed);
+static void optimize_statements(OptimizerData *data, ArrayList *statements,
+                                const OptimizerPass *pass, int *changed);
+
+/*
+ *
+ *  EXPRESSION PASSES
+ *
+ */
+
+// ints wrap around at runtime, overflowing a signed int here is undefined so
+// these are done unsigned
+static int wrap_add(int left, int right) {
+  return (int)((unsigned)left + (unsigned)right);
+}
+
+static int wrap_sub(int left, int right) {
+  return (int)((unsigned)left - (unsigned)right);
+}
+
+static int wrap_mul(int left, int right) {
+  return (int)((unsigned)left * (unsigned)right);
+}
+
+static int fold_int_arith(ArithOp op, int left, int right, int *out) {
+  switch (op) {
+  case ARITH_OP_ADD:
+    *out = wrap_add(left, right);
+    return 1;
+  case ARITH_OP_SUB:
+    *out = wrap_sub(left, right);
+    return 1;
+  case ARITH_OP_MULT:
+    *out = wrap_mul(left, right);
+    return 1;
+  case ARITH_OP_DIV:
+    // both trap here, leave them for the runtime
+    if (right == 0 || (left == INT_MIN && right == -1))
+      return 0;
+    *out = left / right;
+    return 1;
+  }
+  return 0;
+}
+
+static int fold_float_arith(ArithOp op, float left, float right, float *out) {
+  switch (op) {
+  case ARITH_OP_ADD:
+    *out = left + right;
+    return 1;
+  case ARITH_OP_SUB:
+    *out = left - right;
+    return 1;
+  case ARITH_OP_MULT:
+    *out = left * right;
+    return 1;
+  case ARITH_OP_DIV:
+    if (right == 0)
+      return 0;
+    *out = left / right;
+    return 1;
+  }
+  return 0;
+}
+
+static int fold_bool(BoolOp op, ClmExpNode *left, ClmExpNode *right,
+                     int *out) {
+  // two ints are compared as ints at runtime, floats can't hold every int
+  // above 2^24. an int and a float are compared as floats
+  int ints = left->type == EXP_TYPE_INT && right->type == EXP_TYPE_INT;
+  int li = left->ival, ri = right->ival;
+  float l = number_value(left), r = number_value(right);
+  switch (op) {
+  case BOOL_OP_AND:
+  case BOOL_OP_OR:
+    // these are bitwise and & or at runtime, and only work on ints
+    if (!ints)
+      return 0;
+    *out = op == BOOL_OP_AND ? li & ri : li | ri;
+    return 1;
+  case BOOL_OP_EQ:
+    *out = ints ? li == ri : l == r;
+    return 1;
+  case BOOL_OP_NEQ:
+    *out = ints ? li != ri : l != r;
+    return 1;
+  case BOOL_OP_GT:
+    *out = ints ? li > ri : l > r;
+    return 1;
+  case BOOL_OP_LT:
+    *out = ints ? li < ri : l < r;
+    return 1;
+  case BOOL_OP_GTE:
+    *out = ints ? li >= ri : l >= r;
+    return 1;
+  case BOOL_OP_LTE:
+    *out = ints ? li <= ri : l <= r;
+    return 1;
+  }
+  return 0;
+}
+
+// 1 + 2 -> 3, 2 * 1.5 -> 3.0, 3 < 4 -> 1, -(2) -> -2
+static void foldConstants(OptimizerData *data, ClmExpNode *node, int *changed) {
+  switch (node->type) {
+  case EXP_TYPE_ARITH: {
+    ClmExpNode *left = node->arithExp.left;
+    ClmExpNode *right = node->arithExp.right;
+    if (!is_number(left) || !is_number(right))
+      return;
+
+    if (left->type == EXP_TYPE_INT && right->type == EXP_TYPE_INT) {
+      int val;
+      if (fold_int_arith(node->arithExp.operand, left->ival, right->ival,
+                         &val)) {
+        replace_exp(node, clm_exp_new_int(data->compiler, val));
+        (*changed)++;
+      }
+    } else {
+      float val;
+      if (fold_float_arith(node->arithExp.operand, number_value(left),
+                           number_value(right), &val)) {
+        replace_exp(node, clm_exp_new_float(data->compiler, val));
+        (*changed)++;
+      }
+    }
+    break;
+  }
+  case EXP_TYPE_BOOL: {
+    int val;
+    if (is_number(node->boolExp.left) && is_number(node->boolExp.right) &&
+        fold_bool(node->boolExp.operand, node->boolExp.left,
+                  node->boolExp.right, &val)) {
+      replace_exp(node, clm_exp_new_int(data->compiler, val));
+      (*changed)++;
+    }
+    break;
+  }
+  case EXP_TYPE_UNARY: {
+    ClmExpNode *operand = node->unaryExp.node;
+    if (node->unaryExp.operand == UNARY_OP_MINUS &&
+        operand->type == EXP_TYPE_INT) {
+      replace_exp(node,
+                  clm_exp_new_int(data->compiler, wrap_sub(0, operand->ival)));
+      (*changed)++;
+    } else if (node->unaryExp.operand == UNARY_OP_MINUS &&
+               operand->type == EXP_TYPE_FLOAT) {
+      replace_exp(node, clm_exp_new_float(data->compiler, -operand->fval));
+      (*changed)++;
+    } else if (node->unaryExp.operand == UNARY_OP_NOT &&
+               operand->type == EXP_TYPE_INT) {
+      // not is xor 1 at runtime
+      replace_exp(node, clm_exp_new_int(data->compiler, operand->ival ^ 1));
+      (*changed)++;
+    }
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+static ClmExpNode *new_matrix(OptimizerData *data, float *arr, int rows,
+                              int cols) {
+  return clm_exp_new_mat_dec(data->compiler, arr, rows * cols, cols);
+}
+
+static ClmExpNode *fold_mat_add_mat(OptimizerData *data, ArithOp op,
+                                    ClmExpNode *left, ClmExpNode *right) {
+  int rows = left->matDecExp.size.rows, cols = left->matDecExp.size.cols;
+  if (rows != right->matDecExp.size.rows || cols != right->matDecExp.size.cols)
+    return NULL;
+
+  float *arr = clm_alloc(data->compiler, rows * cols * sizeof(*arr));
+  int i;
+  for (i = 0; i < rows * cols; i++) {
+    int l = matrix_element(left, i), r = matrix_element(right, i);
+    arr[i] = (float)(op == ARITH_OP_ADD ? wrap_add(l, r) : wrap_sub(l, r));
+  }
+  return new_matrix(data, arr, rows, cols);
+}
+
+static ClmExpNode *fold_mat_mul_mat(OptimizerData *data, ClmExpNode *left,
+                                    ClmExpNode *right) {
+  int rows = left->matDecExp.size.rows, inner = left->matDecExp.size.cols;
+  int cols = right->matDecExp.size.cols;
+  if (inner != right->matDecExp.size.rows)
+    return NULL;
+
+  float *arr = clm_alloc(data->compiler, rows * cols * sizeof(*arr));
+  int r, c, k;
+  for (r = 0; r < rows; r++) {
+    for (c = 0; c < cols; c++) {
+      int sum = 0;
+      for (k = 0; k < inner; k++) {
+        sum = wrap_add(sum, wrap_mul(matrix_element(left, r * inner + k),
+                                     matrix_element(right, k * cols + c)));
+      }
+      arr[r * cols + c] = (float)sum;
+    }
+  }
+  return new_matrix(data, arr, rows, cols);
+}
+
+static ClmExpNode *fold_int_mul_mat(OptimizerData *data, int scale,
+                                    ClmExpNode *matrix) {
+  int rows = matrix->matDecExp.size.rows, cols = matrix->matDecExp.size.cols;
+  float *arr = clm_alloc(data->compiler, rows * cols * sizeof(*arr));
+  int i;
+  for (i = 0; i < rows * cols; i++) {
+    arr[i] = (float)wrap_mul(scale, matrix_element(matrix, i));
+  }
+  return new_matrix(data, arr, rows, cols);
+}
+
+static ClmExpNode *fold_mat_transpose(OptimizerData *data, ClmExpNode *matrix) {
+  int rows = matrix->matDecExp.size.rows, cols = matrix->matDecExp.size.cols;
+  float *arr = clm_alloc(data->compiler, rows * cols * sizeof(*arr));
+  int r, c;
+  for (r = 0; r < rows; r++) {
+    for (c = 0; c < cols; c++) {
+      arr[c * rows + r] = (float)matrix_element(matrix, r * cols + c);
+    }
+  }
+  return new_matrix(data, arr, cols, rows);
+}
+
+static int fits_folded_matrix(int rows, int cols) {
+  return rows * cols <= MAX_FOLDED_MATRIX_SIZE;
+}
+
+// {1 2,3 4} + {1 1,1 1} -> {2 3,4 5}, 2 * [2:2] -> [2:2], -{1 2} -> {-1 -2}
+static void foldMatrices(OptimizerData *data, ClmExpNode *node, int *changed) {
+  ClmExpNode *folded = NULL;
+
+  if (node->type == EXP_TYPE_ARITH) {
+    ClmExpNode *left = node->arithExp.left;
+    ClmExpNode *right = node->arithExp.right;
+    ArithOp op = node->arithExp.operand;
+
+    if (is_constant_matrix(left) && is_constant_matrix(right)) {
+      if ((op == ARITH_OP_ADD || op == ARITH_OP_SUB) &&
+          fits_folded_matrix(left->matDecExp.size.rows,
+                             left->matDecExp.size.cols))
+        folded = fold_mat_add_mat(data, op, left, right);
+      else if (op == ARITH_OP_MULT &&
+               fits_folded_matrix(left->matDecExp.size.rows,
+                                  right->matDecExp.size.cols))
+        folded = fold_mat_mul_mat(data, left, right);
+    } else if (op == ARITH_OP_MULT && left->type == EXP_TYPE_INT &&
+               is_constant_matrix(right) &&
+               fits_folded_matrix(right->matDecExp.size.rows,
+                                  right->matDecExp.size.cols)) {
+      folded = fold_int_mul_mat(data, left->ival, right);
+    } else if (op == ARITH_OP_MULT && right->type == EXP_TYPE_INT &&
+               is_constant_matrix(left) &&
+               fits_folded_matrix(left->matDecExp.size.rows,
+                                  left->matDecExp.size.cols)) {
+      folded = fold_int_mul_mat(data, right->ival, left);
+    }
+  } else if (node->type == EXP_TYPE_UNARY &&
+             is_constant_matrix(node->unaryExp.node)) {
+    ClmExpNode *matrix = node->unaryExp.node;
+    if (!fits_folded_matrix(matrix->matDecExp.size.rows,
+                            matrix->matDecExp.size.cols))
+      return;
+
+    if (node->unaryExp.operand == UNARY_OP_MINUS)
+      folded = fold_int_mul_mat(data, -1, matrix);
+    else if (node->unaryExp.operand == UNARY_OP_TRANSPOSE)
+      folded = fold_mat_transpose(data, matrix);
+  }
+
+  if (folded != NULL) {
+    replace_exp(node, folded);
+    (*changed)++;
+  }
+}
+
+// --x -> x, !!x -> x, A~~ -> A
+static void reduceDoubleUnary(OptimizerData *data, ClmExpNode *node,
+                              int *changed) {
+  if (node->type != EXP_TYPE_UNARY)
+    return;
+
+  ClmExpNode *operand = node->unaryExp.node;
+  if (operand->type == EXP_TYPE_UNARY &&
+      operand->unaryExp.operand == node->unaryExp.operand) {
+    clm_exp_unbox_unary(node);
+    clm_exp_unbox_unary(node);
+    (*changed)++;
+  }
+}
+
+// x + 0 -> x, 0 + x -> x, x - 0 -> x, x * 1 -> x, 1 * x -> x, x / 1 -> x
+// only int literals are reduced, x + 0.0 is a float even when x is an int
+static void reduceIdArithmetic(OptimizerData *data, ClmExpNode *node,
+                               int *changed) {
+  if (node->type != EXP_TYPE_ARITH)
+    return;
+
+  ClmExpNode *left = node->arithExp.left;
+  ClmExpNode *right = node->arithExp.right;
+
+  switch (node->arithExp.operand) {
+  case ARITH_OP_ADD:
+    if (is_int_value(right, 0)) {
+      clm_exp_unbox_left(node);
+      (*changed)++;
+    } else if (is_int_value(left, 0)) {
+      clm_exp_unbox_right(node);
+      (*changed)++;
+    }
+    break;
+  case ARITH_OP_SUB:
+    if (is_int_value(right, 0)) {
+      clm_exp_unbox_left(node);
+      (*changed)++;
+    }
+    break;
+  case ARITH_OP_MULT:
+    if (is_int_value(right, 1)) {
+      clm_exp_unbox_left(node);
+      (*changed)++;
+    } else if (is_int_value(left, 1)) {
+      clm_exp_unbox_right(node);
+      (*changed)++;
+    }
+    break;
+  case ARITH_OP_DIV:
+    if (is_int_value(right, 1)) {
+      clm_exp_unbox_left(node);
+      (*changed)++;
+    }
+    break;
+  }
+}
+
+/*
+ *
+ *  STATEMENT PASSES
+ *
+ */
+
+// removes everything after a return, and while loops that never run
+static void eliminateDeadCode(OptimizerData *data, ArrayList *statements,
+                              int *changed) {
+  int i;
+  for (i = 0; i < statements->length; i++) {
+    ClmStmtNode *node = statements->data[i];
+
+    if (node->type == STMT_TYPE_WHILE_LOOP &&
+        node->whileLoopStmt.condition->type == EXP_TYPE_INT &&
+        !is_true(node->whileLoopStmt.condition)) {
+      array_list_remove(statements, i);
+      i--;
+      (*changed)++;
+      continue;
+    }
+
+    if (node->type == STMT_TYPE_RET) {
+      while (statements->length > i + 1) {
+        array_list_remove(statements, i + 1);
+        (*changed)++;
+      }
+    }
+  }
+}
+
+// if 1 then a else b end -> if 1 then a end
+// if 0 then a else b end -> if 1 then b end
+// if 0 then a end        -> removed
+// a conditional that is left with a condition of 1 is generated without a
+// test. the bodies keep their own scopes, so they aren't merged into the
+// surrounding statements
+static void reduceConditionals(OptimizerData *data, ArrayList *statements,
+                               int *changed) {
+  int i;
+  for (i = 0; i < statements->length; i++) {
+    ClmStmtNode *node = statements->data[i];
+    if (node->type != STMT_TYPE_CONDITIONAL ||
+        node->conditionStmt.condition->type != EXP_TYPE_INT)
+      continue;
+
+    if (is_true(node->conditionStmt.condition)) {
+      if (node->conditionStmt.falseBody != NULL) {
+        node->conditionStmt.falseBody = NULL;
+        node->conditionStmt.falseScope = NULL;
+        (*changed)++;
+      }
+    } else if (node->conditionStmt.falseBody != NULL) {
+      node->conditionStmt.trueBody = node->conditionStmt.falseBody;
+      node->conditionStmt.trueScope = node->conditionStmt.falseScope;
+      node->conditionStmt.falseBody = NULL;
+      node->conditionStmt.falseScope = NULL;
+      node->conditionStmt.condition->ival = 1;
+      (*changed)++;
+    } else {
+      array_list_remove(statements, i);
+      i--;
+      (*changed)++;
+    }
+  }
+}
+
+typedef struct ConstantSymbol {
+  ClmSymbol *symbol;
+  int assignments;
+  ClmExpNode *value; // the literal assigned, NULL if it wasn't a literal
+} ConstantSymbol;
+
+static ConstantSymbol *find_constant(ArrayList *constants, ClmSymbol *symbol) {
+  int i;
+  for (i = 0; i < constants->length; i++) {
+    ConstantSymbol *constant = constants->data[i];
+    if (constant->symbol == symbol)
+      return constant;
+  }
+  return NULL;
+}
+
+static void count_assignment(ArrayList *constants, ClmSymbol *symbol,
+                             ClmExpNode *value) {
+  if (symbol == NULL)
+    return;
+
+  ConstantSymbol *constant = find_constant(constants, symbol);
+  if (constant == NULL) {
+    constant = malloc(sizeof(*constant));
+    constant->symbol = symbol;
+    constant->assignments = 0;
+    constant->value = value;
+    array_list_push(constants, constant);
+  }
+  constant->assignments++;
+}
+
+static void count_assignments(ArrayList *constants, ClmScope *scope,
+                              ArrayList *statements) {
+  int i;
+  for (i = 0; i < statements->length; i++) {
+    ClmStmtNode *node = statements->data[i];
+    switch (node->type) {
+    case STMT_TYPE_ASSIGN: {
+      ClmExpNode *lhs = node->assignStmt.lhs;
+      ClmExpNode *rhs = node->assignStmt.rhs;
+      int literal = clm_exp_has_no_inds(lhs) && is_number(rhs);
+      count_assignment(constants, lhs->indExp.symbol,
+                       literal ? rhs : NULL);
+      break;
+    }
+    case STMT_TYPE_CONDITIONAL:
+      count_assignments(constants, node->conditionStmt.trueScope,
+                        node->conditionStmt.trueBody);
+      if (node->conditionStmt.falseBody != NULL)
+        count_assignments(constants, node->conditionStmt.falseScope,
+                          node->conditionStmt.falseBody);
+      break;
+    case STMT_TYPE_FUNC_DEC:
+      count_assignments(constants, node->funcDecStmt.scope,
+                        node->funcDecStmt.body);
+      break;
+    case STMT_TYPE_FOR_LOOP: {
+      // the loop variable is assigned every iteration
+      ClmSymbol *symbol = node->forLoopStmt.var;
+      count_assignment(constants, symbol, NULL);
+      count_assignment(constants, symbol, NULL);
+      count_assignments(constants, scope, node->forLoopStmt.body);
+      break;
+    }
+    case STMT_TYPE_WHILE_LOOP:
+      count_assignments(constants, scope, node->whileLoopStmt.body);
+      break;
+    default:
+      break;
+    }
+  }
+}
+
+static int propagate_into_expression(OptimizerData *data, ArrayList *constants,
+                                     ClmScope *scope, ClmExpNode *node) {
+  if (node == NULL)
+    return 0;
+
+  int changed = 0;
+  int i;
+  switch (node->type) {
+  case EXP_TYPE_ARITH:
+    changed += propagate_into_expression(data, constants, scope,
+                                         node->arithExp.left);
+    changed +=
+        propagate_into_expression(data, constants, scope, node->arithExp.right);
+    break;
+  case EXP_TYPE_BOOL:
+    changed += propagate_into_expression(data, constants, scope,
+                                         node->boolExp.left);
+    changed += propagate_into_expression(data, constants, scope,
+                                         node->boolExp.right);
+    break;
+  case EXP_TYPE_CALL:
+    for (i = 0; i < node->callExp.params->length; i++) {
+      changed += propagate_into_expression(data, constants, scope,
+                                           node->callExp.params->data[i]);
+    }
+    break;
+  case EXP_TYPE_INDEX: {
+    if (!clm_exp_has_no_inds(node)) {
+      changed +=
+          propagate_into_expression(data, constants, scope,
+                                    node->indExp.rowIndex);
+      changed +=
+          propagate_into_expression(data, constants, scope,
+                                    node->indExp.colIndex);
+      changed +=
+          propagate_into_expression(data, constants, scope,
+                                    node->indExp.rowEnd);
+      changed +=
+          propagate_into_expression(data, constants, scope,
+                                    node->indExp.colEnd);
+      break;
+    }
+    ConstantSymbol *constant =
+        find_constant(constants, node->indExp.symbol);
+    if (constant != NULL && constant->assignments == 1 &&
+        constant->value != NULL) {
+      ClmExpNode *value = constant->value;
+      replace_exp(node, value->type == EXP_TYPE_INT
+                            ? clm_exp_new_int(data->compiler, value->ival)
+                            : clm_exp_new_float(data->compiler, value->fval));
+      changed++;
+    }
+    break;
+  }
+  case EXP_TYPE_MAT_DEC: {
+    // [n:m] where n and m are constants becomes a constant sized matrix
+    MatrixSize *size = &node->matDecExp.size;
+    ConstantSymbol *constant;
+    if (size->rowVar != NULL &&
+        (constant = find_constant(constants,
+                                  clm_scope_find(data->compiler, scope,
+                                                 size->rowVar))) &&
+        constant->assignments == 1 && constant->value != NULL &&
+        constant->value->type == EXP_TYPE_INT) {
+      size->rows = constant->value->ival;
+      size->rowVar = NULL;
+      changed++;
+    }
+    if (size->colVar != NULL &&
+        (constant = find_constant(constants,
+                                  clm_scope_find(data->compiler, scope,
+                                                 size->colVar))) &&
+        constant->assignments == 1 && constant->value != NULL &&
+        constant->value->type == EXP_TYPE_INT) {
+      size->cols = constant->value->ival;
+      size->colVar = NULL;
+      changed++;
+    }
+    break;
+  }
+  case EXP_TYPE_UNARY:
+    changed += propagate_into_expression(data, constants, scope,
+                                         node->unaryExp.node);
+    break;
+  default:
+    break;
+  }
+  return changed;
+}
+
+static int propagate_into_statements(OptimizerData *data, ArrayList *constants,
+                                     ClmScope *scope, ArrayList *statements) {
+  int changed = 0;
+  int i;
+  for (i = 0; i < statements->length; i++) {
+    ClmStmtNode *node = statements->data[i];
+    switch (node->type) {
+    case STMT_TYPE_ASSIGN:
+      // the variable being assigned stays, only its indices are read
+      changed += propagate_into_expression(
+          data, constants, scope, node->assignStmt.lhs->indExp.rowIndex);
+      changed += propagate_into_expression(
+          data, constants, scope, node->assignStmt.lhs->indExp.colIndex);
+      changed += propagate_into_expression(data, constants, scope,
+                                           node->assignStmt.lhs->indExp.rowEnd);
+      changed += propagate_into_expression(data, constants, scope,
+                                           node->assignStmt.lhs->indExp.colEnd);
+      changed +=
+          propagate_into_expression(data, constants, scope,
+                                    node->assignStmt.rhs);
+      break;
+    case STMT_TYPE_CALL:
+      changed += propagate_into_expression(data, constants, scope,
+                                           node->callExpr);
+      break;
+    case STMT_TYPE_CONDITIONAL:
+      changed += propagate_into_expression(data, constants, scope,
+                                           node->conditionStmt.condition);
+      changed += propagate_into_statements(data, constants,
+                                           node->conditionStmt.trueScope,
+                                           node->conditionStmt.trueBody);
+      if (node->conditionStmt.falseBody != NULL)
+        changed += propagate_into_statements(data, constants,
+                                             node->conditionStmt.falseScope,
+                                             node->conditionStmt.falseBody);
+      break;
+    case STMT_TYPE_FUNC_DEC:
+      changed += propagate_into_statements(data, constants,
+                                           node->funcDecStmt.scope,
+                                           node->funcDecStmt.body);
+      break;
+    case STMT_TYPE_FOR_LOOP:
+      changed +=
+          propagate_into_expression(data, constants, scope,
+                                    node->forLoopStmt.start);
+      changed +=
+          propagate_into_expression(data, constants, scope,
+                                    node->forLoopStmt.end);
+      changed +=
+          propagate_into_expression(data, constants, scope,
+                                    node->forLoopStmt.delta);
+      changed +=
+          propagate_into_statements(data, constants, scope,
+                                    node->forLoopStmt.body);
+      break;
+    case STMT_TYPE_WHILE_LOOP:
+      changed += propagate_into_expression(data, constants, scope,
+                                           node->whileLoopStmt.condition);
+      changed +=
+          propagate_into_statements(data, constants, scope,
+                                    node->whileLoopStmt.body);
+      break;
+    case STMT_TYPE_PRINT:
+      changed += propagate_into_expression(data, constants, scope,
+                                           node->printStmt.expression);
+      break;
+    case STMT_TYPE_RET:
+      changed += propagate_into_expression(data, constants, scope,
+                                           node->returnExpr);
+      break;
+    case STMT_TYPE_IMPORT:
+      break;
+    }
+  }
+  return changed;
+}
+
+// a variable that is only ever assigned a literal once is replaced by that
+// literal everywhere it is read. a variable can't be read before the
+// assignment that declares it, so every read sees the literal
+static void propagateConstants(OptimizerData *data, ArrayList *statements,
+                               int *changed) {
+  ArrayList *constants = array_list_new(free);
+  count_assignments(constants, data->globalScope, statements);
+  *changed +=
+      propagate_into_statements(data, constants, data->globalScope, statements);
+  array_list_free(constants);
+}
+
+/*
+ *
+ *  PASS MANAGER
+ *
+ */
+
+static void optimize_expression(OptimizerData *data, ClmExpNode *node,
+                                const OptimizerPass *pass, int *changed) {
+  if (node == NULL || pass->kind != PASS_EXPRESSION)
+    return;
+
+  int i;
+  switch (node->type) {
+  case EXP_TYPE_ARITH:
+    optimize_expression(data, node->arithExp.left, pass, changed);
+    optimize_expression(data, node->arithExp.right, pass, changed);
+    break;
+  case EXP_TYPE_BOOL:
+    optimize_expression(data, node->boolExp.left, pass, changed);
+    optimize_expression(data, node->boolExp.right, pass, changed);
+    break;
+  case EXP_TYPE_CALL:
+    for (i = 0; i < node->callExp.params->length; i++) {
+      optimize_expression(data, node->callExp.params->data[i], pass, changed);
+    }
+    break;
+  case EXP_TYPE_INDEX:
+    optimize_expression(data, node->indExp.rowIndex, pass, changed);
+    optimize_expression(data, node->indExp.colIndex, pass, changed);
+    optimize_expression(data, node->indExp.rowEnd, pass, changed);
+    optimize_expression(data, node->indExp.colEnd, pass, changed);
+    break;
+  case EXP_TYPE_UNARY:
+    optimize_expression(data, node->unaryExp.node, pass, changed);
+    break;
+  default:
+    break;
+  }
+
+  pass->expression(data, node, changed);
+}
+
+static void optimize_statement(OptimizerData *data, ClmStmtNode *node,
+                               const OptimizerPass *pass, int *changed) {
+  switch (node->type) {
+  case STMT_TYPE_ASSIGN:
+    optimize_expression(data, node->assignStmt.lhs, pass, changed);
+    optimize_expression(data, node->assignStmt.rhs, pass, changed);
+    break;
+  case STMT_TYPE_CALL:
+    optimize_expression(data, node->callExpr, pass, changed);
+    break;
+  case STMT_TYPE_CONDITIONAL:
+    optimize_expression(data, node->conditionStmt.condition, pass, changed);
+    optimize_statements(data, node->conditionStmt.trueBody, pass, changed);
+    if (node->conditionStmt.falseBody != NULL)
+      optimize_statements(data, node->conditionStmt.falseBody, pass, changed);
+    break;
+  case STMT_TYPE_FUNC_DEC:
+    optimize_statements(data, node->funcDecStmt.body, pass, changed);
+    break;
+  case STMT_TYPE_FOR_LOOP:
+    optimize_expression(data, node->forLoopStmt.start, pass, changed);
+    optimize_expression(data, node->forLoopStmt.end, pass, changed);
+    optimize_expression(data, node->forLoopStmt.delta, pass, changed);
+    optimize_statements(data, node->forLoopStmt.body, pass, changed);
+    break;
+  case STMT_TYPE_WHILE_LOOP:
+    optimize_expression(data, node->whileLoopStmt.condition, pass, changed);
+    optimize_statements(data, node->whileLoopStmt.body, pass, changed);
+    break;
+  case STMT_TYPE_PRINT:
+    optimize_expression(data, node->printStmt.expression, pass, changed);
+    break;
+  case STMT_TYPE_RET:
+    optimize_expression(data, node->returnExpr, pass, changed);
+    break;
+  case STMT_TYPE_IMPORT:
+    break;
+  }
+}
+
+static void optimize_statements(OptimizerData *data, ArrayList *statements,
+                                const OptimizerPass *pass, int *changed) {
+  int i;
+  for (i = 0; i < statements->length; i++) {
+    optimize_statement(data, statements->data[i], pass, changed);
+  }
+
+  if (pass->kind == PASS_STATEMENTS)
+    pass->statements(data, statements, changed);
+}
 
-// TODO
-static void foldConstants(ClmExpNode *node, int *changed);
+static int run_pass(OptimizerData *data, ArrayList *statements, int index) {
+  const OptimizerPass *pass = &passes[index];
+  int changed = 0;
+  if (pass->kind == PASS_PROGRAM) {
+    pass->statements(data, statements, &changed);
+  } else {
+    optimize_statements(data, statements, pass, &changed);
+  }
+  data->compiler->passChanges[index] += changed;
+  // nodes were replaced or had their sizes filled in
+  if (changed > 0)
+    clm_compiler_invalidate_types(data->compiler);
+  return changed;
+}
 
-// TODO
-static void foldMatrices(ClmExpNode *node, int *changed);
+static int pass_enabled(ClmCompiler *compiler, int index) {
+  return !(compiler->disabledPasses & (1u << index));
+}
 
-// TODO
-static void reduceDoubleUnary(ClmExpNode *node, int *changed);
+int clm_optimizer_set_pass(ClmCompiler *compiler, const char *name,
+                           int enabled) {
+  int i;
+  for (i = 0; i < NUM_PASSES; i++) {
+    if (string_equals(passes[i].name, name)) {
+      if (enabled)
+        compiler->disabledPasses &= ~(1u << i);
+      else
+        compiler->disabledPasses |= 1u << i;
+      return 1;
+    }
+  }
+  return 0;
+}
 
-// TODO
-static void reduceIdArithmetic(ClmExpNode *node, int *changed);
+void clm_optimizer_set_all_passes(ClmCompiler *compiler, int enabled) {
+  compiler->disabledPasses = enabled ? 0 : (1u << NUM_PASSES) - 1;
+}
 
-// TODO
-static void eliminateDeadCode(ArrayList *statements, int *changed);
+void clm_optimizer_print_report(ClmCompiler *compiler) {
+  int i;
+  printf("optimizer: %d iteration%s\n", compiler->optimizerIterations,
+         compiler->optimizerIterations == 1 ? "" : "s");
+  for (i = 0; i < NUM_PASSES; i++) {
+    if (pass_enabled(compiler, i))
+      printf("  %-22s %d\n", passes[i].name, compiler->passChanges[i]);
+    else
+      printf("  %-22s disabled\n", passes[i].name);
+  }
+}
 
-// TODO
-static void reduceConditionals(ArrayList *statements, int *changed);
+// runs every enabled pass until a whole round of them changes nothing
+void clm_optimizer_main(ClmCompiler *compiler, ArrayList *statements,
+                        ClmScope *globalScope) {
+  OptimizerData data;
+  data.compiler = compiler;
+  data.globalScope = globalScope;
 
-// TODO
-static void propagateConstants(ArrayList *statements, int *changed);
+  int i;
+  for (i = 0; i < NUM_PASSES; i++) {
+    compiler->passChanges[i] = 0;
+  }
 
-// TODO
-void clm_optimizer_main(ArrayList *statements, ClmScope *globalScope) {}
+  int changed, iterations = 0;
+  do {
+    changed = 0;
+    for (i = 0; i < NUM_PASSES; i++) {
+      if (pass_enabled(compiler, i))
+        changed += run_pass(&data, statements, i);
+    }
+    iterations++;
+  } while (changed > 0 && iterations < MAX_OPTIMIZER_ITERATIONS);
+  compiler->optimizerIterations = iterations;
+}
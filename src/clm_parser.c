@@ -1,3 +1,5 @@
+#include <string.h>
+
 #include "clm.h"
 #include "clm_ast.h"
 
@@ -5,189 +7,265 @@ typedef struct ClmParserData {
   ArrayList *parseTree; // ArrayList of ClmStmtNode
   int curInd;
   int numTokens;
-  ClmLexerToken **tokens; // pointer to ClmLexerData.tokens->data
-  char *prevTokenRaw;     // pointer to a token's raw str in ^
+  ClmTokens *tokens;
+  ClmCompiler *compiler;
+  // the elements of the matrix literal being parsed, in a buffer that doubles
+  // as it fills. it is here so an error can free it
+  float *numbers;
+  int numbersLength;
+  int numbersCapacity;
 } ClmParserData;
 
-static ClmParserData data;
+static void consume(ClmParserData *data) { data->curInd++; }
+
+static ClmLexerToken *curr(ClmParserData *data) {
+  return &data->tokens->data[data->curInd];
+}
 
-static void consume() { data.prevTokenRaw = data.tokens[data.curInd++]->raw; }
+static ClmLexerToken *prev(ClmParserData *data) {
+  return &data->tokens->data[data->curInd - 1];
+}
 
-static ClmLexerToken *curr() { return data.tokens[data.curInd]; }
+static ClmLexerToken *next(ClmParserData *data) {
+  return &data->tokens->data[data->curInd + 1];
+}
 
-static ClmLexerToken *prev() { return data.tokens[data.curInd - 1]; }
+// the text of the token just consumed
+static const char *prev_text(ClmParserData *data) {
+  return clm_token_text(data->compiler, data->tokens, prev(data));
+}
 
-static ClmLexerToken *next() { return data.tokens[data.curInd + 1]; }
+// read straight out of the source, which may not have a null after the token
+static int prev_int(ClmParserData *data) {
+  const char *digits = data->tokens->source + prev(data)->offset;
+  int i, val = 0;
+  for (i = 0; i < prev(data)->length; i++)
+    val = 10 * val + (digits[i] - '0');
+  return val;
+}
 
-static ArrayList *consume_statements(int ifElse);
-static ClmStmtNode *consume_for_loop();
-static ClmStmtNode *consume_while_loop();
-static ClmStmtNode *consume_function_decl();
-static ClmStmtNode *consume_statement();
-static int consume_int();
-static float consume_float();
-static int consume_int_or_id(char **dest);
-static ClmExpNode *consume_parameter();
-static ClmExpNode *consume_lhs();
-static ClmExpNode *consume_expression();
-static ClmExpNode *consume_expression_2();
-static ClmExpNode *consume_expression_3();
-static ClmExpNode *consume_expression_4();
-static ClmExpNode *consume_expression_5();
-static ClmExpNode *consume_expression_6();
+static float prev_float(ClmParserData *data) {
+  char buffer[64];
+  int length = prev(data)->length < 63 ? prev(data)->length : 63;
+  memcpy(buffer, data->tokens->source + prev(data)->offset, length);
+  buffer[length] = '\0';
+  return atof(buffer);
+}
 
-static int accept(ClmLexerSymbol symbol) {
-  if (curr()->sym == symbol) {
-    consume();
+static ArrayList *consume_statements(ClmParserData *data, int ifElse);
+static ClmStmtNode *consume_for_loop(ClmParserData *data);
+static ClmStmtNode *consume_while_loop(ClmParserData *data);
+static ClmStmtNode *consume_function_decl(ClmParserData *data);
+static ClmStmtNode *consume_import(ClmParserData *data);
+static ClmStmtNode *consume_statement(ClmParserData *data);
+static int consume_int(ClmParserData *data);
+static float consume_float(ClmParserData *data);
+static int consume_int_or_id(ClmParserData *data, const char **dest);
+static ClmExpNode *consume_parameter(ClmParserData *data);
+static ClmExpNode *consume_range_end(ClmParserData *data);
+static ClmExpNode *consume_lhs(ClmParserData *data);
+static ClmExpNode *consume_expression(ClmParserData *data);
+static ClmExpNode *consume_expression_2(ClmParserData *data);
+static ClmExpNode *consume_expression_3(ClmParserData *data);
+static ClmExpNode *consume_expression_4(ClmParserData *data);
+static ClmExpNode *consume_expression_5(ClmParserData *data);
+static ClmExpNode *consume_expression_6(ClmParserData *data);
+
+static int accept(ClmParserData *data, ClmLexerSymbol symbol) {
+  if (curr(data)->sym == symbol) {
+    consume(data);
     return 1;
   }
   return 0;
 }
 
-static int expect(ClmLexerSymbol symbol) {
-  if (accept(symbol)) {
+static int expect(ClmParserData *data, ClmLexerSymbol symbol) {
+  if (accept(data, symbol)) {
     return 1;
   }
-  clm_error(curr()->lineNo, curr()->colNo,
+  clm_error(data->compiler, curr(data)->lineNo, curr(data)->colNo,
             "Expected token '%s', but found token '%s'",
-            clmLexerSymbolStrings[symbol], clmLexerSymbolStrings[curr()->sym]);
+            clmLexerSymbolStrings[symbol],
+            clmLexerSymbolStrings[curr(data)->sym]);
   return 0;
 }
 
-ArrayList *clm_parser_main(ArrayList *tokens) {
+static void parse(void *data) {
+  ClmParserData *parser = data;
+  parser->parseTree = consume_statements(parser, 0);
+}
+
+static void parse_error(void *data) {
+  ClmParserData *parser = data;
+  free(parser->numbers);
+}
+
+ArrayList *clm_parser_main(ClmCompiler *compiler, ClmTokens *tokens) {
+  ClmParserData data;
   data.curInd = 0;
   data.numTokens = tokens->length;
-  data.tokens = (ClmLexerToken **)tokens->data;
-  return consume_statements(0);
+  data.tokens = tokens;
+  data.compiler = compiler;
+  data.numbers = NULL;
+  clm_recover_with(compiler, parse, parse_error, &data);
+  return data.parseTree;
 }
 
 void clm_print_statements(ArrayList *parseTree) {
   array_list_foreach_2(parseTree, 0, clm_stmt_print);
 }
 
-static ArrayList *consume_statements(int ifElse) {
-  ArrayList *statements = array_list_new(clm_stmt_free);
+static ArrayList *consume_statements(ClmParserData *data, int ifElse) {
+  ArrayList *statements = array_list_new_arena(data->compiler->arena);
 
   // if we are parsing an if else and an else is next, we don't want to handle
   // that here... it is parsed in the consume_statement function
   // when we parse the actual if else
-  while (!accept(KEYWORD_END) && !(ifElse && curr()->sym == KEYWORD_ELSE)) {
-    array_list_push(statements, consume_statement());
+  while (!accept(data, KEYWORD_END) &&
+         !(ifElse && curr(data)->sym == KEYWORD_ELSE)) {
+    array_list_push(statements, consume_statement(data));
   }
 
   return statements;
 }
 
-static int curr_is_int() {
-  return curr()->sym == LITERAL_INT ||
-         (curr()->sym == TOKEN_MINUS && next()->sym == LITERAL_INT);
+static int curr_is_int(ClmParserData *data) {
+  return curr(data)->sym == LITERAL_INT ||
+         (curr(data)->sym == TOKEN_MINUS && next(data)->sym == LITERAL_INT);
 }
 
-static int curr_is_float() {
-  return curr()->sym == LITERAL_FLOAT ||
-         (curr()->sym == TOKEN_MINUS && next()->sym == LITERAL_FLOAT);
+static int curr_is_float(ClmParserData *data) {
+  return curr(data)->sym == LITERAL_FLOAT ||
+         (curr(data)->sym == TOKEN_MINUS && next(data)->sym == LITERAL_FLOAT);
 }
 
-static int curr_is_number() { return curr_is_int() || curr_is_float(); }
+static int curr_is_number(ClmParserData *data) {
+  return curr_is_int(data) || curr_is_float(data);
+}
 
-static int consume_int() {
+static int consume_int(ClmParserData *data) {
   int val = 0;
   int neg = 0;
-  if (accept(TOKEN_MINUS))
+  if (accept(data, TOKEN_MINUS))
     neg = 1;
-  expect(LITERAL_INT);
+  expect(data, LITERAL_INT);
 
-  val = atoi(data.prevTokenRaw);
+  val = prev_int(data);
   return neg ? -val : val;
 }
 
-static float consume_float() {
+static float consume_float(ClmParserData *data) {
   float val = 0;
   int neg = 0;
-  if (accept(TOKEN_MINUS)) {
+  if (accept(data, TOKEN_MINUS)) {
     neg = 1;
   }
-  expect(LITERAL_FLOAT);
-  val = atof(data.prevTokenRaw);
+  expect(data, LITERAL_FLOAT);
+  val = prev_float(data);
   return neg ? -val : val;
 }
 
-static float consume_number() {
-  if (curr_is_int()) {
-    return consume_int();
+static float consume_number(ClmParserData *data) {
+  if (curr_is_int(data)) {
+    return consume_int(data);
+  }
+  return consume_float(data);
+}
+
+static void push_number(ClmParserData *data) {
+  if (data->numbersLength == data->numbersCapacity) {
+    data->numbersCapacity = 2 * data->numbersCapacity;
+    data->numbers = realloc(data->numbers,
+                            data->numbersCapacity * sizeof(*data->numbers));
   }
-  return consume_float();
+  data->numbers[data->numbersLength++] = consume_number(data);
 }
 
-static int consume_int_or_id(char **dest) {
-  if (accept(LITERAL_INT)) {
+static int consume_int_or_id(ClmParserData *data, const char **dest) {
+  if (accept(data, LITERAL_INT)) {
     dest = NULL;
-    return atoi(data.prevTokenRaw);
+    return prev_int(data);
   }
-  expect(LITERAL_ID);
-  *dest = data.prevTokenRaw;
+  expect(data, LITERAL_ID);
+  *dest = prev_text(data);
   return 0;
 }
 
 // id[r:c]
 // id:type
-static ClmExpNode *consume_parameter() {
+static ClmExpNode *consume_parameter(ClmParserData *data) {
   ClmExpNode *node = NULL;
-  char *name;
+  const char *name;
   ClmType type;
-  int rows, cols;
-  char *rowVar, *colVar;
+  int rows = 0, cols = 0;
+  const char *rowVar = NULL, *colVar = NULL;
 
-  if (accept(LITERAL_ID)) {
-    name = data.prevTokenRaw;
+  if (accept(data, LITERAL_ID)) {
+    name = prev_text(data);
 
-    if (accept(TOKEN_LBRACK)) {
-      rows = consume_int_or_id(&rowVar);
+    if (accept(data, TOKEN_LBRACK)) {
+      rows = consume_int_or_id(data, &rowVar);
 
-      expect(TOKEN_COLON);
+      expect(data, TOKEN_COLON);
 
-      cols = consume_int_or_id(&colVar);
+      cols = consume_int_or_id(data, &colVar);
 
-      expect(TOKEN_RBRACK);
+      expect(data, TOKEN_RBRACK);
 
       type = CLM_TYPE_MATRIX;
     } else {
-      expect(TOKEN_COLON);
-      if (accept(KEYWORD_INT)) {
+      expect(data, TOKEN_COLON);
+      if (accept(data, KEYWORD_INT)) {
         type = CLM_TYPE_INT;
-      } else if (accept(KEYWORD_FLOAT)) {
+      } else if (accept(data, KEYWORD_FLOAT)) {
         type = CLM_TYPE_FLOAT;
-      } else if (accept(KEYWORD_STRING)) {
+      } else if (accept(data, KEYWORD_STRING)) {
         type = CLM_TYPE_STRING;
       }
     }
 
-    node = clm_exp_new_param(name, type, rows, cols, rowVar, colVar);
-    node->lineNo = prev()->lineNo;
-    node->colNo = prev()->colNo;
+    node = clm_exp_new_param(data->compiler, name, type, rows, cols, rowVar,
+                             colVar);
+    node->lineNo = prev(data)->lineNo;
+    node->colNo = prev(data)->colNo;
   }
   return node;
 }
 
-static ClmExpNode *consume_lhs() {
-  int lineNo = curr()->lineNo, colNo = curr()->colNo;
+// the end of a range index, after the start has been consumed
+static ClmExpNode *consume_range_end(ClmParserData *data) {
+  if (!accept(data, TOKEN_PERIOD))
+    return NULL;
+  expect(data, TOKEN_PERIOD);
+  return consume_expression(data);
+}
+
+static ClmExpNode *consume_lhs(ClmParserData *data) {
+  int lineNo = curr(data)->lineNo, colNo = curr(data)->colNo;
 
   ClmExpNode *node = NULL;
-  expect(LITERAL_ID);
-  char *name = data.prevTokenRaw;
+  expect(data, LITERAL_ID);
+  const char *name = prev_text(data);
 
   ClmExpNode *rowIndex = NULL, *colIndex = NULL;
-  if (accept(TOKEN_LBRACK)) {
-    // accepts A[x,y] A[,y] A[x,] A[,]
-    if (next()->sym != TOKEN_COMMA)
-      rowIndex = consume_expression();
-    expect(TOKEN_COMMA);
-    if (next()->sym != TOKEN_RBRACK)
-      colIndex = consume_expression();
-    expect(TOKEN_RBRACK);
+  ClmExpNode *rowEnd = NULL, *colEnd = NULL;
+  if (accept(data, TOKEN_LBRACK)) {
+    // accepts A[x,y] A[,y] A[x,] A[,], where x and y can be ranges a..b
+    if (curr(data)->sym != TOKEN_COMMA) {
+      rowIndex = consume_expression(data);
+      rowEnd = consume_range_end(data);
+    }
+    expect(data, TOKEN_COMMA);
+    if (curr(data)->sym != TOKEN_RBRACK) {
+      colIndex = consume_expression(data);
+      colEnd = consume_range_end(data);
+    }
+    expect(data, TOKEN_RBRACK);
   }
 
-  node = clm_exp_new_index(name, rowIndex, colIndex);
+  node = clm_exp_new_index(data->compiler, name, rowIndex, colIndex);
+  node->indExp.rowEnd = rowEnd;
+  node->indExp.colEnd = colEnd;
   node->lineNo = lineNo;
   node->colNo = colNo;
 
@@ -199,35 +277,36 @@ static ClmExpNode *consume_lhs() {
     statements
   end
 */
-static ClmStmtNode *consume_for_loop(){
-  int lineNo = curr()->lineNo, colNo = curr()->colNo;
+static ClmStmtNode *consume_for_loop(ClmParserData *data){
+  int lineNo = curr(data)->lineNo, colNo = curr(data)->colNo;
   
-  expect(KEYWORD_FOR);
+  expect(data, KEYWORD_FOR);
   
-  expect(LITERAL_ID);
-  char *name = data.prevTokenRaw;
+  expect(data, LITERAL_ID);
+  const char *name = prev_text(data);
 
-  expect(KEYWORD_IN);    
+  expect(data, KEYWORD_IN);    
 
-  ClmExpNode *start = consume_expression();
+  ClmExpNode *start = consume_expression(data);
   
   ClmExpNode *delta;
-  if (accept(TOKEN_COMMA)) {
-    delta = consume_expression();
+  if (accept(data, TOKEN_COMMA)) {
+    delta = consume_expression(data);
   } else {
-    delta = clm_exp_new_int(1);
+    delta = clm_exp_new_int(data->compiler, 1);
   }    
 
-  expect(TOKEN_PERIOD);
-  expect(TOKEN_PERIOD);
+  expect(data, TOKEN_PERIOD);
+  expect(data, TOKEN_PERIOD);
 
-  ClmExpNode *end = consume_expression();
+  ClmExpNode *end = consume_expression(data);
 
-  expect(KEYWORD_DO);
+  expect(data, KEYWORD_DO);
 
-  ArrayList *body = consume_statements(0);
+  ArrayList *body = consume_statements(data, 0);
 
-  ClmStmtNode *stmt = clm_stmt_new_for_loop(name, start, end, delta, body);
+  ClmStmtNode *stmt = clm_stmt_new_for_loop(data->compiler, name, start, end,
+                                            delta, body);
   stmt->lineNo = lineNo;
   stmt->colNo = colNo;
 
@@ -239,18 +318,18 @@ static ClmStmtNode *consume_for_loop(){
     statements
   end
 */
-static ClmStmtNode *consume_while_loop(){
-  int lineNo = curr()->lineNo, colNo = curr()->colNo;
+static ClmStmtNode *consume_while_loop(ClmParserData *data){
+  int lineNo = curr(data)->lineNo, colNo = curr(data)->colNo;
   
-  expect(KEYWORD_WHILE);   
+  expect(data, KEYWORD_WHILE);   
 
-  ClmExpNode *condition = consume_expression();
+  ClmExpNode *condition = consume_expression(data);
   
-  expect(KEYWORD_DO);
+  expect(data, KEYWORD_DO);
 
-  ArrayList *body = consume_statements(0);
+  ArrayList *body = consume_statements(data, 0);
 
-  ClmStmtNode *stmt = clm_stmt_new_while_loop(condition, body);
+  ClmStmtNode *stmt = clm_stmt_new_while_loop(data->compiler, condition, body);
   stmt->lineNo = lineNo;
   stmt->colNo = colNo;
 
@@ -262,116 +341,147 @@ static ClmStmtNode *consume_while_loop(){
     statements
   end
 */
-static ClmStmtNode *consume_function_decl(){
-  int lineNo = curr()->lineNo, colNo = curr()->colNo;
+static ClmStmtNode *consume_function_decl(ClmParserData *data){
+  int lineNo = curr(data)->lineNo, colNo = curr(data)->colNo;
 
-  expect(TOKEN_BSLASH);
+  expect(data, TOKEN_BSLASH);
 
-  expect(LITERAL_ID);
-  char *name = data.prevTokenRaw;
+  expect(data, LITERAL_ID);
+  const char *name = prev_text(data);
 
-  ArrayList *params = array_list_new(clm_exp_free);
+  ArrayList *params = array_list_new_arena(data->compiler->arena);
   
-  ClmExpNode *param = consume_parameter();
+  ClmExpNode *param = consume_parameter(data);
   while (param) {
     array_list_push(params, param);
 
-    if (curr()->sym == TOKEN_MINUS || curr()->sym == TOKEN_EQ)
+    if (curr(data)->sym == TOKEN_MINUS || curr(data)->sym == TOKEN_EQ)
       break;
 
-    param = consume_parameter();
+    param = consume_parameter(data);
   }
 
   int rows = -1, cols = -1;
-  char *rowVar = NULL, *colVar = NULL;
+  const char *rowVar = NULL, *colVar = NULL;
   ClmType returnType = CLM_TYPE_NONE;
-  if (accept(TOKEN_MINUS)) {
-    expect(TOKEN_GT);
-    if (accept(KEYWORD_INT)) { //\x ... -> int
+  if (accept(data, TOKEN_MINUS)) {
+    expect(data, TOKEN_GT);
+    if (accept(data, KEYWORD_INT)) { //\x ... -> int
       returnType = CLM_TYPE_INT;
-    } else if (accept(KEYWORD_FLOAT)) { //\x ... -> float
+    } else if (accept(data, KEYWORD_FLOAT)) { //\x ... -> float
       returnType = CLM_TYPE_FLOAT;
-    } else if (accept(KEYWORD_STRING)) { //\x ... -> string
+    } else if (accept(data, KEYWORD_STRING)) { //\x ... -> string
       returnType = CLM_TYPE_STRING;
     } else { //\x ... -> [m:n]
-      expect(TOKEN_LBRACK);
-      rows = consume_int_or_id(&rowVar);
-      expect(TOKEN_COLON);
-      cols = consume_int_or_id(&colVar);
-      expect(TOKEN_RBRACK);
+      expect(data, TOKEN_LBRACK);
+      rows = consume_int_or_id(data, &rowVar);
+      expect(data, TOKEN_COLON);
+      cols = consume_int_or_id(data, &colVar);
+      expect(data, TOKEN_RBRACK);
 
       returnType = CLM_TYPE_MATRIX;
     }
   }
 
-  expect(TOKEN_EQ);
+  expect(data, TOKEN_EQ);
+
+  ArrayList *body = consume_statements(data, 0);
+
+  ClmStmtNode *stmt = clm_stmt_new_dec(data->compiler, name, params, returnType,
+                                       rows, cols, rowVar, colVar, body);
+  stmt->lineNo = lineNo;
+  stmt->colNo = colNo;
+  return stmt;
+}
+
+/*
+  import id [, id]* from id
+*/
+static ClmStmtNode *consume_import(ClmParserData *data) {
+  int lineNo = curr(data)->lineNo, colNo = curr(data)->colNo;
+
+  expect(data, KEYWORD_IMPORT);
 
-  ArrayList *body = consume_statements(0);
+  ArrayList *names = array_list_new_arena(data->compiler->arena);
+  do {
+    expect(data, LITERAL_ID);
+    array_list_push(names, (void *)prev_text(data));
+  } while (accept(data, TOKEN_COMMA));
 
-  ClmStmtNode *stmt = clm_stmt_new_dec(name, params, returnType, rows, cols,
-                                       rowVar, colVar, body);
+  expect(data, KEYWORD_FROM);
+  expect(data, LITERAL_ID);
+
+  ClmStmtNode *stmt = clm_stmt_new_import(data->compiler, prev_text(data),
+                                          names);
   stmt->lineNo = lineNo;
   stmt->colNo = colNo;
   return stmt;
 }
 
-static ClmStmtNode *consume_statement() {
-  int lineNo = curr()->lineNo, colNo = curr()->colNo;
+static ClmStmtNode *consume_statement(ClmParserData *data) {
+  int lineNo = curr(data)->lineNo, colNo = curr(data)->colNo;
 
-  if (curr()->sym == LITERAL_ID) {
-    ClmExpNode *lhs = consume_lhs();
-    expect(TOKEN_EQ);
-    ClmExpNode *rhs = consume_expression();
+  if (curr(data)->sym == LITERAL_ID) {
+    ClmExpNode *lhs = consume_lhs(data);
+    expect(data, TOKEN_EQ);
+    ClmExpNode *rhs = consume_expression(data);
 
-    ClmStmtNode *stmt = clm_stmt_new_assign(lhs, rhs);
+    ClmStmtNode *stmt = clm_stmt_new_assign(data->compiler, lhs, rhs);
     stmt->lineNo = lineNo;
     stmt->colNo = colNo;
     return stmt;
-  } else if (accept(KEYWORD_CALL)) {
-    ClmStmtNode *stmt = clm_stmt_new_call(consume_expression());
+  } else if (accept(data, KEYWORD_CALL)) {
+    ClmStmtNode *stmt = clm_stmt_new_call(data->compiler,
+                                          consume_expression(data));
     stmt->lineNo = lineNo;
     stmt->colNo = colNo;
     return stmt;
-  } else if (accept(KEYWORD_PRINT)) {
-    ClmStmtNode *stmt = clm_stmt_new_print(consume_expression(), 0);
+  } else if (accept(data, KEYWORD_PRINT)) {
+    ClmStmtNode *stmt = clm_stmt_new_print(data->compiler,
+                                           consume_expression(data), 0);
     stmt->lineNo = lineNo;
     stmt->colNo = colNo;
     return stmt;
-  } else if (accept(KEYWORD_PRINTL)) {
-    ClmStmtNode *stmt = clm_stmt_new_print(consume_expression(), 1);
+  } else if (accept(data, KEYWORD_PRINTL)) {
+    ClmStmtNode *stmt = clm_stmt_new_print(data->compiler,
+                                           consume_expression(data), 1);
     stmt->lineNo = lineNo;
     stmt->colNo = colNo;
     return stmt;
-  } else if (curr()->sym == KEYWORD_FOR) {
-    return consume_for_loop();
-  } else if (curr()->sym == KEYWORD_WHILE) {
-    return consume_while_loop();
-  } else if (accept(KEYWORD_IF)) {
-    ClmExpNode *condition = consume_expression();
+  } else if (curr(data)->sym == KEYWORD_FOR) {
+    return consume_for_loop(data);
+  } else if (curr(data)->sym == KEYWORD_WHILE) {
+    return consume_while_loop(data);
+  } else if (accept(data, KEYWORD_IF)) {
+    ClmExpNode *condition = consume_expression(data);
 
-    expect(KEYWORD_THEN);
+    expect(data, KEYWORD_THEN);
 
-    ArrayList *trueBody = consume_statements(1);
+    ArrayList *trueBody = consume_statements(data, 1);
 
     ArrayList *falseBody = NULL;
-    if (accept(KEYWORD_ELSE)) {
-      falseBody = consume_statements(0);
+    if (accept(data, KEYWORD_ELSE)) {
+      falseBody = consume_statements(data, 0);
     }
 
-    ClmStmtNode *stmt = clm_stmt_new_cond(condition, trueBody, falseBody);
+    ClmStmtNode *stmt = clm_stmt_new_cond(data->compiler, condition, trueBody,
+                                          falseBody);
     stmt->lineNo = lineNo;
     stmt->colNo = colNo;
     return stmt;
-  } else if (accept(KEYWORD_RETURN)) {
-    ClmStmtNode *stmt = clm_stmt_new_return(consume_expression());
+  } else if (accept(data, KEYWORD_RETURN)) {
+    ClmStmtNode *stmt = clm_stmt_new_return(data->compiler,
+                                            consume_expression(data));
     stmt->lineNo = lineNo;
     stmt->colNo = colNo;
     return stmt;
-  } else if (curr()->sym == TOKEN_BSLASH) {
-    consume_function_decl();
+  } else if (curr(data)->sym == TOKEN_BSLASH) {
+    return consume_function_decl(data);
+  } else if (curr(data)->sym == KEYWORD_IMPORT) {
+    return consume_import(data);
   } else {
-    clm_error(curr()->lineNo, curr()->colNo, "Unexpected symbol %s",
-              clmLexerSymbolStrings[curr()->sym]);
+    clm_error(data->compiler, curr(data)->lineNo, curr(data)->colNo,
+              "Unexpected symbol %s", clmLexerSymbolStrings[curr(data)->sym]);
   }
   return NULL;
 }
@@ -382,7 +492,7 @@ static BoolOp sym_to_bool_op(ClmLexerSymbol sym) {
     return BOOL_OP_AND;
   case KEYWORD_OR:
     return BOOL_OP_OR;
-  case TOKEN_EQ:
+  case TOKEN_EQEQ:
     return BOOL_OP_EQ;
   case TOKEN_BANGEQ:
     return BOOL_OP_NEQ;
@@ -427,176 +537,188 @@ static UnaryOp sym_to_unary_op(ClmLexerSymbol sym) {
   }
 }
 
-static ClmExpNode *consume_expression() {
+static ClmExpNode *consume_expression(ClmParserData *data) {
   //&& or ||
   ClmExpNode *node1, *node2;
   BoolOp op;
-  node1 = consume_expression_2();
-  while (accept(KEYWORD_AND) || accept(KEYWORD_OR)) {
-    op = sym_to_bool_op(prev()->sym);
-    node2 = consume_expression_2();
-    node1 = clm_exp_new_bool(op, node1, node2);
+  node1 = consume_expression_2(data);
+  while (accept(data, KEYWORD_AND) || accept(data, KEYWORD_OR)) {
+    op = sym_to_bool_op(prev(data)->sym);
+    node2 = consume_expression_2(data);
+    node1 = clm_exp_new_bool(data->compiler, op, node2, node1);
   }
   return node1;
 }
 
-static ClmExpNode *consume_expression_2() {
+static ClmExpNode *consume_expression_2(ClmParserData *data) {
   //== or !=
   ClmExpNode *node1, *node2;
   BoolOp op;
-  node1 = consume_expression_3();
-  while (accept(TOKEN_EQ) || accept(TOKEN_BANGEQ)) {
-    op = sym_to_bool_op(prev()->sym);
-    node2 = consume_expression_2();
-    node1 = clm_exp_new_bool(op, node1, node2);
+  node1 = consume_expression_3(data);
+  while (accept(data, TOKEN_EQEQ) || accept(data, TOKEN_BANGEQ)) {
+    op = sym_to_bool_op(prev(data)->sym);
+    node2 = consume_expression_2(data);
+    node1 = clm_exp_new_bool(data->compiler, op, node2, node1);
   }
   return node1;
 }
 
-static ClmExpNode *consume_expression_3() {
+static ClmExpNode *consume_expression_3(ClmParserData *data) {
   //> or < or >= or <=
   ClmExpNode *node1;
   ClmExpNode *node2;
   BoolOp op;
-  node1 = consume_expression_4();
-  while (accept(TOKEN_GT) || accept(TOKEN_LT) || accept(TOKEN_GTE) ||
-         accept(TOKEN_LTE)) {
-    op = sym_to_bool_op(prev()->sym);
-    node2 = consume_expression_4();
-    node1 = clm_exp_new_bool(op, node1, node2);
+  node1 = consume_expression_4(data);
+  while (accept(data, TOKEN_GT) || accept(data, TOKEN_LT) ||
+         accept(data, TOKEN_GTE) || accept(data, TOKEN_LTE)) {
+    op = sym_to_bool_op(prev(data)->sym);
+    node2 = consume_expression_4(data);
+    node1 = clm_exp_new_bool(data->compiler, op, node2, node1);
   }
   return node1;
 }
 
-static ClmExpNode *consume_expression_4() {
+static ClmExpNode *consume_expression_4(ClmParserData *data) {
   //+ or -
   ClmExpNode *node1;
   ClmExpNode *node2;
   ArithOp op;
-  node1 = consume_expression_5();
-  while (accept(TOKEN_PLUS) || accept(TOKEN_MINUS)) {
-    op = sym_to_arith_op(prev()->sym);
-    node2 = consume_expression_5();
-    node1 = clm_exp_new_arith(op, node1, node2);
+  node1 = consume_expression_5(data);
+  while (accept(data, TOKEN_PLUS) || accept(data, TOKEN_MINUS)) {
+    op = sym_to_arith_op(prev(data)->sym);
+    node2 = consume_expression_5(data);
+    node1 = clm_exp_new_arith(data->compiler, op, node2, node1);
   }
   return node1;
 }
 
-static ClmExpNode *consume_expression_5() {
+static ClmExpNode *consume_expression_5(ClmParserData *data) {
   //* or /
   ClmExpNode *node1;
   ClmExpNode *node2;
   ArithOp op;
-  node1 = consume_expression_6();
-  while (accept(TOKEN_STAR) || accept(TOKEN_FSLASH)) {
-    op = sym_to_arith_op(prev()->sym);
-    node2 = consume_expression_6();
-    node1 = clm_exp_new_arith(op, node1, node2);
+  node1 = consume_expression_6(data);
+  while (accept(data, TOKEN_STAR) || accept(data, TOKEN_FSLASH)) {
+    op = sym_to_arith_op(prev(data)->sym);
+    node2 = consume_expression_6(data);
+    node1 = clm_exp_new_arith(data->compiler, op, node2, node1);
   }
   return node1;
 }
 
-static ClmExpNode *consume_expression_6() {
-  int lineNo = curr()->lineNo, colNo = curr()->colNo;
-  if (accept(TOKEN_LPAREN)) {
-    ClmExpNode *exp = consume_expression();
-    expect(TOKEN_RPAREN);
+static ClmExpNode *consume_expression_6(ClmParserData *data) {
+  int lineNo = curr(data)->lineNo, colNo = curr(data)->colNo;
+  if (accept(data, TOKEN_LPAREN)) {
+    ClmExpNode *exp = consume_expression(data);
+    expect(data, TOKEN_RPAREN);
 
     exp->lineNo = lineNo;
     exp->colNo = colNo;
     return exp;
-  } else if (accept(TOKEN_MINUS) || accept(TOKEN_BANG) || accept(TOKEN_TILDA)) {
-    ClmExpNode *exp =
-        clm_exp_new_unary(sym_to_unary_op(prev()->sym), consume_expression_6());
+  } else if (accept(data, TOKEN_MINUS) || accept(data, TOKEN_BANG) ||
+             accept(data, TOKEN_TILDA)) {
+    // the operator has to be read before consuming the operand, which moves
+    // prev() along
+    UnaryOp op = sym_to_unary_op(prev(data)->sym);
+    ClmExpNode *exp = clm_exp_new_unary(data->compiler, op,
+                                        consume_expression_6(data));
     exp->lineNo = lineNo;
     exp->colNo = colNo;
     return exp;
-  } else if (accept(LITERAL_INT)) {
-    ClmExpNode *exp = clm_exp_new_int(atoi(data.prevTokenRaw));
+  } else if (accept(data, LITERAL_INT)) {
+    ClmExpNode *exp = clm_exp_new_int(data->compiler, prev_int(data));
     exp->lineNo = lineNo;
     exp->colNo = colNo;
     return exp;
-  } else if (accept(LITERAL_FLOAT)) {
-    ClmExpNode *exp = clm_exp_new_float(atof(data.prevTokenRaw));
+  } else if (accept(data, LITERAL_FLOAT)) {
+    ClmExpNode *exp = clm_exp_new_float(data->compiler, prev_float(data));
     exp->lineNo = lineNo;
     exp->colNo = colNo;
     return exp;
-  } else if (accept(LITERAL_STRING)) {
-    ClmExpNode *exp = clm_exp_new_string(data.prevTokenRaw);
+  } else if (accept(data, LITERAL_STRING)) {
+    ClmExpNode *exp = clm_exp_new_string(data->compiler, prev_text(data));
     exp->lineNo = lineNo;
     exp->colNo = colNo;
     return exp;
-  } else if (curr()->sym == LITERAL_ID) {
-    if (next()->sym == TOKEN_LPAREN) {
-      expect(LITERAL_ID);
-      char *name = data.prevTokenRaw;
-      expect(TOKEN_LPAREN);
-
-      ArrayList *params = array_list_new(clm_exp_free);
-      while (curr()->sym != TOKEN_RPAREN) {
-        array_list_push(params, consume_expression());
-        if (accept(TOKEN_COMMA))
+  } else if (curr(data)->sym == LITERAL_ID) {
+    if (next(data)->sym == TOKEN_LPAREN) {
+      expect(data, LITERAL_ID);
+      const char *name = prev_text(data);
+      expect(data, TOKEN_LPAREN);
+
+      ArrayList *params = array_list_new_arena(data->compiler->arena);
+      while (curr(data)->sym != TOKEN_RPAREN) {
+        array_list_push(params, consume_expression(data));
+        if (accept(data, TOKEN_COMMA))
           continue;
         else
           break;
       }
-      expect(TOKEN_RPAREN);
+      expect(data, TOKEN_RPAREN);
 
-      ClmExpNode *exp = clm_exp_new_call(name, params);
+      ClmExpNode *exp = clm_exp_new_call(data->compiler, name, params);
       exp->lineNo = lineNo;
       exp->colNo = colNo;
       return exp;
     } else {
-      ClmExpNode *exp = consume_lhs();
+      ClmExpNode *exp = consume_lhs(data);
       exp->lineNo = lineNo;
       exp->colNo = colNo;
       return exp;
     }
-  } else if (accept(TOKEN_LBRACK)) {
+  } else if (accept(data, TOKEN_LBRACK)) {
     int rows = 0, cols = 0;
-    char *rowVar = NULL, *colVar = NULL;
+    const char *rowVar = NULL, *colVar = NULL;
 
-    rows = consume_int_or_id(&rowVar);
-    expect(TOKEN_COLON);
-    cols = consume_int_or_id(&colVar);
-    expect(TOKEN_RBRACK);
+    rows = consume_int_or_id(data, &rowVar);
+    expect(data, TOKEN_COLON);
+    cols = consume_int_or_id(data, &colVar);
+    expect(data, TOKEN_RBRACK);
 
-    ClmExpNode *exp = clm_exp_new_empty_mat_dec(rows, cols, rowVar, colVar);
+    ClmExpNode *exp = clm_exp_new_empty_mat_dec(data->compiler, rows, cols,
+                                                rowVar, colVar);
     exp->lineNo = lineNo;
     exp->colNo = colNo;
     return exp;
-  } else if (accept(TOKEN_LCURL)) {
-    int cols, num = 0;
-    float *list;
-    int start = prev()->lineNo;
+  } else if (accept(data, TOKEN_LCURL)) {
+    int cols, num;
+    int start = prev(data)->lineNo;
 
-    list = malloc(sizeof(*list));
+    // the elements are read into a buffer that doubles as it fills, then
+    // copied into the arena once the size is known
+    data->numbersLength = 0;
+    data->numbersCapacity = 16;
+    data->numbers = malloc(data->numbersCapacity * sizeof(*data->numbers));
 
     // TODO consume expressions instead of just numbers
     do {
-      list = realloc(list, (num + 1) * sizeof(*list));
-      list[num++] = consume_number();
-    } while (curr_is_number());
+      push_number(data);
+    } while (curr_is_number(data));
 
-    cols = num;
+    cols = data->numbersLength;
 
     int i;
-    while (accept(TOKEN_COMMA)) {
+    while (accept(data, TOKEN_COMMA)) {
       for (i = 0; i < cols; i++) {
-        list = realloc(list, (num + 1) * sizeof(*list));
-        list[num++] = consume_number();
+        push_number(data);
       }
     }
 
-    expect(TOKEN_RCURL);
+    expect(data, TOKEN_RCURL);
+
+    num = data->numbersLength;
+    float *arr = clm_alloc(data->compiler, num * sizeof(*arr));
+    memcpy(arr, data->numbers, num * sizeof(*arr));
+    free(data->numbers);
+    data->numbers = NULL;
 
-    ClmExpNode *exp = clm_exp_new_mat_dec(list, num, cols);
+    ClmExpNode *exp = clm_exp_new_mat_dec(data->compiler, arr, num, cols);
     exp->lineNo = lineNo;
     exp->colNo = colNo;
     return exp;
   } else {
-    clm_error(curr()->lineNo, curr()->colNo, "Unexpected symbol %s",
-              clmLexerSymbolStrings[curr()->sym]);
+    clm_error(data->compiler, curr(data)->lineNo, curr(data)->colNo,
+              "Unexpected symbol %s", clmLexerSymbolStrings[curr(data)->sym]);
   }
 
   // should never return from here... as it will error and exit
@@ -0,0 +1,553 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "clm_asm.h"
+#include "clm_code_gen.h"
+#include "clm_reg_gen.h"
+#include "clm_type.h"
+#include "clm_type_gen.h"
+
+extern void load_var_location(ClmCodeGen *gen, ClmSymbol *sym, char *out_buffer,
+                              int offset, const char *offset_loc);
+extern void load_float_location(ClmCodeGen *gen, ClmSymbol *sym,
+                                char *out_buffer);
+
+typedef enum IrOp {
+  IR_INT,          // dest = ival
+  IR_FLOAT,        // dest = fval
+  IR_LOAD,         // dest = sym
+  IR_LOAD_ELEMENT, // dest = sym[left, right]
+  IR_TO_FLOAT,     // dest = (float)left
+  IR_ADD,          // dest = left + right
+  IR_SUB,          // dest = left - right
+  IR_MUL,          // dest = left * right
+  IR_DIV,          // dest = left / right
+  IR_AND,          // dest = left & right
+  IR_OR,           // dest = left | right
+  IR_CMP,          // dest = left cmp right, 1 or 0
+  IR_NEG,          // dest = -left
+  IR_NOT           // dest = left ^ 1
+} IrOp;
+
+// every instruction defines one virtual register, which is its index in the
+// list. an expression is a tree, so each of them is used exactly once
+typedef struct IrInstr {
+  IrOp op;
+  int left;
+  int right;
+  int isFloat; // the class of the result, IR_CMP always produces an int
+
+  int ival;
+  float fval;
+  BoolOp cmp;
+  ClmSymbol *sym;
+
+  // filled in by allocation
+  int end;    // the instruction that uses the result
+  int folded; // used directly as an immediate or memory operand
+  int reg;    // index into the allocatable registers, -1 if spilled
+  int spill;
+  char operand[64]; // where the result is
+} IrInstr;
+
+// xmm0 is the float scratch register, the rest can be allocated
+#define NUM_XMM_REGS 7
+#define MAX_SPILL_SLOTS 64
+
+static IrInstr *instr(ClmCodeGen *gen, int vreg) {
+  return gen->reg.instrs->data[vreg];
+}
+
+static int emit_ir(ClmCodeGen *gen, IrOp op, int isFloat, int left, int right) {
+  IrInstr *ir = malloc(sizeof(*ir));
+  memset(ir, 0, sizeof(*ir));
+  ir->op = op;
+  ir->isFloat = isFloat;
+  ir->left = left;
+  ir->right = right;
+  ir->reg = -1;
+  ir->spill = -1;
+  array_list_push(gen->reg.instrs, ir);
+
+  int vreg = gen->reg.instrs->length - 1;
+  if (left >= 0)
+    instr(gen, left)->end = vreg;
+  if (right >= 0)
+    instr(gen, right)->end = vreg;
+  ir->end = vreg + 1;
+  return vreg;
+}
+
+static int to_float(ClmCodeGen *gen, int vreg) {
+  IrInstr *ir = instr(gen, vreg);
+  if (ir->isFloat)
+    return vreg;
+  if (ir->op == IR_INT) {
+    // literals are converted here rather than at runtime
+    ir->op = IR_FLOAT;
+    ir->isFloat = 1;
+    ir->fval = (float)ir->ival;
+    return vreg;
+  }
+  return emit_ir(gen, IR_TO_FLOAT, 1, vreg, -1);
+}
+
+int gen_scalar_supported(ClmCodeGen *gen, ClmExpNode *node, ClmScope *scope) {
+  if (node == NULL)
+    return 0;
+
+  switch (node->type) {
+  case EXP_TYPE_INT:
+  case EXP_TYPE_FLOAT:
+    return 1;
+  case EXP_TYPE_INDEX: {
+    ClmSymbol *sym = node->indExp.symbol;
+    if (node->indExp.rowIndex == NULL && node->indExp.colIndex == NULL)
+      return sym->type == CLM_TYPE_INT || sym->type == CLM_TYPE_FLOAT;
+    return sym->type == CLM_TYPE_MATRIX && clm_exp_is_element(node) &&
+           gen_scalar_supported(gen, node->indExp.rowIndex, scope) &&
+           gen_scalar_supported(gen, node->indExp.colIndex, scope);
+  }
+  case EXP_TYPE_ARITH:
+    return gen_scalar_supported(gen, node->arithExp.left, scope) &&
+           gen_scalar_supported(gen, node->arithExp.right, scope);
+  case EXP_TYPE_BOOL:
+    if (!gen_scalar_supported(gen, node->boolExp.left, scope) ||
+        !gen_scalar_supported(gen, node->boolExp.right, scope))
+      return 0;
+    if (node->boolExp.operand == BOOL_OP_AND ||
+        node->boolExp.operand == BOOL_OP_OR)
+      return clm_type_of_exp(gen->compiler, node->boolExp.left,
+                             scope) == CLM_TYPE_INT &&
+             clm_type_of_exp(gen->compiler, node->boolExp.right,
+                             scope) == CLM_TYPE_INT;
+    return 1;
+  case EXP_TYPE_UNARY:
+    if (node->unaryExp.operand == UNARY_OP_TRANSPOSE)
+      return 0;
+    if (node->unaryExp.operand == UNARY_OP_NOT &&
+        clm_type_of_exp(gen->compiler, node->unaryExp.node,
+                        scope) != CLM_TYPE_INT)
+      return 0;
+    return gen_scalar_supported(gen, node->unaryExp.node, scope);
+  default:
+    return 0;
+  }
+}
+
+//
+// Lowering
+//
+static int lower(ClmCodeGen *gen, ClmExpNode *node) {
+  switch (node->type) {
+  case EXP_TYPE_INT: {
+    int vreg = emit_ir(gen, IR_INT, 0, -1, -1);
+    instr(gen, vreg)->ival = node->ival;
+    return vreg;
+  }
+  case EXP_TYPE_FLOAT: {
+    int vreg = emit_ir(gen, IR_FLOAT, 1, -1, -1);
+    instr(gen, vreg)->fval = node->fval;
+    return vreg;
+  }
+  case EXP_TYPE_INDEX: {
+    ClmSymbol *sym = node->indExp.symbol;
+    int vreg;
+    if (sym->type == CLM_TYPE_MATRIX) {
+      int row = lower(gen, node->indExp.rowIndex);
+      int col = lower(gen, node->indExp.colIndex);
+      vreg = emit_ir(gen, IR_LOAD_ELEMENT, 0, row, col);
+    } else {
+      vreg = emit_ir(gen, IR_LOAD, sym->type == CLM_TYPE_FLOAT, -1, -1);
+    }
+    instr(gen, vreg)->sym = sym;
+    return vreg;
+  }
+  case EXP_TYPE_ARITH: {
+    static const IrOp ops[] = {IR_ADD, IR_SUB, IR_MUL, IR_DIV};
+    int isFloat = clm_type_of_exp(gen->compiler, node,
+                                  gen->reg.scope) == CLM_TYPE_FLOAT;
+    int left = lower(gen, node->arithExp.left);
+    int right = lower(gen, node->arithExp.right);
+    if (isFloat) {
+      left = to_float(gen, left);
+      right = to_float(gen, right);
+    }
+    return emit_ir(gen, ops[node->arithExp.operand], isFloat, left, right);
+  }
+  case EXP_TYPE_BOOL: {
+    int left = lower(gen, node->boolExp.left);
+    int right = lower(gen, node->boolExp.right);
+    if (node->boolExp.operand == BOOL_OP_AND)
+      return emit_ir(gen, IR_AND, 0, left, right);
+    if (node->boolExp.operand == BOOL_OP_OR)
+      return emit_ir(gen, IR_OR, 0, left, right);
+
+    if (instr(gen, left)->isFloat || instr(gen, right)->isFloat) {
+      left = to_float(gen, left);
+      right = to_float(gen, right);
+    }
+    int vreg = emit_ir(gen, IR_CMP, 0, left, right);
+    instr(gen, vreg)->cmp = node->boolExp.operand;
+    return vreg;
+  }
+  case EXP_TYPE_UNARY: {
+    int operand = lower(gen, node->unaryExp.node);
+    IrOp op = node->unaryExp.operand == UNARY_OP_MINUS ? IR_NEG : IR_NOT;
+    return emit_ir(gen, op, instr(gen, operand)->isFloat, operand, -1);
+  }
+  default:
+    // gen_scalar_supported keeps everything else out
+    return -1;
+  }
+}
+
+//
+// Allocation
+//
+
+// the right operand of most two address instructions can be an immediate or
+// a memory location, so literals and variables used there don't need loading
+static void fold_operands(ClmCodeGen *gen) {
+  int i;
+  for (i = 0; i < gen->reg.instrs->length; i++) {
+    IrInstr *ir = instr(gen, i);
+    if (ir->right < 0)
+      continue;
+
+    IrInstr *right = instr(gen, ir->right);
+    int is_float_op = right->isFloat;
+    switch (ir->op) {
+    case IR_ADD:
+    case IR_SUB:
+    case IR_MUL:
+    case IR_AND:
+    case IR_OR:
+    case IR_CMP:
+    case IR_LOAD_ELEMENT:
+      right->folded = right->op == IR_LOAD ||
+                      (right->op == IR_INT && !is_float_op);
+      break;
+    case IR_DIV:
+      right->folded = right->op == IR_LOAD;
+      break;
+    default:
+      break;
+    }
+
+    if (right->folded && right->op == IR_INT) {
+      sprintf(right->operand, "%d", right->ival);
+    } else if (right->folded && right->isFloat) {
+      load_float_location(gen, right->sym, right->operand);
+    } else if (right->folded) {
+      load_var_location(gen, right->sym, right->operand, 1, NULL);
+    }
+  }
+}
+
+static int register_of(ClmCodeGen *gen, int vreg, int isFloat) {
+  if (vreg < 0 || instr(gen, vreg)->isFloat != isFloat)
+    return -1;
+  return instr(gen, vreg)->reg;
+}
+
+// linear scan, each value lives from its definition to the instruction that
+// uses it. when there are no registers left the value that lives the
+// longest is spilled
+static void allocate_registers(ClmCodeGen *gen) {
+  int num_int_regs;
+  asm_allocatable_regs(gen, &num_int_regs);
+
+  int owner[2][8];     // owner[isFloat][reg] = vreg, -1 if free
+  int spill_owner[MAX_SPILL_SLOTS]; // spill slots that are in use
+  int num_regs[2] = {num_int_regs, NUM_XMM_REGS};
+  int i, r;
+
+  for (r = 0; r < 8; r++) {
+    owner[0][r] = -1;
+    owner[1][r] = -1;
+  }
+  for (r = 0; r < MAX_SPILL_SLOTS; r++)
+    spill_owner[r] = -1;
+
+  for (i = 0; i < gen->reg.instrs->length; i++) {
+    IrInstr *ir = instr(gen, i);
+    if (ir->folded)
+      continue;
+
+    // the operands die here
+    int operands[2] = {ir->left, ir->right};
+    for (r = 0; r < 2; r++) {
+      if (operands[r] < 0 || instr(gen, operands[r])->folded)
+        continue;
+      IrInstr *operand = instr(gen, operands[r]);
+      if (operand->reg >= 0)
+        owner[operand->isFloat][operand->reg] = -1;
+      else if (operand->spill >= 0)
+        spill_owner[operand->spill] = -1;
+    }
+
+    int *regs = owner[ir->isFloat];
+    int chosen = -1;
+
+    // reusing the left operand's register saves a move
+    int preferred = register_of(gen, ir->left, ir->isFloat);
+    if (preferred >= 0 && regs[preferred] < 0) {
+      chosen = preferred;
+    } else {
+      int right_reg = register_of(gen, ir->right, ir->isFloat);
+      for (r = 0; r < num_regs[ir->isFloat]; r++) {
+        if (regs[r] < 0 && (chosen < 0 || chosen == right_reg))
+          chosen = r;
+      }
+    }
+
+    if (chosen < 0) {
+      int victim = -1;
+      for (r = 0; r < num_regs[ir->isFloat]; r++) {
+        if (victim < 0 ||
+            instr(gen, regs[r])->end > instr(gen, regs[victim])->end)
+          victim = r;
+      }
+
+      IrInstr *spilled = ir;
+      if (instr(gen, regs[victim])->end > ir->end) {
+        spilled = instr(gen, regs[victim]);
+        spilled->reg = -1;
+        chosen = victim;
+      }
+
+      for (r = 0; r < MAX_SPILL_SLOTS && spill_owner[r] >= 0; r++)
+        ;
+      if (r == MAX_SPILL_SLOTS)
+        clm_error(gen->compiler, 0, 0, "expression is too large to generate");
+      spill_owner[r] = i;
+      spilled->spill = r;
+      if (r + 1 > gen->reg.spillSlots)
+        gen->reg.spillSlots = r + 1;
+    }
+
+    if (chosen >= 0) {
+      ir->reg = chosen;
+      regs[chosen] = i;
+    }
+  }
+
+  const AsmReg *int_regs = asm_allocatable_regs(gen, &num_int_regs);
+  for (i = 0; i < gen->reg.instrs->length; i++) {
+    IrInstr *ir = instr(gen, i);
+    if (ir->folded)
+      continue;
+    if (ir->reg >= 0 && ir->isFloat)
+      strcpy(ir->operand, asm_xmm_reg(ir->reg + 1));
+    else if (ir->reg >= 0)
+      strcpy(ir->operand, asm_reg(gen, int_regs[ir->reg]));
+    else if (ir->isFloat)
+      asm_mem_dword(gen, ir->operand, SPILL, SLOT(gen, ir->spill), NULL);
+    else
+      asm_mem(gen, ir->operand, SPILL, SLOT(gen, ir->spill), NULL);
+  }
+}
+
+//
+// Emitting
+//
+static const char *operand(ClmCodeGen *gen, int vreg) {
+  return instr(gen, vreg)->operand;
+}
+
+static int is_register(ClmCodeGen *gen, int vreg) {
+  return vreg >= 0 && !instr(gen, vreg)->folded && instr(gen, vreg)->reg >= 0;
+}
+
+static void move(ClmCodeGen *gen, const char *dest, int vreg, int isFloat) {
+  if (strcmp(dest, operand(gen, vreg)) == 0)
+    return;
+  if (isFloat)
+    asm_movss(gen, dest, operand(gen, vreg));
+  else
+    asm_mov(gen, dest, operand(gen, vreg));
+}
+
+static const char *condition_code(BoolOp op, int isFloat) {
+  // comiss sets the flags like an unsigned compare
+  switch (op) {
+  case BOOL_OP_GT:
+    return isFloat ? "a" : "g";
+  case BOOL_OP_LT:
+    return isFloat ? "b" : "l";
+  case BOOL_OP_GTE:
+    return isFloat ? "ae" : "ge";
+  case BOOL_OP_LTE:
+    return isFloat ? "be" : "le";
+  case BOOL_OP_EQ:
+    return "e";
+  default:
+    return "ne";
+  }
+}
+
+static void emit_instr(ClmCodeGen *gen, int vreg) {
+  char location[64];
+  IrInstr *ir = instr(gen, vreg);
+  const char *scratch = ir->isFloat ? asm_xmm_reg(0) : EAX(gen);
+
+  // the result is worked out in its own register when it has one. it can't
+  // be if that register is also the right operand, the left is moved in first
+  const char *work = ir->operand;
+  if (ir->reg < 0 || (ir->right >= 0 && is_register(gen, ir->right) &&
+                      instr(gen, ir->right)->reg == ir->reg &&
+                      instr(gen, ir->right)->isFloat == ir->isFloat &&
+                      !(is_register(gen, ir->left) &&
+                        instr(gen, ir->left)->reg == ir->reg &&
+                        instr(gen, ir->left)->isFloat == ir->isFloat)))
+    work = scratch;
+
+  switch (ir->op) {
+  case IR_INT:
+    asm_mov_i(gen, work, ir->ival);
+    break;
+  case IR_FLOAT: {
+    int bits;
+    memcpy(&bits, &ir->fval, sizeof(bits));
+    asm_mov_i(gen, "eax", bits);
+    asm_movd(gen, work, "eax");
+    break;
+  }
+  case IR_LOAD:
+    if (ir->isFloat) {
+      load_float_location(gen, ir->sym, location);
+      asm_movss(gen, work, location);
+    } else {
+      load_var_location(gen, ir->sym, location, 1, NULL);
+      asm_mov(gen, work, location);
+    }
+    break;
+  case IR_LOAD_ELEMENT:
+    // eax = (row - 1) * stride + col - 1, edx = the matrix's data
+    asm_mov(gen, EAX(gen), operand(gen, ir->left));
+    asm_dec(gen, EAX(gen));
+    load_var_location(gen, ir->sym, location, 1, NULL);
+    asm_mov(gen, EDX(gen), location);
+    matrix_field(gen, location, EDX(gen), MAT_STRIDE);
+    asm_imul(gen, EAX(gen), location);
+    asm_add(gen, EAX(gen), operand(gen, ir->right));
+    asm_dec(gen, EAX(gen));
+    matrix_field(gen, location, EDX(gen), MAT_DATA);
+    asm_mov(gen, EDX(gen), location);
+    matrix_element(gen, location, EDX(gen), EAX(gen));
+    asm_movsx_dword(gen, work, location);
+    break;
+  case IR_TO_FLOAT:
+    asm_cvtsi2ss(gen, work, operand(gen, ir->left));
+    break;
+  case IR_ADD:
+  case IR_SUB:
+  case IR_MUL:
+    move(gen, work, ir->left, ir->isFloat);
+    if (ir->isFloat) {
+      if (ir->op == IR_ADD)
+        asm_addss(gen, work, operand(gen, ir->right));
+      else if (ir->op == IR_SUB)
+        asm_subss(gen, work, operand(gen, ir->right));
+      else
+        asm_mulss(gen, work, operand(gen, ir->right));
+    } else {
+      if (ir->op == IR_ADD)
+        asm_add(gen, work, operand(gen, ir->right));
+      else if (ir->op == IR_SUB)
+        asm_sub(gen, work, operand(gen, ir->right));
+      else
+        asm_imul(gen, work, operand(gen, ir->right));
+      asm_wrap_int(gen, work);
+    }
+    break;
+  case IR_DIV:
+    if (ir->isFloat) {
+      move(gen, work, ir->left, 1);
+      asm_divss(gen, work, operand(gen, ir->right));
+    } else {
+      asm_mov(gen, EAX(gen), operand(gen, ir->left));
+      asm_sign_extend_a(gen);
+      asm_idiv(gen, operand(gen, ir->right));
+      if (strcmp(work, EAX(gen)) != 0)
+        asm_mov(gen, work, EAX(gen));
+    }
+    break;
+  case IR_AND:
+  case IR_OR:
+    move(gen, work, ir->left, 0);
+    if (ir->op == IR_AND)
+      asm_and(gen, work, operand(gen, ir->right));
+    else
+      asm_or(gen, work, operand(gen, ir->right));
+    break;
+  case IR_CMP: {
+    int isFloat = instr(gen, ir->left)->isFloat;
+    const char *left = operand(gen, ir->left);
+    if (!is_register(gen, ir->left)) {
+      left = isFloat ? asm_xmm_reg(0) : EDX(gen);
+      move(gen, left, ir->left, isFloat);
+    }
+    if (isFloat)
+      asm_comiss(gen, left, operand(gen, ir->right));
+    else
+      asm_cmp(gen, left, operand(gen, ir->right));
+    asm_set(gen, condition_code(ir->cmp, isFloat));
+    if (strcmp(work, EAX(gen)) != 0)
+      asm_mov(gen, work, EAX(gen));
+    break;
+  }
+  case IR_NEG:
+    move(gen, work, ir->left, ir->isFloat);
+    if (ir->isFloat) {
+      // flip the sign bit
+      asm_movd(gen, "eax", work);
+      asm_xor(gen, "eax", "-2147483648");
+      asm_movd(gen, work, "eax");
+    } else {
+      asm_neg(gen, work);
+      asm_wrap_int(gen, work);
+    }
+    break;
+  case IR_NOT:
+    move(gen, work, ir->left, 0);
+    asm_xor(gen, work, "1");
+    break;
+  }
+
+  if (work != ir->operand) {
+    if (ir->isFloat)
+      asm_movss(gen, ir->operand, work);
+    else
+      asm_mov(gen, ir->operand, work);
+  }
+}
+
+const char *gen_scalar_expression(ClmCodeGen *gen, ClmExpNode *node,
+                                  ClmScope *scope) {
+  int i;
+
+  gen->reg.scope = scope;
+  gen->reg.instrs = array_list_new(free);
+
+  int root = lower(gen, node);
+  fold_operands(gen);
+  allocate_registers(gen);
+  for (i = 0; i < gen->reg.instrs->length; i++) {
+    if (!instr(gen, i)->folded)
+      emit_instr(gen, i);
+  }
+
+  strcpy(gen->reg.result, operand(gen, root));
+  array_list_free(gen->reg.instrs);
+  gen->reg.instrs = NULL;
+  return gen->reg.result;
+}
+
+int gen_scalar_spill_slots(ClmCodeGen *gen) { return gen->reg.spillSlots; }
+
+void gen_scalar_reserve_spill_slots(ClmCodeGen *gen, int slots) {
+  if (slots > gen->reg.spillSlots)
+    gen->reg.spillSlots = slots;
+}
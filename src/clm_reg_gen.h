@@ -0,0 +1,41 @@
+#ifndef CLM_REG_GEN_H
+#define CLM_REG_GEN_H
+
+#include "clm_asm.h"
+#include "clm_ast.h"
+#include "clm_scope.h"
+
+//
+// Scalar expressions
+//
+// ints and floats built out of literals, variables, matrix elements and
+// arith/bool/unary operators are lowered into a list of instructions on
+// virtual registers, which are then given machine registers by a linear scan
+// over the list. their types are known statically, so no type tags are pushed
+// and none of the intermediate values touch the stack
+//
+
+// the part of the ClmCodeGen that is the scalar generator's
+typedef struct ClmRegGen {
+  ArrayList *instrs; // the instructions of the expression being generated
+  ClmScope *scope;
+  int spillSlots;
+  char result[64]; // where the value of that expression is left
+} ClmRegGen;
+
+// returns 1 if node can be generated with gen_scalar_expression
+int gen_scalar_supported(ClmCodeGen *gen, ClmExpNode *node, ClmScope *scope);
+
+// evaluates node and returns the register holding the result, a general
+// register for ints and an xmm register for floats. the register is only
+// valid until the next scalar expression is generated
+const char *gen_scalar_expression(ClmCodeGen *gen, ClmExpNode *node,
+                                  ClmScope *scope);
+
+// values that didn't fit in registers are kept in the SPILL global, this is
+// how many slots it needs for everything gen has generated
+int gen_scalar_spill_slots(ClmCodeGen *gen);
+// makes room for the slots needed by code generated on another thread
+void gen_scalar_reserve_spill_slots(ClmCodeGen *gen, int slots);
+
+#endif
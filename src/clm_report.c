@@ -0,0 +1,200 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "clm.h"
+#include "clm_report.h"
+
+static const char *counterNames[CLM_NUM_COUNTERS] = {
+    "tokens", "ast nodes", "scope lookups", "type recomputations",
+    "asm bytes"};
+
+// the same, short enough for the table
+static const char *counterHeadings[CLM_NUM_COUNTERS] = {
+    "tokens", "nodes", "lookups", "retypes", "asm bytes"};
+
+/*
+ *
+ *  CLOCKS
+ *
+ */
+
+static double wall_seconds() {
+#ifdef _WIN32
+  LARGE_INTEGER frequency, counter;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+  return (double)counter.QuadPart / frequency.QuadPart;
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+#endif
+}
+
+// of the whole process, so the code gen's threads are in it
+static double cpu_seconds() {
+#ifdef _WIN32
+  FILETIME creation, exit, kernel, user;
+  GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+  ULARGE_INTEGER k, u;
+  k.LowPart = kernel.dwLowDateTime;
+  k.HighPart = kernel.dwHighDateTime;
+  u.LowPart = user.dwLowDateTime;
+  u.HighPart = user.dwHighDateTime;
+  return (k.QuadPart + u.QuadPart) / 1e7;
+#else
+  return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+static size_t max_rss() {
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS counters;
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    return 0;
+  return counters.PeakWorkingSetSize;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+#ifdef __APPLE__
+  return usage.ru_maxrss; // in bytes
+#else
+  return (size_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+/*
+ *
+ *  PHASES
+ *
+ */
+
+void clm_report_start(ClmTimeReport *report, ClmCompiler *compiler) {
+  memset(report, 0, sizeof(*report));
+  report->compiler = compiler;
+  report->start = wall_seconds();
+  compiler->counting = 1;
+}
+
+void clm_report_phase_start(ClmTimeReport *report, const char *name) {
+  if (report->phasesLength == CLM_MAX_PHASES)
+    return;
+  ClmCompiler *compiler = report->compiler;
+  ClmPhaseReport *phase = &report->phases[report->phasesLength];
+  memset(phase, 0, sizeof(*phase));
+  phase->name = name;
+  phase->start = wall_seconds() - report->start;
+  report->cpuStart = cpu_seconds();
+  report->allocationsStart = compiler->arena->allocations;
+  report->bytesStart = compiler->arena->bytes;
+  memcpy(report->countersStart, compiler->counters,
+         sizeof(report->countersStart));
+}
+
+void clm_report_phase_end(ClmTimeReport *report) {
+  if (report->phasesLength == CLM_MAX_PHASES)
+    return;
+  ClmCompiler *compiler = report->compiler;
+  ClmPhaseReport *phase = &report->phases[report->phasesLength++];
+  int i;
+  phase->wall = wall_seconds() - report->start - phase->start;
+  phase->cpu = cpu_seconds() - report->cpuStart;
+  phase->allocations = compiler->arena->allocations - report->allocationsStart;
+  phase->bytes = compiler->arena->bytes - report->bytesStart;
+  report->maxRss = max_rss();
+  for (i = 0; i < CLM_NUM_COUNTERS; i++)
+    phase->counters[i] = compiler->counters[i] - report->countersStart[i];
+}
+
+/*
+ *
+ *  OUTPUT
+ *
+ */
+
+static void print_phase(FILE *out, const ClmPhaseReport *phase) {
+  fprintf(out, "  %-12s %9.3f %9.3f %8zu %9zu", phase->name,
+          phase->wall * 1000, phase->cpu * 1000, phase->allocations,
+          phase->bytes / 1024);
+  int i;
+  for (i = 0; i < CLM_NUM_COUNTERS; i++)
+    fprintf(out, " %12lld", phase->counters[i]);
+  fprintf(out, "\n");
+}
+
+void clm_report_print(ClmTimeReport *report, FILE *out) {
+  ClmPhaseReport total;
+  int i, j;
+  memset(&total, 0, sizeof(total));
+  total.name = "total";
+
+  fprintf(out, "time report:\n");
+  fprintf(out, "  %-12s %9s %9s %8s %9s", "phase", "wall ms", "cpu ms",
+          "allocs", "arena KB");
+  for (i = 0; i < CLM_NUM_COUNTERS; i++)
+    fprintf(out, " %12s", counterHeadings[i]);
+  fprintf(out, "\n");
+
+  for (i = 0; i < report->phasesLength; i++) {
+    const ClmPhaseReport *phase = &report->phases[i];
+    print_phase(out, phase);
+    total.wall += phase->wall;
+    total.cpu += phase->cpu;
+    total.allocations += phase->allocations;
+    total.bytes += phase->bytes;
+    for (j = 0; j < CLM_NUM_COUNTERS; j++)
+      total.counters[j] += phase->counters[j];
+  }
+  print_phase(out, &total);
+  fprintf(out, "  process max RSS: %zu KB\n", report->maxRss / 1024);
+}
+
+// counter names have spaces, the trace's arguments have underscores
+static void print_argument_name(FILE *out, const char *name) {
+  fputc('"', out);
+  for (; *name != '\0'; name++)
+    fputc(*name == ' ' ? '_' : *name, out);
+  fputc('"', out);
+}
+
+int clm_report_write_trace(ClmTimeReport *report, const char *path) {
+  FILE *out = fopen(path, "w");
+  if (out == NULL)
+    return 0;
+
+  // times are in microseconds
+  fprintf(out,
+          "{\"displayTimeUnit\":\"ms\","
+          "\"otherData\":{\"process_max_rss_bytes\":%zu},\"traceEvents\":[",
+          report->maxRss);
+  int i, j;
+  for (i = 0; i < report->phasesLength; i++) {
+    const ClmPhaseReport *phase = &report->phases[i];
+    fprintf(out,
+            "%s\n{\"name\":\"%s\",\"cat\":\"clm\",\"ph\":\"X\",\"pid\":1,"
+            "\"tid\":1,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"cpu_us\":%.3f,"
+            "\"allocations\":%zu,\"arena_bytes\":%zu",
+            i > 0 ? "," : "", phase->name, phase->start * 1e6,
+            phase->wall * 1e6, phase->cpu * 1e6, phase->allocations,
+            phase->bytes);
+    for (j = 0; j < CLM_NUM_COUNTERS; j++) {
+      fputc(',', out);
+      print_argument_name(out, counterNames[j]);
+      fprintf(out, ":%lld", phase->counters[j]);
+    }
+    fprintf(out, "}}");
+  }
+  fprintf(out, "\n]}\n");
+  return fclose(out) == 0;
+}
@@ -0,0 +1,56 @@
+#ifndef CLM_REPORT_H
+#define CLM_REPORT_H
+
+#include <stdio.h>
+
+#include "clm.h"
+
+//
+// Time report
+//
+// how long each phase of a compilation took, on the clock and on the cpus,
+// what it allocated from the compiler's arena and what it added to the
+// compiler's counters. the phases are timed one after the other, a phase is
+// started once the one before it has ended. the most memory the process had
+// resident is only reported once, for all of them, since it never goes down
+//
+#define CLM_MAX_PHASES 16
+
+typedef struct ClmPhaseReport {
+  const char *name;
+  double start; // seconds after the report started
+  double wall;  // seconds
+  double cpu;   // seconds, of every thread
+  size_t allocations;
+  size_t bytes; // allocated from the arena
+  long long counters[CLM_NUM_COUNTERS];
+} ClmPhaseReport;
+
+typedef struct ClmTimeReport {
+  ClmCompiler *compiler;
+  double start;
+  ClmPhaseReport phases[CLM_MAX_PHASES];
+  int phasesLength;
+  // the process's max resident set size in bytes when the last phase ended,
+  // 0 if it couldn't be found
+  size_t maxRss;
+
+  // where the phase being timed started
+  double cpuStart;
+  size_t allocationsStart;
+  size_t bytesStart;
+  long long countersStart[CLM_NUM_COUNTERS];
+} ClmTimeReport;
+
+// makes compiler count what it does from now on
+void clm_report_start(ClmTimeReport *report, ClmCompiler *compiler);
+void clm_report_phase_start(ClmTimeReport *report, const char *name);
+void clm_report_phase_end(ClmTimeReport *report);
+
+// a table of the phases and their total, then the process's max RSS
+void clm_report_print(ClmTimeReport *report, FILE *out);
+// the phases as complete events of the Chrome trace format, which
+// chrome://tracing and Perfetto open. returns 0 if it couldn't be written
+int clm_report_write_trace(ClmTimeReport *report, const char *path);
+
+#endif
@@ -1,27 +1,21 @@
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "clm.h"
 #include "clm_scope.h"
 
-ClmSymbol *clm_symbol_new(const char *name, ClmType type, void *declaration) {
-  ClmSymbol *symbol = malloc(sizeof(*symbol));
-  symbol->name = string_copy(name);
+ClmSymbol *clm_symbol_new(ClmCompiler *compiler, const char *name, ClmType type,
+                          void *declaration) {
+  ClmSymbol *symbol = clm_alloc(compiler, sizeof(*symbol));
+  symbol->name = name;
   symbol->type = type;
   symbol->declaration = declaration;
   symbol->offset = 0;
   return symbol;
 }
 
-void clm_symbol_free(void *data) {
-  if (data == NULL)
-    return;
-  ClmSymbol *symbol = (ClmSymbol *)data;
-  symbol->declaration = NULL;
-  free(symbol->name);
-  free(symbol);
-}
-
 void clm_symbol_print(void *data, int level) {
   ClmSymbol *symbol = data;
   int q = level;
@@ -33,28 +27,29 @@ void clm_symbol_print(void *data, int level) {
          symbol->offset);
 }
 
-ClmScope *clm_scope_new(ClmScope *parent, void *startNode) {
-  ClmScope *scope = malloc(sizeof(*scope));
-  scope->symbols = array_list_new(clm_symbol_free);
+#define SCOPE_TABLE_SIZE 16
+
+static ClmSymbol **table_new(ClmArena *arena, int size) {
+  ClmSymbol **table = clm_arena_alloc(arena, size * sizeof(*table));
+  memset(table, 0, size * sizeof(*table));
+  return table;
+}
+
+ClmScope *clm_scope_new(ClmCompiler *compiler, ClmScope *parent,
+                        void *startNode) {
+  ClmScope *scope = clm_alloc(compiler, sizeof(*scope));
+  scope->arena = compiler->arena;
+  scope->symbols = array_list_new_arena(scope->arena);
+  scope->tableSize = SCOPE_TABLE_SIZE;
+  scope->table = table_new(scope->arena, scope->tableSize);
   scope->parent = parent;
   if (parent != NULL)
     array_list_push(scope->parent->children, scope);
-  scope->children = array_list_new(clm_scope_free);
+  scope->children = array_list_new_arena(scope->arena);
   scope->startNode = startNode;
   return scope;
 }
 
-void clm_scope_free(void *data) {
-  if (data == NULL)
-    return;
-  ClmScope *scope = (ClmScope *)data;
-  scope->parent = NULL;
-  scope->startNode = NULL;
-  array_list_free(scope->symbols);
-  array_list_free(scope->children);
-  free(scope);
-}
-
 void clm_scope_print(void *data, int level) {
   ClmScope *scope = data;
   int q = level;
@@ -75,33 +70,47 @@ void clm_scope_print(void *data, int level) {
   array_list_foreach_2(scope->children, level + 2, clm_scope_print);
 }
 
-int clm_scope_contains(ClmScope *scope, const char *name) {
-  if (scope == NULL)
-    return 0;
+// names are interned, so they hash and compare by their address
+static unsigned int name_hash(const char *name) {
+  return (unsigned int)((uintptr_t)name >> 4) * 2654435761u;
+}
 
-  int i;
-  for (i = 0; i < scope->symbols->length; i++) {
-    ClmSymbol *curr = scope->symbols->data[i];
-    if (string_equals(curr->name, name)) {
-      return 1;
-    }
+// the symbol with name in just this scope. collisions go in the next empty
+// entry, so a name is found by probing from its hash until an empty entry
+static ClmSymbol *table_find(ClmScope *scope, const char *name,
+                             unsigned int hash) {
+  unsigned int mask = scope->tableSize - 1;
+  unsigned int i;
+  for (i = hash & mask; scope->table[i] != NULL; i = (i + 1) & mask) {
+    if (scope->table[i]->name == name)
+      return scope->table[i];
   }
+  return NULL;
+}
 
-  return clm_scope_contains(scope->parent, name);
+static void table_insert(ClmSymbol **table, int size, ClmSymbol *symbol) {
+  unsigned int mask = size - 1;
+  unsigned int i = name_hash(symbol->name) & mask;
+  while (table[i] != NULL)
+    i = (i + 1) & mask;
+  table[i] = symbol;
 }
 
-ClmSymbol *clm_scope_find(ClmScope *scope, const char *name) {
-  if (scope == NULL)
-    return NULL;
+int clm_scope_contains(ClmCompiler *compiler, ClmScope *scope,
+                       const char *name) {
+  return clm_scope_find(compiler, scope, name) != NULL;
+}
 
-  int i;
-  for (i = 0; i < scope->symbols->length; i++) {
-    ClmSymbol *curr = scope->symbols->data[i];
-    if (string_equals(curr->name, name)) {
-      return curr;
-    }
+ClmSymbol *clm_scope_find(ClmCompiler *compiler, ClmScope *scope,
+                          const char *name) {
+  unsigned int hash = name_hash(name);
+  clm_count(compiler, CLM_COUNTER_SCOPE_LOOKUPS, 1);
+  for (; scope != NULL; scope = scope->parent) {
+    ClmSymbol *symbol = table_find(scope, name, hash);
+    if (symbol != NULL)
+      return symbol;
   }
-  return clm_scope_find(scope->parent, name);
+  return NULL;
 }
 
 ClmScope *clm_scope_find_child(ClmScope *scope, void *startNode) {
@@ -117,16 +126,30 @@ ClmScope *clm_scope_find_child(ClmScope *scope, void *startNode) {
 
 void clm_scope_push(ClmScope *scope, ClmSymbol *symbol) {
   array_list_push(scope->symbols, symbol);
+
+  if (2 * scope->symbols->length > scope->tableSize) {
+    // the symbols are reinserted in the order they were declared, so the
+    // first of two symbols with the same name is still the one found
+    int i;
+    scope->tableSize *= 2;
+    scope->table = table_new(scope->arena, scope->tableSize);
+    for (i = 0; i < scope->symbols->length; i++)
+      table_insert(scope->table, scope->tableSize, scope->symbols->data[i]);
+  } else {
+    table_insert(scope->table, scope->tableSize, symbol);
+  }
 }
 
 int clm_scope_next_local_offset(ClmScope *scope) {
+  // offsets are in stack slots, see SLOT() in clm_asm.h
+  // ebp + 0 holds the old frame pointer, so the first local starts below it
   if (scope->symbols->length == 0)
-    return 0;
+    return -2;
 
   ClmSymbol *last_sym = scope->symbols->data[scope->symbols->length - 1];
 
   if (last_sym->location == LOCATION_PARAMETER) {
-    return 0;
+    return -2;
   } else {
     // every local will be a type and a value
     // including matrices!
@@ -134,6 +157,6 @@ int clm_scope_next_local_offset(ClmScope *scope) {
     // note: contant sized matrices will be optimized at compile time
     // so they won't be passed around...
     // but something like [1 2,3 4] * [m:n] will not be optimzed away!
-    return last_sym->offset - 8;
+    return last_sym->offset - 2;
   }
 }
@@ -11,32 +11,44 @@ typedef enum ClmLocation {
 } ClmLocation;
 
 typedef struct ClmSymbol {
-  char *name;
+  const char *name; // interned
   ClmType type;
   void *declaration;
   int offset;
   ClmLocation location;
 } ClmSymbol;
 
-ClmSymbol *clm_symbol_new(const char *name, ClmType type, void *declaration);
-void clm_symbol_free(void *data);
+ClmSymbol *clm_symbol_new(ClmCompiler *compiler, const char *name, ClmType type,
+                          void *declaration);
 
 void clm_symbol_print(void *data, int level);
 
+// symbols are found by name in an open addressing hash table, which is kept
+// at most half full. names are interned (see string_intern), so the table
+// hashes and compares their addresses. the symbol gen also binds every name
+// it resolves to the node it is used in (indExp.symbol, callExp.symbol...),
+// and the scope of a body to the statement it belongs to, so the phases after
+// it don't have to look anything up. scopes and symbols are allocated from the
+// arena of the compiler they are made for
 typedef struct ClmScope {
-  ArrayList *symbols; // ArrayList of ClmSymbol
+  ClmArena *arena;    // where the table and the lists live
+  ArrayList *symbols; // ArrayList of ClmSymbol, in the order they're declared
+  ClmSymbol **table;  // tableSize entries, NULL where they're empty
+  int tableSize;      // a power of 2
   struct ClmScope *parent;
   ArrayList *children; // ArrayList of ClmScope
   void *startNode;
 } ClmScope;
 
-ClmScope *clm_scope_new(ClmScope *parent, void *startNode);
-void clm_scope_free(void *data);
+ClmScope *clm_scope_new(ClmCompiler *compiler, ClmScope *parent,
+                        void *startNode);
 void clm_scope_print(void *data, int level);
 
-int clm_scope_contains(ClmScope *scope, const char *name);
+int clm_scope_contains(ClmCompiler *compiler, ClmScope *scope,
+                       const char *name);
 
-ClmSymbol *clm_scope_find(ClmScope *scope, const char *name);
+ClmSymbol *clm_scope_find(ClmCompiler *compiler, ClmScope *scope,
+                          const char *name);
 ClmScope *clm_scope_find_child(ClmScope *scope, void *startNode);
 
 void clm_scope_push(ClmScope *scope, ClmSymbol *symbol);
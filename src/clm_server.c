@@ -0,0 +1,418 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "clm.h"
+#include "clm_ast.h"
+#include "clm_server.h"
+
+#ifdef _WIN32
+
+int clm_server_main(const char *socketPath, const char *stdDir,
+                    ClmTarget target) {
+  fprintf(stderr, "the compile server needs unix sockets\n");
+  return 0;
+}
+
+int clm_server_request(const char *socketPath, const char *options,
+                       const char *name, const char *source, size_t length,
+                       StringBuffer *diagnostics, StringBuffer *assembly) {
+  return -1;
+}
+
+#else
+
+#define MAX_OPTIONS 32
+// how long a client has to send its request, and to take the answer
+#define CLIENT_TIMEOUT_SECONDS 5
+
+typedef struct {
+  ClmTarget target;
+  ArrayList *modules;   // the compilers of the std modules, which own them
+  ArrayList *functions; // the functions they declare, in the order loaded
+  ArrayList *scopes;    // the global scope of the module of each function
+  ArrayList *code;      // StdCode, for each target and simd requested
+} ServerData;
+
+static ServerData data;
+
+/*
+ *
+ *  COMPILING
+ *
+ */
+
+// a compilation whose errors are collected instead of ending the process.
+// it is on the heap, so what changes between the setjmp and an error isn't
+// lost with the registers
+typedef struct {
+  ClmCompiler *compiler;
+  jmp_buf recover;
+  ClmTokens *tokens;
+} Compilation;
+
+static Compilation *compilation_start(const char *name,
+                                      StringBuffer *diagnostics) {
+  Compilation *c = malloc(sizeof(*c));
+  c->compiler = clm_compiler_new(data.target);
+  c->compiler->recover = &c->recover;
+  c->compiler->diagnostics = diagnostics;
+  c->compiler->fileName = name;
+  c->compiler->imports = array_list_new(NULL);
+  int i;
+  for (i = 0; i < data.functions->length; i++)
+    array_list_push(c->compiler->imports, data.functions->data[i]);
+  c->tokens = NULL;
+  return c;
+}
+
+static void compilation_free(Compilation *c) {
+  clm_tokens_free(c->tokens);
+  clm_compiler_free(c->compiler);
+  free(c);
+}
+
+// everything up to code generation, the source doesn't need to outlive it
+static ArrayList *compilation_check(Compilation *c, const char *source,
+                                    size_t length, ClmScope **out_scope) {
+  c->tokens = clm_lexer_main(c->compiler, source, length);
+  ArrayList *statements = clm_parser_main(c->compiler, c->tokens);
+  clm_tokens_free(c->tokens);
+  c->tokens = NULL;
+
+  *out_scope = clm_symbol_gen_main(c->compiler, statements);
+  clm_type_check_main(c->compiler, statements, *out_scope);
+  clm_optimizer_main(c->compiler, statements, *out_scope);
+  return statements;
+}
+
+/*
+ *
+ *  STD MODULES
+ *
+ */
+
+static char *read_file(const char *name, size_t *out_length) {
+  FILE *file = fopen(name, "rb");
+  if (file == NULL)
+    return NULL;
+  StringBuffer *buffer = string_buffer_new();
+  char chunk[4096];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0)
+    string_buffer_append_n(buffer, chunk, n);
+  fclose(file);
+
+  char *text = buffer->data;
+  *out_length = buffer->length;
+  free(buffer);
+  return text;
+}
+
+// only functions are kept, a module's globals would need to be initialized
+// by every program that uses it
+static void load_module(const char *name) {
+  size_t length;
+  char *source = read_file(name, &length);
+  if (source == NULL) {
+    fprintf(stderr, "unable to read %s\n", name);
+    return;
+  }
+
+  StringBuffer *diagnostics = string_buffer_new();
+  Compilation *c = compilation_start(name, diagnostics);
+  // the file name has to outlive the module
+  c->compiler->fileName = string_intern(c->compiler, name);
+  int start = data.functions->length;
+  if (setjmp(c->recover) == 0) {
+    ClmScope *scope;
+    ArrayList *statements = compilation_check(c, source, length, &scope);
+    int i;
+    for (i = 0; i < statements->length; i++) {
+      ClmStmtNode *node = statements->data[i];
+      if (node->type != STMT_TYPE_FUNC_DEC)
+        clm_error(c->compiler, node->lineNo, node->colNo,
+                  "Only functions are kept from a std module");
+      array_list_push(data.functions, node);
+      array_list_push(data.scopes, scope);
+    }
+    c->compiler->recover = NULL;
+    c->compiler->diagnostics = NULL;
+    array_list_push(data.modules, c->compiler);
+    free(c);
+    fprintf(stderr, "loaded %s, %d functions\n", name,
+            data.functions->length - start);
+  } else {
+    data.functions->length = start;
+    data.scopes->length = start;
+    compilation_free(c);
+    fprintf(stderr, "skipped %s\n%s", name, diagnostics->data);
+  }
+
+  string_buffer_free(diagnostics);
+  free(source);
+}
+
+static int compare_names(const void *a, const void *b) {
+  return strcmp(*(const char **)a, *(const char **)b);
+}
+
+// in order of their names, so a module can use the ones before it
+static void load_modules(const char *dir) {
+  DIR *d = opendir(dir);
+  if (d == NULL) {
+    fprintf(stderr, "no std modules in %s\n", dir);
+    return;
+  }
+
+  ArrayList *names = array_list_new(free);
+  struct dirent *entry;
+  while ((entry = readdir(d)) != NULL) {
+    size_t n = strlen(entry->d_name);
+    if (n > 4 && strcmp(entry->d_name + n - 4, ".clm") == 0) {
+      char *path = malloc(strlen(dir) + n + 2);
+      sprintf(path, "%s/%s", dir, entry->d_name);
+      array_list_push(names, path);
+    }
+  }
+  closedir(d);
+
+  qsort(names->data, names->length, sizeof(char *), compare_names);
+  int i;
+  for (i = 0; i < names->length; i++)
+    load_module(names->data[i]);
+  array_list_free(names);
+}
+
+// the std functions generated for one target and simd. every request for
+// them appends the same code, so the std modules are only typed and
+// generated the first time
+typedef struct {
+  ClmCompiler *compiler; // has the target, simd and types they were made with
+  ClmGeneratedCode code;
+} StdCode;
+
+static const ClmGeneratedCode *std_code(ClmTarget target, ClmSimd simd) {
+  int i;
+  StdCode *std;
+  for (i = 0; i < data.code->length; i++) {
+    std = data.code->data[i];
+    if (std->compiler->target == target && std->compiler->simd == simd)
+      return &std->code;
+  }
+
+  std = malloc(sizeof(*std));
+  std->compiler = clm_compiler_new(target);
+  std->compiler->simd = simd;
+  std->code.code = string_buffer_new();
+  std->code.spillSlots = 0;
+  std->code.gemmUsed = 0;
+  for (i = 0; i < data.functions->length; i++) {
+    int spillSlots, gemmUsed;
+    StringBuffer *code = clm_code_gen_function(
+        std->compiler, data.functions->data[i], data.scopes->data[i],
+        &spillSlots, &gemmUsed);
+    string_buffer_append_n(std->code.code, code->data, code->length);
+    string_buffer_free(code);
+    if (spillSlots > std->code.spillSlots)
+      std->code.spillSlots = spillSlots;
+    std->code.gemmUsed = std->code.gemmUsed || gemmUsed;
+  }
+  array_list_push(data.code, std);
+  return &std->code;
+}
+
+/*
+ *
+ *  REQUESTS
+ *
+ */
+
+static int compile_request(char *request, size_t length,
+                           StringBuffer *diagnostics, StringBuffer *assembly) {
+  char *name = memchr(request, '\n', length);
+  char *source = NULL;
+  if (name != NULL)
+    source = memchr(name + 1, '\n', length - (name + 1 - request));
+  if (source == NULL) {
+    string_buffer_append(diagnostics, "Error: a request starts with a line "
+                                      "of options and a line with the name "
+                                      "of the file\n");
+    return 1;
+  }
+  *name++ = '\0';
+  *source++ = '\0';
+  size_t sourceLength = length - (source - request);
+
+  // the options. the name of the file is on a line of its own, so it can
+  // have spaces in it
+  char *words[MAX_OPTIONS];
+  int count = 0;
+  char *word = strtok(request, " ");
+  while (word != NULL && count < MAX_OPTIONS) {
+    words[count++] = word;
+    word = strtok(NULL, " ");
+  }
+
+  Compilation *c = compilation_start(name, diagnostics);
+  if (setjmp(c->recover) != 0) {
+    compilation_free(c);
+    return 1;
+  }
+
+  int i;
+  for (i = 0; i < count; i++) {
+    if (!clm_compiler_option(c->compiler, words[i]))
+      clm_error(c->compiler, 0, 0, "Unknown option %s", words[i]);
+  }
+  c->compiler->importsCode = std_code(c->compiler->target, c->compiler->simd);
+
+  ClmScope *scope;
+  ArrayList *statements = compilation_check(c, source, sourceLength, &scope);
+  char *code = clm_code_gen_main(c->compiler, statements, scope);
+  string_buffer_append(assembly, code);
+  free(code);
+  compilation_free(c);
+  return 0;
+}
+
+static int read_all(int fd, StringBuffer *buffer) {
+  char chunk[64 * 1024];
+  ssize_t n;
+  while ((n = read(fd, chunk, sizeof(chunk))) > 0)
+    string_buffer_append_n(buffer, chunk, n);
+  return n == 0;
+}
+
+static int write_all(int fd, const char *buffer, size_t length) {
+  while (length > 0) {
+    ssize_t written = write(fd, buffer, length);
+    if (written <= 0)
+      return 0;
+    buffer += written;
+    length -= written;
+  }
+  return 1;
+}
+
+static void serve(int fd) {
+  StringBuffer *request = string_buffer_new();
+  StringBuffer *diagnostics = string_buffer_new();
+  StringBuffer *assembly = string_buffer_new();
+
+  if (read_all(fd, request)) {
+    int status =
+        compile_request(request->data, request->length, diagnostics, assembly);
+    char header[64];
+    sprintf(header, "%d %zu %zu\n", status, diagnostics->length,
+            assembly->length);
+    // the client may have gone away, there is nothing to do about it
+    if (write_all(fd, header, strlen(header)) &&
+        write_all(fd, diagnostics->data, diagnostics->length))
+      write_all(fd, assembly->data, assembly->length);
+  }
+
+  string_buffer_free(request);
+  string_buffer_free(diagnostics);
+  string_buffer_free(assembly);
+}
+
+static int socket_address(const char *socketPath, struct sockaddr_un *address) {
+  memset(address, 0, sizeof(*address));
+  address->sun_family = AF_UNIX;
+  if (strlen(socketPath) >= sizeof(address->sun_path))
+    return 0;
+  strcpy(address->sun_path, socketPath);
+  return 1;
+}
+
+int clm_server_main(const char *socketPath, const char *stdDir,
+                    ClmTarget target) {
+  struct sockaddr_un address;
+  if (!socket_address(socketPath, &address))
+    return 0;
+
+  data.target = target;
+  data.modules = array_list_new(NULL);
+  data.functions = array_list_new(NULL);
+  data.scopes = array_list_new(NULL);
+  data.code = array_list_new(NULL);
+  load_modules(stdDir);
+  std_code(target, CLM_SIMD_SSE2);
+
+  signal(SIGPIPE, SIG_IGN);
+  int server = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(socketPath);
+  if (server < 0 ||
+      bind(server, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+      listen(server, 64) != 0)
+    return 0;
+  fprintf(stderr, "listening on %s\n", socketPath);
+
+  // one request at a time. a client that stops sending or reading is given
+  // up on after the timeout, so it can't hold up the ones behind it
+  struct timeval timeout = {CLIENT_TIMEOUT_SECONDS, 0};
+  for (;;) {
+    int client = accept(server, NULL, NULL);
+    if (client < 0)
+      continue;
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    serve(client);
+    close(client);
+  }
+  return 1;
+}
+
+int clm_server_request(const char *socketPath, const char *options,
+                       const char *name, const char *source, size_t length,
+                       StringBuffer *diagnostics, StringBuffer *assembly) {
+  struct sockaddr_un address;
+  if (strchr(name, '\n') != NULL || !socket_address(socketPath, &address))
+    return -1;
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    return -1;
+  if (connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  // the end of the source is the end of what is written
+  StringBuffer *answer = string_buffer_new();
+  int status = -1;
+  if (write_all(fd, options, strlen(options)) && write_all(fd, "\n", 1) &&
+      write_all(fd, name, strlen(name)) && write_all(fd, "\n", 1) &&
+      write_all(fd, source, length) && shutdown(fd, SHUT_WR) == 0 &&
+      read_all(fd, answer)) {
+    size_t diagnosticsLength, assemblyLength;
+    char *body = memchr(answer->data, '\n', answer->length);
+    if (body != NULL &&
+        sscanf(answer->data, "%d %zu %zu", &status, &diagnosticsLength,
+               &assemblyLength) == 3 &&
+        (size_t)(answer->data + answer->length - body - 1) ==
+            diagnosticsLength + assemblyLength) {
+      body++;
+      string_buffer_append_n(diagnostics, body, diagnosticsLength);
+      string_buffer_append_n(assembly, body + diagnosticsLength,
+                             assemblyLength);
+    } else {
+      status = -1;
+    }
+  }
+
+  string_buffer_free(answer);
+  close(fd);
+  return status;
+}
+
+#endif
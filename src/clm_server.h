@@ -0,0 +1,36 @@
+#ifndef CLM_SERVER_H
+#define CLM_SERVER_H
+
+#include "clm.h"
+
+//
+// Compile server
+//
+// a long lived process that answers compile requests on a unix socket. the
+// std modules are lexed, parsed, checked and optimized once when it starts,
+// and every program it compiles can call their functions. their code is
+// generated once for each target and simd, and appended to the programs
+// compiled for it. an error in a request is sent back with the answer
+// instead of ending the process. a client has a few seconds to send its
+// request and to read the answer, requests are answered one at a time
+//
+// a request is a line of options, like the command line, a line with the
+// name of the file, followed by the source up to the end of the stream. the
+// answer is a line "<status> <diagnostics length> <assembly length>"
+// followed by the diagnostics and then the assembly, status is 0 when the
+// program compiled
+//
+
+// serves requests until the process is killed, the std modules are the
+// .clm files in stdDir. returns 0 if the socket couldn't be opened
+int clm_server_main(const char *socketPath, const char *stdDir,
+                    ClmTarget target);
+
+// sends a request to the server at socketPath and waits for the answer.
+// returns its status, or -1 if the server couldn't be reached. name can't
+// have a newline in it
+int clm_server_request(const char *socketPath, const char *options,
+                       const char *name, const char *source, size_t length,
+                       StringBuffer *diagnostics, StringBuffer *assembly);
+
+#endif
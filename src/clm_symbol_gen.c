@@ -2,17 +2,40 @@
 
 #include "clm.h"
 #include "clm_ast.h"
+#include "clm_module.h"
 #include "clm_scope.h"
 #include "clm_type.h"
 
-static void gen_expnode_symbols(ClmScope *scope, ClmExpNode *node);
-static void gen_statement_symbols(ClmScope *scope, ClmStmtNode *node);
-static void gen_statements_symbols(ClmScope *scope, ArrayList *statements);
+typedef struct SymbolGenData {
+  ClmCompiler *compiler;
+  // variables belong to the function they are assigned in, or are globals,
+  // even when the assignment is inside the body of a conditional. that way
+  // every variable has a slot that is initialized before the function runs
+  ClmScope *currentFunction;
+} SymbolGenData;
+
+static void gen_expnode_symbols(SymbolGenData *data, ClmScope *scope,
+                                ClmExpNode *node);
+static void gen_index_symbols(SymbolGenData *data, ClmScope *scope,
+                              ClmExpNode *node);
+static void gen_statement_symbols(SymbolGenData *data, ClmScope *scope,
+                                  ClmStmtNode *node);
+static void gen_statements_symbols(SymbolGenData *data, ClmScope *scope,
+                                   ArrayList *statements);
 static void gen_symbol_offsets(ClmScope *scope);
 
-static ClmSymbol *gen_new_sym(ClmScope *scope, const char *name, ClmType type,
-                              void *declaration, int isParam) {
-  ClmSymbol *symbol = clm_symbol_new(name, type, declaration);
+static ClmScope *declaring_scope(SymbolGenData *data, ClmScope *scope) {
+  if (data->currentFunction != NULL)
+    return data->currentFunction;
+  while (scope->parent != NULL)
+    scope = scope->parent;
+  return scope;
+}
+
+static ClmSymbol *gen_new_sym(SymbolGenData *data, ClmScope *scope,
+                              const char *name, ClmType type, void *declaration,
+                              int isParam) {
+  ClmSymbol *symbol = clm_symbol_new(data->compiler, name, type, declaration);
   if (isParam) {
     // parameter to a function
     symbol->location = LOCATION_PARAMETER;
@@ -27,160 +50,261 @@ static ClmSymbol *gen_new_sym(ClmScope *scope, const char *name, ClmType type,
   return symbol;
 }
 
-static void gen_expnode_symbols(ClmScope *scope, ClmExpNode *node) {
+static void gen_expnode_symbols(SymbolGenData *data, ClmScope *scope,
+                                ClmExpNode *node) {
   switch (node->type) {
   case EXP_TYPE_INT:
   case EXP_TYPE_FLOAT:
   case EXP_TYPE_STRING:
     break;
   case EXP_TYPE_ARITH:
-    gen_expnode_symbols(scope, node->arithExp.left);
-    gen_expnode_symbols(scope, node->arithExp.right);
+    gen_expnode_symbols(data, scope, node->arithExp.left);
+    gen_expnode_symbols(data, scope, node->arithExp.right);
     break;
   case EXP_TYPE_BOOL:
-    gen_expnode_symbols(scope, node->boolExp.left);
-    gen_expnode_symbols(scope, node->boolExp.right);
+    gen_expnode_symbols(data, scope, node->boolExp.left);
+    gen_expnode_symbols(data, scope, node->boolExp.right);
     break;
   case EXP_TYPE_CALL: {
     int i;
-    if (!clm_scope_contains(scope, node->callExp.name))
-      clm_error(node->lineNo, node->colNo, "Use of undeclared function %s",
-                node->callExp.name);
+    node->callExp.symbol = clm_scope_find(data->compiler, scope,
+                                          node->callExp.name);
+    if (node->callExp.symbol == NULL)
+      clm_error(data->compiler, node->lineNo, node->colNo,
+                "Use of undeclared function %s", node->callExp.name);
 
     for (i = 0; i < node->callExp.params->length; i++) {
-      gen_expnode_symbols(scope, node->callExp.params->data[i]);
+      gen_expnode_symbols(data, scope, node->callExp.params->data[i]);
     }
     break;
   }
   case EXP_TYPE_INDEX:
-    if (!clm_scope_contains(scope, node->indExp.id))
-      clm_error(node->lineNo, node->colNo, "Use of undeclared variable %s",
-                node->indExp.id);
+    node->indExp.symbol = clm_scope_find(data->compiler, scope,
+                                         node->indExp.id);
+    if (node->indExp.symbol == NULL)
+      clm_error(data->compiler, node->lineNo, node->colNo,
+                "Use of undeclared variable %s", node->indExp.id);
+    gen_index_symbols(data, scope, node);
     break;
   case EXP_TYPE_MAT_DEC: {
     if (node->matDecExp.size.rowVar != NULL &&
-        !clm_scope_contains(scope, node->matDecExp.size.rowVar))
-      clm_error(node->lineNo, node->colNo, "Use of undeclared variable %s",
-                node->matDecExp.size.rowVar);
+        !clm_scope_contains(data->compiler, scope, node->matDecExp.size.rowVar))
+      clm_error(data->compiler, node->lineNo, node->colNo,
+                "Use of undeclared variable %s", node->matDecExp.size.rowVar);
     if (node->matDecExp.size.colVar != NULL &&
-        !clm_scope_contains(scope, node->matDecExp.size.colVar))
-      clm_error(node->lineNo, node->colNo, "Use of undeclared variable %s",
-                node->matDecExp.size.colVar);
+        !clm_scope_contains(data->compiler, scope, node->matDecExp.size.colVar))
+      clm_error(data->compiler, node->lineNo, node->colNo,
+                "Use of undeclared variable %s", node->matDecExp.size.colVar);
     break;
   }
   case EXP_TYPE_PARAM: {
     if (node->paramExp.size.rowVar != NULL &&
-        !clm_scope_contains(scope, node->paramExp.size.rowVar))
-      clm_error(node->lineNo, node->colNo, "Use of undeclared variable %s",
-                node->paramExp.size.rowVar);
+        !clm_scope_contains(data->compiler, scope, node->paramExp.size.rowVar))
+      clm_error(data->compiler, node->lineNo, node->colNo,
+                "Use of undeclared variable %s", node->paramExp.size.rowVar);
     if (node->paramExp.size.colVar != NULL &&
-        !clm_scope_contains(scope, node->paramExp.size.colVar))
-      clm_error(node->lineNo, node->colNo, "Use of undeclared variable %s",
-                node->paramExp.size.colVar);
+        !clm_scope_contains(data->compiler, scope, node->paramExp.size.colVar))
+      clm_error(data->compiler, node->lineNo, node->colNo,
+                "Use of undeclared variable %s", node->paramExp.size.colVar);
     break;
   }
   case EXP_TYPE_UNARY:
-    gen_expnode_symbols(scope, node->unaryExp.node);
+    gen_expnode_symbols(data, scope, node->unaryExp.node);
     break;
   }
 }
 
-static void gen_statement_symbols(ClmScope *scope, ClmStmtNode *node) {
+// the indices are expressions too
+static void gen_index_symbols(SymbolGenData *data, ClmScope *scope,
+                              ClmExpNode *node) {
+  if (node->indExp.rowIndex != NULL)
+    gen_expnode_symbols(data, scope, node->indExp.rowIndex);
+  if (node->indExp.rowEnd != NULL)
+    gen_expnode_symbols(data, scope, node->indExp.rowEnd);
+  if (node->indExp.colIndex != NULL)
+    gen_expnode_symbols(data, scope, node->indExp.colIndex);
+  if (node->indExp.colEnd != NULL)
+    gen_expnode_symbols(data, scope, node->indExp.colEnd);
+}
+
+static void gen_statement_symbols(SymbolGenData *data, ClmScope *scope,
+                                  ClmStmtNode *node) {
   switch (node->type) {
   case STMT_TYPE_ASSIGN: {
     ClmExpNode *lhs = node->assignStmt.lhs;
     ClmExpNode *rhs = node->assignStmt.rhs;
-    ClmSymbol *symbol = clm_scope_find(scope, lhs->indExp.id);
+    ClmSymbol *symbol = clm_scope_find(data->compiler, scope, lhs->indExp.id);
 
-    gen_expnode_symbols(scope, rhs);
+    gen_expnode_symbols(data, scope, rhs);
+    gen_index_symbols(data, scope, lhs);
 
     if (clm_exp_has_no_inds(lhs) && symbol == NULL) {
-      clm_scope_push(scope, gen_new_sym(scope, lhs->indExp.id,
-                                        clm_type_of_exp(rhs, scope), node, 0));
+      ClmScope *owner = declaring_scope(data, scope);
+      symbol = gen_new_sym(data, owner, lhs->indExp.id,
+                           clm_type_of_exp(data->compiler, rhs, scope), node,
+                           0);
+      clm_scope_push(owner, symbol);
     } else if (symbol == NULL) {
-      clm_error(node->lineNo, node->colNo, "Use of undeclared variable %s",
-                lhs->indExp.id);
+      clm_error(data->compiler, node->lineNo, node->colNo,
+                "Use of undeclared variable %s", lhs->indExp.id);
     }
+    lhs->indExp.symbol = symbol;
 
     break;
   }
   case STMT_TYPE_CALL:
-    gen_expnode_symbols(scope, node->callExpr);
+    gen_expnode_symbols(data, scope, node->callExpr);
     break;
   case STMT_TYPE_CONDITIONAL: {
     ArrayList *trueBody = node->conditionStmt.trueBody;
     ArrayList *falseBody = node->conditionStmt.falseBody;
 
-    gen_expnode_symbols(scope, node->conditionStmt.condition);
-    gen_statements_symbols(clm_scope_new(scope, trueBody), trueBody);
-    if (node->conditionStmt.falseBody != NULL)
-      gen_statements_symbols(clm_scope_new(scope, falseBody), falseBody);
+    gen_expnode_symbols(data, scope, node->conditionStmt.condition);
+    node->conditionStmt.trueScope = clm_scope_new(data->compiler, scope,
+                                                  trueBody);
+    gen_statements_symbols(data, node->conditionStmt.trueScope, trueBody);
+    if (node->conditionStmt.falseBody != NULL) {
+      node->conditionStmt.falseScope = clm_scope_new(data->compiler, scope,
+                                                     falseBody);
+      gen_statements_symbols(data, node->conditionStmt.falseScope, falseBody);
+    }
     break;
   }
   case STMT_TYPE_FUNC_DEC: {
-    ClmSymbol *symbol;
-    ClmScope *functionScope = clm_scope_new(scope, node);
+    ClmSymbol *symbol = clm_scope_find(data->compiler, scope,
+                                       node->funcDecStmt.name);
+    // the imported functions are generated with the program's, so their
+    // labels can't be taken twice
+    if (scope->parent == NULL &&
+        ((symbol != NULL && symbol->type == CLM_TYPE_FUNCTION) ||
+         clm_module_uses(data->compiler, node->funcDecStmt.name)))
+      clm_error(data->compiler, node->lineNo, node->colNo,
+                "Function %s is already declared", node->funcDecStmt.name);
+    ClmScope *functionScope = clm_scope_new(data->compiler, scope, node);
+    node->funcDecStmt.scope = functionScope;
     if (node->funcDecStmt.parameters->length > 0) {
       int i;
       for (i = 0; i < node->funcDecStmt.parameters->length; i++) {
         ClmExpNode *param = node->funcDecStmt.parameters->data[i];
-        symbol = gen_new_sym(functionScope, param->paramExp.name,
+        symbol = gen_new_sym(data, functionScope, param->paramExp.name,
                              param->paramExp.type, param, 1);
-        symbol->offset = i * 8 + 8;
-        // framepointer + 8 is first param
+        symbol->offset = i * 2 + 2;
+        // offsets are in stack slots, see SLOT() in clm_asm.h
+        // framepointer + 2 slots is first param
         // matrices are passed as an address
-        // val <- ebp + 20
-        // type <- ebp + 16
-        // val <- ebp + 12
-        // type <- ebp + 8 //params
+        // val <- ebp + 5
+        // type <- ebp + 4
+        // val <- ebp + 3
+        // type <- ebp + 2 //params
         // func:
 
-        // i * 8 because each param takes up 2 places on the stack
+        // i * 2 because each param takes up 2 places on the stack
         clm_scope_push(functionScope, symbol);
       }
     }
-    gen_statements_symbols(functionScope, node->funcDecStmt.body);
-    clm_scope_push(scope, gen_new_sym(scope, node->funcDecStmt.name,
+    ClmScope *enclosingFunction = data->currentFunction;
+    data->currentFunction = functionScope;
+    gen_statements_symbols(data, functionScope, node->funcDecStmt.body);
+    data->currentFunction = enclosingFunction;
+    clm_scope_push(scope, gen_new_sym(data, scope, node->funcDecStmt.name,
                                       CLM_TYPE_FUNCTION, node, 0));
     break;
   }
   case STMT_TYPE_WHILE_LOOP:
     // todo should this generate a new scope?
-    gen_expnode_symbols(scope, node->whileLoopStmt.condition);
-    gen_statements_symbols(scope, node->whileLoopStmt.body);
+    gen_expnode_symbols(data, scope, node->whileLoopStmt.condition);
+    gen_statements_symbols(data, scope, node->whileLoopStmt.body);
     break;
   case STMT_TYPE_FOR_LOOP: {
     // todo shoudl this generate a new scope?
-    if (!clm_scope_contains(scope, node->forLoopStmt.varId)) {
-      clm_scope_push(scope, gen_new_sym(scope, node->forLoopStmt.varId,
-                                        CLM_TYPE_INT, node, 0));
+    node->forLoopStmt.var = clm_scope_find(data->compiler, scope,
+                                           node->forLoopStmt.varId);
+    if (node->forLoopStmt.var == NULL) {
+      node->forLoopStmt.var = gen_new_sym(data, scope, node->forLoopStmt.varId,
+                                          CLM_TYPE_INT, node, 0);
+      clm_scope_push(scope, node->forLoopStmt.var);
     }
-    gen_expnode_symbols(scope, node->forLoopStmt.start);
-    gen_expnode_symbols(scope, node->forLoopStmt.end);
-    gen_expnode_symbols(scope, node->forLoopStmt.delta);
-    gen_statements_symbols(scope, node->forLoopStmt.body);
+    gen_expnode_symbols(data, scope, node->forLoopStmt.start);
+    gen_expnode_symbols(data, scope, node->forLoopStmt.end);
+    gen_expnode_symbols(data, scope, node->forLoopStmt.delta);
+    gen_statements_symbols(data, scope, node->forLoopStmt.body);
     break;
   }
   case STMT_TYPE_PRINT:
-    gen_expnode_symbols(scope, node->printStmt.expression);
+    gen_expnode_symbols(data, scope, node->printStmt.expression);
     break;
   case STMT_TYPE_RET:
-    gen_expnode_symbols(scope, node->returnExpr);
+    gen_expnode_symbols(data, scope, node->returnExpr);
+    break;
+  case STMT_TYPE_IMPORT:
+    // the imports at the top were resolved before anything else
+    if (scope->parent != NULL)
+      clm_error(data->compiler, node->lineNo, node->colNo,
+                "Modules are imported at the top of a program");
     break;
   }
 }
 
-static void gen_statements_symbols(ClmScope *scope, ArrayList *statements) {
+static void gen_statements_symbols(SymbolGenData *data, ClmScope *scope,
+                                   ArrayList *statements) {
   if (statements == NULL)
     return;
   int i;
   for (i = 0; i < statements->length; i++) {
-    gen_statement_symbols(scope, statements->data[i]);
+    gen_statement_symbols(data, scope, statements->data[i]);
+  }
+}
+
+// an imported function is called by the name this compiler interned, its
+// body keeps the scopes of the compilation it was declared in
+static void gen_import_symbols(SymbolGenData *data, ClmScope *globalScope,
+                               ArrayList *imports) {
+  int i;
+  if (imports == NULL)
+    return;
+  for (i = 0; i < imports->length; i++) {
+    ClmStmtNode *node = imports->data[i];
+    clm_scope_push(globalScope,
+                   gen_new_sym(data, globalScope,
+                               string_intern(data->compiler,
+                                             node->funcDecStmt.name),
+                               CLM_TYPE_FUNCTION, node, 0));
+  }
+}
+
+// the functions named by import statements are globals. a module that isn't
+// compiled yet is compiled here, with its own symbol gen
+static void gen_module_symbols(SymbolGenData *data, ClmScope *globalScope,
+                               ArrayList *statements) {
+  int i, j;
+  for (i = 0; i < statements->length; i++) {
+    ClmStmtNode *node = statements->data[i];
+    if (node->type != STMT_TYPE_IMPORT)
+      continue;
+    ArrayList *declarations = clm_module_import(data->compiler, node);
+    for (j = 0; j < declarations->length; j++) {
+      ClmStmtNode *declaration = declarations->data[j];
+      const char *name = declaration->funcDecStmt.name;
+      ClmSymbol *symbol = clm_scope_find(data->compiler, globalScope, name);
+      if (symbol != NULL && symbol->declaration == declaration)
+        continue;
+      if (symbol != NULL)
+        clm_error(data->compiler, node->lineNo, node->colNo,
+                  "Function %s is already declared", name);
+      clm_scope_push(globalScope, gen_new_sym(data, globalScope, name,
+                                              CLM_TYPE_FUNCTION, declaration,
+                                              0));
+    }
   }
 }
 
-ClmScope *clm_symbol_gen_main(ArrayList *statements) {
-  ClmScope *globalScope = clm_scope_new(NULL, NULL);
-  gen_statements_symbols(globalScope, statements);
+ClmScope *clm_symbol_gen_main(ClmCompiler *compiler, ArrayList *statements) {
+  SymbolGenData data;
+  data.compiler = compiler;
+  data.currentFunction = NULL;
+  ClmScope *globalScope = clm_scope_new(compiler, NULL, NULL);
+  gen_module_symbols(&data, globalScope, statements);
+  gen_import_symbols(&data, globalScope, compiler->imports);
+  gen_statements_symbols(&data, globalScope, statements);
   return globalScope;
 }
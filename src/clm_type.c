@@ -1,6 +1,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "clm.h"
 #include "clm_ast.h"
 #include "clm_scope.h"
 #include "clm_type.h"
@@ -12,7 +13,7 @@ const char *clm_type_to_string(ClmType type) {
 }
 
 ClmType clm_type_of_ind(ClmExpNode *node, ClmScope *scope) {
-  ClmSymbol *symbol = clm_scope_find(scope, node->indExp.id);
+  ClmSymbol *symbol = node->indExp.symbol;
   return symbol->type;
 }
 
@@ -106,9 +107,45 @@ static ClmType type_of_arith_matrix_any(ArithOp op, ClmType right_type) {
   }
 }
 
-ClmType clm_type_of_exp(ClmExpNode *node, ClmScope *scope) {
+// types and sizes are cached on the nodes, so every node of an expression is
+// only typed once however many times the phases ask about its ancestors. the
+// cache of every node goes stale at once when the compiler's generation
+// changes
+static ClmType type_of_exp(ClmCompiler *compiler, ClmExpNode *node,
+                           ClmScope *scope);
+static void size_of_exp(ClmCompiler *compiler, ClmExpNode *node,
+                        ClmScope *scope, int *out_rows, int *out_cols);
+
+ClmType clm_type_of_exp(ClmCompiler *compiler, ClmExpNode *node,
+                        ClmScope *scope) {
   if (node == NULL)
     return CLM_TYPE_NONE;
+  unsigned int generation = compiler->typeGeneration;
+  if (node->typeGeneration != generation) {
+    clm_count(compiler, CLM_COUNTER_TYPE_RECOMPUTATIONS, 1);
+    node->cachedType = type_of_exp(compiler, node, scope);
+    node->typeGeneration = generation;
+  }
+  return node->cachedType;
+}
+
+int clm_size_of_exp(ClmCompiler *compiler, ClmExpNode *node, ClmScope *scope,
+                    int *out_rows, int *out_cols) {
+  if (node == NULL)
+    return 0;
+  unsigned int generation = compiler->typeGeneration;
+  if (node->sizeGeneration != generation) {
+    clm_count(compiler, CLM_COUNTER_TYPE_RECOMPUTATIONS, 1);
+    size_of_exp(compiler, node, scope, &node->cachedRows, &node->cachedCols);
+    node->sizeGeneration = generation;
+  }
+  *out_rows = node->cachedRows;
+  *out_cols = node->cachedCols;
+  return *out_rows > 0 && *out_cols > 0;
+}
+
+static ClmType type_of_exp(ClmCompiler *compiler, ClmExpNode *node,
+                           ClmScope *scope) {
   switch (node->type) {
   case EXP_TYPE_INT:
     return CLM_TYPE_INT;
@@ -117,8 +154,8 @@ ClmType clm_type_of_exp(ClmExpNode *node, ClmScope *scope) {
   case EXP_TYPE_STRING:
     return CLM_TYPE_STRING;
   case EXP_TYPE_ARITH: {
-    ClmType right_type = clm_type_of_exp(node->arithExp.right, scope);
-    ClmType left_type = clm_type_of_exp(node->arithExp.left, scope);
+    ClmType right_type = clm_type_of_exp(compiler, node->arithExp.right, scope);
+    ClmType left_type = clm_type_of_exp(compiler, node->arithExp.left, scope);
     switch (left_type) {
     case CLM_TYPE_STRING:
       return type_of_arith_string_any(node->arithExp.operand, right_type);
@@ -135,27 +172,25 @@ ClmType clm_type_of_exp(ClmExpNode *node, ClmScope *scope) {
   case EXP_TYPE_BOOL:
     return CLM_TYPE_INT;
   case EXP_TYPE_CALL: {
-    ClmSymbol *symbol = clm_scope_find(scope, node->callExp.name);
+    ClmSymbol *symbol = node->callExp.symbol;
     ClmStmtNode *func_dec = symbol->declaration;
     return func_dec->funcDecStmt.returnType;
   }
   case EXP_TYPE_INDEX: {
-    ClmSymbol *symbol = clm_scope_find(scope, node->indExp.id);
+    ClmSymbol *symbol = node->indExp.symbol;
     if (node->indExp.rowIndex == NULL && node->indExp.colIndex == NULL) // A
       return symbol->type;
-    else if (node->indExp.rowIndex == NULL) // A[#,x]
-      return CLM_TYPE_MATRIX;
-    else if (node->indExp.colIndex == NULL) // A[x,#]
-      return CLM_TYPE_MATRIX;
-    else // A[x,y]
+    else if (clm_exp_is_element(node)) // A[x,y]
       return CLM_TYPE_INT;
+    else // A[#,x] A[x,#] A[x..z,y]...
+      return CLM_TYPE_MATRIX;
   }
   case EXP_TYPE_MAT_DEC:
     return CLM_TYPE_MATRIX;
   case EXP_TYPE_PARAM:
     return node->paramExp.type;
   case EXP_TYPE_UNARY:
-    return clm_type_of_exp(node->unaryExp.node, scope);
+    return clm_type_of_exp(compiler, node->unaryExp.node, scope);
   default:
     return CLM_TYPE_NONE;
   }
@@ -272,12 +307,18 @@ static void decompose_matrix_size(MatrixSize size, int *out_rows,
   *out_cols = size.cols;
 }
 
-int clm_size_of_exp(ClmExpNode *node, ClmScope *scope, int *out_rows,
-                    int *out_cols) {
-  if (node == NULL) {
-    return 0;
-  }
+// the number of rows or cols an index selects, 0 if it isn't known until
+// the program runs
+static int range_length(ClmExpNode *start, ClmExpNode *end) {
+  if (end == NULL)
+    return 1;
+  if (start->type == EXP_TYPE_INT && end->type == EXP_TYPE_INT)
+    return end->ival - start->ival + 1;
+  return 0;
+}
 
+static void size_of_exp(ClmCompiler *compiler, ClmExpNode *node,
+                        ClmScope *scope, int *out_rows, int *out_cols) {
   *out_rows = 0;
   *out_cols = 0;
 
@@ -296,11 +337,11 @@ int clm_size_of_exp(ClmExpNode *node, ClmScope *scope, int *out_rows,
     int lrows, lcols;
     int rrows, rcols;
 
-    ClmType right_type = clm_type_of_exp(node->arithExp.right, scope);
-    ClmType left_type = clm_type_of_exp(node->arithExp.left, scope);
+    ClmType right_type = clm_type_of_exp(compiler, node->arithExp.right, scope);
+    ClmType left_type = clm_type_of_exp(compiler, node->arithExp.left, scope);
 
-    clm_size_of_exp(node->arithExp.left, scope, &lrows, &lcols);
-    clm_size_of_exp(node->arithExp.right, scope, &rrows, &rcols);
+    clm_size_of_exp(compiler, node->arithExp.left, scope, &lrows, &lcols);
+    clm_size_of_exp(compiler, node->arithExp.right, scope, &rrows, &rcols);
 
     switch (left_type) {
     case CLM_TYPE_STRING:
@@ -327,16 +368,22 @@ int clm_size_of_exp(ClmExpNode *node, ClmScope *scope, int *out_rows,
     break;
   }
   case EXP_TYPE_CALL: {
-    ClmSymbol *symbol = clm_scope_find(scope, node->callExp.name);
+    ClmSymbol *symbol = node->callExp.symbol;
     ClmStmtNode *func_dec = symbol->declaration;
     *out_rows = func_dec->funcDecStmt.returnSize.rows;
     *out_cols = func_dec->funcDecStmt.returnSize.cols;
     break;
   }
   case EXP_TYPE_INDEX: {
-    ClmSymbol *symbol = clm_scope_find(scope, node->indExp.id);
-    ClmStmtNode *declaration = symbol->declaration;
-    clm_size_of_exp(declaration->assignStmt.rhs, scope, out_rows, out_cols);
+    ClmSymbol *symbol = node->indExp.symbol;
+    if (symbol->location == LOCATION_PARAMETER) {
+      // parameters are declared by their param node
+      clm_size_of_exp(compiler, symbol->declaration, scope, out_rows, out_cols);
+    } else {
+      ClmStmtNode *declaration = symbol->declaration;
+      clm_size_of_exp(compiler, declaration->assignStmt.rhs, scope, out_rows,
+                      out_cols);
+    }
 
     // note: if both are NULL, then we have the size of the whole matrix
     //      if only col is !NULL, then we are doing A[#,x], which is all rows 1
@@ -344,12 +391,13 @@ int clm_size_of_exp(ClmExpNode *node, ClmScope *scope, int *out_rows,
     //      if only row is !NULL, then we are doing A[x,#], which is 1 row all
     //      cols
     //      if both are !NULL, then we are doing A[x,y], which is 1 row 1 col
+    //      a range x..z is z - x + 1 rows or cols, if both ends are constant
 
     if (node->indExp.rowIndex != NULL)
-      *out_rows = 1;
+      *out_rows = range_length(node->indExp.rowIndex, node->indExp.rowEnd);
 
     if (node->indExp.colIndex != NULL)
-      *out_cols = 1;
+      *out_cols = range_length(node->indExp.colIndex, node->indExp.colEnd);
 
     break;
   }
@@ -360,13 +408,14 @@ int clm_size_of_exp(ClmExpNode *node, ClmScope *scope, int *out_rows,
     decompose_matrix_size(node->paramExp.size, out_rows, out_cols);
     break;
   case EXP_TYPE_UNARY:
-    clm_size_of_exp(node->unaryExp.node, scope, out_rows, out_cols);
+    if (node->unaryExp.operand == UNARY_OP_TRANSPOSE)
+      clm_size_of_exp(compiler, node->unaryExp.node, scope, out_cols, out_rows);
+    else
+      clm_size_of_exp(compiler, node->unaryExp.node, scope, out_rows, out_cols);
     break;
   default:
     break;
   }
-
-  return *out_rows > 0 && *out_cols > 0;
 }
 
 ClmLocation clm_location_of_exp(ClmExpNode *node, ClmScope *scope){
@@ -382,7 +431,7 @@ ClmLocation clm_location_of_exp(ClmExpNode *node, ClmScope *scope){
     case EXP_TYPE_INDEX:
       if(node->indExp.rowIndex == NULL && node->indExp.colIndex == NULL){
         // its just a var name...
-        return clm_scope_find(scope, node->indExp.id)->location;
+        return node->indExp.symbol->location;
       }
       // there are indexes, it will be pushed onto the stack
       return LOCATION_STACK;
@@ -1,6 +1,7 @@
 #ifndef CLM_TYPE_H_
 #define CLM_TYPE_H_
 
+typedef struct ClmCompiler ClmCompiler;
 typedef struct ClmExpNode ClmExpNode;
 typedef struct ClmScope ClmScope;
 typedef enum ClmLocation ClmLocation;
@@ -16,10 +17,11 @@ typedef enum ClmType {
 
 const char *clm_type_to_string(ClmType type);
 ClmType clm_type_of_ind(ClmExpNode *node, ClmScope *scope);
-ClmType clm_type_of_exp(ClmExpNode *node, ClmScope *scope);
+ClmType clm_type_of_exp(ClmCompiler *compiler, ClmExpNode *node,
+                        ClmScope *scope);
 ClmLocation clm_location_of_exp(ClmExpNode *node, ClmScope *scope);
 int clm_type_is_number(ClmType type);
-int clm_size_of_exp(ClmExpNode *node, ClmScope *scope, int *out_rows,
-                    int *out_cols);
+int clm_size_of_exp(ClmCompiler *compiler, ClmExpNode *node, ClmScope *scope,
+                    int *out_rows, int *out_cols);
 
 #endif
@@ -91,7 +91,8 @@ static int unary_op_is_valid_for(UnaryOp op, ClmType type) {
   }
 }
 
-static void type_check_expression(ClmExpNode *node, ClmScope *scope) {
+static void type_check_expression(ClmCompiler *compiler, ClmExpNode *node,
+                                  ClmScope *scope) {
   if (node == NULL)
     return;
   switch (node->type) {
@@ -100,13 +101,13 @@ static void type_check_expression(ClmExpNode *node, ClmScope *scope) {
   case EXP_TYPE_STRING:
     break;
   case EXP_TYPE_ARITH: {
-    type_check_expression(node->arithExp.right, scope);
-    type_check_expression(node->arithExp.left, scope);
-    ClmType left_type = clm_type_of_exp(node->arithExp.left, scope);
-    ClmType right_type = clm_type_of_exp(node->arithExp.right, scope);
+    type_check_expression(compiler, node->arithExp.right, scope);
+    type_check_expression(compiler, node->arithExp.left, scope);
+    ClmType left_type = clm_type_of_exp(compiler, node->arithExp.left, scope);
+    ClmType right_type = clm_type_of_exp(compiler, node->arithExp.right, scope);
     if (!arith_op_is_valid_for(node->arithExp.operand, left_type, right_type)) {
       // error... arith operand not valid for left type and right type
-      clm_error(node->lineNo, node->colNo,
+      clm_error(compiler, node->lineNo, node->colNo,
                 "Arithmetic operand %s not valid for types %s and %s",
                 arith_op_to_string(node->arithExp.operand),
                 clm_type_to_string(left_type), clm_type_to_string(right_type));
@@ -115,15 +116,16 @@ static void type_check_expression(ClmExpNode *node, ClmScope *scope) {
     if (left_type == CLM_TYPE_MATRIX && right_type == CLM_TYPE_MATRIX) {
       int rrows, rcols;
       int lrows, lcols;
-      clm_size_of_exp(node->arithExp.right, scope, &rrows, &rcols);
-      clm_size_of_exp(node->arithExp.left, scope, &lrows, &lcols);
+      clm_size_of_exp(compiler, node->arithExp.right, scope, &rrows, &rcols);
+      clm_size_of_exp(compiler, node->arithExp.left, scope, &lrows, &lcols);
 
       switch (node->arithExp.operand) {
       case ARITH_OP_MULT:
         if (lcols > 0 && rrows > 0 && lcols != rrows) {
-          clm_error(node->lineNo, node->colNo, "Matrix multiply expects "
-                                               "matrices A:[m:n], B:[q:r], "
-                                               "where n == q");
+          clm_error(compiler, node->lineNo, node->colNo,
+                    "Matrix multiply expects "
+                    "matrices A:[m:n], B:[q:r], "
+                    "where n == q");
         }
         // TODO warn if rowVar != rowVar || colVar != colVar?
         break;
@@ -132,7 +134,7 @@ static void type_check_expression(ClmExpNode *node, ClmScope *scope) {
       case ARITH_OP_SUB:
         if ((rrows > 0 && lrows > 0 && rrows != lrows) ||
             (rcols > 0 && lcols > 0 && rcols != lcols)) {
-          clm_error(node->lineNo, node->colNo,
+          clm_error(compiler, node->lineNo, node->colNo,
                     "Matrix element wise arith operation expects matrices "
                     "A:[m:n], B:[q:r], where m == q and n == r");
         }
@@ -145,13 +147,13 @@ static void type_check_expression(ClmExpNode *node, ClmScope *scope) {
     break;
   }
   case EXP_TYPE_BOOL: {
-    type_check_expression(node->boolExp.right, scope);
-    type_check_expression(node->boolExp.left, scope);
-    ClmType left_type = clm_type_of_exp(node->boolExp.left, scope);
-    ClmType right_type = clm_type_of_exp(node->boolExp.right, scope);
+    type_check_expression(compiler, node->boolExp.right, scope);
+    type_check_expression(compiler, node->boolExp.left, scope);
+    ClmType left_type = clm_type_of_exp(compiler, node->boolExp.left, scope);
+    ClmType right_type = clm_type_of_exp(compiler, node->boolExp.right, scope);
     if (!bool_op_is_valid_for(node->boolExp.operand, left_type, right_type)) {
       // error... bool operand not valid for left type and right type
-      clm_error(node->lineNo, node->colNo,
+      clm_error(compiler, node->lineNo, node->colNo,
                 "Boolean operand %s not valid for types %s and %s",
                 bool_op_to_string(node->boolExp.operand),
                 clm_type_to_string(left_type), clm_type_to_string(right_type));
@@ -160,11 +162,11 @@ static void type_check_expression(ClmExpNode *node, ClmScope *scope) {
     if (left_type == CLM_TYPE_MATRIX && right_type == CLM_TYPE_MATRIX) {
       int rrows, rcols;
       int lrows, lcols;
-      clm_size_of_exp(node->arithExp.right, scope, &rrows, &rcols);
-      clm_size_of_exp(node->arithExp.left, scope, &lrows, &lcols);
+      clm_size_of_exp(compiler, node->arithExp.right, scope, &rrows, &rcols);
+      clm_size_of_exp(compiler, node->arithExp.left, scope, &lrows, &lcols);
       if ((rrows > 0 && lrows > 0 && rrows != lrows) ||
           (rcols > 0 && lcols > 0 && rcols != lcols)) {
-        clm_error(node->lineNo, node->colNo,
+        clm_error(compiler, node->lineNo, node->colNo,
                   "Matrix element wise boolean operation expects matrices "
                   "A:[m:n], B:[q:r], where m == q and n == r");
       }
@@ -174,10 +176,10 @@ static void type_check_expression(ClmExpNode *node, ClmScope *scope) {
   }
   case EXP_TYPE_CALL: {
     int i;
-    ClmSymbol *symbol = clm_scope_find(scope, node->callExp.name);
+    ClmSymbol *symbol = node->callExp.symbol;
     if (symbol->type != CLM_TYPE_FUNCTION) {
       // error... calling a non-function?
-      clm_error(node->lineNo, node->colNo, "%s is not a function",
+      clm_error(compiler, node->lineNo, node->colNo, "%s is not a function",
                 node->callExp.name);
     }
     ClmStmtNode *stmt = symbol->declaration;
@@ -186,11 +188,11 @@ static void type_check_expression(ClmExpNode *node, ClmScope *scope) {
       int diff =
           stmt->funcDecStmt.parameters->length - node->callExp.params->length;
       if (diff < 0) {
-        clm_error(node->lineNo, node->colNo,
+        clm_error(compiler, node->lineNo, node->colNo,
                   "Expected %d less parameters for function %s", -diff,
                   node->callExp.name);
       } else {
-        clm_error(node->lineNo, node->colNo,
+        clm_error(compiler, node->lineNo, node->colNo,
                   "Expected %d more parameters for function %s", diff,
                   node->callExp.name);
       }
@@ -198,35 +200,37 @@ static void type_check_expression(ClmExpNode *node, ClmScope *scope) {
     for (i = 0; i < node->callExp.params->length; i++) {
       ClmExpNode *param = node->callExp.params->data[i];
       ClmExpNode *expected = stmt->funcDecStmt.parameters->data[i];
-      type_check_expression(param, scope);
+      type_check_expression(compiler, param, scope);
 
-      if (expected->paramExp.type != clm_type_of_exp(param, scope)) {
+      if (expected->paramExp.type != clm_type_of_exp(compiler, param, scope)) {
         // error... incorrect type passed in
-        clm_error(node->lineNo, node->colNo,
+        clm_error(compiler, node->lineNo, node->colNo,
                   "In call to function %s, expected type %s for parameter %d,\
                         but found type %s",
                   node->callExp.name,
                   clm_type_to_string(expected->paramExp.type), i,
-                  clm_type_to_string(clm_type_of_exp(param, scope)));
+                  clm_type_to_string(clm_type_of_exp(compiler, param, scope)));
       }
 
       if (expected->paramExp.type == CLM_TYPE_MATRIX) {
         int eRows, eCols;
         int pRows, pCols;
-        clm_size_of_exp(expected, scope, &eRows, &eCols);
-        clm_size_of_exp(param, scope, &pRows, &pCols);
+        clm_size_of_exp(compiler, expected, scope, &eRows, &eCols);
+        clm_size_of_exp(compiler, param, scope, &pRows, &pCols);
 
         if (eRows > 0 && pRows > 0 && eRows != pRows) {
-          clm_error(node->lineNo, node->colNo, "Parameter was expecting a "
-                                               "matrix with %d rows, but is "
-                                               "passed a matrix with %d rows",
+          clm_error(compiler, node->lineNo, node->colNo,
+                    "Parameter was expecting a "
+                    "matrix with %d rows, but is "
+                    "passed a matrix with %d rows",
                     eRows, pRows);
         }
 
         if (eCols > 0 && pCols > 0 && eCols != pCols) {
-          clm_error(node->lineNo, node->colNo, "Parameter was expecting a "
-                                               "matrix with %d cols, but is "
-                                               "passed a matrix with %d cols",
+          clm_error(compiler, node->lineNo, node->colNo,
+                    "Parameter was expecting a "
+                    "matrix with %d cols, but is "
+                    "passed a matrix with %d cols",
                     eCols, pCols);
         }
       }
@@ -235,29 +239,43 @@ static void type_check_expression(ClmExpNode *node, ClmScope *scope) {
   }
   case EXP_TYPE_INDEX: {
     // TODO check if index is greater than constant sized matrix size
-    type_check_expression(node->indExp.rowIndex, scope);
-    type_check_expression(node->indExp.colIndex, scope);
+    type_check_expression(compiler, node->indExp.rowIndex, scope);
+    type_check_expression(compiler, node->indExp.colIndex, scope);
+    type_check_expression(compiler, node->indExp.rowEnd, scope);
+    type_check_expression(compiler, node->indExp.colEnd, scope);
 
     if (!clm_exp_has_no_inds(node) &&
         clm_type_of_ind(node, scope) != CLM_TYPE_MATRIX) {
       // error... only matrices should be indexed into
-      clm_error(node->lineNo, node->colNo,
+      clm_error(compiler, node->lineNo, node->colNo,
                 "Unexpected indices... only matrices can be indexed into");
     }
-    ClmType row_index_type = clm_type_of_exp(node->indExp.rowIndex, scope);
-    ClmType col_index_type = clm_type_of_exp(node->indExp.colIndex, scope);
+    ClmType row_index_type = clm_type_of_exp(compiler, node->indExp.rowIndex,
+                                             scope);
+    ClmType col_index_type = clm_type_of_exp(compiler, node->indExp.colIndex,
+                                             scope);
     if (!clm_type_is_number(row_index_type) &&
         row_index_type != CLM_TYPE_NONE) {
       // error... invalid index
-      clm_error(node->lineNo, node->colNo,
+      clm_error(compiler, node->lineNo, node->colNo,
                 "Invalid row index, expecting a number or a '#'");
     }
     if (!clm_type_is_number(col_index_type) &&
         col_index_type != CLM_TYPE_NONE) {
       // error... invalid index
-      clm_error(node->lineNo, node->colNo,
+      clm_error(compiler, node->lineNo, node->colNo,
                 "Invalid column index, expecting a number or a '#'");
     }
+    if ((node->indExp.rowEnd != NULL &&
+         !clm_type_is_number(clm_type_of_exp(compiler, node->indExp.rowEnd,
+                                             scope))) ||
+        (node->indExp.colEnd != NULL &&
+         !clm_type_is_number(clm_type_of_exp(compiler, node->indExp.colEnd,
+                                             scope)))) {
+      // error... invalid range
+      clm_error(compiler, node->lineNo, node->colNo,
+                "Invalid range, expecting a number after '..'");
+    }
     break;
   }
   case EXP_TYPE_MAT_DEC:
@@ -265,25 +283,28 @@ static void type_check_expression(ClmExpNode *node, ClmScope *scope) {
         node->matDecExp.size.rows * node->matDecExp.size.cols !=
             node->matDecExp.length) {
       // error... mat dec rows or cols have in specific number of items
-      clm_error(node->lineNo, node->colNo, "Invalid matrix declaration");
+      clm_error(compiler, node->lineNo, node->colNo,
+                "Invalid matrix declaration");
     }
     break;
   case EXP_TYPE_PARAM:
     break;
   case EXP_TYPE_UNARY:
-    type_check_expression(node->unaryExp.node, scope);
-    ClmType type = clm_type_of_exp(node->unaryExp.node, scope);
+    type_check_expression(compiler, node->unaryExp.node, scope);
+    ClmType type = clm_type_of_exp(compiler, node->unaryExp.node, scope);
     if (!unary_op_is_valid_for(node->unaryExp.operand, type)) {
       // error... unary operand not valid for type
-      clm_error(
-          node->lineNo, node->colNo, "Unary operand %s not valid for type %s",
-          unary_op_to_string(node->unaryExp.operand), clm_type_to_string(type));
+      clm_error(compiler, node->lineNo, node->colNo,
+                "Unary operand %s not valid for type %s",
+                unary_op_to_string(node->unaryExp.operand),
+                clm_type_to_string(type));
     }
     break;
   }
 }
 
-static void type_check_stmts(ArrayList *statements, ClmScope *scope) {
+static void type_check_stmts(ClmCompiler *compiler, ArrayList *statements,
+                             ClmScope *scope) {
   if (statements == NULL)
     return;
   int i;
@@ -292,93 +313,106 @@ static void type_check_stmts(ArrayList *statements, ClmScope *scope) {
     switch (node->type) {
     case STMT_TYPE_ASSIGN:
       // TODO check if size of expression matches size of variable
-      type_check_expression(node->assignStmt.lhs, scope);
-      type_check_expression(node->assignStmt.rhs, scope);
+      type_check_expression(compiler, node->assignStmt.lhs, scope);
+      type_check_expression(compiler, node->assignStmt.rhs, scope);
       if (node->assignStmt.lhs->type != EXP_TYPE_INDEX)
-        clm_error(node->lineNo, node->colNo, "Must assign to a variable");
+        clm_error(compiler, node->lineNo, node->colNo,
+                  "Must assign to a variable");
       break;
     case STMT_TYPE_CALL:
-      type_check_expression(node->callExpr, scope);
+      type_check_expression(compiler, node->callExpr, scope);
       break;
     case STMT_TYPE_CONDITIONAL: {
-      type_check_expression(node->conditionStmt.condition, scope);
-      if (clm_type_of_exp(node->conditionStmt.condition, scope) !=
+      type_check_expression(compiler, node->conditionStmt.condition, scope);
+      if (clm_type_of_exp(compiler, node->conditionStmt.condition, scope) !=
           CLM_TYPE_INT) {
         // error... condition should be a boolean value
-        clm_error(node->lineNo, node->colNo,
+        clm_error(compiler, node->lineNo, node->colNo,
                   "Condition expression should be a boolean, but got type %s",
                   clm_type_to_string(
-                      clm_type_of_exp(node->conditionStmt.condition, scope)));
+                      clm_type_of_exp(compiler, node->conditionStmt.condition,
+                                      scope)));
       }
-      ClmScope *true_scope =
-          clm_scope_find_child(scope, node->conditionStmt.trueBody);
-      type_check_stmts(node->conditionStmt.trueBody, true_scope);
+      ClmScope *true_scope = node->conditionStmt.trueScope;
+      type_check_stmts(compiler, node->conditionStmt.trueBody, true_scope);
       if (node->conditionStmt.falseBody != NULL) {
-        ClmScope *false_scope =
-            clm_scope_find_child(scope, node->conditionStmt.falseBody);
-        type_check_stmts(node->conditionStmt.falseBody, false_scope);
+        ClmScope *false_scope = node->conditionStmt.falseScope;
+        type_check_stmts(compiler, node->conditionStmt.falseBody, false_scope);
       }
       break;
     }
     case STMT_TYPE_FUNC_DEC: {
-      ClmScope *function_scope = clm_scope_find_child(scope, node);
-      type_check_stmts(node->funcDecStmt.body, function_scope);
+      ClmScope *function_scope = node->funcDecStmt.scope;
+      type_check_stmts(compiler, node->funcDecStmt.body, function_scope);
       // todo check return type
       break;
     }
     case STMT_TYPE_WHILE_LOOP:
     {
-      type_check_expression(node->whileLoopStmt.condition, scope);
-      ClmType conditionType = clm_type_of_exp(node->whileLoopStmt.condition, scope);
+      type_check_expression(compiler, node->whileLoopStmt.condition, scope);
+      ClmType conditionType = clm_type_of_exp(compiler,
+                                              node->whileLoopStmt.condition,
+                                              scope);
       if(conditionType != CLM_TYPE_INT){
         // error, condition should be a boolean value
-        clm_error(node->lineNo, node->colNo, "While loop condition should be a boolean, but got type %s", clm_type_to_string(conditionType));
+        clm_error(compiler, node->lineNo, node->colNo,
+                  "While loop condition should be a boolean, but got type %s",
+                  clm_type_to_string(conditionType));
       }
       break;
     }
     case STMT_TYPE_FOR_LOOP: {
-      type_check_expression(node->forLoopStmt.start, scope);
-      type_check_expression(node->forLoopStmt.end, scope);
-      type_check_expression(node->forLoopStmt.delta, scope);
+      type_check_expression(compiler, node->forLoopStmt.start, scope);
+      type_check_expression(compiler, node->forLoopStmt.end, scope);
+      type_check_expression(compiler, node->forLoopStmt.delta, scope);
 
-      if (clm_type_of_exp(node->forLoopStmt.start, scope) != CLM_TYPE_INT) {
+      if (clm_type_of_exp(compiler, node->forLoopStmt.start, scope) !=
+          CLM_TYPE_INT) {
         // error.. loop var should be an int
         clm_error(
-            node->lineNo, node->colNo,
+            compiler, node->lineNo, node->colNo,
             "Loop starting expression should be an int, but got type %s",
-            clm_type_to_string(clm_type_of_exp(node->forLoopStmt.start, scope)));
+            clm_type_to_string(
+                clm_type_of_exp(compiler, node->forLoopStmt.start, scope)));
       }
-      if (clm_type_of_exp(node->forLoopStmt.end, scope) != CLM_TYPE_INT) {
+      if (clm_type_of_exp(compiler, node->forLoopStmt.end, scope) !=
+          CLM_TYPE_INT) {
         // error.. loop var should be a number
         clm_error(
-            node->lineNo, node->colNo,
+            compiler, node->lineNo, node->colNo,
             "Loop ending expression should be an int, but got type %s",
-            clm_type_to_string(clm_type_of_exp(node->forLoopStmt.end, scope)));
+            clm_type_to_string(
+                clm_type_of_exp(compiler, node->forLoopStmt.end, scope)));
       }
-      if (clm_type_of_exp(node->forLoopStmt.delta, scope) != CLM_TYPE_INT) {
+      if (clm_type_of_exp(compiler, node->forLoopStmt.delta, scope) !=
+          CLM_TYPE_INT) {
         // error.. loop var should be a number
         clm_error(
-            node->lineNo, node->colNo,
+            compiler, node->lineNo, node->colNo,
             "Loop delta expression should be an int, but got type %s",
-            clm_type_to_string(clm_type_of_exp(node->forLoopStmt.delta, scope)));
+            clm_type_to_string(
+                clm_type_of_exp(compiler, node->forLoopStmt.delta, scope)));
       }
 
-      ClmScope *loop_scope = clm_scope_find_child(scope, node);
-      type_check_stmts(node->forLoopStmt.body, loop_scope);
+      // loops share the scope they're in
+      type_check_stmts(compiler, node->forLoopStmt.body, scope);
       break;
     }
     case STMT_TYPE_PRINT:
-      type_check_expression(node->printStmt.expression, scope);
+      type_check_expression(compiler, node->printStmt.expression, scope);
       break;
     case STMT_TYPE_RET:
-      type_check_expression(node->returnExpr, scope);
+      type_check_expression(compiler, node->returnExpr, scope);
+      break;
+    case STMT_TYPE_IMPORT:
+      // the imported signatures were checked with their module
       break;
     }
   }
 }
 
-static int check_function_returns(ArrayList *body, ClmScope *scope,
-                                  ClmType returnType) {
+static int check_function_returns(ClmCompiler *compiler, ArrayList *body,
+                                  ClmScope *scope, ClmType returnType) {
   int has_return = 0;
   int i;
   for (i = 0; i < body->length; i++) {
@@ -390,15 +424,15 @@ static int check_function_returns(ArrayList *body, ClmScope *scope,
       break;
     case STMT_TYPE_CONDITIONAL: {
       // todo are these scopes real?
-      ClmScope *true_scope =
-          clm_scope_find_child(scope, node->conditionStmt.trueBody);
-      int true_return = check_function_returns(node->conditionStmt.trueBody,
+      ClmScope *true_scope = node->conditionStmt.trueScope;
+      int true_return = check_function_returns(compiler,
+                                               node->conditionStmt.trueBody,
                                                true_scope, returnType);
 
       if (node->conditionStmt.falseBody != NULL) {
-        ClmScope *false_scope =
-            clm_scope_find_child(scope, node->conditionStmt.falseBody);
-        int false_return = check_function_returns(node->conditionStmt.falseBody,
+        ClmScope *false_scope = node->conditionStmt.falseScope;
+        int false_return = check_function_returns(compiler,
+                                                  node->conditionStmt.falseBody,
                                                   false_scope, returnType);
 
         // if both have valid returns in them we have a valid return
@@ -412,21 +446,25 @@ static int check_function_returns(ArrayList *body, ClmScope *scope,
       // func dec in a function dec?
       break;
     case STMT_TYPE_WHILE_LOOP:
-      has_return |= check_function_returns(node->whileLoopStmt.body, scope, returnType);
+      has_return |= check_function_returns(compiler, node->whileLoopStmt.body,
+                                           scope, returnType);
       break;
     case STMT_TYPE_FOR_LOOP:
       has_return |=
-          check_function_returns(node->forLoopStmt.body, scope, returnType);
+          check_function_returns(compiler, node->forLoopStmt.body, scope,
+                                 returnType);
       break;
     case STMT_TYPE_PRINT:
+    case STMT_TYPE_IMPORT:
       break;
     case STMT_TYPE_RET:
-      if (clm_type_of_exp(node->returnExpr, scope) != returnType) {
+      if (clm_type_of_exp(compiler, node->returnExpr, scope) != returnType) {
         // error... return type invalid
-        clm_error(node->lineNo, node->colNo,
+        clm_error(compiler, node->lineNo, node->colNo,
                   "Function expects return type %s, but got type %s",
                   clm_type_to_string(returnType),
-                  clm_type_to_string(clm_type_of_exp(node->returnExpr, scope)));
+                  clm_type_to_string(clm_type_of_exp(compiler, node->returnExpr,
+                                                     scope)));
       } else {
         has_return = 1;
       }
@@ -436,7 +474,8 @@ static int check_function_returns(ArrayList *body, ClmScope *scope,
   return has_return;
 }
 
-static void check_returns(ArrayList *statements, ClmScope *scope) {
+static void check_returns(ClmCompiler *compiler, ArrayList *statements,
+                          ClmScope *scope) {
   int i;
   for (i = 0; i < statements->length; i++) {
     ClmStmtNode *node = statements->data[i];
@@ -446,24 +485,22 @@ static void check_returns(ArrayList *statements, ClmScope *scope) {
     case STMT_TYPE_CALL:
       break;
     case STMT_TYPE_CONDITIONAL: {
-      ClmScope *true_scope =
-          clm_scope_find_child(scope, node->conditionStmt.trueBody);
-      check_returns(node->conditionStmt.trueBody, true_scope);
+      ClmScope *true_scope = node->conditionStmt.trueScope;
+      check_returns(compiler, node->conditionStmt.trueBody, true_scope);
 
       if (node->conditionStmt.falseBody != NULL) {
-        ClmScope *false_scope =
-            clm_scope_find_child(scope, node->conditionStmt.falseBody);
-        check_returns(node->conditionStmt.falseBody, false_scope);
+        ClmScope *false_scope = node->conditionStmt.falseScope;
+        check_returns(compiler, node->conditionStmt.falseBody, false_scope);
       }
       break;
     }
     case STMT_TYPE_FUNC_DEC: {
-      ClmScope *func_scope = clm_scope_find_child(scope, node);
+      ClmScope *func_scope = node->funcDecStmt.scope;
       if (node->funcDecStmt.returnType != CLM_TYPE_NONE) {
-        if (!check_function_returns(node->funcDecStmt.body, func_scope,
-                                    node->funcDecStmt.returnType)) {
+        if (!check_function_returns(compiler, node->funcDecStmt.body,
+                                    func_scope, node->funcDecStmt.returnType)) {
           // error... expected return but didn't find a valid one!
-          clm_error(node->lineNo, node->colNo,
+          clm_error(compiler, node->lineNo, node->colNo,
                     "Function %s does not have a valid return statement,"
                     " but expects a return of type %s",
                     node->funcDecStmt.name,
@@ -473,17 +510,18 @@ static void check_returns(ArrayList *statements, ClmScope *scope) {
       break;
     }
     case STMT_TYPE_WHILE_LOOP:
-      check_returns(node->whileLoopStmt.body, scope);
+      check_returns(compiler, node->whileLoopStmt.body, scope);
       break;
     case STMT_TYPE_FOR_LOOP:
-      check_returns(node->forLoopStmt.body, scope);
+      check_returns(compiler, node->forLoopStmt.body, scope);
       break;
     case STMT_TYPE_PRINT:
+    case STMT_TYPE_IMPORT:
       break;
     case STMT_TYPE_RET:
       if (scope->parent == NULL) {
         // error... shouldn't have a return in global scope
-        clm_error(node->lineNo, node->colNo,
+        clm_error(compiler, node->lineNo, node->colNo,
                   "Global scope should have no returns");
       }
       break;
@@ -491,7 +529,8 @@ static void check_returns(ArrayList *statements, ClmScope *scope) {
   }
 }
 
-void clm_type_check_main(ArrayList *statements, ClmScope *globalScope) {
-  type_check_stmts(statements, globalScope);
-  check_returns(statements, globalScope);
+void clm_type_check_main(ClmCompiler *compiler, ArrayList *statements,
+                         ClmScope *globalScope) {
+  type_check_stmts(compiler, statements, globalScope);
+  check_returns(compiler, statements, globalScope);
 }
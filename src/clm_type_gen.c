@@ -1,67 +1,71 @@
+#include <stdio.h>
+#include <string.h>
+
 #include "clm_type_gen.h"
 #include "clm_asm.h"
+#include "clm_gemm_gen.h"
 
 // arith
-static void gen_mat_add_mat();
-static void gen_mat_sub_mat();
-static void gen_mat_mul_mat();
-static void gen_mat_div_mat();
-static void gen_mat_mul_int();
-static void gen_mat_div_int();
-static void gen_mat_mul_float();
-static void gen_mat_div_float();
-
-static void gen_int_add_int();
-static void gen_int_sub_int();
-static void gen_int_mul_int();
-static void gen_int_div_int();
-static void gen_int_add_float();
-static void gen_int_sub_float();
-static void gen_int_mul_float();
-static void gen_int_div_float();
-static void gen_int_mul_mat();
-
-static void gen_float_add_int();
-static void gen_float_sub_int();
-static void gen_float_mul_int();
-static void gen_float_div_int();
-static void gen_float_add_float();
-static void gen_float_sub_float();
-static void gen_float_mul_float();
-static void gen_float_div_float();
-static void gen_float_mul_mat();
-
-static void gen_string_add_string();
+static void gen_mat_add_mat(ClmCodeGen *gen, int temps);
+static void gen_mat_sub_mat(ClmCodeGen *gen, int temps);
+static void gen_mat_mul_mat(ClmCodeGen *gen, int temps);
+static void gen_mat_div_mat(ClmCodeGen *gen);
+static void gen_mat_mul_int(ClmCodeGen *gen, int temps);
+static void gen_mat_div_int(ClmCodeGen *gen, int temps);
+static void gen_mat_mul_float(ClmCodeGen *gen, int temps);
+static void gen_mat_div_float(ClmCodeGen *gen, int temps);
+
+static void gen_int_add_int(ClmCodeGen *gen);
+static void gen_int_sub_int(ClmCodeGen *gen);
+static void gen_int_mul_int(ClmCodeGen *gen);
+static void gen_int_div_int(ClmCodeGen *gen);
+static void gen_int_add_float(ClmCodeGen *gen);
+static void gen_int_sub_float(ClmCodeGen *gen);
+static void gen_int_mul_float(ClmCodeGen *gen);
+static void gen_int_div_float(ClmCodeGen *gen);
+static void gen_int_mul_mat(ClmCodeGen *gen, int temps);
+
+static void gen_float_add_int(ClmCodeGen *gen);
+static void gen_float_sub_int(ClmCodeGen *gen);
+static void gen_float_mul_int(ClmCodeGen *gen);
+static void gen_float_div_int(ClmCodeGen *gen);
+static void gen_float_add_float(ClmCodeGen *gen);
+static void gen_float_sub_float(ClmCodeGen *gen);
+static void gen_float_mul_float(ClmCodeGen *gen);
+static void gen_float_div_float(ClmCodeGen *gen);
+static void gen_float_mul_mat(ClmCodeGen *gen, int temps);
+
+static void gen_string_add_string(ClmCodeGen *gen);
 
 // bool
-static void gen_mat_and_mat();
-static void gen_mat_or_mat();
-static void gen_mat_cmp_mat(BoolOp op);
-
-static void gen_int_and_int();
-static void gen_int_and_float();
-static void gen_int_or_int();
-static void gen_int_or_float();
-static void gen_int_cmp_int(BoolOp op);
-static void gen_int_cmp_float(BoolOp op);
-
-static void gen_float_and_int();
-static void gen_float_and_float();
-static void gen_float_or_int();
-static void gen_float_or_float();
-static void gen_float_cmp_int(BoolOp op);
-static void gen_float_cmp_float(BoolOp op);
-
-static void gen_string_cmp_string(BoolOp op);
+static void gen_mat_and_mat(ClmCodeGen *gen);
+static void gen_mat_or_mat(ClmCodeGen *gen);
+static void gen_mat_cmp_mat(ClmCodeGen *gen, BoolOp op, int temps);
+
+static void gen_int_and_int(ClmCodeGen *gen);
+static void gen_int_and_float(ClmCodeGen *gen);
+static void gen_int_or_int(ClmCodeGen *gen);
+static void gen_int_or_float(ClmCodeGen *gen);
+static void gen_int_cmp_int(ClmCodeGen *gen, BoolOp op);
+static void gen_int_cmp_float(ClmCodeGen *gen, BoolOp op);
+
+static void gen_float_and_int(ClmCodeGen *gen);
+static void gen_float_and_float(ClmCodeGen *gen);
+static void gen_float_or_int(ClmCodeGen *gen);
+static void gen_float_or_float(ClmCodeGen *gen);
+static void gen_float_cmp_int(ClmCodeGen *gen, BoolOp op);
+static void gen_float_cmp_float(ClmCodeGen *gen, BoolOp op);
+
+static void gen_string_cmp_string(ClmCodeGen *gen, BoolOp op);
 
 // unary
-static void gen_mat_minus();
-static void gen_mat_transpose();
+static void gen_mat_minus(ClmCodeGen *gen, int temps);
+static void gen_mat_transpose(ClmCodeGen *gen, int temps);
 
-static void gen_int_minus();
-static void gen_int_not();
+static void gen_int_minus(ClmCodeGen *gen);
+static void gen_int_not(ClmCodeGen *gen);
 
-static void gen_float_minus();
+static void gen_float_minus(ClmCodeGen *gen);
 
 // stack will look like this
 // right
@@ -69,31 +73,345 @@ static void gen_float_minus();
 // left
 // left type <- esp
 // stack grows down
-// so esp + 4 is previous element
+// so esp + SLOT(1) is previous element
+
+extern void next_label(ClmCodeGen *gen, char *buffer);
+
+void matrix_element(ClmCodeGen *gen, char *out, const char *base,
+                    const char *index) {
+  char scaled[16];
+  sprintf(scaled, "%s*%d", index, MAT_ELEMENT_SIZE);
+  asm_mem_dword(gen, out, base, 0, scaled);
+}
+
+void matrix_field(ClmCodeGen *gen, char *out, const char *base, int field) {
+  asm_mem(gen, out, base, SLOT(gen, field), NULL);
+}
+
+// pops a matrix pointer off of the typed stack
+static void pop_matrix_into(ClmCodeGen *gen, const char *dest) {
+  asm_pop(gen, dest); // type
+  asm_pop(gen, dest);
+}
+
+void gen_mat_new(ClmCodeGen *gen, const char *rows, const char *cols,
+                 int zeroed) {
+  char location[64];
+
+  asm_mov(gen, EAX(gen), rows);
+  asm_imul(gen, EAX(gen), cols);
+  asm_imul_i(gen, EAX(gen), MAT_ELEMENT_SIZE);
+  asm_add_i(gen, EAX(gen), SLOT(gen, MAT_DESCRIPTOR_SLOTS) + MAT_ALIGNMENT);
+  if (zeroed)
+    asm_calloc(gen, EAX(gen));
+  else
+    asm_malloc(gen, EAX(gen));
+
+  asm_mov(gen, EDX(gen), rows);
+  matrix_field(gen, location, EAX(gen), MAT_ROWS);
+  asm_mov(gen, location, EDX(gen));
+  asm_mov(gen, EDX(gen), cols);
+  matrix_field(gen, location, EAX(gen), MAT_COLS);
+  asm_mov(gen, location, EDX(gen));
+  matrix_field(gen, location, EAX(gen), MAT_STRIDE);
+  asm_mov(gen, location, EDX(gen));
+
+  // the elements follow the descriptor, at the next aligned address
+  sprintf(location, "[%s+%d]", EAX(gen),
+          SLOT(gen, MAT_DESCRIPTOR_SLOTS) + MAT_ALIGNMENT - 1);
+  asm_lea(gen, EDX(gen), location);
+  sprintf(location, "%d", -MAT_ALIGNMENT);
+  asm_and(gen, EDX(gen), location);
+  matrix_field(gen, location, EAX(gen), MAT_DATA);
+  asm_mov(gen, location, EDX(gen));
+}
+
+typedef void (*asm_func2)(ClmCodeGen *, const char *, const char *);
+
+// an operation applied to every element of a matrix. value is the element of
+// the left matrix, and other is the element of the right matrix or the
+// scalar operand, depending on the operation
+typedef struct ElementOp {
+  // value is a 32 bit register and other a 32 bit operand
+  asm_func2 scalar;
+  // value and other are vector registers, NULL if the operation can't be
+  // vectorized
+  asm_func2 vector;
+} ElementOp;
+
+// vector registers used by gen_elements. each of the two vectors handled per
+// iteration has a value register and one for the right operand
+#define VECTOR_VALUE(gen, n) asm_vector_reg(gen, (n) * 2)
+#define VECTOR_OTHER(gen, n) asm_vector_reg(gen, (n) * 2 + 1)
+#define VECTOR_SCALAR(gen) asm_vector_reg(gen, 4)
+#define VECTOR_SCRATCH(gen) asm_vector_reg(gen, 5)
+
+// formats [base+ecx*4+offset], where offset is in bytes
+static void vector_element(ClmCodeGen *gen, char *out, const char *base,
+                           int offset) {
+  int len = sprintf(out, "[%s+%s*%d", base, ECX(gen), MAT_ELEMENT_SIZE);
+  if (offset != 0)
+    len += sprintf(out + len, "%+d", offset);
+  sprintf(out + len, "]");
+}
+
+// pushes the stride of the matrix that base points at, in bytes
+static void push_stride(ClmCodeGen *gen, const char *base) {
+  char location[64];
+  matrix_field(gen, location, base, MAT_STRIDE);
+  asm_mov(gen, EAX(gen), location);
+  asm_imul_i(gen, EAX(gen), MAT_ELEMENT_SIZE);
+  asm_push(gen, EAX(gen));
+}
+
+/*
+        esi = left, edi = right, ebx = dest, and all three are preserved
+        step = 2 vectors, or 1 element without a vector form
+
+        rows = dest.rows, cols = dest.cols
+        if left, right and dest are all contiguous
+                rows = 1, cols = rows * cols
+        left, right and dest = their data
+        while rows != 0
+                ecx = cols
+                while ecx % step != 0
+                        ecx--
+                        dest[ecx] = op(left[ecx], other)
+                while ecx != 0
+                        ecx -= step
+                        dest[ecx:ecx + step] = op(left[ecx:ecx + step], other)
+                left, right and dest += their strides
+                rows--
+
+        other is right if right_matrix is set, otherwise scalar_other in the
+        scalar loop and VECTOR_SCALAR in the vector loop. a slice shares the
+        stride of the matrix it is taken from, so it is walked a row at a time
+*/
+static void gen_elements(ClmCodeGen *gen, const ElementOp *op, int right_matrix,
+                         const char *scalar_other) {
+  char strided_label[LABEL_SIZE], row_label[LABEL_SIZE], row_end[LABEL_SIZE];
+  char tail_label[LABEL_SIZE], vector_label[LABEL_SIZE], end_label[LABEL_SIZE];
+  char left[64], right[64], dest[64], mask[16];
+  char rows[64], cols[64], left_stride[64], right_stride[64], dest_stride[64];
+  const char *value = asm_reg_dword(REG_A);
+  int vector_size = asm_vector_lanes(gen) * MAT_ELEMENT_SIZE;
+  int step = op->vector != NULL ? asm_vector_lanes(gen) * 2 : 1;
+  int i;
+  next_label(gen, strided_label);
+  next_label(gen, row_label);
+  next_label(gen, row_end);
+  next_label(gen, tail_label);
+  next_label(gen, vector_label);
+  next_label(gen, end_label);
+  sprintf(mask, "%d", step - 1);
+  asm_mem(gen, rows, ESP(gen), SLOT(gen, 4), NULL);
+  asm_mem(gen, cols, ESP(gen), SLOT(gen, 3), NULL);
+  asm_mem(gen, left_stride, ESP(gen), SLOT(gen, 2), NULL);
+  asm_mem(gen, right_stride, ESP(gen), SLOT(gen, 1), NULL);
+  asm_mem(gen, dest_stride, ESP(gen), 0, NULL);
+
+  asm_push(gen, ESI(gen));
+  asm_push(gen, EDI(gen));
+  asm_push(gen, EBX(gen));
+  matrix_field(gen, dest, EBX(gen), MAT_ROWS);
+  asm_push(gen, dest);
+  matrix_field(gen, dest, EBX(gen), MAT_COLS);
+  asm_push(gen, dest);
+  push_stride(gen, ESI(gen));
+  if (right_matrix)
+    push_stride(gen, EDI(gen));
+  else
+    asm_push_const_i(gen, 0);
+  push_stride(gen, EBX(gen));
+
+  // a matrix is contiguous when its stride is its number of cols
+  asm_mov(gen, EAX(gen), cols);
+  asm_imul_i(gen, EAX(gen), MAT_ELEMENT_SIZE);
+  asm_cmp(gen, EAX(gen), left_stride);
+  asm_jmp_neq(gen, strided_label);
+  asm_cmp(gen, EAX(gen), dest_stride);
+  asm_jmp_neq(gen, strided_label);
+  if (right_matrix) {
+    asm_cmp(gen, EAX(gen), right_stride);
+    asm_jmp_neq(gen, strided_label);
+  }
+  asm_mov(gen, EAX(gen), rows);
+  asm_imul(gen, EAX(gen), cols);
+  asm_mov(gen, cols, EAX(gen));
+  asm_mov_i(gen, rows, 1);
+
+  asm_label(gen, strided_label);
+  if (right_matrix) {
+    matrix_field(gen, right, EDI(gen), MAT_DATA);
+    asm_mov(gen, EDX(gen), right);
+  }
+  matrix_field(gen, left, ESI(gen), MAT_DATA);
+  asm_mov(gen, ESI(gen), left);
+  matrix_field(gen, dest, EBX(gen), MAT_DATA);
+  asm_mov(gen, EBX(gen), dest);
+  matrix_element(gen, left, ESI(gen), ECX(gen));
+  matrix_element(gen, right, EDX(gen), ECX(gen));
+  matrix_element(gen, dest, EBX(gen), ECX(gen));
+
+  asm_label(gen, row_label);
+  asm_cmp(gen, rows, "0");
+  asm_jmp_eq(gen, end_label);
+  asm_mov(gen, ECX(gen), cols);
+
+  asm_label(gen, tail_label);
+  if (op->vector != NULL) {
+    asm_mov(gen, EAX(gen), ECX(gen));
+    asm_and(gen, EAX(gen), mask);
+    asm_cmp(gen, EAX(gen), "0");
+    asm_jmp_eq(gen, vector_label);
+  } else {
+    asm_cmp(gen, ECX(gen), "0");
+    asm_jmp_eq(gen, row_end);
+  }
+  asm_dec(gen, ECX(gen));
+  asm_mov(gen, value, left);
+  op->scalar(gen, value, right_matrix ? right : scalar_other);
+  asm_mov(gen, dest, value);
+  asm_jmp(gen, tail_label);
+
+  if (op->vector != NULL) {
+    asm_label(gen, vector_label);
+    asm_cmp(gen, ECX(gen), "0");
+    asm_jmp_eq(gen, row_end);
+    asm_sub_i(gen, ECX(gen), step);
+    for (i = 0; i < 2; i++) {
+      vector_element(gen, left, ESI(gen), i * vector_size);
+      asm_movdqu(gen, VECTOR_VALUE(gen, i), left);
+      if (right_matrix) {
+        vector_element(gen, right, EDX(gen), i * vector_size);
+        asm_movdqu(gen, VECTOR_OTHER(gen, i), right);
+      }
+    }
+    for (i = 0; i < 2; i++)
+      op->vector(gen, VECTOR_VALUE(gen, i),
+                 right_matrix ? VECTOR_OTHER(gen, i) : VECTOR_SCALAR(gen));
+    for (i = 0; i < 2; i++) {
+      vector_element(gen, dest, EBX(gen), i * vector_size);
+      asm_movdqu(gen, dest, VECTOR_VALUE(gen, i));
+    }
+    asm_jmp(gen, vector_label);
+  }
+
+  asm_label(gen, row_end);
+  asm_add(gen, ESI(gen), left_stride);
+  if (right_matrix)
+    asm_add(gen, EDX(gen), right_stride);
+  asm_add(gen, EBX(gen), dest_stride);
+  asm_dec(gen, rows);
+  asm_jmp(gen, row_label);
+
+  asm_label(gen, end_label);
+  if (op->vector != NULL && asm_get_simd(gen) == CLM_SIMD_AVX2)
+    asm_vzeroupper(gen);
+  asm_add_i(gen, ESP(gen), SLOT(gen, 5));
+  asm_pop(gen, EBX(gen));
+  asm_pop(gen, EDI(gen));
+  asm_pop(gen, ESI(gen));
+}
+
+static void copy_scalar(ClmCodeGen *gen, const char *value,
+                        const char *other) {}
+static void copy_vector(ClmCodeGen *gen, const char *value,
+                        const char *other) {}
+static const ElementOp copy_op = {copy_scalar, copy_vector};
 
-extern void next_label(char *buffer);
+/*
+        new = alloc(src.rows, src.cols)
+        new.data = src.data
+*/
+void gen_mat_clone(ClmCodeGen *gen, const char *src) {
+  char rows[64], cols[64];
+  matrix_field(gen, rows, src, MAT_ROWS);
+  matrix_field(gen, cols, src, MAT_COLS);
+
+  gen_mat_new(gen, rows, cols, 0);
+  asm_mov(gen, EBX(gen), EAX(gen));
+  if (strcmp(src, ESI(gen)) != 0)
+    asm_mov(gen, ESI(gen), src);
+  gen_elements(gen, &copy_op, 0, NULL);
+  asm_mov(gen, EAX(gen), EBX(gen));
+}
+
+/*
+        dest = pop, a slice
+        src = pop
+        dest.data = src.data
+        free dest and src if it is a temporary
+*/
+void gen_mat_copy_into(ClmCodeGen *gen, int temps) {
+  pop_matrix_into(gen, EBX(gen));
+  pop_matrix_into(gen, ESI(gen));
+  gen_elements(gen, &copy_op, 0, NULL);
+  asm_free(gen, EBX(gen));
+  if (temps & TEMP_LEFT)
+    asm_free(gen, ESI(gen));
+}
+
+// the result goes in ebx, written over a temporary operand if there is one.
+// a slice is never written over, its elements belong to another matrix.
+// returns which operand was reused, TEMP_LEFT, TEMP_RIGHT or 0
+static int gen_mat_destination(ClmCodeGen *gen, int temps, const char *left,
+                               const char *right) {
+  char rows[64], cols[64];
+  if ((temps & TEMP_LEFT) && !(temps & VIEW_LEFT)) {
+    asm_mov(gen, EBX(gen), left);
+    return TEMP_LEFT;
+  } else if ((temps & TEMP_RIGHT) && !(temps & VIEW_RIGHT)) {
+    asm_mov(gen, EBX(gen), right);
+    return TEMP_RIGHT;
+  }
+  matrix_field(gen, rows, left, MAT_ROWS);
+  matrix_field(gen, cols, left, MAT_COLS);
+  gen_mat_new(gen, rows, cols, 0);
+  asm_mov(gen, EBX(gen), EAX(gen));
+  return 0;
+}
+
+// frees the operands of an operation that are temporaries, freeing a slice
+// only frees its descriptor
+static void free_temporaries(ClmCodeGen *gen, int temps, const char *left,
+                             const char *right) {
+  if (temps & TEMP_LEFT)
+    asm_free(gen, left);
+  if (temps & TEMP_RIGHT)
+    asm_free(gen, right);
+}
+
+// pops an int off of the stack into INT_CONST, and formats INT_CONST as a 32
+// bit operand for the fpu
+static void pop_int_into_fpu_operand(ClmCodeGen *gen, char *operand) {
+  char location[64];
+  asm_mem(gen, location, INT_CONST, 0, NULL);
+  pop_int_into(gen, location);
+  asm_mem_dword(gen, operand, INT_CONST, 0, NULL);
+}
 
-void gen_mat_arith(ArithOp op, ClmType other_type) {
+void gen_mat_arith(ClmCodeGen *gen, ArithOp op, ClmType other_type, int temps) {
   switch (other_type) {
   case CLM_TYPE_INT:
     if (op == ARITH_OP_MULT)
-      gen_mat_mul_int();
+      gen_mat_mul_int(gen, temps);
     else if (op == ARITH_OP_DIV)
-      gen_mat_div_int();
+      gen_mat_div_int(gen, temps);
     break;
   case CLM_TYPE_FLOAT:
     if (op == ARITH_OP_MULT)
-      gen_mat_mul_float();
+      gen_mat_mul_float(gen, temps);
     else if (op == ARITH_OP_DIV)
-      gen_mat_div_float();
+      gen_mat_div_float(gen, temps);
     break;
   case CLM_TYPE_MATRIX:
     if (op == ARITH_OP_MULT)
-      gen_mat_mul_int();
+      gen_mat_mul_mat(gen, temps);
     else if (op == ARITH_OP_ADD)
-      gen_mat_add_mat();
+      gen_mat_add_mat(gen, temps);
     else if (op == ARITH_OP_SUB)
-      gen_mat_sub_mat();
+      gen_mat_sub_mat(gen, temps);
     break;
   default:
     // shouldn't get here
@@ -102,141 +420,239 @@ void gen_mat_arith(ArithOp op, ClmType other_type) {
 }
 
 /*
-        lrows = [edx + 4]
-        lele = lrows * [edx + 8]
+        left = pop
+        right = pop
+        dest = left or right if either is a temporary, otherwise a new matrix
+        push dest
 
-        for(ecx = lele - 1, ecx >= 0, ecx--)
-                ebx = 12 + ecx * 4
-                add [esp + ebx], [edx + ebx]
+        dest.data = op(left.data, right.data)
 
-        pop matrix
+        free the temporaries that aren't dest
 */
-static void gen_mat_add_mat() {
-  char cmp_label[LABEL_SIZE], end_label[LABEL_SIZE];
-  next_label(cmp_label);
-  next_label(end_label);
-
-  asm_mov(ECX, "[edx + 4]");
-  asm_imul(ECX, "[edx + 8]");
-  asm_mov(EAX, ECX);
-  asm_dec(ECX);
+static void gen_mat_elementwise(ClmCodeGen *gen, const ElementOp *op,
+                                int temps) {
+  int reused;
+
+  pop_matrix_into(gen, ESI(gen));
+  pop_matrix_into(gen, EDI(gen));
+  reused = gen_mat_destination(gen, temps, ESI(gen), EDI(gen));
+  asm_push(gen, EBX(gen));
+  asm_push_const_i(gen, (int)CLM_TYPE_MATRIX);
+
+  gen_elements(gen, op, 1, NULL);
+  free_temporaries(gen, temps & ~reused, ESI(gen), EDI(gen));
+}
 
-  asm_label(cmp_label);
-  asm_cmp(ECX, "0");
-  asm_jmp_l(end_label);
+static const ElementOp add_op = {asm_add, asm_paddd};
+static const ElementOp sub_op = {asm_sub, asm_psubd};
 
-  asm_mov(EBX, ECX);
-  asm_imul(EBX, "4");
-  asm_add(EBX, "12");
-  asm_add("dword [esp + ebx]", "dword [edx + ebx]");
+static void gen_mat_add_mat(ClmCodeGen *gen, int temps) {
+  gen_mat_elementwise(gen, &add_op, temps);
+}
 
-  asm_dec(ECX);
-  asm_jmp(cmp_label);
+static void gen_mat_sub_mat(ClmCodeGen *gen, int temps) {
+  gen_mat_elementwise(gen, &sub_op, temps);
+}
 
-  asm_label(end_label);
+/*
+        left = pop
+        right = pop
+        dest = [left.rows:right.cols] of 0s
+        dest += left * right
+        free the temporaries
+        push dest
+*/
+static void gen_mat_mul_mat(ClmCodeGen *gen, int temps) {
+  char rows[64], cols[64];
+  matrix_field(gen, rows, ESI(gen), MAT_ROWS);
+  matrix_field(gen, cols, EDI(gen), MAT_COLS);
+
+  pop_matrix_into(gen, ESI(gen));
+  pop_matrix_into(gen, EDI(gen));
+  gen_mat_new(gen, rows, cols, 1);
+  asm_mov(gen, EBX(gen), EAX(gen));
+
+  asm_push(gen, ESI(gen));
+  asm_push(gen, EDI(gen));
+  asm_push(gen, EBX(gen));
+  gen_gemm_call(gen);
+  asm_pop(gen, EBX(gen));
+  asm_pop(gen, EDI(gen));
+  asm_pop(gen, ESI(gen));
+
+  free_temporaries(gen, temps, ESI(gen), EDI(gen));
+  asm_push(gen, EBX(gen));
+  asm_push_const_i(gen, (int)CLM_TYPE_MATRIX);
+}
 
-  pop_matrix_of_size(EAX);
+static void gen_mat_div_mat(ClmCodeGen *gen) {
+  // TODO
 }
 
 /*
-        lrows = [edx + 4]
-        lele = lrows * [edx + 8]
+        scalar = pop int or float
+        matrix = pop
+        dest = matrix if it is a temporary, otherwise a new matrix
+        push dest
 
-        for(ecx = lele - 1, ecx >= 0, ecx--)
-                ebx = 12 + ecx * 4
-                add [esp + ebx], [edx + ebx]
+        dest.data = op(matrix.data, scalar)
 
-        pop matrix
+        an int scalar is kept in edi and a float one in FLOAT_CONST, and both
+        are copied into every lane of VECTOR_SCALAR. temps says whether
+        matrix is a temporary with TEMP_LEFT and VIEW_LEFT
 */
-static void gen_mat_sub_mat() {
-  char cmp_label[LABEL_SIZE], end_label[LABEL_SIZE];
-  next_label(cmp_label);
-  next_label(end_label);
+static void gen_mat_scale(ClmCodeGen *gen, const ElementOp *op,
+                          ClmType scalar_type, int temps) {
+  char scalar[64];
+  int reused;
+
+  if (scalar_type == CLM_TYPE_INT) {
+    pop_int_into(gen, EDI(gen));
+    // sign extended for idiv
+    asm_movsx_dword(gen, EDI(gen), asm_reg_dword(REG_DI));
+    asm_mem_dword(gen, scalar, INT_CONST, 0, NULL);
+    asm_mov(gen, scalar, asm_reg_dword(REG_DI));
+  } else {
+    asm_mem_dword(gen, scalar, FLOAT_CONST, 0, NULL);
+    pop_float_into(gen, scalar);
+  }
+  pop_matrix_into(gen, ESI(gen));
+  reused = gen_mat_destination(gen, temps & (TEMP_LEFT | VIEW_LEFT), ESI(gen),
+                               NULL);
+  asm_push(gen, EBX(gen));
+  asm_push_const_i(gen, (int)CLM_TYPE_MATRIX);
+
+  if (op->vector != NULL)
+    asm_pbroadcastd(gen, VECTOR_SCALAR(gen), scalar);
+  gen_elements(gen, op, 0,
+               scalar_type == CLM_TYPE_INT ? asm_reg_dword(REG_DI) : scalar);
+  free_temporaries(gen, temps & TEMP_LEFT & ~reused, ESI(gen), NULL);
+}
 
-  asm_mov(ECX, "[edx + 4]");
-  asm_imul(ECX, "[edx + 8]");
-  asm_mov(EAX, ECX);
-  asm_dec(ECX);
+// sse2 has no 32 bit multiply (pmulld is sse4.1), so the even and odd lanes
+// are multiplied into 64 bit products by pmuludq and their low halves are
+// interleaved back together. other holds the same int in every lane
+void gen_vector_mul_int(ClmCodeGen *gen, const char *value, const char *other,
+                        const char *scratch) {
+  if (asm_get_simd(gen) == CLM_SIMD_AVX2) {
+    asm_pmulld(gen, value, other);
+    return;
+  }
+  asm_movdqa(gen, scratch, value);
+  asm_pmuludq(gen, value, other);
+  asm_psrlq(gen, scratch, 32);
+  asm_pmuludq(gen, scratch, other);
+  asm_pshufd(gen, value, value, 8);
+  asm_pshufd(gen, scratch, scratch, 8);
+  asm_punpckldq(gen, value, scratch);
+}
 
-  asm_label(cmp_label);
-  asm_cmp(ECX, "0");
-  asm_jmp_l(end_label);
+void gen_vector_neg(ClmCodeGen *gen, const char *value, const char *scratch) {
+  asm_pxor(gen, scratch, scratch);
+  asm_psubd(gen, scratch, value);
+  asm_movdqa(gen, value, scratch);
+}
 
-  asm_mov(EBX, ECX);
-  asm_imul(EBX, "4");
-  asm_add(EBX, "12");
-  asm_sub("dword [esp + ebx]", "dword [edx + ebx]");
+static void mul_int_vector(ClmCodeGen *gen, const char *value,
+                           const char *other) {
+  gen_vector_mul_int(gen, value, other, VECTOR_SCRATCH(gen));
+}
 
-  asm_dec(ECX);
-  asm_jmp(cmp_label);
+// value / other, where other is edi. there is no vector integer division
+static void div_int_scalar(ClmCodeGen *gen, const char *value,
+                           const char *other) {
+  asm_movsx_dword(gen, EAX(gen), value);
+  asm_sign_extend_a(gen);
+  asm_idiv(gen, EDI(gen));
+}
 
-  asm_label(end_label);
+// elements are ints, so scaling by a float rounds each result towards zero.
+// the math is done with 32 bit floats, like the rest of the float math
+static void mul_float_scalar(ClmCodeGen *gen, const char *value,
+                             const char *other) {
+  asm_cvtsi2ss(gen, asm_xmm_reg(5), value);
+  asm_mulss(gen, asm_xmm_reg(5), other);
+  asm_cvttss2si(gen, value, asm_xmm_reg(5));
+}
 
-  pop_matrix_of_size(EAX);
+static void div_float_scalar(ClmCodeGen *gen, const char *value,
+                             const char *other) {
+  asm_cvtsi2ss(gen, asm_xmm_reg(5), value);
+  asm_divss(gen, asm_xmm_reg(5), other);
+  asm_cvttss2si(gen, value, asm_xmm_reg(5));
 }
 
-static void gen_mat_mul_mat() {
-  // TODO
+static void mul_float_vector(ClmCodeGen *gen, const char *value,
+                             const char *other) {
+  asm_cvtdq2ps(gen, value, value);
+  asm_mulps(gen, value, other);
+  asm_cvttps2dq(gen, value, value);
 }
 
-static void gen_mat_div_mat() {
-  // TODO
+static void div_float_vector(ClmCodeGen *gen, const char *value,
+                             const char *other) {
+  asm_cvtdq2ps(gen, value, value);
+  asm_divps(gen, value, other);
+  asm_cvttps2dq(gen, value, value);
 }
 
+static const ElementOp mul_int_op = {asm_imul, mul_int_vector};
+static const ElementOp div_int_op = {div_int_scalar, NULL};
+static const ElementOp mul_float_op = {mul_float_scalar, mul_float_vector};
+static const ElementOp div_float_op = {div_float_scalar, div_float_vector};
+
 /*
         matrix
-        cols
-        rows
-        matrix type <- edx
+        matrix type
         int val
-        int type <-esp
+        int type <- esp
 */
-static void gen_mat_mul_int() {
+static void gen_mat_mul_int(ClmCodeGen *gen, int temps) {
   // note this funcs is genned differently... see code_gen gen_arith comment
-  gen_int_mul_mat();
+  gen_mat_scale(gen, &mul_int_op, CLM_TYPE_INT, temps);
 }
 
-static void gen_mat_div_int() {
+static void gen_mat_div_int(ClmCodeGen *gen, int temps) {
   // note this funcs is genned differently... see code_gen gen_arith comment
-  // TODO
+  gen_mat_scale(gen, &div_int_op, CLM_TYPE_INT, temps);
 }
 
-static void gen_mat_mul_float() {
+static void gen_mat_mul_float(ClmCodeGen *gen, int temps) {
   // note this funcs is genned differently... see code_gen gen_arith comment
-  // TODO
+  gen_mat_scale(gen, &mul_float_op, CLM_TYPE_FLOAT, temps);
 }
 
-static void gen_mat_div_float() {
+static void gen_mat_div_float(ClmCodeGen *gen, int temps) {
   // note this funcs is genned differently... see code_gen gen_arith comment
-  // TODO
+  gen_mat_scale(gen, &div_float_op, CLM_TYPE_FLOAT, temps);
 }
 
 // int arith
-void gen_int_arith(ArithOp op, ClmType other_type) {
+void gen_int_arith(ClmCodeGen *gen, ArithOp op, ClmType other_type, int temps) {
   switch (other_type) {
   case CLM_TYPE_INT:
     if (op == ARITH_OP_ADD)
-      gen_int_add_int();
+      gen_int_add_int(gen);
     else if (op == ARITH_OP_SUB)
-      gen_int_sub_int();
+      gen_int_sub_int(gen);
     else if (op == ARITH_OP_MULT)
-      gen_int_mul_int();
+      gen_int_mul_int(gen);
     else if (op == ARITH_OP_DIV)
-      gen_int_div_int();
+      gen_int_div_int(gen);
     break;
   case CLM_TYPE_FLOAT:
     if (op == ARITH_OP_ADD)
-      gen_int_add_float();
+      gen_int_add_float(gen);
     else if (op == ARITH_OP_SUB)
-      gen_int_sub_float();
+      gen_int_sub_float(gen);
     else if (op == ARITH_OP_MULT)
-      gen_int_mul_float();
+      gen_int_mul_float(gen);
     else if (op == ARITH_OP_DIV)
-      gen_int_div_float();
+      gen_int_div_float(gen);
     break;
   case CLM_TYPE_MATRIX:
     if (op == ARITH_OP_MULT)
-      gen_int_mul_mat();
+      gen_int_mul_mat(gen, temps);
     break;
   default:
     // shouldn't get here
@@ -244,118 +660,93 @@ void gen_int_arith(ArithOp op, ClmType other_type) {
   }
 }
 
-static void gen_int_add_int() {
-  pop_int_into(EAX);
-  pop_int_into(EBX);
-  asm_add(EAX, EBX);
-  asm_push(EAX);
-  asm_push_const_i((int)CLM_TYPE_INT);
+static void gen_int_add_int(ClmCodeGen *gen) {
+  pop_int_into(gen, EAX(gen));
+  pop_int_into(gen, EBX(gen));
+  asm_add(gen, EAX(gen), EBX(gen));
+  asm_wrap_int(gen, EAX(gen));
+  asm_push(gen, EAX(gen));
+  asm_push_const_i(gen, (int)CLM_TYPE_INT);
 }
 
-static void gen_int_sub_int() {
-  pop_int_into(EAX);
-  pop_int_into(EBX);
-  asm_sub(EAX, EBX);
-  asm_push(EAX);
-  asm_push_const_i((int)CLM_TYPE_INT);
+static void gen_int_sub_int(ClmCodeGen *gen) {
+  pop_int_into(gen, EAX(gen));
+  pop_int_into(gen, EBX(gen));
+  asm_sub(gen, EAX(gen), EBX(gen));
+  asm_wrap_int(gen, EAX(gen));
+  asm_push(gen, EAX(gen));
+  asm_push_const_i(gen, (int)CLM_TYPE_INT);
 }
 
-static void gen_int_mul_int() {
-  pop_int_into(EAX);
-  pop_int_into(EBX);
-  asm_imul(EAX, EBX);
-  asm_push(EAX);
-  asm_push_const_i((int)CLM_TYPE_INT);
+static void gen_int_mul_int(ClmCodeGen *gen) {
+  pop_int_into(gen, EAX(gen));
+  pop_int_into(gen, EBX(gen));
+  asm_imul(gen, EAX(gen), EBX(gen));
+  asm_wrap_int(gen, EAX(gen));
+  asm_push(gen, EAX(gen));
+  asm_push_const_i(gen, (int)CLM_TYPE_INT);
 }
 
-static void gen_int_div_int() {
+static void gen_int_div_int(ClmCodeGen *gen) {
   // TODO
 }
 
-static void gen_int_add_float() {
-  pop_int_into("dword [" INT_CONST "]");
-  asm_fiadd("dword [" INT_CONST "]");
+static void gen_int_add_float(ClmCodeGen *gen) {
+  char operand[64];
+  pop_int_into_fpu_operand(gen, operand);
+  asm_fiadd(gen, operand);
 }
 
-static void gen_int_sub_float() {
-  pop_int_into("dword [" INT_CONST "]");
-  asm_fisub("dword [" INT_CONST "]");
+static void gen_int_sub_float(ClmCodeGen *gen) {
+  char operand[64];
+  pop_int_into_fpu_operand(gen, operand);
+  asm_fisubr(gen, operand);
 }
 
-static void gen_int_mul_float() {
-  pop_int_into("dword [" INT_CONST "]");
-  asm_fimul("dword [" INT_CONST "]");
+static void gen_int_mul_float(ClmCodeGen *gen) {
+  char operand[64];
+  pop_int_into_fpu_operand(gen, operand);
+  asm_fimul(gen, operand);
 }
 
-static void gen_int_div_float() {
-  pop_int_into("dword [" INT_CONST "]");
-  asm_fidiv("dword [" INT_CONST "]");
+static void gen_int_div_float(ClmCodeGen *gen) {
+  char operand[64];
+  pop_int_into_fpu_operand(gen, operand);
+  asm_fidivr(gen, operand);
 }
 
-/*
-        lrows = [edx + 4]
-        lele = lrows * [edx + 8]
-        eax = [esp + 4]
-        for(ecx = lele - 1, ecx >= 0, ecx--)
-                ebx = 12 + ecx * 4
-                imul [edx + ebx], eax
-
-        pop int
-*/
-static void gen_int_mul_mat() {
-  char cmp_label[LABEL_SIZE], end_label[LABEL_SIZE];
-  next_label(cmp_label);
-  next_label(end_label);
-
-  asm_mov(ECX, "[edx + 4]");
-  asm_imul(ECX, "[edx + 8]");
-  asm_dec(ECX);
-
-  asm_mov(EAX, "[esp + 4]");
-
-  asm_label(cmp_label);
-  asm_cmp(ECX, "0");
-  asm_jmp_l(end_label);
-
-  asm_mov(EBX, ECX);
-  asm_imul(EBX, "4");
-  asm_add(EBX, "12");
-  asm_imul("dword [edx + ebx]", "eax");
-
-  asm_dec(ECX);
-  asm_jmp(cmp_label);
-
-  asm_label(end_label);
-
-  pop_int_into(EAX);
+// the matrix is the right operand, its flags are moved to the left ones
+static void gen_int_mul_mat(ClmCodeGen *gen, int temps) {
+  gen_mat_scale(gen, &mul_int_op, CLM_TYPE_INT, temps >> 1);
 }
 
 // float arith
-void gen_float_arith(ArithOp op, ClmType other_type) {
+void gen_float_arith(ClmCodeGen *gen, ArithOp op, ClmType other_type,
+                     int temps) {
   switch (other_type) {
   case CLM_TYPE_INT:
     if (op == ARITH_OP_ADD)
-      gen_float_add_int();
+      gen_float_add_int(gen);
     else if (op == ARITH_OP_SUB)
-      gen_float_sub_int();
+      gen_float_sub_int(gen);
     else if (op == ARITH_OP_MULT)
-      gen_float_mul_int();
+      gen_float_mul_int(gen);
     else if (op == ARITH_OP_DIV)
-      gen_float_div_int();
+      gen_float_div_int(gen);
     break;
   case CLM_TYPE_FLOAT:
     if (op == ARITH_OP_ADD)
-      gen_float_add_float();
+      gen_float_add_float(gen);
     else if (op == ARITH_OP_SUB)
-      gen_float_sub_float();
+      gen_float_sub_float(gen);
     else if (op == ARITH_OP_MULT)
-      gen_float_mul_float();
+      gen_float_mul_float(gen);
     else if (op == ARITH_OP_DIV)
-      gen_float_div_float();
+      gen_float_div_float(gen);
     break;
   case CLM_TYPE_MATRIX:
     if (op == ARITH_OP_MULT)
-      gen_float_mul_mat();
+      gen_float_mul_mat(gen, temps);
     break;
   default:
     // shouldn't get here
@@ -363,120 +754,134 @@ void gen_float_arith(ArithOp op, ClmType other_type) {
   }
 }
 
-static void gen_float_add_int() {
-  asm_pop(EBX); // pop float type value
-  pop_int_into("dword [" INT_CONST "]");
-  asm_fiadd("dword [" INT_CONST "]");
-  asm_push(EBX); // push float value
+static void gen_float_add_int(ClmCodeGen *gen) {
+  char operand[64];
+  asm_pop(gen, EBX(gen)); // pop float type value
+  pop_int_into_fpu_operand(gen, operand);
+  asm_fiadd(gen, operand);
+  asm_push(gen, EBX(gen)); // push float value
 }
 
-static void gen_float_sub_int() {
-  asm_pop(EBX); // pop float type value
-  pop_int_into("dword [" INT_CONST "]");
-  asm_fisubr("dword [" INT_CONST "]");
-  asm_push(EBX); // push float value
+static void gen_float_sub_int(ClmCodeGen *gen) {
+  char operand[64];
+  asm_pop(gen, EBX(gen)); // pop float type value
+  pop_int_into_fpu_operand(gen, operand);
+  asm_fisub(gen, operand);
+  asm_push(gen, EBX(gen)); // push float value
 }
 
-static void gen_float_mul_int() {
-  asm_pop(EBX); // pop float type value
-  pop_int_into("dword [" INT_CONST "]");
-  asm_fimul("dword [" INT_CONST "]");
-  asm_push(EBX); // push float value
+static void gen_float_mul_int(ClmCodeGen *gen) {
+  char operand[64];
+  asm_pop(gen, EBX(gen)); // pop float type value
+  pop_int_into_fpu_operand(gen, operand);
+  asm_fimul(gen, operand);
+  asm_push(gen, EBX(gen)); // push float value
 }
 
-static void gen_float_div_int() {
-  asm_pop(EBX); // pop float type value
-  pop_int_into("dword [" INT_CONST "]");
-  asm_fidivr("dword [" INT_CONST "]");
-  asm_push(EBX); // push float value
+static void gen_float_div_int(ClmCodeGen *gen) {
+  char operand[64];
+  asm_pop(gen, EBX(gen)); // pop float type value
+  pop_int_into_fpu_operand(gen, operand);
+  asm_fidiv(gen, operand);
+  asm_push(gen, EBX(gen)); // push float value
 }
 
-static void gen_float_add_float() {
+static void gen_float_add_float(ClmCodeGen *gen) {
   // pop the type values from the regular stack
   // note: there are 2 type values on regular stack, but leave one because
   // we are still generating a float
-  asm_pop(EAX);
-  asm_faddp(ST1, ST0);
+  asm_pop(gen, EAX(gen));
+  asm_faddp(gen, ST1(gen), ST0(gen));
 }
 
-static void gen_float_sub_float() {
-  asm_pop(EAX);
-  asm_fsubp(ST1, ST0);
+// the left operand is in st0, the right in st1
+static void gen_float_sub_float(ClmCodeGen *gen) {
+  asm_pop(gen, EAX(gen));
+  asm_fsubrp(gen, ST1(gen), ST0(gen));
 }
 
-static void gen_float_mul_float() {
-  asm_pop(EAX);
-  asm_fmulp(ST1, ST0);
+static void gen_float_mul_float(ClmCodeGen *gen) {
+  asm_pop(gen, EAX(gen));
+  asm_fmulp(gen, ST1(gen), ST0(gen));
 }
 
-static void gen_float_div_float() {
-  asm_pop(EAX);
-  asm_fdivp(ST1, ST0);
+static void gen_float_div_float(ClmCodeGen *gen) {
+  asm_pop(gen, EAX(gen));
+  asm_fdivrp(gen, ST1(gen), ST0(gen));
 }
 
-static void gen_float_mul_mat() {
-  // TODO
+static void gen_float_mul_mat(ClmCodeGen *gen, int temps) {
+  gen_mat_scale(gen, &mul_float_op, CLM_TYPE_FLOAT, temps >> 1);
 }
 
 // string arith
-void gen_string_arith(ArithOp op, ClmType other_type) {
+void gen_string_arith(ClmCodeGen *gen, ArithOp op, ClmType other_type) {
   if (op == ARITH_OP_ADD && other_type == CLM_TYPE_STRING)
-    gen_string_add_string();
+    gen_string_add_string(gen);
 }
 
-static void gen_string_add_string() {
+static void gen_string_add_string(ClmCodeGen *gen) {
   // TODO
 }
 
-void gen_mat_bool(BoolOp op, ClmType other_type) {
+void gen_mat_bool(ClmCodeGen *gen, BoolOp op, ClmType other_type, int temps) {
   // other type here can only be CLM_TYPE_MATRIX
   switch (op) {
   case BOOL_OP_AND:
-    gen_mat_and_mat();
+    gen_mat_and_mat(gen);
     break;
   case BOOL_OP_OR:
-    gen_mat_or_mat();
+    gen_mat_or_mat(gen);
     break;
   default:
-    gen_mat_cmp_mat(op);
+    gen_mat_cmp_mat(gen, op, temps);
     break;
   }
 }
 
-static void gen_mat_and_mat() {
+static void gen_mat_and_mat(ClmCodeGen *gen) {
   // TODO
 }
 
-static void gen_mat_or_mat() {
+static void gen_mat_or_mat(ClmCodeGen *gen) {
   // TODO
 }
 
-typedef void (*asm_func1)(const char *);
+typedef void (*asm_func1)(ClmCodeGen *, const char *);
+
+// ebx = the address of element (edx, ecx) of the matrix that base points at
+static void gen_element_address(ClmCodeGen *gen, const char *base) {
+  char location[64];
+  asm_mov(gen, EBX(gen), EDX(gen));
+  matrix_field(gen, location, base, MAT_STRIDE);
+  asm_imul(gen, EBX(gen), location);
+  asm_add(gen, EBX(gen), ECX(gen));
+  asm_imul_i(gen, EBX(gen), MAT_ELEMENT_SIZE);
+  matrix_field(gen, location, base, MAT_DATA);
+  asm_add(gen, EBX(gen), location);
+}
+
 /*
-        lrows = [esp + 4]
-        rrows = [edx + 4]
-        cmp lrows, rrows
-        jneq false_label
-
-        lele = lrows * [esp + 8]
-        rele = rrows * [edx + 8]
-        cmp lele, rele
-        jneq false_label
-
-        for(ecx = lele - 1, ecx >= 0, ecx--)
-                eax = 12 + ecx * 4
-                cmp dword [esp + eax], dword [edx + eax]
-                cmp_func false_label
-
-        pop matrices
-        push 1
+        left = pop
+        right = pop
+        if left.rows != right.rows or left.cols != right.cols
+                goto false_label
+
+        for(edx = rows - 1, edx >= 0, edx--)
+                for(ecx = cols - 1, ecx >= 0, ecx--)
+                        eax = left.data[edx * left.stride + ecx]
+                        cmp eax, right.data[edx * right.stride + ecx]
+                        cmp_func false_label
+
+        ebx = 1
         jmp end_label
 false_label
-        pop matrices
-        push 0
+        ebx = 0
 end_label
+        free the temporaries
+        push ebx
 */
-static void gen_mat_cmp_mat(BoolOp op) {
+static void gen_mat_cmp_mat(ClmCodeGen *gen, BoolOp op, int temps) {
   asm_func1 jmp_func;
   switch (op) {
   case BOOL_OP_GT:
@@ -501,105 +906,120 @@ static void gen_mat_cmp_mat(BoolOp op) {
     return;
   }
 
-  char cmp_label[256], true_label[256], false_label[256], end_label[256];
-  next_label(cmp_label);
-  next_label(true_label);
-  next_label(false_label);
-  next_label(end_label);
-
-  // compare rows
-  asm_mov(EAX, "[esp + 4]");
-  asm_mov(EBX, "[edx + 4]");
-  asm_cmp(EAX, EBX);
-  asm_jmp_neq(false_label);
-
-  // compare num elements
-  asm_imul(EAX, "[esp + 8]");
-  asm_imul(EBX, "[edx + 8]");
-  asm_cmp(EAX, EBX);
-  asm_jmp_neq(false_label);
-
-  // ecx = num elements - 1
-  asm_mov(ECX, EAX);
-  asm_dec(ECX);
-
-  asm_label(cmp_label);
-  asm_cmp(ECX, "0");
-  asm_jmp_l(true_label);
-
-  // eax = 12 + 4 * ecx
-  asm_mov(EAX, ECX);
-  asm_imul(EAX, "4");
-  asm_add(EAX, "12");
-  asm_cmp("dword [esp + eax]", "dword [edx + eax]");
-  jmp_func(false_label);
-
-  asm_dec(EAX);
-  asm_jmp(cmp_label);
-
-  asm_label(true_label);
-  pop_matrix_of_size(EBX); // ebx still contains number of elements
-  asm_push_const_i(1);
-  asm_jmp(end_label);
-
-  asm_label(false_label);
-  pop_matrix_of_size(EBX); // ebx still contains number of elements
-  asm_push_const_i(0);
-
-  asm_label(end_label);
+  char row_label[LABEL_SIZE], col_label[LABEL_SIZE], true_label[LABEL_SIZE];
+  char false_label[LABEL_SIZE], end_label[LABEL_SIZE];
+  char location[64], element[64];
+  const char *value = asm_reg_dword(REG_A);
+  next_label(gen, row_label);
+  next_label(gen, col_label);
+  next_label(gen, true_label);
+  next_label(gen, false_label);
+  next_label(gen, end_label);
+  asm_mem_dword(gen, element, EBX(gen), 0, NULL);
+
+  pop_matrix_into(gen, ESI(gen));
+  pop_matrix_into(gen, EDI(gen));
+
+  // compare sizes
+  matrix_field(gen, location, ESI(gen), MAT_ROWS);
+  asm_mov(gen, EAX(gen), location);
+  matrix_field(gen, location, EDI(gen), MAT_ROWS);
+  asm_cmp(gen, EAX(gen), location);
+  asm_jmp_neq(gen, false_label);
+  matrix_field(gen, location, ESI(gen), MAT_COLS);
+  asm_mov(gen, EAX(gen), location);
+  matrix_field(gen, location, EDI(gen), MAT_COLS);
+  asm_cmp(gen, EAX(gen), location);
+  asm_jmp_neq(gen, false_label);
+
+  matrix_field(gen, location, ESI(gen), MAT_ROWS);
+  asm_mov(gen, EDX(gen), location);
+
+  asm_label(gen, row_label);
+  asm_dec(gen, EDX(gen));
+  asm_cmp(gen, EDX(gen), "0");
+  asm_jmp_l(gen, true_label);
+  matrix_field(gen, location, ESI(gen), MAT_COLS);
+  asm_mov(gen, ECX(gen), location);
+
+  asm_label(gen, col_label);
+  asm_dec(gen, ECX(gen));
+  asm_cmp(gen, ECX(gen), "0");
+  asm_jmp_l(gen, row_label);
+
+  gen_element_address(gen, ESI(gen));
+  asm_mov(gen, value, element);
+  gen_element_address(gen, EDI(gen));
+  asm_cmp(gen, value, element);
+  jmp_func(gen, false_label);
+  asm_jmp(gen, col_label);
+
+  asm_label(gen, true_label);
+  asm_mov_i(gen, EBX(gen), 1);
+  asm_jmp(gen, end_label);
+
+  asm_label(gen, false_label);
+  asm_mov_i(gen, EBX(gen), 0);
+
+  asm_label(gen, end_label);
+  free_temporaries(gen, temps, ESI(gen), EDI(gen));
+  asm_push(gen, EBX(gen));
+  asm_push_const_i(gen, (int)CLM_TYPE_INT);
 }
 
-void gen_int_bool(BoolOp op, ClmType other_type) {
+void gen_int_bool(ClmCodeGen *gen, BoolOp op, ClmType other_type) {
   switch (op) {
   case BOOL_OP_AND:
     if (other_type == CLM_TYPE_INT) {
-      gen_int_and_int();
+      gen_int_and_int(gen);
     } else {
       // other_type == CLM_TYPE_FLOAT
-      gen_int_and_float();
+      gen_int_and_float(gen);
     }
     break;
   case BOOL_OP_OR:
     if (other_type == CLM_TYPE_INT) {
-      gen_int_or_int();
+      gen_int_or_int(gen);
     } else {
       // other_type == CLM_TYPE_FLOAT
-      gen_int_or_float();
+      gen_int_or_float(gen);
     }
     break;
   default:
     if (other_type == CLM_TYPE_INT) {
-      gen_int_cmp_int(op);
+      gen_int_cmp_int(gen, op);
     } else {
-      gen_int_cmp_float(op);
+      gen_int_cmp_float(gen, op);
     }
     break;
   }
 }
 
-static void gen_int_and_int() {
-  pop_int_into(EAX);
-  pop_int_into(EBX);
-  asm_and(EAX, EBX);
-  asm_push(EAX);
+static void gen_int_and_int(ClmCodeGen *gen) {
+  pop_int_into(gen, EAX(gen));
+  pop_int_into(gen, EBX(gen));
+  asm_and(gen, EAX(gen), EBX(gen));
+  asm_push(gen, EAX(gen));
+  asm_push_const_i(gen, (int)CLM_TYPE_INT);
 }
 
-static void gen_int_and_float() {
+static void gen_int_and_float(ClmCodeGen *gen) {
   // TODO
 }
 
-static void gen_int_or_int() {
-  pop_int_into(EAX);
-  pop_int_into(EBX);
-  asm_or(EAX, EBX);
-  asm_push(EAX);
+static void gen_int_or_int(ClmCodeGen *gen) {
+  pop_int_into(gen, EAX(gen));
+  pop_int_into(gen, EBX(gen));
+  asm_or(gen, EAX(gen), EBX(gen));
+  asm_push(gen, EAX(gen));
+  asm_push_const_i(gen, (int)CLM_TYPE_INT);
 }
 
-static void gen_int_or_float() {
+static void gen_int_or_float(ClmCodeGen *gen) {
   // TODO
 }
 
-static void gen_int_cmp_int(BoolOp op) {
+static void gen_int_cmp_int(ClmCodeGen *gen, BoolOp op) {
   asm_func1 jmp_func;
   switch (op) {
   case BOOL_OP_GT:
@@ -626,84 +1046,85 @@ static void gen_int_cmp_int(BoolOp op) {
 
   char end_label[256];
   char false_label[256];
-  next_label(false_label);
-  next_label(end_label);
+  next_label(gen, false_label);
+  next_label(gen, end_label);
 
-  pop_int_into(EAX);
-  pop_int_into(EBX);
-  asm_cmp(EAX, EBX);
+  pop_int_into(gen, EAX(gen));
+  pop_int_into(gen, EBX(gen));
+  asm_cmp(gen, EAX(gen), EBX(gen));
 
-  jmp_func(false_label);
+  jmp_func(gen, false_label);
 
-  asm_push_const_i(1);
-  asm_jmp(end_label);
-  asm_label(false_label);
-  asm_push_const_i(0);
-  asm_label(end_label);
+  asm_push_const_i(gen, 1);
+  asm_jmp(gen, end_label);
+  asm_label(gen, false_label);
+  asm_push_const_i(gen, 0);
+  asm_label(gen, end_label);
+  asm_push_const_i(gen, (int)CLM_TYPE_INT);
 }
 
-static void gen_int_cmp_float(BoolOp op) {
+static void gen_int_cmp_float(ClmCodeGen *gen, BoolOp op) {
   // TODO
 }
 
-void gen_float_bool(BoolOp op, ClmType other_type) {
+void gen_float_bool(ClmCodeGen *gen, BoolOp op, ClmType other_type) {
   switch (op) {
   case BOOL_OP_AND:
     if (other_type == CLM_TYPE_INT) {
-      gen_float_and_int();
+      gen_float_and_int(gen);
     } else {
       // other_type == CLM_TYPE_FLOAT
-      gen_float_and_float();
+      gen_float_and_float(gen);
     }
     break;
   case BOOL_OP_OR:
     if (other_type == CLM_TYPE_INT) {
-      gen_float_or_int();
+      gen_float_or_int(gen);
     } else {
       // other_type == CLM_TYPE_FLOAT
-      gen_float_or_float();
+      gen_float_or_float(gen);
     }
     break;
   default:
     if (other_type == CLM_TYPE_INT) {
-      gen_float_cmp_int(op);
+      gen_float_cmp_int(gen, op);
     } else {
-      gen_float_cmp_float(op);
+      gen_float_cmp_float(gen, op);
     }
     break;
   }
 }
 
-static void gen_float_and_int() {
+static void gen_float_and_int(ClmCodeGen *gen) {
   // TODO
 }
 
-static void gen_float_and_float() {
+static void gen_float_and_float(ClmCodeGen *gen) {
   // TODO
 }
 
-static void gen_float_or_int() {
+static void gen_float_or_int(ClmCodeGen *gen) {
   // TODO
 }
 
-static void gen_float_or_float() {
+static void gen_float_or_float(ClmCodeGen *gen) {
   // TODO
 }
 
-static void gen_float_cmp_int(BoolOp op) {
+static void gen_float_cmp_int(ClmCodeGen *gen, BoolOp op) {
   // TODO
 }
 
-static void gen_float_cmp_float(BoolOp op) {
+static void gen_float_cmp_float(ClmCodeGen *gen, BoolOp op) {
   // TODO
 }
 
-void gen_string_bool(BoolOp op, ClmType other_type) {
+void gen_string_bool(ClmCodeGen *gen, BoolOp op, ClmType other_type) {
   // other type here can only be CLM_TYPE_STRING
   switch (op) {
   case BOOL_OP_EQ:
   case BOOL_OP_NEQ:
-    gen_string_cmp_string(op);
+    gen_string_cmp_string(gen, op);
     break;
   default:
     // shouldn't get here
@@ -711,17 +1132,17 @@ void gen_string_bool(BoolOp op, ClmType other_type) {
   }
 }
 
-static void gen_string_cmp_string(BoolOp op) {
+static void gen_string_cmp_string(ClmCodeGen *gen, BoolOp op) {
   // TODO
 }
 
-void gen_mat_unary(UnaryOp op) {
+void gen_mat_unary(ClmCodeGen *gen, UnaryOp op, int temps) {
   switch (op) {
   case UNARY_OP_TRANSPOSE:
-    gen_mat_transpose();
+    gen_mat_transpose(gen, temps);
     break;
   case UNARY_OP_MINUS:
-    gen_mat_minus();
+    gen_mat_minus(gen, temps);
     break;
   default:
     // shouldn't get here
@@ -729,43 +1150,115 @@ void gen_mat_unary(UnaryOp op) {
   }
 }
 
-static void gen_mat_minus() {
-  char cmp_label[LABEL_SIZE], end_label[LABEL_SIZE];
-  next_label(cmp_label);
-  next_label(end_label);
+static void minus_scalar(ClmCodeGen *gen, const char *value,
+                         const char *other) {
+  asm_neg(gen, value);
+}
 
-  asm_mov(ECX, "[esp + 8]");
-  asm_imul(ECX, "[esp + 12]");
-  asm_dec(ECX);
+static void minus_vector(ClmCodeGen *gen, const char *value,
+                         const char *other) {
+  gen_vector_neg(gen, value, VECTOR_SCRATCH(gen));
+}
 
-  asm_label(cmp_label);
+static const ElementOp minus_op = {minus_scalar, minus_vector};
 
-  asm_cmp(ECX, "0");
-  asm_jmp_l(end_label);
+/*
+        matrix = pop
+        dest = matrix if it is a temporary, otherwise a new matrix
+        push dest
 
-  asm_mov(EBX, ECX);
-  asm_imul(EBX, "4");
-  asm_add(EBX, "12");
-  asm_neg("dword [esp + ebx]");
+        dest.data = -matrix.data
+*/
+static void gen_mat_minus(ClmCodeGen *gen, int temps) {
+  int reused;
 
-  asm_dec(ECX);
-  asm_jmp(cmp_label);
+  pop_matrix_into(gen, ESI(gen));
+  reused = gen_mat_destination(gen, temps, ESI(gen), NULL);
+  asm_push(gen, EBX(gen));
+  asm_push_const_i(gen, (int)CLM_TYPE_MATRIX);
 
-  asm_label(end_label);
+  gen_elements(gen, &minus_op, 0, NULL);
+  free_temporaries(gen, temps & ~reused, ESI(gen), NULL);
 }
 
-static void gen_mat_transpose() {
-  // TODO
-  // https://en.wikipedia.org/wiki/In-place_matrix_transposition
+/*
+        matrix = pop
+        dest = [matrix.cols:matrix.rows]
+        push dest
+
+        for(ecx = 0, ecx < rows, ecx++)
+                for(edx = 0, edx < cols, edx++)
+                        dest.data[edx * dest.stride + ecx] =
+                                matrix.data[ecx * matrix.stride + edx]
+
+        free matrix if it is a temporary
+*/
+static void gen_mat_transpose(ClmCodeGen *gen, int temps) {
+  char row_label[LABEL_SIZE], col_label[LABEL_SIZE];
+  char row_end[LABEL_SIZE], end_label[LABEL_SIZE];
+  char rows[64], cols[64], location[64], element[64], dest[64];
+  const char *value = asm_reg_dword(REG_A);
+  next_label(gen, row_label);
+  next_label(gen, col_label);
+  next_label(gen, row_end);
+  next_label(gen, end_label);
+  matrix_field(gen, rows, ESI(gen), MAT_ROWS);
+  matrix_field(gen, cols, ESI(gen), MAT_COLS);
+  matrix_element(gen, element, EDI(gen), EAX(gen));
+  asm_mem_dword(gen, dest, EDI(gen), 0, NULL);
+
+  pop_matrix_into(gen, ESI(gen));
+  gen_mat_new(gen, cols, rows, 0);
+  asm_mov(gen, EBX(gen), EAX(gen));
+  asm_push(gen, EBX(gen));
+  asm_push_const_i(gen, (int)CLM_TYPE_MATRIX);
+
+  asm_mov_i(gen, ECX(gen), 0);
+  asm_label(gen, row_label);
+  asm_cmp(gen, ECX(gen), rows);
+  asm_jmp_ge(gen, end_label);
+
+  asm_mov_i(gen, EDX(gen), 0);
+  asm_label(gen, col_label);
+  asm_cmp(gen, EDX(gen), cols);
+  asm_jmp_ge(gen, row_end);
+
+  asm_mov(gen, EAX(gen), ECX(gen));
+  matrix_field(gen, location, ESI(gen), MAT_STRIDE);
+  asm_imul(gen, EAX(gen), location);
+  asm_add(gen, EAX(gen), EDX(gen));
+  matrix_field(gen, location, ESI(gen), MAT_DATA);
+  asm_mov(gen, EDI(gen), location);
+  asm_mov(gen, value, element);
+
+  asm_mov(gen, EDI(gen), EDX(gen));
+  matrix_field(gen, location, EBX(gen), MAT_STRIDE);
+  asm_imul(gen, EDI(gen), location);
+  asm_add(gen, EDI(gen), ECX(gen));
+  asm_imul_i(gen, EDI(gen), MAT_ELEMENT_SIZE);
+  matrix_field(gen, location, EBX(gen), MAT_DATA);
+  asm_add(gen, EDI(gen), location);
+  asm_mov(gen, dest, value);
+
+  asm_inc(gen, EDX(gen));
+  asm_jmp(gen, col_label);
+
+  asm_label(gen, row_end);
+  asm_inc(gen, ECX(gen));
+  asm_jmp(gen, row_label);
+
+  asm_label(gen, end_label);
+  if (temps & TEMP_LEFT)
+    asm_free(gen, ESI(gen));
 }
 
-void gen_int_unary(UnaryOp op) {
+void gen_int_unary(ClmCodeGen *gen, UnaryOp op) {
   switch (op) {
   case UNARY_OP_MINUS:
-    gen_int_minus();
+    gen_int_minus(gen);
     break;
   case UNARY_OP_NOT:
-    gen_int_not();
+    gen_int_not(gen);
     break;
   default:
     // shouldn't get here
@@ -773,36 +1266,47 @@ void gen_int_unary(UnaryOp op) {
   }
 }
 
-static void gen_int_minus() { asm_neg("dword [esp + 4]"); }
+static void gen_int_minus(ClmCodeGen *gen) {
+  char value[64];
+  asm_mem(gen, value, ESP(gen), SLOT(gen, 1), NULL);
+  asm_mov(gen, EAX(gen), value);
+  asm_neg(gen, EAX(gen));
+  asm_wrap_int(gen, EAX(gen));
+  asm_mov(gen, value, EAX(gen));
+}
 
-static void gen_int_not() { asm_xor("dword [esp + 4]", "1"); }
+static void gen_int_not(ClmCodeGen *gen) {
+  char value[64];
+  asm_mem(gen, value, ESP(gen), SLOT(gen, 1), NULL);
+  asm_xor(gen, value, "1");
+}
 
-void gen_float_unary(UnaryOp op) {
+void gen_float_unary(ClmCodeGen *gen, UnaryOp op) {
   // only op can be minus
-  gen_float_minus();
+  gen_float_minus(gen);
 }
 
-static void gen_float_minus() {
+static void gen_float_minus(ClmCodeGen *gen) {
   // TODO
 }
 
-void gen_string_unary(UnaryOp op) {
+void gen_string_unary(ClmCodeGen *gen, UnaryOp op) {
   // shouldn't get called
 }
 
-void gen_print_type(ClmType type, int nl) {
+void gen_print_type(ClmCodeGen *gen, ClmType type, int nl, int temps) {
   switch (type) {
   case CLM_TYPE_INT:
-    gen_print_int(nl);
+    gen_print_int(gen, nl);
     break;
   case CLM_TYPE_FLOAT:
-    gen_print_float(nl);
+    gen_print_float(gen, nl);
     break;
   case CLM_TYPE_MATRIX:
-    gen_print_mat(nl);
+    gen_print_mat(gen, nl, temps & TEMP_LEFT);
     break;
   case CLM_TYPE_STRING:
-    gen_print_string(nl);
+    gen_print_string(gen, nl);
     break;
   default:
     // shouldn't get here
@@ -811,63 +1315,82 @@ void gen_print_type(ClmType type, int nl) {
 }
 
 /*
-        pop
-        lrows = pop
-        lcols = pop
-        lele = lrows * lcols
-
-        for(ecx = lele, ecx != 0, ecx--)
-                eax = pop
-                print_int(eax, ecx % lcols == 0)
+        matrix = pop, kept on the stack while printing
+        for(ebx = 0, ebx < rows, ebx++)
+                print newline
+                for(ecx = 0, ecx < cols, ecx++)
+                        print matrix.data[ebx * stride + ecx]
+        print newline
+        free matrix if it is a temporary
+
+        printf preserves ebx, and ecx is saved around it
 */
-void gen_print_mat(int nl) {
-  char cmp_label[LABEL_SIZE], end_label[LABEL_SIZE], nl_label[LABEL_SIZE];
-  next_label(cmp_label);
-  next_label(end_label);
-  next_label(nl_label);
-
-  asm_pop(ECX); // pop type
-  asm_pop(ECX); // pop rows
-  asm_pop(EBX); // pop cols
-  asm_imul(ECX, EBX);
-  asm_mov("[" T_ROW_END "]", EBX);
-
-  asm_label(cmp_label);
-  asm_cmp(ECX, "0");
-  asm_jmp_eq(end_label);
-
-  asm_mov(EDX, "0");
-  asm_mov(EAX, ECX);
-  asm_div("[" T_ROW_END "]");
-  asm_cmp(EDX, "0");
-  asm_jmp_neq(nl_label);
-
-  asm_print_char("''", 0, 1);
-
-  asm_label(nl_label);
-
-  asm_pop(EAX);
-  asm_print_int(EAX, 1, 0);
-
-  asm_dec(ECX);
-  asm_jmp(cmp_label);
-
-  asm_label(end_label);
-
-  asm_print_char("''", 0, 1);
+void gen_print_mat(ClmCodeGen *gen, int nl, int temp) {
+  char row_label[LABEL_SIZE], col_label[LABEL_SIZE];
+  char row_end[LABEL_SIZE], end_label[LABEL_SIZE];
+  char matrix[64], location[64], element[64];
+  next_label(gen, row_label);
+  next_label(gen, col_label);
+  next_label(gen, row_end);
+  next_label(gen, end_label);
+  asm_mem(gen, matrix, ESP(gen), 0, NULL);
+  matrix_element(gen, element, EAX(gen), EDX(gen));
+
+  pop_matrix_into(gen, EAX(gen));
+  asm_push(gen, EAX(gen));
+  asm_mov_i(gen, EBX(gen), 0);
+
+  asm_label(gen, row_label);
+  asm_mov(gen, EAX(gen), matrix);
+  matrix_field(gen, location, EAX(gen), MAT_ROWS);
+  asm_cmp(gen, EBX(gen), location);
+  asm_jmp_ge(gen, end_label);
+
+  asm_print_newline(gen);
+  asm_mov_i(gen, ECX(gen), 0);
+
+  asm_label(gen, col_label);
+  asm_mov(gen, EAX(gen), matrix);
+  matrix_field(gen, location, EAX(gen), MAT_COLS);
+  asm_cmp(gen, ECX(gen), location);
+  asm_jmp_ge(gen, row_end);
+
+  asm_mov(gen, EDX(gen), EBX(gen));
+  matrix_field(gen, location, EAX(gen), MAT_STRIDE);
+  asm_imul(gen, EDX(gen), location);
+  asm_add(gen, EDX(gen), ECX(gen));
+  matrix_field(gen, location, EAX(gen), MAT_DATA);
+  asm_mov(gen, EAX(gen), location);
+  asm_movsx_dword(gen, EAX(gen), element);
+  asm_print_int(gen, EAX(gen), 1, 0);
+
+  asm_inc(gen, ECX(gen));
+  asm_jmp(gen, col_label);
+
+  asm_label(gen, row_end);
+  asm_inc(gen, EBX(gen));
+  asm_jmp(gen, row_label);
+
+  asm_label(gen, end_label);
+  asm_print_newline(gen);
+
+  asm_pop(gen, EAX(gen));
+  if (temp)
+    asm_free(gen, EAX(gen));
 }
 
-void gen_print_int(int nl) {
-  pop_int_into(EAX);
-  asm_print_int(EAX, 0, nl);
+void gen_print_int(ClmCodeGen *gen, int nl) {
+  pop_int_into(gen, EAX(gen));
+  asm_print_int(gen, EAX(gen), 0, nl);
 }
 
-void gen_print_float(int nl) {
-  pop_float_into("qword [" DOUBLE_CONST "]");
-  asm_print_float("dword [" DOUBLE_CONST "], dword [" DOUBLE_CONST "+4]", 0,
-                  nl);
+void gen_print_float(ClmCodeGen *gen, int nl) {
+  char location[64];
+  asm_mem_qword(gen, location, DOUBLE_CONST, 0, NULL);
+  pop_float_into(gen, location);
+  asm_print_float(gen, DOUBLE_CONST, 0, nl);
 }
 
-void gen_print_string(int nl) {
+void gen_print_string(ClmCodeGen *gen, int nl) {
   // TODO
 }
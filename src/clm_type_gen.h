@@ -1,40 +1,100 @@
 #ifndef CLM_MAT_GEN_H
 #define CLM_MAT_GEN_H
 
+#include "clm_asm.h"
 #include "clm_ast.h"
 #include "clm_type.h"
 
+//
+// Matrices
+//
+// a matrix value is a pointer to a descriptor on the heap, which is
+//   rows, cols, stride, data
+// one word each. data points at rows * stride 32 bit ints, allocated in the
+// same block as the descriptor and aligned to MAT_ALIGNMENT bytes, so a
+// vector load of the elements never straddles two cache lines. on the typed
+// stack a matrix is its pointer followed by its type, like an int
+//
+// a matrix expression that isn't just a variable creates a new matrix, a
+// temporary. whatever consumes a temporary owns it, so operations write
+// their result over a temporary operand and free the ones they don't reuse
+//
+// a slice of a variable, A[x,] A[,y] A[x..z,y..w], is a view: a temporary
+// descriptor of its own, with the stride and the data of the variable it is
+// taken from. freeing a view frees only the descriptor, and a view is never
+// written over, so every operation has to follow stride rather than treat
+// the elements as rows * cols contiguous ints
+//
+#define MAT_ROWS 0
+#define MAT_COLS 1
+#define MAT_STRIDE 2
+#define MAT_DATA 3
+#define MAT_DESCRIPTOR_SLOTS 4
+#define MAT_ELEMENT_SIZE 4
+#define MAT_ALIGNMENT 32
+
+// which operands of an operation are temporaries, and which of those are
+// views
+#define TEMP_LEFT 1
+#define TEMP_RIGHT 2
+#define VIEW_LEFT 4
+#define VIEW_RIGHT 8
+
+// format the location of element index of the data that base points at, and
+// of a field of the descriptor that base points at
+void matrix_element(ClmCodeGen *gen, char *out, const char *base,
+                    const char *index);
+void matrix_field(ClmCodeGen *gen, char *out, const char *base, int field);
+
+// allocates a rows x cols matrix and leaves its pointer in eax. rows and cols
+// can't be eax, edx or relative to esp. clobbers edx
+void gen_mat_new(ClmCodeGen *gen, const char *rows, const char *cols,
+                 int zeroed);
+// copies the matrix pointed to by src (esi or edi) into a new matrix, and
+// leaves its pointer in eax. clobbers ebx, ecx, edx and esi
+void gen_mat_clone(ClmCodeGen *gen, const char *src);
+// pops a view and then a matrix, copies the matrix into the elements the view
+// covers, and frees the view. TEMP_LEFT says the matrix is a temporary
+void gen_mat_copy_into(ClmCodeGen *gen, int temps);
+
+// value = value * other and value = -value, for vector registers of 32 bit
+// ints. sse2 has no 32 bit multiply, scratch is clobbered to make up for it
+void gen_vector_mul_int(ClmCodeGen *gen, const char *value, const char *other,
+                        const char *scratch);
+void gen_vector_neg(ClmCodeGen *gen, const char *value, const char *scratch);
+
 //
 // Arith operations
 //
-void gen_mat_arith(ArithOp op, ClmType other_type);
-void gen_int_arith(ArithOp op, ClmType other_type);
-void gen_float_arith(ArithOp op, ClmType other_type);
-void gen_string_arith(ArithOp op, ClmType other_type);
+void gen_mat_arith(ClmCodeGen *gen, ArithOp op, ClmType other_type, int temps);
+void gen_int_arith(ClmCodeGen *gen, ArithOp op, ClmType other_type, int temps);
+void gen_float_arith(ClmCodeGen *gen, ArithOp op, ClmType other_type,
+                     int temps);
+void gen_string_arith(ClmCodeGen *gen, ArithOp op, ClmType other_type);
 
 //
 // Boolean operations
 //
-void gen_mat_bool(BoolOp op, ClmType other_type);
-void gen_int_bool(BoolOp op, ClmType other_type);
-void gen_float_bool(BoolOp op, ClmType other_type);
-void gen_string_bool(BoolOp op, ClmType other_type);
+void gen_mat_bool(ClmCodeGen *gen, BoolOp op, ClmType other_type, int temps);
+void gen_int_bool(ClmCodeGen *gen, BoolOp op, ClmType other_type);
+void gen_float_bool(ClmCodeGen *gen, BoolOp op, ClmType other_type);
+void gen_string_bool(ClmCodeGen *gen, BoolOp op, ClmType other_type);
 
 //
 // Unary operations
 //
-void gen_mat_unary(UnaryOp op);
-void gen_int_unary(UnaryOp op);
-void gen_float_unary(UnaryOp op);
-void gen_string_unary(UnaryOp op);
+void gen_mat_unary(ClmCodeGen *gen, UnaryOp op, int temps);
+void gen_int_unary(ClmCodeGen *gen, UnaryOp op);
+void gen_float_unary(ClmCodeGen *gen, UnaryOp op);
+void gen_string_unary(ClmCodeGen *gen, UnaryOp op);
 
 //
 // printing
 //
-void gen_print_type(ClmType type, int nl);
-void gen_print_mat(int nl);
-void gen_print_int(int nl);
-void gen_print_float(int nl);
-void gen_print_string(int nl);
+void gen_print_type(ClmCodeGen *gen, ClmType type, int nl, int temps);
+void gen_print_mat(ClmCodeGen *gen, int nl, int temp);
+void gen_print_int(ClmCodeGen *gen, int nl);
+void gen_print_float(ClmCodeGen *gen, int nl);
+void gen_print_string(ClmCodeGen *gen, int nl);
 
 #endif
@@ -12,16 +12,43 @@
 #include <string.h>
 #include <time.h>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include "clm.h"
+#include "clm_ast_bin.h"
+#include "clm_cache.h"
+#include "clm_module.h"
+#include "clm_report.h"
 #include "clm_scope.h"
+#include "clm_server.h"
 
 char *file_name;
 
-void clm_error(int line, int col, const char *fmt, ...) {
+void clm_error(ClmCompiler *compiler, int line, int col, const char *fmt,
+               ...) {
   va_list ap;
   va_start(ap, fmt);
 
-  printf("%s:%d:%d:", file_name, line, col);
+  if (compiler != NULL && compiler->recover != NULL) {
+    StringBuffer *diagnostics = compiler->diagnostics;
+    string_buffer_appendf(diagnostics, "%s:%d:%d: Error: ", compiler->fileName,
+                          line, col);
+    string_buffer_vappendf(diagnostics, fmt, ap);
+    string_buffer_append(diagnostics, "\n");
+    va_end(ap);
+    longjmp(*compiler->recover, 1);
+  }
+
+  // an error in an imported module is reported against the module
+  printf("%s:%d:%d:", compiler != NULL && compiler->fileName != NULL
+                          ? compiler->fileName
+                          : file_name,
+         line, col);
 
 #ifdef _WIN32
   HANDLE console_handle = GetStdHandle(STD_OUTPUT_HANDLE);
@@ -44,76 +71,370 @@ void clm_error(int line, int col, const char *fmt, ...) {
   exit(1);
 }
 
-static char *file_contents(char *file_name) {
-  FILE *file = fopen(file_name, "rb");
+// the program being compiled. a regular file is mapped read only, so lexing
+// starts right away without a copy of it. anything else, like a pipe or stdin
+// given as -, is read into a buffer with a null after the end
+typedef struct SourceFile {
+  const char *data;
+  size_t length;
+  int mapped;
+} SourceFile;
+
+static void read_source(FILE *file, SourceFile *source) {
+  size_t capacity = 64 * 1024, length = 0, n;
+  char *buffer = malloc(capacity + 1);
+  if (!buffer) {
+    printf("unable to allocate memory");
+    exit(1);
+  }
+
+  while ((n = fread(buffer + length, 1, capacity - length, file)) > 0) {
+    length += n;
+    if (length == capacity) {
+      capacity = 2 * capacity;
+      buffer = realloc(buffer, capacity + 1);
+    }
+  }
+  buffer[length] = '\0';
+
+  source->data = buffer;
+  source->length = length;
+  source->mapped = 0;
+}
+
+static int open_source(const char *name, SourceFile *source) {
+  if (strcmp(name, "-") == 0) {
+    read_source(stdin, source);
+    return 1;
+  }
+
+#ifdef _WIN32
+  FILE *file = fopen(name, "rb");
   if (!file)
-    return NULL;
+    return 0;
+#else
+  int fd = open(name, O_RDONLY);
+  if (fd < 0)
+    return 0;
 
-  char *buffer;
-  long length;
+  // an empty file can't be mapped, it is read like a pipe
+  struct stat info;
+  if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+    void *data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED) {
+      madvise(data, info.st_size, MADV_SEQUENTIAL);
+      close(fd);
+      source->data = data;
+      source->length = info.st_size;
+      source->mapped = 1;
+      return 1;
+    }
+  }
 
-  int success = fseek(file, 0L, SEEK_END);
-  if (success < 0) {
-    strerror(errno);
-    printf("error: couldn't read to end of file");
-    exit(1);
+  FILE *file = fdopen(fd, "rb");
+#endif
+  read_source(file, source);
+  fclose(file);
+  return 1;
+}
+
+static void close_source(SourceFile *source) {
+#ifndef _WIN32
+  if (source->mapped) {
+    munmap((void *)source->data, source->length);
+    return;
   }
-  length = ftell(file);
-  rewind(file);
+#endif
+  free((void *)source->data);
+}
 
-  buffer = malloc((length + 1) * sizeof(char));
+static void usage() {
+  printf("usage: clm [--target=win32|linux64] [--simd=sse2|avx2] "
+         "[-o output] [-O0] [--no-<pass>] [--opt-report] [-j threads] "
+         "[--connect=socket] [--no-cache] [-I dir] [--module] "
+         "[--emit-ast=bin] [--time-report[=trace.json]] file.clm|-\n"
+         "       clm --server=socket [--std=dir] [--target=win32|linux64]\n");
+  exit(1);
+}
 
-  if (!buffer) {
-    printf("unable to allocate memory");
+static void write_output(const char *output_name, const char *data,
+                         size_t length) {
+  FILE *output = fopen(output_name, "wb");
+  if (output == NULL)
+    clm_error(NULL, 0, 0, "Unable to open %s for writing", output_name);
+  fwrite(data, 1, length, output);
+  fclose(output);
+}
+
+// has the server at socket compile the source, which is quicker than
+// starting over for every file
+static int compile_remotely(const char *socket, const char *options,
+                            const char *file_name, SourceFile *source,
+                            const char *output_name) {
+  StringBuffer *diagnostics = string_buffer_new();
+  StringBuffer *assembly = string_buffer_new();
+  int status = clm_server_request(socket, options, file_name, source->data,
+                                  source->length, diagnostics, assembly);
+  if (status < 0) {
+    printf("Unable to reach a server at %s\n", socket);
     exit(1);
   }
 
-  int num_read = fread(buffer, sizeof(char), length, file);
-  if (num_read != length) {
-    printf("read too many");
-    exit(1);
+  printf("%s", diagnostics->data);
+  if (status == 0)
+    write_output(output_name, assembly->data, assembly->length);
+
+  string_buffer_free(diagnostics);
+  string_buffer_free(assembly);
+  return status;
+}
+
+// the modules a program imports aren't part of its cache key
+static int imports_modules(ClmTokens *tokens) {
+  int i;
+  for (i = 0; i < tokens->length; i++) {
+    if (tokens->data[i].sym == KEYWORD_IMPORT)
+      return 1;
   }
-  buffer[length] = '\0';
+  return 0;
+}
 
-  fclose(file);
+// -I directories first, then $CLM_PATH
+static void add_module_dir(StringBuffer *path, const char *dir) {
+  char separator[2] = {CLM_PATH_SEPARATOR, '\0'};
+  if (dir == NULL || dir[0] == '\0')
+    return;
+  if (path->length > 0)
+    string_buffer_append(path, separator);
+  string_buffer_append(path, dir);
+}
 
-  return buffer;
+// writes the code cached under key to the output, returns 0 on a miss
+static int write_cached(const char *cache_dir, const char *key,
+                        const char *output_name) {
+  StringBuffer *code = string_buffer_new();
+  int hit = clm_cache_lookup(cache_dir, key, code);
+  if (hit)
+    write_output(output_name, code->data, code->length);
+  string_buffer_free(code);
+  return hit;
 }
 
-static void write_to_file(const char *name, const char *contents) {
-  FILE *file = fopen(name, "w+");
+// the phases are only timed with --time-report
+static void phase_start(ClmTimeReport *report, const char *name) {
+  if (report != NULL)
+    clm_report_phase_start(report, name);
+}
 
-  fprintf(file, contents);
+static void phase_end(ClmTimeReport *report) {
+  if (report != NULL)
+    clm_report_phase_end(report);
+}
 
-  fclose(file);
+static void end_report(ClmTimeReport *report, const char *trace_name) {
+  if (report == NULL)
+    return;
+  clm_report_print(report, stdout);
+  if (trace_name != NULL && !clm_report_write_trace(report, trace_name))
+    clm_error(NULL, 0, 0, "Unable to write %s", trace_name);
+}
+
+static void write_program(ClmCompiler *compiler, ArrayList *statements,
+                          ClmScope *globalScope, const char *output_name) {
+  FILE *output = fopen(output_name, "wb");
+  if (output == NULL)
+    clm_error(NULL, 0, 0, "Unable to open %s for writing", output_name);
+
+  clm_code_gen_stream(compiler, statements, globalScope, fileno(output));
+
+  fclose(output);
 }
 
 int main(int argc, char *argv[]) {
-  file_name = "test_floats.clm";
+#ifdef _WIN32
+  ClmCompiler *compiler = clm_compiler_new(CLM_TARGET_WIN32);
+  const char *output_name = "output.asm";
+#else
+  ClmCompiler *compiler = clm_compiler_new(CLM_TARGET_LINUX64);
+  const char *output_name = "output.s";
+#endif
+  int opt_report = 0, use_cache = 1, module = 0, emit_ast = 0;
+  ClmTimeReport time_report, *report = NULL;
+  const char *trace_name = NULL;
+  const char *server = NULL, *connect = NULL, *std_dir = "std";
+  // the compiler options, for a server to compile with
+  StringBuffer *options = string_buffer_new();
+  StringBuffer *module_path = string_buffer_new();
+  file_name = NULL;
 
-  char *contents = file_contents(file_name);
-  if (contents == NULL)
-    clm_error(0, 0, "No file with name %s", file_name);
+  int i;
+  for (i = 1; i < argc; i++) {
+    if (clm_compiler_option(compiler, argv[i])) {
+      string_buffer_appendf(options, "%s ", argv[i]);
+    } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      output_name = argv[++i];
+    } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+      compiler->threads = atoi(argv[++i]);
+    } else if (strncmp(argv[i], "--server=", 9) == 0) {
+      server = argv[i] + 9;
+    } else if (strncmp(argv[i], "--connect=", 10) == 0) {
+      connect = argv[i] + 10;
+    } else if (strncmp(argv[i], "--std=", 6) == 0) {
+      std_dir = argv[i] + 6;
+    } else if (strcmp(argv[i], "--no-cache") == 0) {
+      use_cache = 0;
+    } else if (strcmp(argv[i], "--opt-report") == 0) {
+      opt_report = 1;
+    } else if (strcmp(argv[i], "-I") == 0 && i + 1 < argc) {
+      add_module_dir(module_path, argv[++i]);
+    } else if (strcmp(argv[i], "--module") == 0) {
+      module = 1;
+    } else if (strcmp(argv[i], "--emit-ast=bin") == 0) {
+      emit_ast = 1;
+    } else if (strcmp(argv[i], "--time-report") == 0) {
+      report = &time_report;
+    } else if (strncmp(argv[i], "--time-report=", 14) == 0) {
+      report = &time_report;
+      trace_name = argv[i] + 14;
+    } else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+      usage();
+    } else {
+      file_name = argv[i];
+    }
+  }
 
-  ArrayList *tokens = clm_lexer_main(contents);
+  if (server != NULL) {
+    if (!clm_server_main(server, std_dir, compiler->target)) {
+      printf("Unable to listen on %s\n", server);
+      return 1;
+    }
+    return 0;
+  }
+
+  if (file_name == NULL)
+    usage();
+  add_module_dir(module_path, getenv("CLM_PATH"));
+  compiler->modulePath = module_path->data;
+  compiler->fileName = file_name;
+
+  SourceFile source;
+  if (!open_source(file_name, &source))
+    clm_error(NULL, 0, 0, "No file with name %s", file_name);
+
+  if (connect != NULL) {
+    return compile_remotely(connect, options->data, file_name, &source,
+                            output_name);
+  }
+  string_buffer_free(options);
+  if (report != NULL)
+    clm_report_start(report, compiler);
+
+  // a binary AST was checked and optimized before it was written, so code is
+  // generated from it as it is
+  if (clm_ast_is_binary(source.data, source.length)) {
+    ClmScope *globalScope;
+    phase_start(report, "load ast");
+    ArrayList *parseTree =
+        clm_ast_load(compiler, source.data, source.length, &globalScope);
+    close_source(&source);
+    if (parseTree == NULL)
+      clm_error(NULL, 0, 0, "%s isn't a binary AST this version of clm reads",
+                file_name);
+    phase_end(report);
+    phase_start(report, "code gen");
+    write_program(compiler, parseTree, globalScope, output_name);
+    phase_end(report);
+    end_report(report, trace_name);
+    clm_compiler_free(compiler);
+    string_buffer_free(module_path);
+    return 0;
+  }
+
+  phase_start(report, "lexer");
+  ClmTokens *tokens = clm_lexer_main(compiler, source.data, source.length);
+  phase_end(report);
   // clm_lexer_print(tokens);
 
-  ArrayList *parseTree = clm_parser_main(tokens);
+  // a program seen before with the same options is only lexed. the reports
+  // need every phase to run. on a miss, the functions that haven't changed
+  // since they were last generated are reused
+  char cache_dir[1024], key[CLM_CACHE_KEY_SIZE];
+  int cached = use_cache && !opt_report && report == NULL && !module &&
+               !emit_ast &&
+               clm_cache_dir(cache_dir, sizeof(cache_dir));
+  if (cached) {
+    compiler->functionCache = cache_dir;
+    cached = !imports_modules(tokens);
+  }
+  if (cached) {
+    clm_cache_key(compiler, tokens, key);
+    if (write_cached(cache_dir, key, output_name)) {
+      clm_tokens_free(tokens);
+      close_source(&source);
+      clm_compiler_free(compiler);
+      string_buffer_free(module_path);
+      return 0;
+    }
+  }
+
+  phase_start(report, "parser");
+  ArrayList *parseTree = clm_parser_main(compiler, tokens);
+  phase_end(report);
   // clm_parser_print(parseTree);
 
-  ClmScope *globalScope = clm_symbol_gen_main(parseTree);
+  // the tree doesn't point into the tokens or the source
+  clm_tokens_free(tokens);
+  close_source(&source);
+
+  phase_start(report, "symbol gen");
+  ClmScope *globalScope = clm_symbol_gen_main(compiler, parseTree);
+  phase_end(report);
   // clm_scope_print(globalScope, 0);
 
-  clm_type_check_main(parseTree, globalScope);
+  phase_start(report, "type check");
+  clm_type_check_main(compiler, parseTree, globalScope);
+  phase_end(report);
 
-  const char *asm_source = clm_code_gen_main(parseTree, globalScope);
+  phase_start(report, "optimizer");
+  clm_optimizer_main(compiler, parseTree, globalScope);
+  phase_end(report);
+  if (opt_report)
+    clm_optimizer_print_report(compiler);
+
+  if (module) {
+    phase_start(report, "module");
+    if (!clm_module_write(compiler, parseTree, globalScope, output_name))
+      clm_error(NULL, 0, 0, "Unable to write %s", output_name);
+    phase_end(report);
+    end_report(report, trace_name);
+    clm_compiler_free(compiler);
+    string_buffer_free(module_path);
+    return 0;
+  }
+
+  if (emit_ast) {
+    phase_start(report, "emit ast");
+    StringBuffer *ast = clm_ast_serialize(parseTree, globalScope);
+    write_output(output_name, ast->data, ast->length);
+    string_buffer_free(ast);
+    phase_end(report);
+    end_report(report, trace_name);
+    clm_compiler_free(compiler);
+    string_buffer_free(module_path);
+    return 0;
+  }
 
-  write_to_file("output.asm", asm_source);
+  phase_start(report, "code gen");
+  write_program(compiler, parseTree, globalScope, output_name);
+  phase_end(report);
+  if (cached)
+    clm_cache_store_file(cache_dir, key, output_name, CLM_CACHE_MAX_SIZE);
+  else if (compiler->functionCache != NULL)
+    clm_cache_evict(cache_dir, CLM_CACHE_MAX_SIZE);
+  end_report(report, trace_name);
 
-  free(contents);
-  array_list_free(tokens);
-  array_list_free(parseTree);
-  clm_scope_free(globalScope);
+  clm_compiler_free(compiler);
+  string_buffer_free(module_path);
 
   return 0;
 }
@@ -0,0 +1,36 @@
+// linked into a generated program by clm_test_run_counting, not into the
+// tests. malloc, calloc and free are wrapped with -Wl,--wrap so the program's
+// own calls are counted, and the allocations still live when it exits are
+// printed after everything it printed
+#include <stdio.h>
+#include <stdlib.h>
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void __real_free(void *ptr);
+
+static long live;
+
+void *__wrap_malloc(size_t size) {
+  void *ptr = __real_malloc(size);
+  if (ptr != NULL)
+    live++;
+  return ptr;
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+  void *ptr = __real_calloc(count, size);
+  if (ptr != NULL)
+    live++;
+  return ptr;
+}
+
+void __wrap_free(void *ptr) {
+  if (ptr != NULL)
+    live--;
+  __real_free(ptr);
+}
+
+__attribute__((destructor)) static void print_live(void) {
+  printf("live allocations %ld\n", live);
+}
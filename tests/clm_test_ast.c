@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clm.h"
+#include "clm_ast.h"
+#include "clm_ast_bin.h"
+#include "clm_scope.h"
+#include "clm_tests.h"
+
+static ClmTestProgram optimize(const char *source) {
+  ClmTestProgram program = clm_test_compile(CLM_TARGET_LINUX64, source);
+  clm_test_optimize(&program);
+  return program;
+}
+
+int clm_test_ast() {
+  const char *program = "\\square B[2:2] -> [2:2] =\n"
+                        "  return B * B\n"
+                        "end\n"
+                        "\\count n:int -> int =\n"
+                        "  s = 0\n"
+                        "  for i in 1..n do\n"
+                        "    if i > 2 then\n"
+                        "      s = s + i\n"
+                        "    else\n"
+                        "      s = s - 1\n"
+                        "    end\n"
+                        "  end\n"
+                        "  return s\n"
+                        "end\n"
+                        "A = {1 2, 3 4}\n"
+                        "x = 1.5\n"
+                        "printl square(A)\n"
+                        "printl count(5)\n"
+                        "printl -x * 2\n"
+                        "printl A[1..2, 2]\n";
+
+  ClmTestProgram checked = optimize(program);
+  char *expected = clm_test_generate(&checked);
+  StringBuffer *ast = clm_ast_serialize(checked.statements, checked.scope);
+  clm_compiler_free(checked.compiler);
+  CLM_ASSERT(clm_ast_is_binary(ast->data, ast->length));
+
+  // the loaded tree generates the same code, and is written out the same
+  ClmScope *scope;
+  ClmCompiler *compiler = clm_compiler_new(CLM_TARGET_LINUX64);
+  ArrayList *statements =
+      clm_ast_load(compiler, ast->data, ast->length, &scope);
+  CLM_ASSERT(statements != NULL && scope != NULL);
+  char *code = clm_code_gen_main(compiler, statements, scope);
+  CLM_ASSERT(strcmp(code, expected) == 0);
+  StringBuffer *again = clm_ast_serialize(statements, scope);
+  CLM_ASSERT(again->length == ast->length &&
+             memcmp(again->data, ast->data, ast->length) == 0);
+
+  // the line of each node comes back too
+  ClmStmtNode *count = statements->data[1];
+  CLM_ASSERT(count->type == STMT_TYPE_FUNC_DEC && count->lineNo == 4);
+  CLM_ASSERT(strcmp(count->funcDecStmt.name, "count") == 0);
+  CLM_ASSERT(count->funcDecStmt.scope->parent == scope);
+
+  // one that is cut short isn't loaded
+  CLM_ASSERT(clm_ast_load(compiler, ast->data, ast->length - 4, &scope) ==
+             NULL);
+  CLM_ASSERT(!clm_ast_is_binary(program, strlen(program)));
+
+  // nor is one with nothing, or something past the end of its table, where a
+  // node has to have something. every word after the header's magic is
+  // corrupted in turn, and whatever still loads has to generate
+  unsigned int *words = malloc(ast->length);
+  unsigned int corruptions[] = {0xffffffffu, 0x7fffffffu};
+  size_t i, j;
+  for (j = 0; j < sizeof(corruptions) / sizeof(corruptions[0]); j++) {
+    for (i = 1; i < ast->length / sizeof(*words); i++) {
+      memcpy(words, ast->data, ast->length);
+      words[i] = corruptions[j];
+      ClmCompiler *corrupted = clm_compiler_new(CLM_TARGET_LINUX64);
+      statements = clm_ast_load(corrupted, (const char *)words, ast->length,
+                                &scope);
+      if (statements != NULL)
+        free(clm_code_gen_main(corrupted, statements, scope));
+      clm_compiler_free(corrupted);
+    }
+  }
+  free(words);
+
+  clm_compiler_free(compiler);
+  string_buffer_free(ast);
+  string_buffer_free(again);
+  free(expected);
+  free(code);
+  return 1;
+}
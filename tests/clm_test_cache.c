@@ -0,0 +1,233 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#ifdef _WIN32
+#include <sys/utime.h>
+#else
+#include <utime.h>
+#endif
+
+#include "clm.h"
+#include "clm_ast.h"
+#include "clm_cache.h"
+#include "clm_tests.h"
+
+// a cache directory of up to 255 characters and a key in it
+#define CACHE_PATH_SIZE (256 + CLM_CACHE_KEY_SIZE)
+
+static int clm_test_cache_keys();
+static int clm_test_cache_store();
+static int clm_test_cache_functions();
+
+int clm_test_cache() {
+  int result = 1;
+
+  printf("Testing keys... ");
+  if (!clm_test_cache_keys()) {
+    result = 0;
+  } else {
+    printf(" OK.\n");
+  }
+
+  printf("Testing store and eviction... ");
+  if (!clm_test_cache_store()) {
+    result = 0;
+  } else {
+    printf(" OK.\n");
+  }
+
+  printf("Testing functions... ");
+  if (!clm_test_cache_functions()) {
+    result = 0;
+  } else {
+    printf(" OK.\n");
+  }
+
+  return result;
+}
+
+static void key_of(ClmCompiler *compiler, const char *source, char *out_key) {
+  ClmTokens *tokens = clm_lexer_main(compiler, source, strlen(source));
+  clm_cache_key(compiler, tokens, out_key);
+  clm_tokens_free(tokens);
+}
+
+int clm_test_cache_keys() {
+  char a[CLM_CACHE_KEY_SIZE], b[CLM_CACHE_KEY_SIZE];
+  ClmCompiler *compiler = clm_compiler_new(CLM_TARGET_LINUX64);
+
+  // only the tokens matter, not how they are laid out
+  key_of(compiler, "a = 1 + 2\nprintl a\n", a);
+  key_of(compiler, "a=1+2\n\n   printl    a\n", b);
+  CLM_ASSERT(strlen(a) == CLM_CACHE_KEY_SIZE - 1);
+  CLM_ASSERT(strcmp(a, b) == 0);
+
+  key_of(compiler, "a = 1 + 3\nprintl a\n", b);
+  CLM_ASSERT(strcmp(a, b) != 0);
+  key_of(compiler, "ab = 1 + 2\nprintl ab\n", b);
+  CLM_ASSERT(strcmp(a, b) != 0);
+
+  // nor can the code be shared between options that change it
+  compiler->simd = CLM_SIMD_AVX2;
+  key_of(compiler, "a = 1 + 2\nprintl a\n", b);
+  CLM_ASSERT(strcmp(a, b) != 0);
+  compiler->simd = CLM_SIMD_SSE2;
+  clm_optimizer_set_pass(compiler, "fold-constants", 0);
+  key_of(compiler, "a = 1 + 2\nprintl a\n", b);
+  CLM_ASSERT(strcmp(a, b) != 0);
+
+  clm_compiler_free(compiler);
+  return 1;
+}
+
+static int write_file(const char *path, size_t size) {
+  FILE *file = fopen(path, "wb");
+  if (file == NULL)
+    return 0;
+  size_t i;
+  for (i = 0; i < size; i++)
+    fputc('a' + i % 26, file);
+  return fclose(file) == 0;
+}
+
+// makes the entry look like it was last used at time
+static void set_used(const char *dir, const char *key, time_t time) {
+  char path[CACHE_PATH_SIZE];
+  struct utimbuf times = {time, time};
+  snprintf(path, sizeof(path), "%s/%s", dir, key);
+  utime(path, &times);
+}
+
+int clm_test_cache_store() {
+  const char *keys[] = {"00000000000000000000000000000001",
+                        "00000000000000000000000000000002",
+                        "00000000000000000000000000000003"};
+  char dir[256];
+  StringBuffer *code = string_buffer_new();
+  int i;
+
+  putenv("CLM_CACHE_DIR=clm_test_cache");
+  CLM_ASSERT(clm_cache_dir(dir, sizeof(dir)));
+  CLM_ASSERT(write_file("clm_test_cache.s", 100));
+  for (i = 0; i < 3; i++) {
+    char path[CACHE_PATH_SIZE];
+    snprintf(path, sizeof(path), "%s/%s", dir, keys[i]);
+    remove(path);
+  }
+
+  CLM_ASSERT(!clm_cache_lookup(dir, keys[0], code));
+  CLM_ASSERT(clm_cache_store_file(dir, keys[0], "clm_test_cache.s", 250));
+  CLM_ASSERT(clm_cache_lookup(dir, keys[0], code));
+  CLM_ASSERT(code->length == 100 && strncmp(code->data, "abc", 3) == 0);
+
+  // the least recently used entry goes once they don't all fit
+  CLM_ASSERT(clm_cache_store_file(dir, keys[1], "clm_test_cache.s", 250));
+  set_used(dir, keys[0], 2000);
+  set_used(dir, keys[1], 1000);
+  CLM_ASSERT(clm_cache_store_file(dir, keys[2], "clm_test_cache.s", 250));
+  string_buffer_clear(code);
+  CLM_ASSERT(clm_cache_lookup(dir, keys[0], code));
+  CLM_ASSERT(!clm_cache_lookup(dir, keys[1], code));
+  CLM_ASSERT(clm_cache_lookup(dir, keys[2], code));
+
+  for (i = 0; i < 3; i++) {
+    char path[CACHE_PATH_SIZE];
+    snprintf(path, sizeof(path), "%s/%s", dir, keys[i]);
+    remove(path);
+  }
+  remove("clm_test_cache.s");
+  string_buffer_free(code);
+  return 1;
+}
+
+static ClmTestProgram optimize(const char *source) {
+  ClmTestProgram program = clm_test_compile(CLM_TARGET_LINUX64, source);
+  clm_test_optimize(&program);
+  return program;
+}
+
+static void function_key(ClmTestProgram *program, const char *name,
+                         char *out_key) {
+  int i;
+  out_key[0] = '\0';
+  for (i = 0; i < program->statements->length; i++) {
+    ClmStmtNode *node = program->statements->data[i];
+    if (node->type == STMT_TYPE_FUNC_DEC &&
+        strcmp(node->funcDecStmt.name, name) == 0)
+      clm_cache_function_key(program->compiler, node, out_key);
+  }
+}
+
+int clm_test_cache_functions() {
+  const char *before = "\\twice a:int -> int =\n"
+                       "  return a * 2\n"
+                       "end\n"
+                       "\\total n:int -> int =\n"
+                       "  s = 0\n"
+                       "  for i in 1..n do\n"
+                       "    s = s + twice(i)\n"
+                       "  end\n"
+                       "  return s\n"
+                       "end\n"
+                       "printl total(3)\n";
+  const char *after = "\\twice a:int -> int =\n"
+                      "  return a * 2\n"
+                      "end\n"
+                      "\\total n:int -> int =\n"
+                      "  s = 1\n"
+                      "  for i in 1..n do\n"
+                      "    s = s + twice(i)\n"
+                      "  end\n"
+                      "  return s\n"
+                      "end\n"
+                      "printl total(4)\n";
+  char twice[CLM_CACHE_KEY_SIZE], total[CLM_CACHE_KEY_SIZE];
+  char key[CLM_CACHE_KEY_SIZE], dir[256];
+
+  // only the function that was edited has a new key
+  ClmTestProgram first = optimize(before);
+  ClmTestProgram second = optimize(after);
+  function_key(&first, "twice", twice);
+  function_key(&first, "total", total);
+  CLM_ASSERT(strlen(twice) == CLM_CACHE_KEY_SIZE - 1);
+  function_key(&second, "twice", key);
+  CLM_ASSERT(strcmp(twice, key) == 0);
+  function_key(&second, "total", key);
+  CLM_ASSERT(strcmp(total, key) != 0);
+
+  // the functions come out the same from the cache as without it
+  putenv("CLM_CACHE_DIR=clm_test_cache");
+  CLM_ASSERT(clm_cache_dir(dir, sizeof(dir)));
+  char *uncached =
+      clm_test_generate(&first);
+  first.compiler->functionCache = dir;
+  free(clm_test_generate(&first));
+  char *code =
+      clm_test_generate(&first);
+  CLM_ASSERT(strcmp(code, uncached) == 0);
+  free(code);
+
+  // and the edited program reuses the one that didn't change
+  const char *marked = "0 0\n; reused twice\n";
+  CLM_ASSERT(clm_cache_store(dir, twice, marked, strlen(marked)));
+  second.compiler->functionCache = dir;
+  code = clm_test_generate(&second);
+  CLM_ASSERT(strstr(code, "; reused twice\n") != NULL);
+  CLM_ASSERT(strstr(code, "_total:\n") != NULL);
+  free(code);
+
+  char path[CACHE_PATH_SIZE];
+  snprintf(path, sizeof(path), "%s/%s", dir, twice);
+  remove(path);
+  snprintf(path, sizeof(path), "%s/%s", dir, total);
+  remove(path);
+  function_key(&second, "total", key);
+  snprintf(path, sizeof(path), "%s/%s", dir, key);
+  remove(path);
+  free(uncached);
+  clm_compiler_free(first.compiler);
+  clm_compiler_free(second.compiler);
+  return 1;
+}
@@ -0,0 +1,718 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clm.h"
+#include "clm_ast.h"
+#include "clm_scope.h"
+#include "clm_tests.h"
+
+static int clm_test_code_gen_buffer();
+static int clm_test_code_gen_program();
+static int clm_test_code_gen_stream();
+static int clm_test_code_gen_registers();
+static int clm_test_code_gen_ints();
+static int clm_test_code_gen_matrices();
+static int clm_test_code_gen_gemm();
+static int clm_test_code_gen_elementwise();
+static int clm_test_code_gen_fusion();
+static int clm_test_code_gen_slices();
+static int clm_test_code_gen_compilers();
+static int clm_test_code_gen_parallel();
+static int clm_test_code_gen_imports();
+static int clm_test_code_gen_calls();
+
+int clm_test_code_gen() {
+  int result = 1;
+
+  printf("Testing code buffer... ");
+  if (!clm_test_code_gen_buffer()) {
+    result = 0;
+  } else {
+    printf(" OK.\n");
+  }
+
+  printf("Testing program... ");
+  if (!clm_test_code_gen_program()) {
+    result = 0;
+  } else {
+    printf(" OK.\n");
+  }
+
+  printf("Testing streaming... ");
+  if (!clm_test_code_gen_stream()) {
+    result = 0;
+  } else {
+    printf(" OK.\n");
+  }
+
+  printf("Testing registers... ");
+  if (!clm_test_code_gen_registers()) {
+    result = 0;
+  } else {
+    printf(" OK.\n");
+  }
+
+  printf("Testing int width... ");
+  if (!clm_test_code_gen_ints()) {
+    result = 0;
+  } else {
+    printf(" OK.\n");
+  }
+
+  printf("Testing matrices... ");
+  if (!clm_test_code_gen_matrices()) {
+    result = 0;
+  } else {
+    printf(" OK.\n");
+  }
+
+  printf("Testing matrix multiply... ");
+  if (!clm_test_code_gen_gemm()) {
+    result = 0;
+  } else {
+    printf(" OK.\n");
+  }
+
+  printf("Testing element-wise... ");
+  if (!clm_test_code_gen_elementwise()) {
+    result = 0;
+  } else {
+    printf(" OK.\n");
+  }
+
+  printf("Testing fusion... ");
+  if (!clm_test_code_gen_fusion()) {
+    result = 0;
+  } else {
+    printf(" OK.\n");
+  }
+
+  printf("Testing slices... ");
+  if (!clm_test_code_gen_slices()) {
+    result = 0;
+  } else {
+    printf(" OK.\n");
+  }
+
+  printf("Testing compilers... ");
+  if (!clm_test_code_gen_compilers()) {
+    result = 0;
+  } else {
+    printf(" OK.\n");
+  }
+
+  printf("Testing parallel functions... ");
+  if (!clm_test_code_gen_parallel()) {
+    result = 0;
+  } else {
+    printf(" OK.\n");
+  }
+
+  printf("Testing imports... ");
+  if (!clm_test_code_gen_imports()) {
+    result = 0;
+  } else {
+    printf(" OK.\n");
+  }
+
+  printf("Testing calls... ");
+  if (!clm_test_code_gen_calls()) {
+    result = 0;
+  } else {
+    printf(" OK.\n");
+  }
+
+  return result;
+}
+
+int clm_test_code_gen_buffer() {
+  StringBuffer *buffer = string_buffer_new();
+
+  int i;
+  for (i = 0; i < 10000; i++) {
+    string_buffer_append(buffer, "push eax\n");
+  }
+  CLM_ASSERT(buffer->length == 10000 * strlen("push eax\n"));
+  CLM_ASSERT(buffer->data[buffer->length] == '\0');
+
+  // longer than the initial capacity, so the format has to be redone
+  char long_operand[4096];
+  memset(long_operand, 'a', sizeof(long_operand) - 1);
+  long_operand[sizeof(long_operand) - 1] = '\0';
+
+  size_t length = buffer->length;
+  string_buffer_appendf(buffer, "mov %s,%d\n", long_operand, 42);
+  CLM_ASSERT(buffer->length == length + strlen(long_operand) + 8);
+  CLM_ASSERT(strcmp(buffer->data + buffer->length - 4, ",42\n") == 0);
+
+  string_buffer_free(buffer);
+  return 1;
+}
+
+int clm_test_code_gen_program() {
+  const char *program = "a = 3\n"
+                        "printl a + 2\n";
+
+  ClmTestProgram checked = clm_test_compile(CLM_TARGET_LINUX64, program);
+
+  char *code = clm_test_generate(&checked);
+  CLM_ASSERT(strstr(code, "main:\n") != NULL);
+  CLM_ASSERT(strstr(code, "call printf\n") != NULL);
+  CLM_ASSERT(strstr(code, "_a: .quad ") != NULL);
+  CLM_ASSERT(strstr(code, "print_int_nl: .asciz \"%d\\n\"") != NULL);
+
+  checked.compiler->target = CLM_TARGET_WIN32;
+  free(code);
+  code = clm_test_generate(&checked);
+  CLM_ASSERT(strstr(code, "format PE console\n") != NULL);
+  CLM_ASSERT(strstr(code, "start:\n") != NULL);
+  CLM_ASSERT(strstr(code, "_a dd ") != NULL);
+
+  free(code);
+  clm_compiler_free(checked.compiler);
+  return 1;
+}
+
+// streaming has to produce exactly what is generated in memory, including
+// when the program is big enough to be flushed more than once
+int clm_test_code_gen_stream() {
+  StringBuffer *program = string_buffer_new();
+  string_buffer_append(program, "a = 1\n");
+  int i;
+  for (i = 0; i < 20000; i++) {
+    string_buffer_append(program, "a = a + 1\n");
+  }
+  string_buffer_append(program, "printl a\n");
+
+  ClmTestProgram checked = clm_test_compile(CLM_TARGET_LINUX64, program->data);
+
+  FILE *file = tmpfile();
+  CLM_ASSERT(file != NULL);
+  clm_code_gen_stream(checked.compiler, checked.statements, checked.scope,
+                      fileno(file));
+
+  fseek(file, 0, SEEK_END);
+  long length = ftell(file);
+  rewind(file);
+  char *streamed = malloc(length + 1);
+  CLM_ASSERT(fread(streamed, 1, length, file) == (size_t)length);
+  streamed[length] = '\0';
+  fclose(file);
+
+  char *code = clm_test_generate(&checked);
+  CLM_ASSERT(strcmp(code, streamed) == 0);
+
+  free(code);
+  free(streamed);
+  string_buffer_free(program);
+  clm_compiler_free(checked.compiler);
+  return 1;
+}
+
+// scalar expressions are evaluated in registers, without the typed stack,
+// and values spill to memory when there aren't enough registers
+int clm_test_code_gen_registers() {
+  const char *program =
+      "a = 1\n"
+      "b = 2\n"
+      "c = (a + b) * (a - b)\n"
+      "d = a + (b + (a + (b + (a + (b + (a + (b + (a + (b + 1)))))))))\n"
+      "x = 1.5\n"
+      "y = x * a + 2\n";
+
+  ClmTestProgram checked = clm_test_compile(CLM_TARGET_LINUX64, program);
+
+  char *code = clm_test_generate(&checked);
+  CLM_ASSERT(strstr(code, "push") == NULL);
+  CLM_ASSERT(strstr(code, "imul rbx,rcx\n") != NULL);
+  CLM_ASSERT(strstr(code, "cvtsi2ss xmm2,") != NULL);
+  CLM_ASSERT(strstr(code, "movss dword ptr [_y+8],xmm1\n") != NULL);
+  CLM_ASSERT(strstr(code, "__SPILL__: .quad ") != NULL);
+
+  // win32 has fewer registers, so it spills more
+  checked.compiler->target = CLM_TARGET_WIN32;
+  free(code);
+  code = clm_test_generate(&checked);
+  CLM_ASSERT(strstr(code, "imul ebx,ecx\n") != NULL);
+  CLM_ASSERT(strstr(code, "__SPILL__ dd 0\ndd ") != NULL);
+
+  free(code);
+  clm_compiler_free(checked.compiler);
+
+#ifdef CLM_TESTS_RUN_PROGRAMS
+  // and what the registers and spills work out is what gets printed
+  const char *printed =
+      "a = 7\n"
+      "b = 3\n"
+      "c = (a + b) * (a - b)\n"
+      "d = a + (b + (a + (b + (a + (b + (a + (b + (a + (b + 1)))))))))\n"
+      "e = a / b - a * b\n"
+      "x = 1.5\n"
+      "y = x * a + 2\n"
+      "printl c\n"
+      "printl d\n"
+      "printl e\n"
+      "printl y\n";
+  char output[256];
+
+  checked = clm_test_compile(CLM_TARGET_LINUX64, printed);
+  code = clm_test_generate(&checked);
+  CLM_ASSERT(clm_test_run(code, output, sizeof(output)));
+  CLM_ASSERT(strcmp(output, "40\n51\n-19\n12.500000\n") == 0);
+
+  free(code);
+  clm_compiler_free(checked.compiler);
+#endif
+  return 1;
+}
+
+// ints are 32 bits on every target, so int arithmetic on linux64 wraps the
+// same as the optimizer folds it, in registers and on the typed stack
+int clm_test_code_gen_ints() {
+  const char *program = "\\f x:int -> int =\n"
+                        "  return x\n"
+                        "end\n"
+                        "a = 2147483647\n"
+                        "b = a + 1\n"
+                        "printl b\n"
+                        "printl b < 0\n"
+                        "printl f(a) + 1 < 0\n"
+                        "printl -b\n"
+                        "printl a * 3\n"
+                        "printl b / 3 * 7 - 1\n"
+                        "c = 2147483647 + 1\n"
+                        "printl c < 0\n";
+
+  ClmTestProgram checked = clm_test_compile(CLM_TARGET_LINUX64, program);
+  char *code = clm_test_generate(&checked);
+  CLM_ASSERT(strstr(code, "movsxd rax,eax\n") != NULL);
+  CLM_ASSERT(strstr(code, "cdq\n") != NULL);
+  CLM_ASSERT(strstr(code, "cqo\n") == NULL);
+
+#ifdef CLM_TESTS_RUN_PROGRAMS
+  const char *expected = "-2147483648\n1\n1\n-2147483648\n2147483645\n"
+                         "-715827879\n1\n";
+  char output[256];
+  CLM_ASSERT(clm_test_run(code, output, sizeof(output)));
+  CLM_ASSERT(strcmp(output, expected) == 0);
+
+  // folded by the optimizer, the same
+  free(code);
+  clm_test_optimize(&checked);
+  code = clm_test_generate(&checked);
+  CLM_ASSERT(clm_test_run(code, output, sizeof(output)));
+  CLM_ASSERT(strcmp(output, expected) == 0);
+#endif
+
+  // win32 registers are 32 bits already
+  checked.compiler->target = CLM_TARGET_WIN32;
+  free(code);
+  code = clm_test_generate(&checked);
+  CLM_ASSERT(strstr(code, "movsx") == NULL);
+
+  free(code);
+  clm_compiler_free(checked.compiler);
+  return 1;
+}
+
+int clm_test_code_gen_matrices() {
+  const char *program = "n = 3\n"
+                        "A = [n:n]\n"
+                        "B = A + A\n"
+                        "A = B\n"
+                        "printl A[2,]\n";
+
+  ClmTestProgram checked = clm_test_compile(CLM_TARGET_LINUX64, program);
+
+  // a matrix variable is just a pointer to a descriptor on the heap
+  char *code = clm_test_generate(&checked);
+  CLM_ASSERT(strstr(code, "_A: .quad 1\n.zero 8\n") != NULL);
+  CLM_ASSERT(strstr(code, "call calloc\n") != NULL);
+  CLM_ASSERT(strstr(code, "call malloc\n") != NULL);
+  CLM_ASSERT(strstr(code, "call free\n") != NULL);
+  // the multiply routine is only emitted by programs that use it
+  CLM_ASSERT(strstr(code, "__GEMM__") == NULL);
+
+  checked.compiler->target = CLM_TARGET_WIN32;
+  free(code);
+  code = clm_test_generate(&checked);
+  CLM_ASSERT(strstr(code, "_A dd 1\ndd 1 dup 0\n") != NULL);
+  CLM_ASSERT(strstr(code, "cinvoke calloc, 1, eax\n") != NULL);
+  CLM_ASSERT(strstr(code, "cinvoke free, dword [_A+4]\n") != NULL);
+
+  free(code);
+  clm_compiler_free(checked.compiler);
+  return 1;
+}
+
+int clm_test_code_gen_gemm() {
+  const char *program = "A = {1 2, 3 4}\n"
+                        "B = A * A\n";
+  ClmTestProgram checked = clm_test_compile(CLM_TARGET_LINUX64, program);
+
+  char *code = clm_test_generate(&checked);
+  CLM_ASSERT(strstr(code, "call __GEMM__\n") != NULL);
+  CLM_ASSERT(strstr(code, "__GEMM__:\n") != NULL);
+  // sse2 multiplies the even and odd columns separately
+  CLM_ASSERT(strstr(code, "pmuludq xmm11,xmm10\n") != NULL);
+  CLM_ASSERT(strstr(code, "punpckldq xmm0,xmm1\n") != NULL);
+
+  checked.compiler->simd = CLM_SIMD_AVX2;
+  free(code);
+  code = clm_test_generate(&checked);
+  CLM_ASSERT(strstr(code, "vpbroadcastd ymm10,dword ptr [rsi]\n") != NULL);
+  CLM_ASSERT(strstr(code, "vpmulld ymm11,ymm11,ymm8\n") != NULL);
+  CLM_ASSERT(strstr(code, "vzeroupper\n") != NULL);
+
+  // win32 only has 8 vector registers, so the tiles are smaller
+  checked.compiler->target = CLM_TARGET_WIN32;
+  free(code);
+  code = clm_test_generate(&checked);
+  CLM_ASSERT(strstr(code, "vpmulld ymm7,ymm7,ymm4\n") != NULL);
+
+  free(code);
+  clm_compiler_free(checked.compiler);
+  return 1;
+}
+
+int clm_test_code_gen_elementwise() {
+  const char *program = "A = {1 2, 3 4}\n"
+                        "B = A + A\n"
+                        "C = -B\n"
+                        "D = C * 3\n"
+                        "E = D / 2.5\n"
+                        "F = E / 2\n";
+  ClmTestProgram checked = clm_test_compile(CLM_TARGET_LINUX64, program);
+
+  char *code = clm_test_generate(&checked);
+  CLM_ASSERT(strstr(code, "paddd xmm0,xmm1\n") != NULL);
+  CLM_ASSERT(strstr(code, "movdqu xmm2,[rsi+rcx*4+16]\n") != NULL);
+  CLM_ASSERT(strstr(code, "psubd xmm5,xmm0\n") != NULL);
+  CLM_ASSERT(strstr(code, "pmuludq xmm0,xmm4\n") != NULL);
+  CLM_ASSERT(strstr(code, "divps xmm0,xmm4\n") != NULL);
+  CLM_ASSERT(strstr(code, "cvttps2dq xmm0,xmm0\n") != NULL);
+  // there is no vector integer division, and ints are divided as 32 bits
+  CLM_ASSERT(strstr(code, "idiv edi\n") != NULL);
+
+  checked.compiler->simd = CLM_SIMD_AVX2;
+  free(code);
+  code = clm_test_generate(&checked);
+  CLM_ASSERT(strstr(code, "vpaddd ymm0,ymm0,ymm1\n") != NULL);
+  CLM_ASSERT(strstr(code, "vmovdqu ymm2,[rsi+rcx*4+32]\n") != NULL);
+  CLM_ASSERT(strstr(code, "vpmulld ymm0,ymm0,ymm4\n") != NULL);
+  CLM_ASSERT(strstr(code, "vzeroupper\n") != NULL);
+
+  free(code);
+  clm_compiler_free(checked.compiler);
+  return 1;
+}
+
+static int count_lines(const char *code, const char *line) {
+  int count = 0;
+  while ((code = strstr(code, line)) != NULL) {
+    count++;
+    code += strlen(line);
+  }
+  return count;
+}
+
+int clm_test_code_gen_fusion() {
+  const char *program = "A = {1 2, 3 4}\n"
+                        "B = {5 6, 7 8}\n"
+                        "C = A + B - A * 2\n";
+  ClmTestProgram checked = clm_test_compile(CLM_TARGET_LINUX64, program);
+
+  // one loop over the leftover elements and one over whole vectors, and
+  // no temporaries besides the result
+  char *code = clm_test_generate(&checked);
+  CLM_ASSERT(count_lines(code, "paddd") == 2);
+  CLM_ASSERT(count_lines(code, "psubd") == 2);
+  CLM_ASSERT(count_lines(code, "call malloc") == 3);
+  CLM_ASSERT(strstr(code, "movd xmm0,dword ptr [rax+rcx*4]\n") != NULL);
+  CLM_ASSERT(strstr(code, "movd dword ptr [rbx+rcx*4],xmm0\n") != NULL);
+
+  checked.compiler->simd = CLM_SIMD_AVX2;
+  free(code);
+  code = clm_test_generate(&checked);
+  CLM_ASSERT(strstr(code, "vmovd xmm0,dword ptr [rax+rcx*4]\n") != NULL);
+  CLM_ASSERT(strstr(code, "vmovdqu [rbx+rcx*4],ymm0\n") != NULL);
+
+  free(code);
+  clm_compiler_free(checked.compiler);
+  return 1;
+}
+
+int clm_test_code_gen_slices() {
+  const char *program = "A = {1 2, 3 4}\n"
+                        "B = A[1..2, 2] + A[, 1]\n"
+                        "printl A[2, ]\n";
+  ClmTestProgram checked = clm_test_compile(CLM_TARGET_LINUX64, program);
+
+  // a slice is only a descriptor, the elements stay in A
+  char *code = clm_test_generate(&checked);
+  CLM_ASSERT(count_lines(code, "call malloc") == 5);
+  CLM_ASSERT(count_lines(code, "mov rdi,32\n") == 3);
+  CLM_ASSERT(count_lines(code, "call free") == 5);
+
+  free(code);
+  clm_compiler_free(checked.compiler);
+
+#ifdef CLM_TESTS_RUN_PROGRAMS
+  // a slice passed to a function is a view the caller frees afterwards
+  const char *looped = "\\first A[m:n] -> int =\n"
+                       "  return A[1,1]\n"
+                       "end\n"
+                       "M = {1 2, 3 4}\n"
+                       "i = 0\n"
+                       "while i < %d do\n"
+                       "  x = first(M[2, ]) + first(M[1..2, 2])\n"
+                       "  i = i + 1\n"
+                       "end\n"
+                       "printl x\n";
+  char source[512], once[64], output[64];
+  snprintf(source, sizeof(source), looped, 1);
+  checked = clm_test_compile(CLM_TARGET_LINUX64, source);
+  code = clm_test_generate(&checked);
+  CLM_ASSERT(clm_test_run_counting(code, once, sizeof(once)));
+  free(code);
+  clm_compiler_free(checked.compiler);
+
+  snprintf(source, sizeof(source), looped, 1000);
+  checked = clm_test_compile(CLM_TARGET_LINUX64, source);
+  code = clm_test_generate(&checked);
+  CLM_ASSERT(clm_test_run_counting(code, output, sizeof(output)));
+  CLM_ASSERT(strncmp(output, "5\nlive allocations ", 19) == 0);
+  CLM_ASSERT(strcmp(output, once) == 0);
+  free(code);
+  clm_compiler_free(checked.compiler);
+#endif
+  return 1;
+}
+
+int clm_test_code_gen_compilers() {
+  const char *program = "A = {1 2, 3 4}\n"
+                        "B = A * A\n";
+
+  // two compilations in flight at once, each with its own options and names
+  ClmCompiler *first = clm_compiler_new(CLM_TARGET_LINUX64);
+  ClmCompiler *second = clm_compiler_new(CLM_TARGET_WIN32);
+  second->simd = CLM_SIMD_AVX2;
+
+  ClmTokens *firstTokens = clm_lexer_main(first, program, strlen(program));
+  ClmTokens *secondTokens = clm_lexer_main(second, program, strlen(program));
+  ArrayList *firstStatements = clm_parser_main(first, firstTokens);
+  ArrayList *secondStatements = clm_parser_main(second, secondTokens);
+  ClmStmtNode *firstAssign = firstStatements->data[0];
+  ClmStmtNode *secondAssign = secondStatements->data[0];
+  CLM_ASSERT(firstAssign->assignStmt.lhs->indExp.id !=
+             secondAssign->assignStmt.lhs->indExp.id);
+  ClmScope *firstScope = clm_symbol_gen_main(first, firstStatements);
+  ClmScope *secondScope = clm_symbol_gen_main(second, secondStatements);
+  clm_type_check_main(first, firstStatements, firstScope);
+  clm_type_check_main(second, secondStatements, secondScope);
+
+  // each program's code is its own, generating the other doesn't touch it
+  char *firstCode = clm_code_gen_main(first, firstStatements, firstScope);
+  char *secondCode = clm_code_gen_main(second, secondStatements, secondScope);
+  CLM_ASSERT(strstr(firstCode, "main:\n") != NULL);
+  CLM_ASSERT(strstr(firstCode, "pmuludq") != NULL);
+  CLM_ASSERT(strstr(secondCode, "format PE console\n") != NULL);
+  CLM_ASSERT(strstr(secondCode, "vpmulld") != NULL);
+
+  free(firstCode);
+  free(secondCode);
+  clm_tokens_free(firstTokens);
+  clm_tokens_free(secondTokens);
+  clm_compiler_free(first);
+  clm_compiler_free(second);
+  return 1;
+}
+
+int clm_test_code_gen_parallel() {
+  const char *program = "A = {1 2, 3 4}\n"
+                        "\\smaller a:int b:int -> int =\n"
+                        "  if a < b then\n"
+                        "    return a\n"
+                        "  else\n"
+                        "    return b\n"
+                        "  end\n"
+                        "end\n"
+                        "\\total n:int -> int =\n"
+                        "  s = 0\n"
+                        "  for i in 1..n do\n"
+                        "    s = s + i\n"
+                        "  end\n"
+                        "  return s\n"
+                        "end\n"
+                        "\\square B[2:2] -> [2:2] =\n"
+                        "  return B * A\n"
+                        "end\n"
+                        "printl smaller(2, 3) + total(4)\n";
+
+  ClmTestProgram checked = clm_test_compile(CLM_TARGET_LINUX64, program);
+
+  checked.compiler->threads = 1;
+  char *sequential = clm_test_generate(&checked);
+  // each function names its own labels
+  CLM_ASSERT(strstr(sequential, "smaller__label0:\n") != NULL);
+  CLM_ASSERT(strstr(sequential, "total__label0:\n") != NULL);
+  CLM_ASSERT(strstr(sequential, "\nlabel0:\n") != NULL);
+
+  // the functions come out the same, in the same order, on any number of
+  // threads, and the multiply one of them calls is still emitted
+  checked.compiler->threads = 3;
+  char *code = clm_test_generate(&checked);
+  CLM_ASSERT(strcmp(code, sequential) == 0);
+  CLM_ASSERT(strstr(code, "__GEMM__:\n") != NULL);
+  CLM_ASSERT(strstr(code, "_smaller:\n") < strstr(code, "_total:\n"));
+
+  free(code);
+  free(sequential);
+  clm_compiler_free(checked.compiler);
+
+  // more functions than the threads generate in one batch come out in order
+  StringBuffer *many = string_buffer_new();
+  int i;
+  for (i = 0; i < 40; i++)
+    string_buffer_appendf(many, "\\f%d x:int -> int =\n"
+                                "  return x + %d\n"
+                                "end\n",
+                          i, i);
+  string_buffer_append(many, "printl f0(1) + f39(2)\n");
+  checked = clm_test_compile(CLM_TARGET_LINUX64, many->data);
+  string_buffer_free(many);
+
+  checked.compiler->threads = 1;
+  sequential = clm_test_generate(&checked);
+  checked.compiler->threads = 2;
+  code = clm_test_generate(&checked);
+  CLM_ASSERT(strcmp(code, sequential) == 0);
+  CLM_ASSERT(strstr(code, "_f9:\n") < strstr(code, "_f10:\n"));
+  CLM_ASSERT(strstr(code, "_f38:\n") < strstr(code, "_f39:\n"));
+
+  free(code);
+  free(sequential);
+  clm_compiler_free(checked.compiler);
+  return 1;
+}
+
+int clm_test_code_gen_imports() {
+  const char *module = "\\smaller a:int b:int -> int =\n"
+                       "  if a < b then\n"
+                       "    return a\n"
+                       "  end\n"
+                       "  return b\n"
+                       "end\n";
+  const char *program = "printl smaller(2, 3)\n";
+
+  ClmTestProgram checkedModule = clm_test_compile(CLM_TARGET_LINUX64, module);
+
+  // the module is checked once, and each program that imports it generates
+  // its functions along with its own
+  int i;
+  for (i = 0; i < 2; i++) {
+    ClmCompiler *compiler = clm_compiler_new(CLM_TARGET_LINUX64);
+    compiler->imports = array_list_new(NULL);
+    array_list_push(compiler->imports, checkedModule.statements->data[0]);
+    ClmTestProgram checked = clm_test_check(compiler, program);
+
+    char *code = clm_test_generate(&checked);
+    CLM_ASSERT(strstr(code, "_smaller:\n") != NULL);
+    CLM_ASSERT(strstr(code, "call _smaller\n") != NULL);
+    CLM_ASSERT(strstr(code, "smaller__label0:\n") != NULL);
+
+    free(code);
+    clm_compiler_free(compiler);
+  }
+
+  clm_compiler_free(checkedModule.compiler);
+  return 1;
+}
+
+// a function pops its arguments when it returns, and a float argument's value
+// is in its slot rather than on the fpu stack
+int clm_test_code_gen_calls() {
+  const char *program = "\\f x:int -> int =\n"
+                        "  return x * 2\n"
+                        "end\n"
+                        "\\fl x:float -> float =\n"
+                        "  return x\n"
+                        "end\n"
+                        "\\m n:int -> [2:2] =\n"
+                        "  A = [2:2]\n"
+                        "  A[1,1] = n\n"
+                        "  return A\n"
+                        "end\n"
+                        "printl f(5) + f(1)\n"
+                        "printl fl(2.0)\n"
+                        "printl fl(1.5 * 3.0)\n"
+                        "printl fl(fl(0.5))\n"
+                        "B = m(3) + m(4)\n"
+                        "printl B\n"
+                        "i = 0\n"
+                        "while i < 1000000 do\n"
+                        "  j = f(i)\n"
+                        "  i = i + 1\n"
+                        "end\n"
+                        "printl j\n";
+
+  ClmTestProgram checked = clm_test_compile(CLM_TARGET_LINUX64, program);
+
+  char *code = clm_test_generate(&checked);
+  CLM_ASSERT(strstr(code, "ret 16\n") != NULL);
+  CLM_ASSERT(strstr(code, "fstp dword ptr [rsp]\n") != NULL);
+  CLM_ASSERT(strstr(code, "movss dword ptr [rsp],") != NULL);
+
+#ifdef CLM_TESTS_RUN_PROGRAMS
+  char output[256];
+  CLM_ASSERT(clm_test_run(code, output, sizeof(output)));
+  CLM_ASSERT(strcmp(output, "12\n"
+                            "2.000000\n"
+                            "4.500000\n"
+                            "0.500000\n"
+                            "\n7 0 \n0 0 \n"
+                            "1999998\n") == 0);
+#endif
+
+  checked.compiler->target = CLM_TARGET_WIN32;
+  free(code);
+  code = clm_test_generate(&checked);
+  CLM_ASSERT(strstr(code, "ret 8\n") != NULL);
+  CLM_ASSERT(strstr(code, "fstp dword [esp]\n") != NULL);
+
+  free(code);
+  clm_compiler_free(checked.compiler);
+
+#ifdef CLM_TESTS_RUN_PROGRAMS
+  // the caller frees the temporaries it passes, so looping more doesn't
+  // leave more allocations behind
+  const char *looped = "\\first A[m:n] -> int =\n"
+                       "  return A[1,1]\n"
+                       "end\n"
+                       "M = {1 2, 3 4}\n"
+                       "i = 0\n"
+                       "while i < %d do\n"
+                       "  x = first(M * 2) + first(M + M)\n"
+                       "  i = i + 1\n"
+                       "end\n"
+                       "printl x\n";
+  char source[512], once[64];
+  snprintf(source, sizeof(source), looped, 1);
+  checked = clm_test_compile(CLM_TARGET_LINUX64, source);
+  code = clm_test_generate(&checked);
+  CLM_ASSERT(clm_test_run_counting(code, once, sizeof(once)));
+  free(code);
+  clm_compiler_free(checked.compiler);
+
+  snprintf(source, sizeof(source), looped, 1000);
+  checked = clm_test_compile(CLM_TARGET_LINUX64, source);
+  code = clm_test_generate(&checked);
+  CLM_ASSERT(clm_test_run_counting(code, output, sizeof(output)));
+  CLM_ASSERT(strncmp(output, "4\nlive allocations ", 19) == 0);
+  CLM_ASSERT(strcmp(output, once) == 0);
+  free(code);
+  clm_compiler_free(checked.compiler);
+#endif
+  return 1;
+}
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "clm.h"
 #include "clm_tests.h"
@@ -8,8 +9,16 @@ static int clm_test_lexer_ids();
 static int clm_test_lexer_numbers();
 static int clm_test_lexer_keywords();
 
+// names are interned in the compiler the tokens were lexed by
+static ClmCompiler *compiler;
+
+static const char *text(ClmTokens *tokens, int i) {
+  return clm_token_text(compiler, tokens, &tokens->data[i]);
+}
+
 int clm_test_lexer() {
   int result = 1;
+  compiler = clm_compiler_new(CLM_TARGET_LINUX64);
 
   printf("Testing ids... ");
   if (!clm_test_lexer_ids()) {
@@ -32,27 +41,41 @@ int clm_test_lexer() {
     printf(" OK.\n");
   }
 
+  clm_compiler_free(compiler);
   return result;
 }
 
 int clm_test_lexer_ids() {
   const char *program = "thisIsAGoodID\n"
                         "this_one_is_too\n"
-                        "and_2this_1\n";
+                        "and_2this_1\n"
+                        "iff ends prints tno\n";
 
-  ArrayList *tokens_list = clm_lexer_main(program);
-  ClmLexerToken **tokens = (ClmLexerToken **)tokens_list->data;
+  ClmTokens *tokens_list = clm_lexer_main(compiler, program, strlen(program));
+  ClmLexerToken *tokens = tokens_list->data;
+
+  // names are interned, so the same text is the same pointer
+  CLM_ASSERT(text(tokens_list, 0) == string_intern(compiler, "thisIsAGoodID"));
 
   int i = 0;
-  CLM_ASSERT(tokens[i]->sym == LITERAL_ID &&
-             string_equals(tokens[i++]->raw, "thisIsAGoodID"));
-  CLM_ASSERT(tokens[i]->sym == LITERAL_ID &&
-             string_equals(tokens[i++]->raw, "this_one_is_too"));
-  CLM_ASSERT(tokens[i]->sym == LITERAL_ID &&
-             string_equals(tokens[i++]->raw, "and_2this_1"));
-  CLM_ASSERT(tokens[i]->sym == KEYWORD_END);
-
-  array_list_free(tokens_list);
+  CLM_ASSERT(tokens[i].sym == LITERAL_ID &&
+             string_equals(text(tokens_list, i++), "thisIsAGoodID"));
+  CLM_ASSERT(tokens[i].sym == LITERAL_ID &&
+             string_equals(text(tokens_list, i++), "this_one_is_too"));
+  CLM_ASSERT(tokens[i].sym == LITERAL_ID &&
+             string_equals(text(tokens_list, i++), "and_2this_1"));
+  // close to keywords, but not them
+  CLM_ASSERT(tokens[i].sym == LITERAL_ID &&
+             string_equals(text(tokens_list, i++), "iff"));
+  CLM_ASSERT(tokens[i].sym == LITERAL_ID &&
+             string_equals(text(tokens_list, i++), "ends"));
+  CLM_ASSERT(tokens[i].sym == LITERAL_ID &&
+             string_equals(text(tokens_list, i++), "prints"));
+  CLM_ASSERT(tokens[i].sym == LITERAL_ID &&
+             string_equals(text(tokens_list, i++), "tno"));
+  CLM_ASSERT(tokens[i].sym == KEYWORD_END);
+
+  clm_tokens_free(tokens_list);
   return 1;
 }
 
@@ -62,23 +85,30 @@ int clm_test_lexer_numbers() {
                         "0.0112\n"
                         "2345.0012\n";
 
-  ArrayList *tokens_list = clm_lexer_main(program);
-  ClmLexerToken **tokens = (ClmLexerToken **)tokens_list->data;
+  ClmTokens *tokens_list = clm_lexer_main(compiler, program, strlen(program));
+  ClmLexerToken *tokens = tokens_list->data;
 
   int i = 0;
-  CLM_ASSERT(tokens[i]->sym == LITERAL_INT &&
-             string_equals(tokens[i++]->raw, "12345"));
-  CLM_ASSERT(tokens[i]->sym == TOKEN_MINUS &&
-             string_equals(tokens[i++]->raw, "-"));
-  CLM_ASSERT(tokens[i]->sym == LITERAL_FLOAT &&
-             string_equals(tokens[i++]->raw, "3412."));
-  CLM_ASSERT(tokens[i]->sym == LITERAL_FLOAT &&
-             string_equals(tokens[i++]->raw, "0.0112"));
-  CLM_ASSERT(tokens[i]->sym == LITERAL_FLOAT &&
-             string_equals(tokens[i++]->raw, "2345.0012"));
-  CLM_ASSERT(tokens[i]->sym == KEYWORD_END);
-
-  array_list_free(tokens_list);
+  CLM_ASSERT(tokens[i].sym == LITERAL_INT &&
+             string_equals(text(tokens_list, i++), "12345"));
+  CLM_ASSERT(tokens[i].sym == TOKEN_MINUS &&
+             string_equals(text(tokens_list, i++), "-"));
+  CLM_ASSERT(tokens[i].sym == LITERAL_FLOAT &&
+             string_equals(text(tokens_list, i++), "3412."));
+  CLM_ASSERT(tokens[i].sym == LITERAL_FLOAT &&
+             string_equals(text(tokens_list, i++), "0.0112"));
+  CLM_ASSERT(tokens[i].sym == LITERAL_FLOAT &&
+             string_equals(text(tokens_list, i++), "2345.0012"));
+  CLM_ASSERT(tokens[i].sym == KEYWORD_END);
+  clm_tokens_free(tokens_list);
+
+  // only the given length of the source is lexed, even without a null there
+  tokens_list = clm_lexer_main(compiler, program, 3);
+  tokens = tokens_list->data;
+  CLM_ASSERT(tokens_list->length == 2 && tokens[0].sym == LITERAL_INT &&
+             string_equals(text(tokens_list, 0), "123"));
+
+  clm_tokens_free(tokens_list);
   return 1;
 }
 
@@ -126,54 +156,74 @@ int clm_test_lexer_keywords() {
                         "*\n"
                         "~\n";
 
-  ArrayList *tokens_list = clm_lexer_main(program);
-  ClmLexerToken **tokens = (ClmLexerToken **)tokens_list->data;
+  ClmTokens *tokens_list = clm_lexer_main(compiler, program, strlen(program));
+  ClmLexerToken *tokens = tokens_list->data;
 
   int i = 0;
-  CLM_ASSERT(tokens[i++]->sym == KEYWORD_AND);
-  CLM_ASSERT(tokens[i++]->sym == KEYWORD_CALL);
-  CLM_ASSERT(tokens[i++]->sym == KEYWORD_DO);
-  CLM_ASSERT(tokens[i++]->sym == KEYWORD_ELSE);
-  CLM_ASSERT(tokens[i++]->sym == KEYWORD_END);
-  CLM_ASSERT(tokens[i++]->sym == KEYWORD_FLOAT);
-  CLM_ASSERT(tokens[i++]->sym == KEYWORD_FOR);
-  CLM_ASSERT(tokens[i++]->sym == KEYWORD_WHILE);
-  CLM_ASSERT(tokens[i++]->sym == KEYWORD_IF);
-  CLM_ASSERT(tokens[i++]->sym == KEYWORD_IN);
-  CLM_ASSERT(tokens[i++]->sym == KEYWORD_INT);
-  CLM_ASSERT(tokens[i++]->sym == KEYWORD_OR);
-  CLM_ASSERT(tokens[i++]->sym == KEYWORD_PRINT);
-  CLM_ASSERT(tokens[i++]->sym == KEYWORD_PRINTL);
-  CLM_ASSERT(tokens[i++]->sym == KEYWORD_RETURN);
-  CLM_ASSERT(tokens[i++]->sym == KEYWORD_STRING);
-  CLM_ASSERT(tokens[i++]->sym == KEYWORD_THEN);
-  CLM_ASSERT(tokens[i++]->sym == KEYWORD_TO);
-  CLM_ASSERT(tokens[i++]->sym == TOKEN_BANG);
-  CLM_ASSERT(tokens[i++]->sym == TOKEN_BSLASH);
-  CLM_ASSERT(tokens[i++]->sym == TOKEN_COLON);
-  CLM_ASSERT(tokens[i++]->sym == TOKEN_COMMA);
-  CLM_ASSERT(tokens[i++]->sym == TOKEN_EQ);
-  CLM_ASSERT(tokens[i++]->sym == TOKEN_EQEQ);
-  CLM_ASSERT(tokens[i++]->sym == TOKEN_FSLASH);
-  CLM_ASSERT(tokens[i++]->sym == TOKEN_GT);
-  CLM_ASSERT(tokens[i++]->sym == TOKEN_GTE);
-  CLM_ASSERT(tokens[i++]->sym == TOKEN_LBRACK);
-  CLM_ASSERT(tokens[i++]->sym == TOKEN_LCURL);
-  CLM_ASSERT(tokens[i++]->sym == TOKEN_LPAREN);
-  CLM_ASSERT(tokens[i++]->sym == TOKEN_LT);
-  CLM_ASSERT(tokens[i++]->sym == TOKEN_LTE);
-  CLM_ASSERT(tokens[i++]->sym == TOKEN_MINUS);
-  CLM_ASSERT(tokens[i++]->sym == TOKEN_BANGEQ);
-  CLM_ASSERT(tokens[i++]->sym == TOKEN_PERIOD);
-  CLM_ASSERT(tokens[i++]->sym == TOKEN_PLUS);
-  CLM_ASSERT(tokens[i++]->sym == TOKEN_RBRACK);
-  CLM_ASSERT(tokens[i++]->sym == TOKEN_RCURL);
-  CLM_ASSERT(tokens[i++]->sym == TOKEN_RPAREN);
-  CLM_ASSERT(tokens[i++]->sym == TOKEN_SEMI);
-  CLM_ASSERT(tokens[i++]->sym == TOKEN_STAR);
-  CLM_ASSERT(tokens[i++]->sym == TOKEN_TILDA);
-  CLM_ASSERT(tokens[i++]->sym == KEYWORD_END);
-
-  array_list_free(tokens_list);
+  CLM_ASSERT(tokens[i++].sym == KEYWORD_AND);
+  CLM_ASSERT(tokens[i++].sym == KEYWORD_CALL);
+  CLM_ASSERT(tokens[i++].sym == KEYWORD_DO);
+  CLM_ASSERT(tokens[i++].sym == KEYWORD_ELSE);
+  CLM_ASSERT(tokens[i++].sym == KEYWORD_END);
+  CLM_ASSERT(tokens[i++].sym == KEYWORD_FLOAT);
+  CLM_ASSERT(tokens[i++].sym == KEYWORD_FOR);
+  CLM_ASSERT(tokens[i++].sym == KEYWORD_WHILE);
+  CLM_ASSERT(tokens[i++].sym == KEYWORD_IF);
+  CLM_ASSERT(tokens[i++].sym == KEYWORD_IN);
+  CLM_ASSERT(tokens[i++].sym == KEYWORD_INT);
+  CLM_ASSERT(tokens[i++].sym == KEYWORD_OR);
+  CLM_ASSERT(tokens[i++].sym == KEYWORD_PRINT);
+  CLM_ASSERT(tokens[i++].sym == KEYWORD_PRINTL);
+  CLM_ASSERT(tokens[i++].sym == KEYWORD_RETURN);
+  CLM_ASSERT(tokens[i++].sym == KEYWORD_STRING);
+  CLM_ASSERT(tokens[i++].sym == KEYWORD_THEN);
+  CLM_ASSERT(tokens[i++].sym == KEYWORD_TO);
+  CLM_ASSERT(tokens[i++].sym == TOKEN_BANG);
+  CLM_ASSERT(tokens[i++].sym == TOKEN_BSLASH);
+  CLM_ASSERT(tokens[i++].sym == TOKEN_COLON);
+  CLM_ASSERT(tokens[i++].sym == TOKEN_COMMA);
+  CLM_ASSERT(tokens[i++].sym == TOKEN_EQ);
+  CLM_ASSERT(tokens[i++].sym == TOKEN_EQEQ);
+  CLM_ASSERT(tokens[i++].sym == TOKEN_FSLASH);
+  CLM_ASSERT(tokens[i++].sym == TOKEN_GT);
+  CLM_ASSERT(tokens[i++].sym == TOKEN_GTE);
+  CLM_ASSERT(tokens[i++].sym == TOKEN_LBRACK);
+  CLM_ASSERT(tokens[i++].sym == TOKEN_LCURL);
+  CLM_ASSERT(tokens[i++].sym == TOKEN_LPAREN);
+  CLM_ASSERT(tokens[i++].sym == TOKEN_LT);
+  CLM_ASSERT(tokens[i++].sym == TOKEN_LTE);
+  CLM_ASSERT(tokens[i++].sym == TOKEN_MINUS);
+  CLM_ASSERT(tokens[i++].sym == TOKEN_BANGEQ);
+  CLM_ASSERT(tokens[i++].sym == TOKEN_PERIOD);
+  CLM_ASSERT(tokens[i++].sym == TOKEN_PLUS);
+  CLM_ASSERT(tokens[i++].sym == TOKEN_RBRACK);
+  CLM_ASSERT(tokens[i++].sym == TOKEN_RCURL);
+  CLM_ASSERT(tokens[i++].sym == TOKEN_RPAREN);
+  CLM_ASSERT(tokens[i++].sym == TOKEN_SEMI);
+  CLM_ASSERT(tokens[i++].sym == TOKEN_STAR);
+  CLM_ASSERT(tokens[i++].sym == TOKEN_TILDA);
+  CLM_ASSERT(tokens[i++].sym == KEYWORD_END);
+  clm_tokens_free(tokens_list);
+
+  // keywords are only looked for in the entry of their hash, so one that is
+  // missing from the table or shares an entry with another isn't found
+  static const ClmLexerSymbol keywords[] = {
+#define literal(tok, str)
+#define token(tok, str)
+#define keyword(tok, str) tok,
+#include "keywords.inc"
+#undef literal
+#undef token
+#undef keyword
+  };
+  size_t k;
+  for (k = 0; k < sizeof(keywords) / sizeof(keywords[0]); k++) {
+    const char *keyword = clmLexerSymbolStrings[keywords[k]];
+    tokens_list = clm_lexer_main(compiler, keyword, strlen(keyword));
+    CLM_ASSERT(tokens_list->length >= 1 &&
+               tokens_list->data[0].sym == keywords[k]);
+    clm_tokens_free(tokens_list);
+  }
+
   return 1;
 }
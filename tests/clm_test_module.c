@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clm.h"
+#include "clm_ast.h"
+#include "clm_module.h"
+#include "clm_tests.h"
+
+static int write_source(const char *path, const char *source) {
+  FILE *file = fopen(path, "wb");
+  if (file == NULL)
+    return 0;
+  fputs(source, file);
+  return fclose(file) == 0;
+}
+
+static char *compile(const char *source) {
+  ClmTestProgram program = clm_test_compile(CLM_TARGET_LINUX64, source);
+  clm_test_optimize(&program);
+  char *code = clm_test_generate(&program);
+  clm_compiler_free(program.compiler);
+  return code;
+}
+
+int clm_test_module() {
+  const char *module = "\\smaller a:int b:int -> int =\n"
+                       "  if a < b then\n"
+                       "    return a\n"
+                       "  end\n"
+                       "  return b\n"
+                       "end\n"
+                       "\\least a:int b:int c:int -> int =\n"
+                       "  return smaller(smaller(a, b), c)\n"
+                       "end\n"
+                       "\\unused a:int -> int =\n"
+                       "  return a\n"
+                       "end\n";
+  const char *program = "import least from clm_test_module\n"
+                        "printl least(9, 4, 7)\n";
+
+  remove("clm_test_module" CLM_MODULE_EXTENSION);
+  CLM_ASSERT(write_source("clm_test_module.clm", module));
+
+  // the first import compiles the module and writes its interface
+  char *compiled = compile(program);
+  FILE *file = fopen("clm_test_module" CLM_MODULE_EXTENSION, "rb");
+  CLM_ASSERT(file != NULL);
+  fclose(file);
+
+  // only the imported function and the ones it calls come with the program
+  CLM_ASSERT(strstr(compiled, "_least:\n") != NULL);
+  CLM_ASSERT(strstr(compiled, "_smaller:\n") != NULL);
+  CLM_ASSERT(strstr(compiled, "_unused:\n") == NULL);
+
+  // the next one reads the interface, and the code is the same
+  remove("clm_test_module.clm");
+  char *loaded = compile(program);
+  CLM_ASSERT(strcmp(compiled, loaded) == 0);
+
+  remove("clm_test_module" CLM_MODULE_EXTENSION);
+  free(compiled);
+  free(loaded);
+  return 1;
+}
@@ -0,0 +1,311 @@
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clm.h"
+#include "clm_ast.h"
+#include "clm_scope.h"
+#include "clm_tests.h"
+
+static int clm_test_optimizer_fold_constants();
+static int clm_test_optimizer_fold_overflow();
+static int clm_test_optimizer_fold_matrices();
+static int clm_test_optimizer_reductions();
+static int clm_test_optimizer_conditionals();
+static int clm_test_optimizer_propagate_constants();
+static int clm_test_optimizer_disabled();
+
+static ArrayList *optimize(ClmTestProgram *program, const char *source) {
+  *program = clm_test_compile(CLM_TARGET_LINUX64, source);
+  clm_test_optimize(program);
+  return program->statements;
+}
+
+static ClmExpNode *rhs(ArrayList *statements, int i) {
+  return ((ClmStmtNode *)statements->data[i])->assignStmt.rhs;
+}
+
+int clm_test_optimizer() {
+  int result = 1;
+
+  printf("Testing constant folding... ");
+  if (!clm_test_optimizer_fold_constants()) {
+    result = 0;
+  } else {
+    printf(" OK.\n");
+  }
+
+  printf("Testing overflowing folds... ");
+  if (!clm_test_optimizer_fold_overflow()) {
+    result = 0;
+  } else {
+    printf(" OK.\n");
+  }
+
+  printf("Testing matrix folding... ");
+  if (!clm_test_optimizer_fold_matrices()) {
+    result = 0;
+  } else {
+    printf(" OK.\n");
+  }
+
+  printf("Testing reductions... ");
+  if (!clm_test_optimizer_reductions()) {
+    result = 0;
+  } else {
+    printf(" OK.\n");
+  }
+
+  printf("Testing conditionals... ");
+  if (!clm_test_optimizer_conditionals()) {
+    result = 0;
+  } else {
+    printf(" OK.\n");
+  }
+
+  printf("Testing constant propagation... ");
+  if (!clm_test_optimizer_propagate_constants()) {
+    result = 0;
+  } else {
+    printf(" OK.\n");
+  }
+
+  printf("Testing disabled passes... ");
+  if (!clm_test_optimizer_disabled()) {
+    result = 0;
+  } else {
+    printf(" OK.\n");
+  }
+
+  return result;
+}
+
+int clm_test_optimizer_fold_constants() {
+  ClmTestProgram program;
+  ArrayList *statements = optimize(&program, "a = 3 + 4 * 2\n"
+                                             "b = 10 - 4 - 3\n"
+                                             "c = 1.5 * 2\n"
+                                             "d = 3 < 4\n"
+                                             "e = -(2)\n"
+                                             "f = 7 / 0\n"
+                                             "g = 16777217 == 16777216\n"
+                                             "h = 16777217 > 16777216\n"
+                                             "i = 16777217 == 16777216.0\n");
+
+  CLM_ASSERT(rhs(statements, 0)->type == EXP_TYPE_INT &&
+             rhs(statements, 0)->ival == 11);
+  CLM_ASSERT(rhs(statements, 1)->type == EXP_TYPE_INT &&
+             rhs(statements, 1)->ival == 3);
+  CLM_ASSERT(rhs(statements, 2)->type == EXP_TYPE_FLOAT &&
+             rhs(statements, 2)->fval == 3.0f);
+  CLM_ASSERT(rhs(statements, 3)->type == EXP_TYPE_INT &&
+             rhs(statements, 3)->ival == 1);
+  CLM_ASSERT(rhs(statements, 4)->type == EXP_TYPE_INT &&
+             rhs(statements, 4)->ival == -2);
+  // division by zero is left for the runtime
+  CLM_ASSERT(rhs(statements, 5)->type == EXP_TYPE_ARITH);
+  // ints above 2^24 are compared as ints, an int and a float as floats
+  CLM_ASSERT(rhs(statements, 6)->type == EXP_TYPE_INT &&
+             rhs(statements, 6)->ival == 0);
+  CLM_ASSERT(rhs(statements, 7)->type == EXP_TYPE_INT &&
+             rhs(statements, 7)->ival == 1);
+  CLM_ASSERT(rhs(statements, 8)->type == EXP_TYPE_INT &&
+             rhs(statements, 8)->ival == 1);
+
+  clm_compiler_free(program.compiler);
+  return 1;
+}
+
+int clm_test_optimizer_fold_overflow() {
+  ClmTestProgram program;
+  ArrayList *statements =
+      optimize(&program, "a = 0 - 2147483647 - 1\n"
+                         "b = (0 - 2147483647 - 1) / (0 - 1)\n"
+                         "c = 2147483647 + 1\n"
+                         "d = 65536 * 65536\n"
+                         "e = -(0 - 2147483647 - 1)\n"
+                         "F = 65536 * {65536 1}\n");
+
+  CLM_ASSERT(rhs(statements, 0)->type == EXP_TYPE_INT &&
+             rhs(statements, 0)->ival == INT_MIN);
+  // traps at runtime like a division by zero, so it's left there
+  CLM_ASSERT(rhs(statements, 1)->type == EXP_TYPE_ARITH);
+  // the rest wrap around the way they do at runtime
+  CLM_ASSERT(rhs(statements, 2)->type == EXP_TYPE_INT &&
+             rhs(statements, 2)->ival == INT_MIN);
+  CLM_ASSERT(rhs(statements, 3)->type == EXP_TYPE_INT &&
+             rhs(statements, 3)->ival == 0);
+  CLM_ASSERT(rhs(statements, 4)->type == EXP_TYPE_INT &&
+             rhs(statements, 4)->ival == INT_MIN);
+  ClmExpNode *f = rhs(statements, 5);
+  CLM_ASSERT(f->type == EXP_TYPE_MAT_DEC && f->matDecExp.arr[0] == 0 &&
+             f->matDecExp.arr[1] == 65536);
+
+  clm_compiler_free(program.compiler);
+
+  // the same once constant propagation has put the values together
+  statements = optimize(&program, "n = 0 - 2147483647 - 1\n"
+                                  "m = 0 - 1\n"
+                                  "a = n / m\n"
+                                  "b = n * m\n");
+  CLM_ASSERT(rhs(statements, 2)->type == EXP_TYPE_ARITH);
+  CLM_ASSERT(rhs(statements, 3)->type == EXP_TYPE_INT &&
+             rhs(statements, 3)->ival == INT_MIN);
+
+  clm_compiler_free(program.compiler);
+  return 1;
+}
+
+int clm_test_optimizer_fold_matrices() {
+  ClmTestProgram program;
+  ArrayList *statements =
+      optimize(&program, "A = {1 2, 3 4} + {1 1, 1 1}\n"
+                         "B = {1 2, 3 4} * {5 6, 7 8}\n"
+                         "C = 2 * [2:3]\n"
+                         "D = -{1 2}\n");
+
+  ClmExpNode *a = rhs(statements, 0);
+  CLM_ASSERT(a->type == EXP_TYPE_MAT_DEC && a->matDecExp.arr != NULL);
+  CLM_ASSERT(a->matDecExp.arr[0] == 2 && a->matDecExp.arr[1] == 3 &&
+             a->matDecExp.arr[2] == 4 && a->matDecExp.arr[3] == 5);
+
+  ClmExpNode *b = rhs(statements, 1);
+  CLM_ASSERT(b->type == EXP_TYPE_MAT_DEC);
+  CLM_ASSERT(b->matDecExp.arr[0] == 19 && b->matDecExp.arr[1] == 22 &&
+             b->matDecExp.arr[2] == 43 && b->matDecExp.arr[3] == 50);
+
+  ClmExpNode *c = rhs(statements, 2);
+  CLM_ASSERT(c->type == EXP_TYPE_MAT_DEC && c->matDecExp.size.rows == 2 &&
+             c->matDecExp.size.cols == 3 && c->matDecExp.arr[5] == 0);
+
+  ClmExpNode *d = rhs(statements, 3);
+  CLM_ASSERT(d->type == EXP_TYPE_MAT_DEC && d->matDecExp.arr[0] == -1 &&
+             d->matDecExp.arr[1] == -2);
+
+  clm_compiler_free(program.compiler);
+  return 1;
+}
+
+int clm_test_optimizer_reductions() {
+  ClmTestProgram program;
+  ArrayList *statements = optimize(&program, "\\f x:int -> int =\n"
+                                             "  a = x + 0\n"
+                                             "  b = 1 * x\n"
+                                             "  c = -(-x)\n"
+                                             "  return a\n"
+                                             "  print b\n"
+                                             "end\n");
+
+  ArrayList *body =
+      ((ClmStmtNode *)statements->data[0])->funcDecStmt.body;
+  CLM_ASSERT(rhs(body, 0)->type == EXP_TYPE_INDEX);
+  CLM_ASSERT(rhs(body, 1)->type == EXP_TYPE_INDEX);
+  CLM_ASSERT(rhs(body, 2)->type == EXP_TYPE_INDEX);
+  // everything after the return is dead
+  CLM_ASSERT(body->length == 4);
+
+  clm_compiler_free(program.compiler);
+  return 1;
+}
+
+int clm_test_optimizer_conditionals() {
+  ClmTestProgram program;
+  ArrayList *statements = optimize(&program, "if 1 < 2 then\n"
+                                             "  print 1\n"
+                                             "else\n"
+                                             "  print 2\n"
+                                             "end\n"
+                                             "if 0 then\n"
+                                             "  print 3\n"
+                                             "end\n"
+                                             "if 2 < 1 then\n"
+                                             "  print 4\n"
+                                             "else\n"
+                                             "  print 5\n"
+                                             "end\n"
+                                             "while 0 do\n"
+                                             "  print 6\n"
+                                             "end\n");
+
+  CLM_ASSERT(statements->length == 2);
+
+  ClmStmtNode *first = statements->data[0];
+  CLM_ASSERT(first->type == STMT_TYPE_CONDITIONAL &&
+             first->conditionStmt.falseBody == NULL);
+  ClmStmtNode *print = first->conditionStmt.trueBody->data[0];
+  CLM_ASSERT(print->printStmt.expression->ival == 1);
+
+  ClmStmtNode *second = statements->data[1];
+  CLM_ASSERT(second->conditionStmt.condition->ival == 1 &&
+             second->conditionStmt.falseBody == NULL);
+  print = second->conditionStmt.trueBody->data[0];
+  CLM_ASSERT(print->printStmt.expression->ival == 5);
+
+  // the remaining body still has its scope, and it moved with the body
+  ClmScope *trueScope =
+      clm_scope_find_child(program.scope, second->conditionStmt.trueBody);
+  CLM_ASSERT(trueScope != NULL &&
+             second->conditionStmt.trueScope == trueScope);
+
+  clm_compiler_free(program.compiler);
+  return 1;
+}
+
+int clm_test_optimizer_propagate_constants() {
+  ClmTestProgram program;
+  ArrayList *statements = optimize(&program, "n = 3\n"
+                                             "m = 1\n"
+                                             "m = m + 1\n"
+                                             "a = n * 2\n"
+                                             "b = m * 2\n"
+                                             "A = [n:n]\n");
+
+  CLM_ASSERT(rhs(statements, 3)->type == EXP_TYPE_INT &&
+             rhs(statements, 3)->ival == 6);
+  // m is assigned twice, so it isn't a constant
+  CLM_ASSERT(rhs(statements, 4)->type == EXP_TYPE_ARITH);
+
+  ClmExpNode *a = rhs(statements, 5);
+  CLM_ASSERT(a->matDecExp.size.rowVar == NULL && a->matDecExp.size.rows == 3);
+  CLM_ASSERT(a->matDecExp.size.colVar == NULL && a->matDecExp.size.cols == 3);
+
+  clm_compiler_free(program.compiler);
+
+  // a size cached before the optimizer filled it in isn't used after
+  const char *source = "n = 3\n"
+                       "A = [n:n]\n";
+  program = clm_test_compile(CLM_TARGET_LINUX64, source);
+  statements = program.statements;
+
+  int rows, cols;
+  CLM_ASSERT(!clm_size_of_exp(program.compiler, rhs(statements, 1),
+                              program.scope, &rows, &cols));
+  clm_test_optimize(&program);
+  CLM_ASSERT(clm_size_of_exp(program.compiler, rhs(statements, 1),
+                             program.scope, &rows, &cols) &&
+             rows == 3 && cols == 3);
+
+  clm_compiler_free(program.compiler);
+  return 1;
+}
+
+int clm_test_optimizer_disabled() {
+  ClmTestProgram program;
+
+  ClmCompiler *compiler = clm_compiler_new(CLM_TARGET_LINUX64);
+  CLM_ASSERT(clm_optimizer_set_pass(compiler, "fold-constants", 0));
+  CLM_ASSERT(!clm_optimizer_set_pass(compiler, "not-a-pass", 0));
+  program = clm_test_check(compiler, "a = 1 + 2\n");
+  clm_test_optimize(&program);
+  ArrayList *statements = program.statements;
+  CLM_ASSERT(rhs(statements, 0)->type == EXP_TYPE_ARITH);
+  clm_compiler_free(program.compiler);
+
+  // the passes are options of one compiler, a new one has all of them
+  statements = optimize(&program, "a = 1 + 2\n");
+  CLM_ASSERT(rhs(statements, 0)->type == EXP_TYPE_INT);
+  clm_compiler_free(program.compiler);
+
+  return 1;
+}
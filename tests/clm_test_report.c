@@ -0,0 +1,72 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clm.h"
+#include "clm_report.h"
+#include "clm_tests.h"
+
+int clm_test_report() {
+  const char *program = "\\twice a:int -> int =\n"
+                        "  return a * 2\n"
+                        "end\n"
+                        "A = {1 2, 3 4}\n"
+                        "printl A * twice(3)\n";
+  ClmCompiler *compiler = clm_compiler_new(CLM_TARGET_LINUX64);
+  ClmTimeReport report;
+
+  // nothing is counted until the report starts
+  ClmTokens *tokens = clm_lexer_main(compiler, program, strlen(program));
+  clm_tokens_free(tokens);
+  CLM_ASSERT(compiler->counters[CLM_COUNTER_TOKENS] == 0);
+
+  clm_report_start(&report, compiler);
+  clm_report_phase_start(&report, "lexer");
+  tokens = clm_lexer_main(compiler, program, strlen(program));
+  clm_report_phase_end(&report);
+  clm_report_phase_start(&report, "parser");
+  ArrayList *statements = clm_parser_main(compiler, tokens);
+  clm_report_phase_end(&report);
+  clm_tokens_free(tokens);
+  clm_report_phase_start(&report, "symbol gen");
+  ClmScope *scope = clm_symbol_gen_main(compiler, statements);
+  clm_report_phase_end(&report);
+  clm_report_phase_start(&report, "code gen");
+  clm_type_check_main(compiler, statements, scope);
+  char *code = clm_code_gen_main(compiler, statements, scope);
+  size_t length = strlen(code);
+  free(code);
+  clm_report_phase_end(&report);
+
+  // each phase gets what it did
+  CLM_ASSERT(report.phasesLength == 4);
+  CLM_ASSERT(report.phases[0].counters[CLM_COUNTER_TOKENS] > 0);
+  CLM_ASSERT(report.phases[0].counters[CLM_COUNTER_AST_NODES] == 0);
+  CLM_ASSERT(report.phases[1].counters[CLM_COUNTER_AST_NODES] > 0);
+  CLM_ASSERT(report.phases[1].allocations > 0);
+  CLM_ASSERT(report.phases[1].bytes > 0);
+  CLM_ASSERT(report.phases[2].counters[CLM_COUNTER_SCOPE_LOOKUPS] > 0);
+  CLM_ASSERT(report.phases[3].counters[CLM_COUNTER_TYPE_RECOMPUTATIONS] > 0);
+  CLM_ASSERT(report.phases[3].counters[CLM_COUNTER_ASM_BYTES] ==
+             (long long)length);
+  CLM_ASSERT(report.phases[3].wall >= 0 && report.phases[3].cpu >= 0);
+  CLM_ASSERT(report.phases[3].start >= report.phases[0].start);
+
+  CLM_ASSERT(clm_report_write_trace(&report, "clm_test_trace.json"));
+  FILE *file = fopen("clm_test_trace.json", "rb");
+  CLM_ASSERT(file != NULL);
+  char trace[4096];
+  size_t read = fread(trace, 1, sizeof(trace) - 1, file);
+  trace[read] = '\0';
+  fclose(file);
+  remove("clm_test_trace.json");
+  CLM_ASSERT(strncmp(trace, "{\"displayTimeUnit\"", 18) == 0);
+  CLM_ASSERT(strstr(trace, "\"name\":\"symbol gen\"") != NULL);
+  CLM_ASSERT(strstr(trace, "\"scope_lookups\":") != NULL);
+  // the max RSS is the process's, so it isn't in every phase
+  CLM_ASSERT(strstr(trace, "\"process_max_rss_bytes\":") != NULL);
+  CLM_ASSERT(strstr(trace, "peak") == NULL);
+
+  clm_compiler_free(compiler);
+  return 1;
+}
@@ -0,0 +1,206 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "clm.h"
+#include "clm_server.h"
+#include "clm_tests.h"
+
+#ifndef _WIN32
+
+static int clm_test_server_std(const char *socket);
+static int clm_test_server_stalled(const char *socket);
+static int clm_test_server_errors(const char *socket);
+
+// sends source and keeps the status, what it printed is in the buffers
+static int request(const char *socket, const char *source,
+                   StringBuffer *diagnostics, StringBuffer *assembly) {
+  string_buffer_clear(diagnostics);
+  string_buffer_clear(assembly);
+  return clm_server_request(socket, "--target=linux64", "test.clm", source,
+                            strlen(source), diagnostics, assembly);
+}
+
+// runs the clm the tests were built with as a server on socket, with the std
+// modules of the source tree, and waits until it answers
+static pid_t start_server(const char *socket) {
+  char option[128];
+  snprintf(option, sizeof(option), "--server=%s", socket);
+  pid_t pid = fork();
+  if (pid == 0) {
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, STDERR_FILENO);
+    execl(CLM_TEST_CLM, "clm", option, "--std=" CLM_TEST_STD,
+          "--target=linux64", (char *)NULL);
+    _exit(1);
+  }
+
+  StringBuffer *diagnostics = string_buffer_new();
+  StringBuffer *assembly = string_buffer_new();
+  int tries;
+  for (tries = 0; tries < 200; tries++) {
+    if (request(socket, "printl 1\n", diagnostics, assembly) == 0)
+      break;
+    usleep(50 * 1000);
+  }
+  string_buffer_free(diagnostics);
+  string_buffer_free(assembly);
+  if (tries == 200) {
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    return -1;
+  }
+  return pid;
+}
+
+int clm_test_server() {
+  char socket[64];
+  snprintf(socket, sizeof(socket), "/tmp/clm_test_server_%d.sock",
+           (int)getpid());
+  pid_t pid = start_server(socket);
+  CLM_ASSERT(pid > 0);
+
+  int result = 1;
+  printf("Testing std functions... ");
+  if (!clm_test_server_std(socket)) {
+    result = 0;
+  } else {
+    printf(" OK.\n");
+  }
+
+  printf("Testing failing requests... ");
+  if (!clm_test_server_errors(socket)) {
+    result = 0;
+  } else {
+    printf(" OK.\n");
+  }
+
+  printf("Testing stalled clients... ");
+  if (!clm_test_server_stalled(socket)) {
+    result = 0;
+  } else {
+    printf(" OK.\n");
+  }
+
+  kill(pid, SIGTERM);
+  waitpid(pid, NULL, 0);
+  unlink(socket);
+  return result;
+}
+
+int clm_test_server_std(const char *socket) {
+  const char *program = "printl min(3, 4) + pow(2, 3)\n"
+                        "B = ident(2)\n"
+                        "B[1, 2] = abs(-5)\n"
+                        "printl B\n";
+  StringBuffer *diagnostics = string_buffer_new();
+  StringBuffer *assembly = string_buffer_new();
+
+  // every std module loads, and the std functions are there without an import
+  CLM_ASSERT(request(socket, program, diagnostics, assembly) == 0);
+  CLM_ASSERT(diagnostics->length == 0);
+  CLM_ASSERT(strstr(assembly->data, "_min:\n") != NULL);
+  CLM_ASSERT(strstr(assembly->data, "_swap_rows:\n") != NULL);
+  CLM_ASSERT(strstr(assembly->data, "_next_random:\n") != NULL);
+
+  // the std code generated for the first request is reused by the next
+  char *first = strdup(assembly->data);
+  CLM_ASSERT(request(socket, program, diagnostics, assembly) == 0);
+  CLM_ASSERT(strcmp(assembly->data, first) == 0);
+  free(first);
+
+#ifdef CLM_TESTS_RUN_PROGRAMS
+  char output[256];
+  CLM_ASSERT(clm_test_run(assembly->data, output, sizeof(output)));
+  CLM_ASSERT(strcmp(output, "11\n\n1 5 \n0 1 \n") == 0);
+#endif
+
+  string_buffer_free(diagnostics);
+  string_buffer_free(assembly);
+  return 1;
+}
+
+// an error in any phase leaves the server able to answer the next request
+int clm_test_server_errors(const char *socket) {
+  // a function too deep to generate, so the error is in the code generator
+  // halfway through an expression
+  StringBuffer *deep = string_buffer_new();
+  string_buffer_append(deep, "\\deep x:int -> int =\n  return ");
+  int i;
+  for (i = 0; i < 200; i++)
+    string_buffer_append(deep, "(x * ");
+  string_buffer_append(deep, "x");
+  for (i = 0; i < 200; i++)
+    string_buffer_append(deep, ")");
+  string_buffer_append(deep, "\nend\nprintl deep(1)\n");
+
+  const char *failing[] = {
+      "printl 1 $\n",          // the lexer
+      "printl 1.2.3\n",        // the lexer, in a number
+      "A = {1 2 3\nprintl A\n", // the parser, in a matrix literal
+      "printl y\n",            // the symbol generator
+      deep->data,              // the code generator
+  };
+  StringBuffer *diagnostics = string_buffer_new();
+  StringBuffer *assembly = string_buffer_new();
+  int round;
+  for (round = 0; round < 3; round++) {
+    for (i = 0; i < (int)(sizeof(failing) / sizeof(failing[0])); i++) {
+      CLM_ASSERT(request(socket, failing[i], diagnostics, assembly) != 0);
+      CLM_ASSERT(diagnostics->length > 0);
+    }
+  }
+
+  const char *program = "A = {1 2 3}\n"
+                        "printl max(A[1, 3], 2)\n";
+  CLM_ASSERT(request(socket, program, diagnostics, assembly) == 0);
+  CLM_ASSERT(diagnostics->length == 0);
+
+#ifdef CLM_TESTS_RUN_PROGRAMS
+  char output[256];
+  CLM_ASSERT(clm_test_run(assembly->data, output, sizeof(output)));
+  CLM_ASSERT(strcmp(output, "3\n") == 0);
+#endif
+
+  string_buffer_free(deep);
+  string_buffer_free(diagnostics);
+  string_buffer_free(assembly);
+  return 1;
+}
+
+// a client that connects and sends nothing is given up on, and the next one
+// is answered
+int clm_test_server_stalled(const char *socket_path) {
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, socket_path);
+  int stalled = socket(AF_UNIX, SOCK_STREAM, 0);
+  CLM_ASSERT(stalled >= 0);
+  CLM_ASSERT(connect(stalled, (struct sockaddr *)&address, sizeof(address)) ==
+             0);
+
+  StringBuffer *diagnostics = string_buffer_new();
+  StringBuffer *assembly = string_buffer_new();
+  CLM_ASSERT(request(socket_path, "printl 2\n", diagnostics, assembly) == 0);
+  close(stalled);
+
+  string_buffer_free(diagnostics);
+  string_buffer_free(assembly);
+  return 1;
+}
+
+#else
+
+int clm_test_server() { return 1; }
+
+#endif
@@ -4,16 +4,56 @@
 #define CLM_ASSERT(x)                                                          \
   do {                                                                         \
     if (!(x)) {                                                                \
-      printf("Assertion : " #x " FAILED\n");                                   \
+      printf("Assertion : %s FAILED\n", #x);                                   \
       return 0;                                                                \
     }                                                                          \
   } while (0)
 
+#include <stddef.h>
+
+#include "clm.h"
+
+// a program after the front end, on the compiler it was checked by
+typedef struct ClmTestProgram {
+  ClmCompiler *compiler;
+  ArrayList *statements;
+  ClmScope *scope;
+} ClmTestProgram;
+
+// lexes, parses, generates the symbols of and type checks source with
+// compiler. the tokens aren't kept, the names in the tree are interned
+ClmTestProgram clm_test_check(ClmCompiler *compiler, const char *source);
+// the same with a new compiler for target, freeing the compiler frees the
+// rest of the program
+ClmTestProgram clm_test_compile(ClmTarget target, const char *source);
+// runs the optimizer over the program
+void clm_test_optimize(ClmTestProgram *program);
+// the program's code, which the caller frees
+char *clm_test_generate(ClmTestProgram *program);
+
+// generated linux64 programs can be assembled and run where the tests run
+#if defined(__linux__) && defined(__x86_64__)
+#define CLM_TESTS_RUN_PROGRAMS
+#endif
+
+// assembles and links linux64 code with the compiler the tests were built
+// with, runs it and puts what it printed in out. returns 0 if it couldn't be
+// built or didn't exit with 0
+int clm_test_run(const char *code, char *out, size_t size);
+// the same, and what it printed is followed by "live allocations n\n", the
+// number of its allocations that weren't freed when it exited
+int clm_test_run_counting(const char *code, char *out, size_t size);
+
 int clm_test_lexer();
 int clm_test_parser();
 int clm_test_symbol_gen();
 int clm_test_type_check();
 int clm_test_optimizer();
 int clm_test_code_gen();
+int clm_test_cache();
+int clm_test_ast();
+int clm_test_module();
+int clm_test_report();
+int clm_test_server();
 
 #endif
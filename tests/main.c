@@ -6,13 +6,21 @@
 #include <shellapi.h>
 #endif
 
+#include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
 
 #include "clm_tests.h"
 
 char *file_name;
 
-void clm_error(int line, int col, const char *fmt, ...) {
+void clm_error(ClmCompiler *compiler, int line, int col, const char *fmt,
+               ...) {
   va_list ap;
   va_start(ap, fmt);
 
@@ -37,10 +45,110 @@ void clm_error(int line, int col, const char *fmt, ...) {
   va_end(ap);
 }
 
+ClmTestProgram clm_test_check(ClmCompiler *compiler, const char *source) {
+  ClmTestProgram program;
+  program.compiler = compiler;
+  ClmTokens *tokens = clm_lexer_main(compiler, source, strlen(source));
+  program.statements = clm_parser_main(compiler, tokens);
+  clm_tokens_free(tokens);
+  program.scope = clm_symbol_gen_main(compiler, program.statements);
+  clm_type_check_main(compiler, program.statements, program.scope);
+  return program;
+}
+
+ClmTestProgram clm_test_compile(ClmTarget target, const char *source) {
+  return clm_test_check(clm_compiler_new(target), source);
+}
+
+void clm_test_optimize(ClmTestProgram *program) {
+  clm_optimizer_main(program->compiler, program->statements, program->scope);
+}
+
+char *clm_test_generate(ClmTestProgram *program) {
+  return clm_code_gen_main(program->compiler, program->statements,
+                           program->scope);
+}
+
+#ifdef CLM_TESTS_RUN_PROGRAMS
+// builds code with the extra sources and linker flags in link
+static int run_program(const char *code, const char *link, char *out,
+                       size_t size) {
+  char dir[] = "/tmp/clm_testXXXXXX";
+  char source[64], program[64], command[512];
+  if (mkdtemp(dir) == NULL)
+    return 0;
+  snprintf(source, sizeof(source), "%s/program.s", dir);
+  snprintf(program, sizeof(program), "%s/program", dir);
+
+  int result = 0;
+  FILE *file = fopen(source, "w");
+  if (file != NULL) {
+    fputs(code, file);
+    fclose(file);
+    // the generated code has absolute addresses
+    snprintf(command, sizeof(command), "%s -no-pie -o %s %s %s", CLM_TEST_CC,
+             program, source, link);
+    if (system(command) == 0) {
+      FILE *output = popen(program, "r");
+      if (output != NULL) {
+        size_t length = fread(out, 1, size - 1, output);
+        out[length] = '\0';
+        result = pclose(output) == 0;
+      }
+    }
+  }
+
+  remove(program);
+  remove(source);
+  rmdir(dir);
+  return result;
+}
+
+int clm_test_run(const char *code, char *out, size_t size) {
+  return run_program(code, "", out, size);
+}
+
+int clm_test_run_counting(const char *code, char *out, size_t size) {
+  return run_program(code,
+                     CLM_TEST_ALLOC_COUNT
+                     " -Wl,--wrap=malloc,--wrap=calloc,--wrap=free",
+                     out, size);
+}
+#endif
+
 int main(int argc, char *argv[]) {
-  int res;
+  int res, failed = 0;
   res = clm_test_lexer();
   printf("LEXER : %s\n", res ? "PASSED" : "FAILED");
+  failed = failed || !res;
+
+  res = clm_test_optimizer();
+  printf("OPTIMIZER : %s\n", res ? "PASSED" : "FAILED");
+  failed = failed || !res;
+
+  res = clm_test_code_gen();
+  printf("CODE GEN : %s\n", res ? "PASSED" : "FAILED");
+  failed = failed || !res;
+
+  res = clm_test_cache();
+  printf("CACHE : %s\n", res ? "PASSED" : "FAILED");
+  failed = failed || !res;
+
+  res = clm_test_ast();
+  printf("AST : %s\n", res ? "PASSED" : "FAILED");
+  failed = failed || !res;
+
+  res = clm_test_report();
+  printf("REPORT : %s\n", res ? "PASSED" : "FAILED");
+  failed = failed || !res;
+
+  res = clm_test_module();
+  printf("MODULE : %s\n", res ? "PASSED" : "FAILED");
+  failed = failed || !res;
+
+  res = clm_test_server();
+  printf("SERVER : %s\n", res ? "PASSED" : "FAILED");
+  failed = failed || !res;
 
-  return 0;
+  return failed;
 }